@@ -1,7 +1,16 @@
 #include <arch/cpu.h>
+#include <arch/x86_64/asm.h>
+#include <arch/x86_64/tlb.h>
 #include <bits/errno.h>
 #include <sync/atomic.h>
 
+void cpu_relax(void) {
+#if defined (__x86_64__)
+    x86_64_tlb_poll();
+    cpu_pause();
+#endif
+}
+
 usize cpu_getticks(void) {
     bool intena = disable_interrupts();
     usize ticks = cpu->timer_ticks;
@@ -3,6 +3,7 @@
 #include <arch/firmware/bios.h>
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <mm/numa.h>
 #include <string.h>
 
 static xsdt_t   *XSDT = NULL;
@@ -114,4 +115,111 @@ bool acpi_disable_8259A(void) {
 
     // disable 8259A-PICs
     return BTEST(MADT->flags, 0);
-}
\ No newline at end of file
+}
+
+/**
+ * Proximity domains can be any 32-bit number,
+ * nodes are numbered densely from 0 in the order
+ * the SRAT first mentions their domain.
+ */
+static uint32_t acpi_pxm[NNUMA];
+static int      acpi_npxm = 0;
+
+static int acpi_pxm_to_node(uint32_t pxm, bool add) {
+    for (int node = 0; node < acpi_npxm; ++node) {
+        if (acpi_pxm[node] == pxm)
+            return node;
+    }
+
+    if (!add || acpi_npxm >= NNUMA)
+        return -ENOSPC;
+
+    acpi_pxm[acpi_npxm] = pxm;
+    return acpi_npxm++;
+}
+
+static int acpi_parse_srat(acpiSRAT_t *srat) {
+    int     err  = 0;
+    int     node = 0;
+    uint8_t *entry = NULL;
+
+    for (entry = srat->entries; entry < (uint8_t *)srat + srat->hdr.length; entry += entry[1]) {
+        if (entry[1] == 0)
+            return -EINVAL;
+
+        switch (entry[0]) {
+        case ACPI_SRAT_LAPIC: {
+            acpiSRAT_lapic_t *lapic = (acpiSRAT_lapic_t *)entry;
+            uint32_t pxm = lapic->pxm_lo | (lapic->pxm_hi[0] << 8) |
+                (lapic->pxm_hi[1] << 16) | ((uint32_t)lapic->pxm_hi[2] << 24);
+
+            if (!(lapic->flags & ACPI_SRAT_ENABLED))
+                break;
+            if ((node = acpi_pxm_to_node(pxm, true)) < 0)
+                return node;
+            // CPUs outside NCPU are never brought up, nothing to record.
+            numa_add_cpu(node, lapic->apic_id);
+            break;
+        }
+        case ACPI_SRAT_X2APIC: {
+            acpiSRAT_x2apic_t *x2apic = (acpiSRAT_x2apic_t *)entry;
+
+            if (!(x2apic->flags & ACPI_SRAT_ENABLED))
+                break;
+            if ((node = acpi_pxm_to_node(x2apic->pxm, true)) < 0)
+                return node;
+            numa_add_cpu(node, x2apic->x2apic_id);
+            break;
+        }
+        case ACPI_SRAT_MEM: {
+            acpiSRAT_mem_t *mem = (acpiSRAT_mem_t *)entry;
+
+            // hot-pluggable ranges are not there yet.
+            if (!(mem->flags & ACPI_SRAT_ENABLED) || (mem->flags & ACPI_SRAT_HOTPLUG))
+                break;
+            if ((node = acpi_pxm_to_node(mem->pxm, true)) < 0)
+                return node;
+            if ((err = numa_add_memblk(node, mem->base, mem->length)))
+                return err;
+            break;
+        }
+        }
+    }
+
+    return 0;
+}
+
+static void acpi_parse_slit(acpiSLIT_t *slit) {
+    int from = 0, to = 0;
+
+    for (uint64_t i = 0; i < slit->nlocality; ++i) {
+        if ((from = acpi_pxm_to_node(i, false)) < 0)
+            continue;
+
+        for (uint64_t j = 0; j < slit->nlocality; ++j) {
+            if ((to = acpi_pxm_to_node(j, false)) < 0)
+                continue;
+            numa_set_distance(from, to, slit->entries[i * slit->nlocality + j]);
+        }
+    }
+}
+
+int acpi_numa_init(void) {
+    int         err  = 0;
+    acpiSRAT_t  *srat = NULL;
+    acpiSLIT_t  *slit = NULL;
+
+    acpi_npxm = 0;
+
+    if (!(srat = (acpiSRAT_t *)acpi_enumerate("SRAT")))
+        return -ENOENT;
+
+    if ((err = acpi_parse_srat(srat)))
+        return err;
+
+    // without a SLIT every other node is equally far.
+    if ((slit = (acpiSLIT_t *)acpi_enumerate("SLIT")))
+        acpi_parse_slit(slit);
+
+    return 0;
+}
@@ -2,19 +2,68 @@
 #include <arch/paging.h>
 #include <arch/ucontext.h>
 #include <core/defs.h>
+#include <fs/icache.h>
 #include <fs/inode.h>
 #include <mm/mem.h>
 #include <mm/mmap.h>
 #include <mm/page.h>
+#include <mm/zram.h>
+#include <sys/elf_dynamic.h>
 #include <sys/thread.h>
 
+/// Pages mapped ahead of a file-backed read fault, at most.
+#define FAULT_AROUND_PAGES  16
+
+/// Same, in a region advised MADV_SEQUENTIAL.
+#define FAULT_AHEAD_SEQ_PAGES   64
+
 #define panic_page_fault(trapframe, fault, type) ({                                                           \
     panic("%s(): %s:%d: @[\e[025453;04m0x%p\e[0m], err_code: %x : %s, from '%s' space\n",                     \
           __func__, __FILE__, __LINE__, fault->addr, fault->err_code, type, fault->user ? "user" : "kernel"); \
 })
 
+/// Can the 2MiB window around 'addr' be backed by a single huge page?
+/// Only private anonymous memory qualifies, and only if the whole
+/// window lies inside the region. mlock() pins 4KiB frames, so a
+/// locked region gets no huge pages either.
+static bool vmr_thp_eligible(vmr_t *vmr, uintptr_t addr) {
+    const uintptr_t start = PG2MROUND(addr);
+
+    if (vmr->file || __vmr_shared(vmr) || __vmr_locked(vmr))
+        return false;
+
+    return (start >= __vmr_start(vmr)) &&
+        ((start + PGSZ2MB - 1) <= __vmr_end(vmr));
+}
+
+/// A read of private anonymous memory that was never written
+/// maps the shared zero page read-only, handle_cow_fault()
+/// swaps in a private frame on the first write.
+static int map_zero_page(vmr_t *vmr, pagefault_desc_t *fault) {
+    int         err = 0;
+    uintptr_t   pa  = 0;
+
+    if ((err = zero_page_get(&pa)))
+        return err;
+
+    if ((err = arch_map_i(PGROUND(fault->addr), pa, PGSZ,
+        (int)(vmr->vflags & ~PTE_W) | PTE_ALLOC))) {
+        __page_put(pa);
+        return err;
+    }
+
+    return 0;
+}
+
 int map_anonymous_page(vmr_t *vmr, pagefault_desc_t *fault) {
     int vflags = vmr->vflags | (__vmr_zero(vmr) ? PTE_ZERO : 0);
+
+    /// Try a transparent huge page first, this fails with -EEXIST
+    /// once part of the window has already been faulted in.
+    if (vmr_thp_eligible(vmr, fault->addr) &&
+        !arch_map_hugepage(PG2MROUND(fault->addr), vflags))
+        return 0;
+
     /// Map an anonymous page (not backed by a file) into memory
     /// Map the anonymous page into the process's address space
     return arch_map_n(fault->addr, PGSZ, vflags);
@@ -61,17 +110,98 @@ int enable_write_access(pagefault_desc_t *fault) {
     // Enable write access to a COW page without copying
 #if defined(__x86_64__)
     fault->cow->raw |= PTE_W;
+    // a CPU still caching the read-only entry takes a spurious
+    // fault that finds the page writable, no IPI is needed.
     invlpg(fault->addr);
-    arch_tlbshootdown(rdcr3(), fault->addr);
 #endif
     return 0;
 }
 
+/// Map the icache page 'page' at 'va', the mapping holds its own
+/// reference which PTE_ALLOC hands back to the page on unmap.
+static int map_cached_page(uintptr_t va, page_t *page, int vflags) {
+    int         err     = 0;
+    uintptr_t   paddr   = 0;
+
+    if ((err = page_get(page)))
+        return err;
+
+    if ((err = page_get_address(page, (void **)&paddr)) ||
+        (err = arch_map_i(PGROUND(va), paddr, PGSZ, vflags | PTE_ALLOC))) {
+        page_put(page);
+        return err;
+    }
+
+    return 0;
+}
+
+/// Can the page-cache page backing 'va' be mapped as is? Only if it is
+/// page aligned in the file and the whole of it lies inside both the
+/// file and the region's file-backed part. '*pgno' gets its index.
+static bool vmr_page_mappable(vmr_t *vmr, uintptr_t va, off_t *pgno) {
+    const usize size    = PGROUND(va) - __vmr_start(vmr);
+    const usize offset  = size + vmr->file_pos;
+
+    if (PGOFF(offset) || vmr->file->i_cache == NULL)
+        return false;
+
+    if ((size + PGSZ > __vmr_filesz(vmr)) ||
+        (offset + PGSZ > (usize)igetsize(vmr->file)))
+        return false;
+
+    if (pgno) *pgno = offset / PGSZ;
+    return true;
+}
+
+/// Map up to FAULT_AROUND_PAGES pages around the faulting one that
+/// the page cache already holds, so that sequential access through
+/// a file mapping takes one fault per window instead of one per page.
+/// Pages not cached yet are left to fault in on their own, except in
+/// a MADV_SEQUENTIAL region where the window ahead of the fault is
+/// read in as well. MADV_RANDOM regions get no window at all, nor
+/// do locked ones, where only the faulting page takes a pin.
+static void fault_around(vmr_t *vmr, pagefault_desc_t *fault, int vflags) {
+    int             err     = 0;
+    page_t          *page   = NULL;
+    off_t           pgno    = 0;
+    const bool      seq     = vmr->flags & VM_SEQ_READ;
+    const uintptr_t window  = (seq ? FAULT_AHEAD_SEQ_PAGES : FAULT_AROUND_PAGES) * PGSZ;
+    uintptr_t       start   = seq ? PGROUND(fault->addr) : ALIGN_DOWN(PGROUND(fault->addr), window);
+    uintptr_t       end     = start + window - 1;
+
+    if ((vmr->flags & VM_RAND_READ) || __vmr_locked(vmr))
+        return;
+
+    start   = (start < __vmr_start(vmr)) ? __vmr_start(vmr) : start;
+    end     = (end > __vmr_end(vmr)) ? __vmr_end(vmr) : end;
+
+    for (uintptr_t va = start; va < end; va += PGSZ) {
+        if (va == PGROUND(fault->addr) || !arch_getmapping(va, NULL))
+            continue;
+
+        if (!vmr_page_mappable(vmr, va, &pgno))
+            continue;
+
+        if (seq)
+            err = icache_getpage(vmr->file->i_cache, pgno, &page);
+        else
+            err = icache_lookup(vmr->file->i_cache, pgno, &page);
+
+        if (err)
+            continue;
+
+        if (map_cached_page(va, page, vflags))
+            break;
+    }
+}
+
 int load_page_from_file(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, usize size) {
     int         err       = 0;
-    uintptr_t   paddr     = 0;
-    uint8_t     buf[PGSZ] = {0};
     page_t      *page     = NULL;
+    char        *va       = (char *)PGROUND(fault->addr);
+    /// private pages are shared with the cache until the first
+    /// write breaks them off through the COW path.
+    const int   vflags    = __vmr_shared(vmr) ? vmr->vflags : (int)(vmr->vflags & ~PTE_W);
 
     // Load a page from a file into memory
     if (vmr->file) {
@@ -81,6 +211,17 @@ int load_page_from_file(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, usiz
             return -EFAULT;
         }
 
+        if (vmr_page_mappable(vmr, fault->addr, NULL) ||
+            (__vmr_shared(vmr) && vmr->file->i_cache && !PGOFF(offset))) {
+            icache_lock(vmr->file->i_cache);
+            if (!(err = icache_getpage(vmr->file->i_cache, offset / PGSZ, &page)) &&
+                !(err = map_cached_page(fault->addr, page, vflags)))
+                fault_around(vmr, fault, vflags);
+            icache_unlock(vmr->file->i_cache);
+            iunlock(vmr->file);
+            return err;
+        }
+
         /**
          * @brief get the minimum size to read from the file on-disk.
          * Take into account the size between the start of the memory region and
@@ -89,47 +230,27 @@ int load_page_from_file(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, usiz
         usize min = __min(__vmr_filesz(vmr) - size, igetsize(vmr->file) - offset);
         size = (size < __vmr_filesz(vmr)) ? __min(PGSZ, min) : 0;
 
-        if (__vmr_shared(vmr)) { // shared vmr?
-            if ((err = icache_getpage(vmr->file->i_cache, offset / PGSZ, &page))) {
-                iunlock(vmr->file);
-                return err;
-            }
-
-            if ((err = page_get(page))) {
-                iunlock(vmr->file);
-                return err;
-            }
-
-            if ((err = page_get_address(page, (void **)&paddr))) {
-                iunlock(vmr->file);
-                return err;
-            }
-
-            if ((err = arch_map_i(fault->addr, paddr, PGSZ, vmr->vflags))) {
-                iunlock(vmr->file);
-                return err;
-            }
-        } else { // vmr is not shared.
-            if ((err = arch_map_n(fault->addr, PGSZ, 
-                vmr->vflags | (((__vmr_filesz(vmr) < __vmr_size(vmr)) ||
-                    __vmr_zero(vmr)) ? PTE_ZERO : 0)))) {
-                iunlock(vmr->file);
-                return err;
-            }
-            
-            if ((err = iread(vmr->file, offset, buf, size)) < 0) {
-                arch_unmap_n(fault->addr, PGSZ);
-                iunlock(vmr->file);
-                return err;
-            }
+        // a page straddling the end of the file-backed part gets its own copy.
+        if ((err = arch_map_n(fault->addr, PGSZ, vmr->vflags))) {
+            iunlock(vmr->file);
+            return err;
+        }
 
-            memcpy((void *)PGROUND(fault->addr), buf, PGSZ);
+        if ((err = iread(vmr->file, offset, va, size)) < 0) {
+            arch_unmap_n(fault->addr, PGSZ);
+            iunlock(vmr->file);
+            return err;
         }
 
+        memset(va + err, 0, PGSZ - err);
         iunlock(vmr->file);
         return 0;
     }
 
+    // nothing to read yet, a shared region needs its own frame up front.
+    if (!__vmr_shared(vmr))
+        return map_zero_page(vmr, fault);
+
     return map_anonymous_page(vmr, fault);
 }
 
@@ -138,12 +259,19 @@ int handle_cow_fault(vmr_t *vmr, pagefault_desc_t *fault) {
     int         err         = 0;
     usize       pgref       = 0;
     uintptr_t   srcpaddr    = fault->cow->raw;
+
+    // first write to a zero-page mapping, nothing to copy.
+    if (iszero_page(srcpaddr)) {
+        if ((err = arch_map_n(fault->addr, PGSZ, PTE_REMAP | PTE_ZERO | vmr->vflags)))
+            return err;
+        return __page_put(PGROUND(srcpaddr));
+    }
     
     if ((err = __page_getcount(PGROUND(srcpaddr), &pgref)))
         return err;
 
-    if (pgref > 1) {
-        // If the page is shared, copy it before writing
+    if (pgref > 1 || (pgref == 1 && !__page_exclusive(PGROUND(srcpaddr)))) {
+        // If the page is shared, or belongs to the page cache, copy it before writing
         return copy_page_on_write(vmr, fault, srcpaddr);
     } else if (pgref == 1) {
         // If the page is not shared, just mark it writable
@@ -156,9 +284,8 @@ int handle_cow_fault(vmr_t *vmr, pagefault_desc_t *fault) {
 
 int handle_writable_page_fault(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, usize size) {
     int         err         = 0;
-    uintptr_t   paddr       = 0;
-    uint8_t     buf[PGSZ]   = {0};
     page_t      *page       = NULL;
+    char        *va         = (char *)PGROUND(fault->addr);
 
     // Handle writable page faults for non-COW pages
     if (fault->err_code & PTE_P) {
@@ -170,6 +297,16 @@ int handle_writable_page_fault(vmr_t *vmr, pagefault_desc_t *fault, size_t offse
     if (vmr->file) {
         // Load the page from a file if it's backed by one
         ilock(vmr->file);
+
+        if (__vmr_shared(vmr) && vmr->file->i_cache && !PGOFF(offset)) { // shared vmr?
+            icache_lock(vmr->file->i_cache);
+            if (!(err = icache_getpage(vmr->file->i_cache, offset / PGSZ, &page)))
+                err = map_cached_page(fault->addr, page, vmr->vflags);
+            icache_unlock(vmr->file->i_cache);
+            iunlock(vmr->file);
+            return err;
+        }
+
         /**
          * @brief get the minimum size to read from the file on-disk.
          * Take into account the size between the start of the memory region and
@@ -180,42 +317,20 @@ int handle_writable_page_fault(vmr_t *vmr, pagefault_desc_t *fault, size_t offse
                 (size_t)__min(PGSZ, (size_t)__min(__vmr_filesz(vmr) - size,
                 igetsize(vmr->file) - offset)) : 0;
 
-        if (__vmr_shared(vmr)) { // shared vmr?
-            if ((err = icache_getpage(vmr->file->i_cache, offset / PGSZ, &page))) {
-                iunlock(vmr->file);
-                return err;
-            }
-            
-            if ((err = page_get(page))) {
-                iunlock(vmr->file);
-                return err;
-            }
-
-            if ((err = page_get_address(page, (void **)&paddr))) {
-                iunlock(vmr->file);
-                return err;
-            }
-
-            if ((err = arch_map_i(fault->addr, paddr, PGSZ, vmr->vflags))) {
-                iunlock(vmr->file);
-                return err;
-            }
-        } else { // vmr is not shared.
-            if ((err = arch_map_n(fault->addr, PGSZ, 
-                vmr->vflags | (((__vmr_filesz(vmr) < __vmr_size(vmr)) ||
-                    __vmr_zero(vmr)) ? PTE_ZERO : 0)))) {
-                iunlock(vmr->file);
-                return err;
-            }
-            
-            if ((err = iread(vmr->file, offset, buf, size)) < 0) {
-                arch_unmap_n(fault->addr, PGSZ);
-                iunlock(vmr->file);
-                return err;
-            }
+        // vmr is not shared, the write needs a private copy anyway.
+        if ((err = arch_map_n(fault->addr, PGSZ, vmr->vflags))) {
+            iunlock(vmr->file);
+            return err;
+        }
 
-            memcpy((void *)PGROUND(fault->addr), buf, PGSZ);
+        // read straight into the new page rather than through a bounce buffer.
+        if ((err = iread(vmr->file, offset, va, size)) < 0) {
+            arch_unmap_n(fault->addr, PGSZ);
+            iunlock(vmr->file);
+            return err;
         }
+
+        memset(va + err, 0, PGSZ - err);
         iunlock(vmr->file);
         return 0;
     }
@@ -235,6 +350,12 @@ int handle_write_fault(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, usize
         return handle_cow_fault(vmr, fault);
     }
 
+    // mprotect() leaves frames it can not tell are exclusively owned
+    // read-only, in a shared region the write goes straight through.
+    if (fault->cow && (fault->err_code & PTE_P)) {
+        return enable_write_access(fault);
+    }
+
     // Handle other writable page faults
     return handle_writable_page_fault(vmr, fault, offset, sz);
 }
@@ -257,7 +378,31 @@ int handle_read_exec_fault(vmr_t *vmr, pagefault_desc_t *fault, size_t offset, u
     return load_page_from_file(vmr, fault, offset, sz);
 }
 
+/// Bring back a page swap_shrinker compressed into zram.
+/// Mapping the fresh frame over the swap entry drops the slot.
+static int swap_in_page(vmr_t *vmr, pagefault_desc_t *fault, ulong slot) {
+    int         err = 0;
+    uintptr_t   pa  = 0;
+
+    if ((fault->err_code & PTE_W) && !__vmr_write(vmr))
+        return -EACCES;
+
+    if ((err = pmman.get_page(GFP_NORMAL, (void **)&pa)))
+        return err;
+
+    // mapped dirty, the copy in zram goes with the swap entry
+    // so MADV_FREE must not take the page for a clean one.
+    if ((err = zram_load(slot, pa)) ||
+        (err = arch_map_i(PGROUND(fault->addr), pa, PGSZ, (int)vmr->vflags | PTE_ALLOC | PTE_D))) {
+        pmman.free(pa);
+        return err == -EIO ? -EFAULT : err;
+    }
+
+    return 0;
+}
+
 int default_pgf_handler(vmr_t *vmr, pagefault_desc_t *fault) {
+    ulong slot   = 0;
     usize offset = 0;
     usize size   = 0;
 
@@ -266,6 +411,11 @@ int default_pgf_handler(vmr_t *vmr, pagefault_desc_t *fault) {
         return -EINVAL;  // Return error if VMR or fault is invalid
     }
 
+    // A swapped out page, nothing else applies until it is back.
+    if (!(fault->err_code & PTE_P) && !arch_getswap(fault->addr, &slot)) {
+        return swap_in_page(vmr, fault, slot);
+    }
+
     // Calculate the offset within the file corresponding to the faulting address
     offset = (size = (PGROUND(fault->addr) - __vmr_start(vmr))) + vmr->file_pos;
 
@@ -319,8 +469,31 @@ void handle_kernel_fault(mcontext_t *trapframe, pagefault_desc_t *fault) {
     }
 }
 
+/// The frame mapped at 'va' as mlock() pins it, 0 if there is none.
+static uintptr_t locked_frame(uintptr_t va) {
+    pte_t   *pte    = NULL;
+
+    if (arch_getmapping(va, &pte))
+        return 0;
+
+#if defined(__x86_64__)
+    if (pte_isPS(pte) || !pte_isalloc(pte) || iszero_page(PTE2PHYS(pte)))
+        return 0;
+    return PTE2PHYS(pte);
+#else
+    return 0;
+#endif
+}
+
 int handle_vmr_fault(vmr_t *vmr, pagefault_desc_t *fault) {
-    int err = 0;
+    int         err     = 0;
+    uintptr_t   pa      = 0;
+    const bool  locked  = __vmr_locked(vmr);
+
+    // in a locked region the frame a fault replaces gives its pin
+    // back first, whatever is mapped once the fault is over takes one.
+    if (locked && (pa = locked_frame(fault->addr)))
+        __page_unpin(pa);
 
     // If the VMR has a custom page fault handler, invoke it
     if (vmr->vmops && vmr->vmops->fault_handler) {
@@ -330,9 +503,55 @@ int handle_vmr_fault(vmr_t *vmr, pagefault_desc_t *fault) {
         err = default_pgf_handler(vmr, fault);
     }
 
+    if (locked && (pa = locked_frame(fault->addr)))
+        __page_pin(pa);
+
     return err;
 }
 
+int vmr_populate(vmr_t *vmr, uintptr_t start, uintptr_t end) {
+    int                 err     = 0;
+    pte_t               *pte    = NULL;
+    pagefault_desc_t    fault   = {0};
+    const bool          write   = __vmr_write(vmr) && !__vmr_shared(vmr);
+
+    for (uintptr_t va = PGROUND(start); va <= end; va += PGSZ) {
+        pte = NULL;
+        if (!arch_getmapping(va, &pte) && !write)
+            continue;
+
+#if defined(__x86_64__)
+        // COW works on 4KiB pages.
+        if (pte && pte_isPS(pte)) {
+            if ((err = arch_split_page(va)) || (err = arch_getmapping(va, &pte)))
+                return err;
+        }
+
+        // a writable entry in a table shared since fork() is not ours yet.
+        if (pte && write) {
+            if ((err = arch_unshare_pt(va)) || (err = arch_getmapping(va, &pte)))
+                return err;
+        }
+
+        // already private and writable, nothing to break.
+        if (pte && pte_isW(pte))
+            continue;
+#endif
+
+        fault = (pagefault_desc_t){
+            .addr       = va,
+            .cow        = pte,
+            .user       = 1,
+            .err_code   = PTE_U | (pte ? PTE_P : 0) | (write ? PTE_W : 0),
+        };
+
+        if ((err = handle_vmr_fault(vmr, &fault)))
+            return err;
+    }
+
+    return 0;
+}
+
 void arch_do_page_fault(mcontext_t *trapframe) {
     int         err     = 0;
     pagefault_desc_t  fault   = {0};
@@ -358,6 +577,14 @@ void arch_do_page_fault(mcontext_t *trapframe) {
             handle_signal_or_thread_exit(trapframe);
         }
 
+        // first call through a lazily bound PLT slot.
+#if defined(__x86_64__)
+        if (trapframe->rip == MAGIC_PLTRESOLVE && fault.user &&
+            elf_plt_resolve(trapframe) == 0) {
+#endif
+            return;
+        }
+
         /// TODO: increase refcnt on mmap here.
         mmap = current->t_mmap;  // Retrieve the current thread's memory map
     }
@@ -380,6 +607,30 @@ void arch_do_page_fault(mcontext_t *trapframe) {
         return;
     }
 
+#if defined(__x86_64__)
+    // COW and the other handlers work on 4KiB pages, so break up
+    // a huge page before letting them at it.
+    if (fault.cow && pte_isPS(fault.cow)) {
+        if ((err = arch_split_page(fault.addr)) ||
+            (err = arch_getmapping(fault.addr, &fault.cow))) {
+            mmap_unlock(mmap);
+            send_sigbus(trapframe, &fault);
+            return;
+        }
+    }
+
+    // the first write to a page table shared since fork() copies it,
+    // the fault then goes on as a COW fault on the private copy.
+    if (fault.cow && (fault.err_code & PTE_W)) {
+        if ((err = arch_unshare_pt(fault.addr)) ||
+            (err = arch_getmapping(fault.addr, &fault.cow))) {
+            mmap_unlock(mmap);
+            send_sigbus(trapframe, &fault);
+            return;
+        }
+    }
+#endif
+
     // Handle the page fault within the found VMR
     if ((err = handle_vmr_fault(vmr, &fault)) == -EFAULT) {
         // Handle errors specific to SIGBUS or SIGSEGV signals
@@ -32,13 +32,13 @@ int arch_map(uintptr_t frame, int i4, int i3, int i2, int i1, int flags) {
 #endif
 }
 
-void arch_unmap(int i4, int i3, int i2, int i1) {
+int arch_unmap(int i4, int i3, int i2, int i1) {
 #if defined (__x86_64__)
     return x86_64_unmap(i4, i3, i2, i1);
 #endif
 }
 
-void arch_unmap_n(uintptr_t v, size_t sz) {
+int arch_unmap_n(uintptr_t v, size_t sz) {
 #if defined (__x86_64__)
     return x86_64_unmap_n(v, sz);
 #endif
@@ -50,6 +50,18 @@ int arch_map_i(uintptr_t v, uintptr_t p, size_t sz, int flags) {
 #endif
 }
 
+int arch_map_hugepage(uintptr_t vaddr, int flags) {
+#if defined (__x86_64__)
+    return x86_64_map_hugepage(vaddr, flags);
+#endif
+}
+
+int arch_split_page(uintptr_t vaddr) {
+#if defined (__x86_64__)
+    return x86_64_split_page(vaddr);
+#endif
+}
+
 int arch_mprotect(uintptr_t vaddr, size_t sz, int flags) {
 #if defined (__x86_64__)
     return x86_64_mprotect(vaddr, sz, flags);
@@ -68,6 +80,18 @@ int arch_mount(uintptr_t p, void **pvp) {
 #endif
 }
 
+int arch_physmap_range(uintptr_t paddr, usize size) {
+#if defined (__x86_64__)
+    return x86_64_physmap_range(paddr, size);
+#endif
+}
+
+bool arch_physmap_covers(uintptr_t paddr, usize size) {
+#if defined (__x86_64__)
+    return x86_64_physmap_covers(paddr, size);
+#endif
+}
+
 void arch_unmount(uintptr_t v) {
 #if defined (__x86_64__)
     return x86_64_unmount(v);
@@ -92,6 +116,18 @@ int arch_lazycpy(uintptr_t dst, uintptr_t src) {
 #endif
 }
 
+int arch_unshare_pt(uintptr_t vaddr) {
+#if defined (__x86_64__)
+    return x86_64_unshare_pt(vaddr);
+#endif
+}
+
+void arch_drop_shared(void) {
+#if defined (__x86_64__)
+    x86_64_drop_shared();
+#endif
+}
+
 int arch_memcpypp(uintptr_t pdst, uintptr_t psrc, size_t size) {
 #if defined (__x86_64__)
     return x86_64_memcpypp(pdst, psrc, size);
@@ -128,15 +164,93 @@ void arch_putpgdir(uintptr_t pdbr) {
 #endif
 }
 
+int arch_getswap(uintptr_t vaddr, ulong *pslot) {
+#if defined (__x86_64__)
+    return x86_64_getswap(vaddr, pslot);
+#endif
+}
+
+usize arch_swapout_range(uintptr_t vaddr, usize sz, usize nr, bool lazyfree) {
+#if defined (__x86_64__)
+    return x86_64_swapout_range(vaddr, sz, nr, lazyfree);
+#endif
+}
+
+usize arch_migrate_range(uintptr_t vaddr, usize sz, uintptr_t lo, uintptr_t hi,
+    int (*alloc)(void *arg, uintptr_t *ppa), void *arg) {
+#if defined (__x86_64__)
+    return x86_64_migrate_range(vaddr, sz, lo, hi, alloc, arg);
+#endif
+}
+
+int arch_lazyfree_range(uintptr_t vaddr, usize sz) {
+#if defined (__x86_64__)
+    return x86_64_lazyfree_range(vaddr, sz);
+#endif
+}
+
+bool arch_test_and_clear_dirty(uintptr_t vaddr) {
+#if defined (__x86_64__)
+    return x86_64_test_and_clear_dirty(vaddr);
+#endif
+}
+
+int arch_pin_range(uintptr_t vaddr, usize sz, bool pin) {
+#if defined (__x86_64__)
+    return x86_64_pin_range(vaddr, sz, pin);
+#endif
+}
+
+int arch_move_range(uintptr_t src, uintptr_t dst, usize sz) {
+#if defined (__x86_64__)
+    return x86_64_move_range(src, dst, sz);
+#endif
+}
+
 void arch_tlbshootdown(uintptr_t pdbr, uintptr_t vaddr) {
 #if defined (__x86_64__)
     x86_64_tlb_shootdown(pdbr, vaddr);
 #endif
 }
 
-void arch_pagefree(uintptr_t vaddr, usize sz) {
-    arch_unmap_n(vaddr, sz);
-    vmman.free(vaddr);
+void arch_tlbshootdown_range(uintptr_t pdbr, uintptr_t vaddr, usize size) {
+#if defined (__x86_64__)
+    x86_64_tlb_shootdown_range(pdbr, vaddr, size);
+#endif
+}
+
+void arch_tlbbatch_begin(void) {
+#if defined (__x86_64__)
+    x86_64_tlb_batch_begin();
+#endif
+}
+
+void arch_tlbbatch_end(void) {
+#if defined (__x86_64__)
+    x86_64_tlb_batch_end();
+#endif
+}
+
+void arch_tlbbatch_flush(void) {
+#if defined (__x86_64__)
+    x86_64_tlb_batch_flush();
+#endif
+}
+
+void arch_tlbshootdown_handler(void) {
+#if defined (__x86_64__)
+    x86_64_tlb_shootdown_handler();
+#endif
+}
+
+int arch_tlbgetstats(int cpuid, tlb_stats_t *stats) {
+#if defined (__x86_64__)
+    return x86_64_tlb_getstats(cpuid, stats);
+#endif
+}
+
+void arch_pagefree(uintptr_t vaddr, usize sz __unused) {
+    vmman.free_lazy(vaddr);
 }
 
 int arch_pagealloc(usize sz, uintptr_t *addr) {
@@ -1,3 +1,4 @@
+#include <arch/paging.h>
 #include <arch/traps.h>
 #include <arch/ucontext.h>
 #include <arch/x86_64/lapic.h>
@@ -132,7 +133,7 @@ void trap(ucontext_t *uctx) {
 
         case T_LAPIC_TIMER: lapic_timerintr(); break;
 
-        case T_TLBSHTDWN: break;
+        case T_TLBSHTDWN: arch_tlbshootdown_handler(); break;
 
         case T_PANIC: isr_ne(mctx->trapno); break;
 
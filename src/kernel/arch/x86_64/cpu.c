@@ -4,6 +4,7 @@
 #include <arch/x86_64/mmu.h>
 #include <arch/x86_64/msr.h>
 #include <arch/x86_64/lapic.h>
+#include <arch/x86_64/tlb.h>
 #include <bits/errno.h>
 #include <boot/boot.h>
 #include <core/debug.h>
@@ -131,6 +132,7 @@ static void cpu_init(void) {
     idt_init();
     gdt_init();
     lapic_init();
+    x86_64_tlb_init();
     scheduler_init();
     atomic_inc(&cpus_online);
     atomic_or(&cpu->flags, CPU_ONLINE);
@@ -222,7 +224,7 @@ void bootothers(void) {
             TRAMPOLINE_ENTRY  = 4040 / sizeof(uintptr_t),  /* Entry point   */
         };
 
-        trampoline[TRAMPOLINE_PGTBL] = rdcr3();               /* Page table  */
+        trampoline[TRAMPOLINE_PGTBL] = PGROUND(rdcr3());      /* Page table  */
         trampoline[TRAMPOLINE_STACK] = stack + AP_STACK_SIZE; /* Stack top   */
         trampoline[TRAMPOLINE_ENTRY] = (uintptr_t)ap_start;   /* Entry point */
 
@@ -3,9 +3,13 @@
 #include <arch/x86_64/asm.h>
 #include <arch/x86_64/paging.h>
 #include <arch/x86_64/lapic.h>
+#include <arch/x86_64/tlb.h>
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <cpuid.h>
 #include <mm/mem.h>
+#include <mm/page.h>
+#include <mm/zram.h>
 #include <string.h>
 #include <sys/thread.h>
 
@@ -24,9 +28,94 @@ void x86_64_dumptable(pte_t *table) {
     }
 }
 
-void x86_64_tlb_shootdown(uintptr_t pdbr __unused, uintptr_t addr __unused) {
-    invlpg(addr);
-    lapic_send_ipi(T_TLBSHTDWN, IPI_ALLXSELF);
+/**
+ * Physical ranges currently covered by the permanent direct map.
+ * Populated once during boot by x86_64_physmap_range() and
+ * only read afterwards, so lookups need no locking.
+ */
+#define NPHYSMAP    16
+
+static struct {
+    uintptr_t   start;
+    uintptr_t   end;
+} physmap[NPHYSMAP];
+
+static usize    physmap_cnt = 0;
+
+static bool x86_64_has_1g_pages(void) {
+    static int  has_1g = -1;
+    uint        reg[4] = {0};
+
+    if (has_1g < 0) {
+        __get_cpuid(0x80000001, &reg[0], &reg[1], &reg[2], &reg[3]);
+        has_1g = (reg[3] & (1 << 26)) ? 1 : 0;
+    }
+
+    return has_1g ? true : false;
+}
+
+bool x86_64_physmap_covers(uintptr_t pa, usize size) {
+    for (usize i = 0; i < physmap_cnt; ++i) {
+        if ((pa >= physmap[i].start) && ((pa + size) <= physmap[i].end))
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Map physical memory [pa, pa + size) into the direct map at PHYS2VIRT(pa).
+ * 1GiB pages are used wherever the CPU supports them and the range allows,
+ * 2MiB pages everywhere else. The range is widened to 2MiB boundaries.
+ */
+int x86_64_physmap_range(uintptr_t pa, usize size) {
+    int         err     = 0;
+    uintptr_t   end     = ALIGN_UP(pa + size, PGSZ2MB);
+    const int   flags   = PTE_KRW | PTE_G;
+
+    pa = ALIGN_DOWN(pa, PGSZ2MB);
+
+    if (size == 0 || end > PHYSMAP_SIZE)
+        return -EINVAL;
+
+    // a range carrying on from the last one only extends it.
+    if (physmap_cnt == 0 || physmap[physmap_cnt - 1].end != pa) {
+        if (physmap_cnt >= NPHYSMAP)
+            return -ENOSPC;
+    }
+
+    for (uintptr_t addr = pa; addr < end; ) {
+        uintptr_t   va = PHYS2VIRT(addr);
+        int         i4 = PML4I(va), i3 = PDPTI(va), i2 = PDI(va);
+
+        // Whole, aligned gigabyte: use a single 1GiB PDPTE.
+        if (!(addr & (PGSZ1GB - 1)) && ((end - addr) >= PGSZ1GB) &&
+            !x86_64_map_1g(addr, i4, i3, flags)) {
+            addr += PGSZ1GB;
+            continue;
+        }
+
+        // Already covered by a 1GiB page from an earlier range.
+        if (pte_isP(PML4E(i4)) && pte_isPS(PDPTE(i4, i3))) {
+            addr = ALIGN_DOWN(addr, PGSZ1GB) + PGSZ1GB;
+            continue;
+        }
+
+        // -EEXIST: covered by an earlier, overlapping range.
+        if ((err = x86_64_map_2m(addr, i4, i3, i2, flags)) && err != -EEXIST)
+            return err;
+
+        addr += PGSZ2MB;
+    }
+
+    if (physmap_cnt && physmap[physmap_cnt - 1].end == pa) {
+        physmap[physmap_cnt - 1].end = end;
+        return 0;
+    }
+
+    physmap[physmap_cnt].start  = pa;
+    physmap[physmap_cnt].end    = end;
+    physmap_cnt += 1;
+    return 0;
 }
 
 static inline int x86_64_map_pdpt(int i4, int flags) {
@@ -45,7 +134,8 @@ static inline int x86_64_map_pdpt(int i4, int flags) {
         }
 
         PML4E(i4)->raw = l3 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
+        // nothing was mapped here, so no other CPU can have it cached.
+        invlpg((uintptr_t)PDPTE(i4, 0));
     }
 
     return 0;
@@ -67,7 +157,7 @@ static inline int x86_64_map_pdt(int i4, int i3, int flags) {
         }
 
         PML4E(i4)->raw = l3 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
+        invlpg((uintptr_t)PDPTE(i4, 0));
     }
 
     if (!pte_isP(PDPTE(i4, i3))) {
@@ -76,7 +166,7 @@ static inline int x86_64_map_pdt(int i4, int i3, int flags) {
         }
 
         PDPTE(i4, i3)->raw = l2 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
+        invlpg((uintptr_t)PDTE(i4, i3, 0));
     }
 
     return 0;
@@ -84,7 +174,7 @@ error:
     if (l3 != 0) {
         PML4E(i4)->raw = 0;
         x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
-        pmman.free(l3);
+        x86_64_tlb_free(l3, 0);
     }
     return err;
 }
@@ -105,7 +195,7 @@ static inline int x86_64_map_pt(int i4, int i3, int i2, int flags) {
         }
 
         PML4E(i4)->raw = l3 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
+        invlpg((uintptr_t)PDPTE(i4, 0));
     }
 
     if (!pte_isP(PDPTE(i4, i3))) {
@@ -114,7 +204,7 @@ static inline int x86_64_map_pt(int i4, int i3, int i2, int flags) {
         }
 
         PDPTE(i4, i3)->raw = l2 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
+        invlpg((uintptr_t)PDTE(i4, i3, 0));
     }
 
     if (!pte_isP(PDTE(i4, i3, i2))) {
@@ -123,7 +213,7 @@ static inline int x86_64_map_pt(int i4, int i3, int i2, int flags) {
         }
 
         PDTE(i4, i3, i2)->raw = l1 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PTE(i4, i3, i2, 0));
+        invlpg((uintptr_t)PTE(i4, i3, i2, 0));
     }
 
     return 0;
@@ -131,13 +221,13 @@ error:
     if (l2 != 0) {
         PDPTE(i4, i3)->raw = 0;
         x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
-        pmman.free(l2);
+        x86_64_tlb_free(l2, 0);
     }
 
     if (l3 != 0) {
         PML4E(i4)->raw = 0;
         x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
-        pmman.free(l3);
+        x86_64_tlb_free(l3, 0);
     }
     return err;
 }
@@ -154,7 +244,7 @@ static inline void x86_64_unmap_pdpt(int i4) {
     l3 = PGROUND(PML4E(i4)->raw);
     PML4E(i4)->raw = 0;
     x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
-    pmman.free(l3);
+    x86_64_tlb_free(l3, 0);
 }
 
 static inline void x86_64_unmap_pdt(int i4, int i3) {
@@ -172,7 +262,183 @@ static inline void x86_64_unmap_pdt(int i4, int i3) {
     l2 = PGROUND(PDPTE(i4, i3)->raw);
     PDPTE(i4, i3)->raw = 0;
     x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
-    pmman.free(l2);
+    x86_64_tlb_free(l2, 0);
+}
+
+/**
+ * Page tables shared by fork().
+ * Rather than copy every leaf table, fork() points the child's page
+ * directory entry at the parent's table and clears the W bit of both
+ * entries. The first write to the 2MiB range from either side faults
+ * and takes a private copy, see x86_64_unshare_pt(). The 'mapcnt' of
+ * the table's page counts the directory entries pointing to it, and the
+ * frames a shared table maps hold one reference for the table as a whole.
+ */
+static inline bool x86_64_pt_isshared(int i4, int i3, int i2) {
+    if (!pte_isP(PML4E(i4)) || !pte_isP(PDPTE(i4, i3)) || pte_isPS(PDPTE(i4, i3)))
+        return false;
+
+    return pte_isP(PDTE(i4, i3, i2)) && !pte_isPS(PDTE(i4, i3, i2)) &&
+        !pte_isW(PDTE(i4, i3, i2));
+}
+
+/*How many directory entries point to the table 'l1'.*/
+static atomic_ulong *x86_64_pt_mapcnt(uintptr_t l1) {
+    page_t *page = phys_to_page(PGROUND(l1));
+
+    assert(page, "Page table %p is not in the memmap.\n", l1);
+    return &page->mapcnt;
+}
+
+/**
+ * Drop a reference to the shared table 'l1', the last one releases its pages.
+ * The directory entry that pointed to it is gone and shot down already,
+ * the frames are freed once the shootdown is acknowledged.
+ */
+static void x86_64_pt_put(uintptr_t l1) {
+    pte_t *pt = NULL;
+
+    if (atomic_dec_fetch(x86_64_pt_mapcnt(l1)) != 0)
+        return;
+
+    // the table leaks along with what it maps, there is no other way to reach them.
+    if (x86_64_mount(l1, (void **)&pt))
+        return;
+
+    for (int i1 = 0; i1 < NPTE; ++i1) {
+        if (pte_isswap(&pt[i1]))
+            zram_free(PTE2SWP(&pt[i1]));
+        else if (pte_isP(&pt[i1]) && pte_isalloc(&pt[i1]))
+            x86_64_tlb_free(PTE2PHYS(&pt[i1]), 0);
+    }
+
+    x86_64_unmount((uintptr_t)pt);
+    x86_64_tlb_free(l1, 0);
+}
+
+/*Unhook the shared table at PDTE(i4, i3, i2) from this address space.*/
+static void x86_64_drop_pt(int i4, int i3, int i2) {
+    const uintptr_t l1 = PGROUND(PDTE(i4, i3, i2)->raw);
+
+    PDTE(i4, i3, i2)->raw = 0;
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, i2));
+    x86_64_tlb_shootdown_range(rdcr3(), i2v(i4, i3, i2, 0), PGSZ2MB);
+    x86_64_pt_put(l1);
+}
+
+/**
+ * Share the page table 'src' points to through 'dst' as well.
+ * Called by fork() with the parent's page directory mounted.
+ */
+static void x86_64_share_pt(pte_t *src, pte_t *dst) {
+    atomic_ulong *mapcnt = x86_64_pt_mapcnt(src->raw);
+
+    // a private table gets its first two users, a shared one another.
+    if (pte_isW(src)) {
+        atomic_write(mapcnt, 2);
+        __atomic_and_fetch(&src->raw, ~(u64)PTE_W, __ATOMIC_SEQ_CST);
+    } else {
+        atomic_inc(mapcnt);
+    }
+
+    dst->raw = src->raw;
+}
+
+int x86_64_unshare_pt(uintptr_t va) {
+    int         err     = 0;
+    int         i1      = 0;
+    u64         raw     = 0;
+    uintptr_t   l1      = 0, old = 0;
+    pte_t       *src    = NULL, *dst = NULL;
+    const int   i4      = PML4I(va), i3 = PDPTI(va), i2 = PDI(va);
+
+    if (!x86_64_pt_isshared(i4, i3, i2))
+        return 0;
+
+    old = PGROUND(PDTE(i4, i3, i2)->raw);
+
+    // everyone else has let go of it, the table is ours again.
+    // only we can fork it, so the count cannot go back up under us.
+    if (atomic_read(x86_64_pt_mapcnt(old)) == 1) {
+        atomic_write(x86_64_pt_mapcnt(old), 0);
+        PDTE(i4, i3, i2)->raw |= PTE_W;
+        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, i2));
+        x86_64_tlb_shootdown_range(rdcr3(), i2v(i4, i3, i2, 0), PGSZ2MB);
+        return 0;
+    }
+
+    if ((err = pmman.get_page(GFP_NORMAL, (void **)&l1)))
+        return err;
+
+    // the recursive window onto the shared table is read-only, go around it.
+    if ((err = x86_64_mount(old, (void **)&src)))
+        goto error;
+
+    if ((err = x86_64_mount(l1, (void **)&dst)))
+        goto error;
+
+    // the same as fork() used to do for every table, but only for this one.
+    for (i1 = 0; i1 < NPTE; ++i1) {
+        raw = src[i1].raw;
+
+        if (_isswap(raw)) {
+            if ((err = zram_dup(PTE2SWP(&src[i1]))))
+                goto undo;
+        } else if (_isP(raw)) {
+            // Enforce Copy-On-Write on both sides.
+            raw = __atomic_and_fetch(&src[i1].raw, ~(u64)PTE_W, __ATOMIC_SEQ_CST);
+
+            if (!ismmio_addr(PGROUND(raw)) && (err = __page_get(PGROUND(raw))))
+                goto undo;
+        }
+
+        dst[i1].raw = raw;
+    }
+
+    x86_64_unmount((uintptr_t)dst);
+    x86_64_unmount((uintptr_t)src);
+
+    PDTE(i4, i3, i2)->raw = l1 | PGOFF(PDTE(i4, i3, i2)->raw) | PTE_W;
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, i2));
+    x86_64_tlb_shootdown_range(rdcr3(), i2v(i4, i3, i2, 0), PGSZ2MB);
+
+    x86_64_pt_put(old);
+    return 0;
+undo:
+    while (i1--) {
+        if (pte_isswap(&dst[i1]))
+            zram_free(PTE2SWP(&dst[i1]));
+        else if (pte_isP(&dst[i1]) && !ismmio_addr(PTE2PHYS(&dst[i1])))
+            __page_put(PTE2PHYS(&dst[i1]));
+    }
+error:
+    if (dst)
+        x86_64_unmount((uintptr_t)dst);
+    if (src)
+        x86_64_unmount((uintptr_t)src);
+    pmman.free(l1);
+    return err;
+}
+
+void x86_64_drop_shared(void) {
+    x86_64_tlb_batch_begin();
+
+    for (usize i4 = 0; i4 < PML4I(USTACK); ++i4) {
+        if (!pte_isP(PML4E(i4)))
+            continue;
+
+        for (usize i3 = 0; i3 < NPTE; ++i3) {
+            if (!pte_isP(PDPTE(i4, i3)) || pte_isPS(PDPTE(i4, i3)))
+                continue;
+
+            for (usize i2 = 0; i2 < NPTE; ++i2) {
+                if (x86_64_pt_isshared(i4, i3, i2))
+                    x86_64_drop_pt(i4, i3, i2);
+            }
+        }
+    }
+
+    x86_64_tlb_batch_end();
 }
 
 static inline void x86_64_unmap_pt(int i4, int i3, int i2) {
@@ -190,17 +456,239 @@ static inline void x86_64_unmap_pt(int i4, int i3, int i2) {
     if (!pte_isP(PDTE(i4, i3, i2)))
         return;
 
+    // still in use by whoever we share it with.
+    if (x86_64_pt_isshared(i4, i3, i2)) {
+        x86_64_drop_pt(i4, i3, i2);
+        return;
+    }
+
     // printk("[%s:%d] i4: %d, i3: %d i2: %d\n", __FILE__, __LINE__, i4, i3, i2);
     l1 = PGROUND(PDTE(i4, i3, i2)->raw);
     PDTE(i4, i3, i2)->raw = 0;
     x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PTE(i4, i3, i2, 0));
-    pmman.free(l1);
+    x86_64_tlb_free(l1, 0);
+}
+
+/**
+ * Break the 1GiB page at PDPTE(i4, i3) into a page directory
+ * of 512 2MiB entries that map the same frames with the same flags.
+ */
+static int x86_64_split_pdpte(int i4, int i3) {
+    int         err     = 0;
+    uintptr_t   l2      = 0;
+    pte_t       *pdt    = NULL;
+    const u64   raw     = PDPTE(i4, i3)->raw;
+    uintptr_t   pa      = ALIGN_DOWN(PGROUND(raw), PGSZ1GB);
+
+    if (!_isP(raw) || !_isPS(raw))
+        return 0;
+
+    if ((err = pmman.get_page(GFP_NORMAL, (void **)&l2)))
+        return err;
+
+    // fill the new table before it goes live so that no CPU
+    // ever sees a hole in the mapping.
+    if ((err = x86_64_mount(l2, (void **)&pdt))) {
+        pmman.free(l2);
+        return err;
+    }
+
+    for (int i2 = 0; i2 < NPTE; ++i2, pa += PGSZ2MB)
+        pdt[i2].raw = pa | PGOFF(raw);
+
+    x86_64_unmount((uintptr_t)pdt);
+
+    PDPTE(i4, i3)->raw = l2 | PTE_WT | PTE_KRW | (raw & PTE_U);
+
+    // the recursive slots used to resolve to the data frame itself.
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDT(i4, i3));
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, 0));
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, 0, 0));
+    return 0;
+}
+
+/**
+ * Break the 2MiB page at PDTE(i4, i3, i2) into a page table
+ * of 512 4KiB entries that map the same frames with the same flags.
+ */
+static int x86_64_split_pdte(int i4, int i3, int i2) {
+    int         err     = 0;
+    uintptr_t   l1      = 0;
+    pte_t       *pt     = NULL;
+    const u64   raw     = PDTE(i4, i3, i2)->raw;
+    uintptr_t   pa      = ALIGN_DOWN(PGROUND(raw), PGSZ2MB);
+
+    if (!_isP(raw) || !_isPS(raw))
+        return 0;
+
+    if ((err = pmman.get_page(GFP_NORMAL, (void **)&l1)))
+        return err;
+
+    if ((err = x86_64_mount(l1, (void **)&pt))) {
+        pmman.free(l1);
+        return err;
+    }
+
+    // bit 7 is PAT in a 4KiB entry, so PS must not leak into it.
+    for (int i1 = 0; i1 < NPTE; ++i1, pa += PGSZ)
+        pt[i1].raw = pa | (PGOFF(raw) & ~PTE_PS);
+
+    x86_64_unmount((uintptr_t)pt);
+
+    PDTE(i4, i3, i2)->raw = l1 | PTE_WT | PTE_KRW | (raw & PTE_U);
+
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, i2));
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, i2, 0));
+    return 0;
+}
+
+int x86_64_split_page(uintptr_t va) {
+    int err = 0;
+    int i4  = PML4I(va), i3 = PDPTI(va), i2 = PDI(va);
+
+    if (!pte_isP(PML4E(i4)) || !pte_isP(PDPTE(i4, i3)))
+        return 0;
+
+    if ((err = x86_64_split_pdpte(i4, i3)))
+        return err;
+
+    if (!pte_isP(PDTE(i4, i3, i2)))
+        return 0;
+
+    return x86_64_split_pdte(i4, i3, i2);
+}
+
+static inline bool x86_64_pt_isempty(int i4, int i3, int i2) {
+    for (int i1 = 0; i1 < NPTE; ++i1) {
+        if (PTE(i4, i3, i2, i1)->raw)
+            return false;
+    }
+    return true;
+}
+
+int x86_64_map_1g(uintptr_t pa, int i4, int i3, int flags) {
+    int         err     = 0;
+    int         do_remap= _isremap(flags);
+
+    flags   = extract_vmflags(flags) & ~PTE_PS;
+
+    if (iL_INV(i4) || iL_INV(i3))
+        return -EINVAL;
+
+    if (pa & (PGSZ1GB - 1))
+        return -EINVAL;
+
+    if (!x86_64_has_1g_pages())
+        return -ENOTSUP;
+
+    if ((err = x86_64_map_pdpt(i4, flags)))
+        return err;
+
+    if (!pte_isP(PDPTE(i4, i3))) {
+        PDPTE(i4, i3)->raw = pa | PGOFF(flags) | PTE_PS;
+        invlpg(i2v(i4, i3, 0, 0));
+        return 0;
+    }
+
+    if (!(do_remap && pte_isPS(PDPTE(i4, i3))))
+        return -EEXIST;
+
+    PDPTE(i4, i3)->raw = pa | PGOFF(flags) | PTE_PS;
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, 0, 0));
+    return 0;
+}
+
+int x86_64_map_2m(uintptr_t pa, int i4, int i3, int i2, int flags) {
+    int         err     = 0;
+    int         do_remap= _isremap(flags);
+
+    flags   = extract_vmflags(flags) & ~PTE_PS;
+
+    if (iL_INV(i4) || iL_INV(i3) || iL_INV(i2))
+        return -EINVAL;
+
+    if (PG2MOFF(pa))
+        return -EINVAL;
+
+    if ((err = x86_64_map_pdt(i4, i3, flags)))
+        return err;
+
+    if ((err = x86_64_split_pdpte(i4, i3)))
+        return err;
+
+    // a page table left behind by earlier 4KiB mappings that
+    // have all gone away can make room for the large page.
+    if (pte_isP(PDTE(i4, i3, i2)) && !pte_isPS(PDTE(i4, i3, i2)) &&
+        x86_64_pt_isempty(i4, i3, i2))
+        x86_64_unmap_pt(i4, i3, i2);
+
+    if (!pte_isP(PDTE(i4, i3, i2))) {
+        PDTE(i4, i3, i2)->raw = pa | PGOFF(flags) | PTE_PS;
+        invlpg(i2v(i4, i3, i2, 0));
+        return 0;
+    }
+
+    if (!(do_remap && pte_isPS(PDTE(i4, i3, i2))))
+        return -EEXIST;
+
+    PDTE(i4, i3, i2)->raw = pa | PGOFF(flags) | PTE_PS;
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, i2, 0));
+    return 0;
+}
+
+int x86_64_map_hugepage(uintptr_t va, int flags) {
+    int         err     = 0;
+    uintptr_t   pa      = 0;
+    gfp_t       gfp     = GFP_NORMAL | (_iszero(flags) ? GFP_ZERO : 0);
+
+    if (PG2MOFF(va))
+        return -EINVAL;
+
+    if ((err = pmman.get_pages(gfp, PG2MORDER, (void **)&pa)))
+        return err;
+
+    if ((err = x86_64_map_2m(pa, PML4I(va), PDPTI(va),
+        PDI(va), flags | PTE_ALLOC))) {
+        pmman.free_pages(pa, PG2MORDER);
+        return err;
+    }
+
+    return 0;
+}
+
+static void x86_64_unmap_1g(int i4, int i3) {
+    const u64 raw = PDPTE(i4, i3)->raw;
+
+    PDPTE(i4, i3)->raw = 0;
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDT(i4, i3));
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, 0));
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, 0, 0));
+
+    if (_isalloc(raw))
+        x86_64_tlb_free(ALIGN_DOWN(PGROUND(raw), PGSZ1GB), PG1GORDER);
+}
+
+static void x86_64_unmap_2m(int i4, int i3, int i2) {
+    const u64 raw = PDTE(i4, i3, i2)->raw;
+
+    PDTE(i4, i3, i2)->raw = 0;
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PT(i4, i3, i2));
+    x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, i2, 0));
+
+    if (_isalloc(raw))
+        x86_64_tlb_free(ALIGN_DOWN(PGROUND(raw), PGSZ2MB), PG2MORDER);
 }
 
 void x86_64_switchvm(uintptr_t pdbr, uintptr_t *old) {
-    if (old) *old = rdcr3();
     // if PDBR is null, then switch to the kernel address space (_PML4_)
-    wrcr3(pdbr ? pdbr : V2LO(_PML4_));
+    pdbr = pdbr ? pdbr : V2LO(_PML4_);
+
+    pushcli();
+    // CR3 also carries the PCID, callers only want the table.
+    if (old) *old = PGROUND(rdcr3());
+    // publish the switch before any translation of pdbr can be cached.
+    wrcr3(x86_64_tlb_switch(pdbr));
+    popcli();
 }
 
 void x86_64_switchkvm(void) {
@@ -208,7 +696,7 @@ void x86_64_switchkvm(void) {
 }
 
 bool x86_64_active_pdbr(uintptr_t pdbr) {
-    return rdcr3() == pdbr;
+    return PGROUND(rdcr3()) == PGROUND(pdbr);
 }
 
 int x86_64_map(uintptr_t pa, int i4, int i3, int i2, int i1, int flags) {
@@ -231,7 +719,7 @@ int x86_64_map(uintptr_t pa, int i4, int i3, int i2, int i1, int flags) {
         }
 
         PML4E(i4)->raw = l3 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
+        invlpg((uintptr_t)PDPTE(i4, 0));
         // printk("%s:%d: i4(%d) l3: %p -> %p\n", __FILE__, __LINE__, i4, PDPTE(i4, 0), l3);
     }
 
@@ -241,49 +729,70 @@ int x86_64_map(uintptr_t pa, int i4, int i3, int i2, int i1, int flags) {
         }
 
         PDPTE(i4, i3)->raw = l2 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
+        invlpg((uintptr_t)PDTE(i4, i3, 0));
         // printk("%s:%d: i3(%d, %d) l2: %p -> %p\n", __FILE__, __LINE__, i4, i3, PDTE(i4, i3, 0), l2);
     }
 
+    // a 4KiB mapping inside a large page needs the page broken up first.
+    if ((err = x86_64_split_pdpte(i4, i3)))
+        goto error;
+
+    if ((err = x86_64_split_pdte(i4, i3, i2)))
+        goto error;
+
+    if ((err = x86_64_unshare_pt(va)))
+        goto error;
+
     if (!pte_isP(PDTE(i4, i3, i2))) {
         if ((err = pmman.get_page(GFP_NORMAL | GFP_ZERO, (void **)&l1))) {
             goto error;
         }
 
         PDTE(i4, i3, i2)->raw = l1 | PGOFF(flags | PTE_WT | PTE_KRW);
-        x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PTE(i4, i3, i2, 0));
+        invlpg((uintptr_t)PTE(i4, i3, i2, 0));
         // printk("%s:%d: i2(%d, %d, %d) l1: %p -> %p\n", __FILE__, __LINE__, i4, i3, i2, PTE(i4, i3, i2, 0), l1);
     }
 
-    if (!pte_isP(PTE(i4, i3, i2, i1)))
+    if (!pte_isP(PTE(i4, i3, i2, i1))) {
+        // the page we are replacing was swapped out, its copy goes.
+        if (pte_isswap(PTE(i4, i3, i2, i1)))
+            zram_free(PTE2SWP(PTE(i4, i3, i2, i1)));
+
+        // a fresh mapping replaces nothing a TLB could hold.
         PTE(i4, i3, i2, i1)->raw = PGROUND(pa) | PGOFF(flags);
-    else if (do_remap) // acknowledge remap request.
+        invlpg(va);
+    } else if (do_remap) { // acknowledge remap request.
         PTE(i4, i3, i2, i1)->raw = PGROUND(pa) | PGOFF(flags);
+        x86_64_tlb_shootdown(rdcr3(), va);
+    }
+
+    // a private user frame, one compaction can move.
+    if (_isalloc(flags) && _isU(flags) && PTE2PHYS(PTE(i4, i3, i2, i1)) == PGROUND(pa))
+        __page_setmovable(pa);
     // else
     //     panic("%s:%d: already mapped, (%d, %d, %d, %d): %p -> %p\n",
     //         __FILE__, __LINE__, i4, i3, i2, i1,
     //         i2v(i4, i3, i2, i1), PTE(i4, i3, i2, i1)->raw);
 
-    x86_64_tlb_shootdown(rdcr3(), va);
-
     return 0;
 error:
     if (l2 != 0) {
         PDPTE(i4, i3)->raw = 0;
         x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDTE(i4, i3, 0));
-        pmman.free(l2);
+        x86_64_tlb_free(l2, 0);
     }
 
     if (l3 != 0) {
         PML4E(i4)->raw = 0;
         x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PDPTE(i4, 0));
-        pmman.free(l3);
+        x86_64_tlb_free(l3, 0);
     }
 
     return err;
 }
 
-void x86_64_unmap(int i4, int i3, int i2, int i1) {
+int x86_64_unmap(int i4, int i3, int i2, int i1) {
+    int       err = 0;
     uintptr_t pa = 0;
     
     if (!pte_isP(PML4E(i4)))
@@ -291,10 +800,28 @@ void x86_64_unmap(int i4, int i3, int i2, int i1) {
     
     if (!pte_isP(PDPTE(i4, i3)))
         goto done;
+
+    // unmapping part of a large page keeps the rest of it mapped,
+    // splitting it, or unsharing a table, needs a page we may not get.
+    if ((err = x86_64_split_pdpte(i4, i3)))
+        return err;
     
     if (!pte_isP(PDTE(i4, i3, i2)))
         goto done;
-    
+
+    if ((err = x86_64_split_pdte(i4, i3, i2)))
+        return err;
+
+    if ((err = x86_64_unshare_pt(i2v(i4, i3, i2, 0))))
+        return err;
+
+    // a swapped out page only has its compressed copy to drop.
+    if (pte_isswap(PTE(i4, i3, i2, i1))) {
+        zram_free(PTE2SWP(PTE(i4, i3, i2, i1)));
+        PTE(i4, i3, i2, i1)->raw = 0;
+        goto done;
+    }
+
     if (!pte_isP(PTE(i4, i3, i2, i1)))
         goto done;
 
@@ -304,34 +831,86 @@ void x86_64_unmap(int i4, int i3, int i2, int i1) {
     x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, i2, i1));
 done:
     /** Deallocate this page frame
-     * if it was allocated at the time of mapping.*/
+     * if it was allocated at the time of mapping,
+     * once no other CPU can still reach it.*/
     if (_isalloc(pa)) {
         // debug("[NOTE]: Freeing frame{0x%p}...\n", PGROUND(pa));
-        pmman.free(PGROUND(pa));
+        x86_64_tlb_free(PGROUND(pa), 0);
     }
+    return 0;
 }
 
-void x86_64_unmap_n(uintptr_t va, usize sz) {
-    for (usize nr = NPAGE(sz); nr; --nr, va += PGSZ) {
-        x86_64_unmap(PML4I(va), PDPTI(va), PDI(va), PTI(va));
+int x86_64_unmap_n(uintptr_t va, usize sz) {
+    int err = 0;
+
+    x86_64_tlb_batch_begin();
+
+    for (usize nr = NPAGE(sz); nr; ) {
+        int i4 = PML4I(va), i3 = PDPTI(va), i2 = PDI(va);
+
+        // drop large pages wholesale when the range covers them.
+        if (pte_isP(PML4E(i4)) && pte_isP(PDPTE(i4, i3))) {
+            if (pte_isPS(PDPTE(i4, i3))) {
+                if (!(va & (PGSZ1GB - 1)) && nr >= NPAGE(PGSZ1GB)) {
+                    x86_64_unmap_1g(i4, i3);
+                    nr -= NPAGE(PGSZ1GB), va += PGSZ1GB;
+                    continue;
+                }
+            } else if (pte_isP(PDTE(i4, i3, i2)) && pte_isPS(PDTE(i4, i3, i2))) {
+                if (!PG2MOFF(va) && nr >= NPTE) {
+                    x86_64_unmap_2m(i4, i3, i2);
+                    nr -= NPTE, va += PGSZ2MB;
+                    continue;
+                }
+            } else if (x86_64_pt_isshared(i4, i3, i2)) {
+                // no need for a private copy only to empty it.
+                if (!PG2MOFF(va) && nr >= NPTE) {
+                    x86_64_drop_pt(i4, i3, i2);
+                    nr -= NPTE, va += PGSZ2MB;
+                    continue;
+                }
+            }
+        }
+
+        if ((err = x86_64_unmap(i4, i3, i2, PTI(va))))
+            break;
+        nr -= 1, va += PGSZ;
     }
+
+    x86_64_tlb_batch_end();
+    return err;
 }
 
 int x86_64_map_i(uintptr_t va, uintptr_t pa, usize sz, int flags) {
     int         err = 0;
     uintptr_t   vr  = va;
     usize       nr  = NPAGE(sz);
+    const bool  huge= _isPS(flags) ? true : false;
+
+    flags &= ~PTE_PS;
+
+    x86_64_tlb_batch_begin();
+
+    while (nr) {
+        // PTE_PS asks for 2MiB pages wherever both addresses line up.
+        if (huge && nr >= NPTE && !PG2MOFF(va) && !PG2MOFF(pa) &&
+            !x86_64_map_2m(pa, PML4I(va), PDPTI(va), PDI(va), flags)) {
+            nr -= NPTE, pa += PGSZ2MB, va += PGSZ2MB;
+            continue;
+        }
 
-    for (; nr; --nr, pa += PGSZ, va += PGSZ) {
         if ((err = x86_64_map(pa, PML4I(va),
             PDPTI(va), PDI(va), PTI(va), flags)))
             goto error;
+
+        nr -= 1, pa += PGSZ, va += PGSZ;
     }
 
+    x86_64_tlb_batch_end();
     return 0;
 error:
-    nr = NPAGE(sz) - nr;
-    x86_64_unmap_n(vr, nr * PGSZ);
+    x86_64_unmap_n(vr, va - vr);
+    x86_64_tlb_batch_end();
     return err;
 }
 
@@ -349,18 +928,47 @@ int x86_64_mprotect(uintptr_t va, usize sz, int flags) {
     // Clear all permissions first, then apply new ones
     const int perm_mask = (PTE_U | PTE_R | PTE_W | PTE_X);
 
-    for (; nr; nr--, va += PGSZ) {
+    // one IPI per remote CPU for the whole range.
+    x86_64_tlb_batch_begin();
+
+    while (nr) {
+        usize span = 1;
+
+        if ((err = x86_64_unshare_pt(va)))
+            break;
+
         if ((err = x86_64_getmapping(va, &pte))) {
-            if (err == -ENOENT) continue;  // Skip unmapped pages???
-            return err;
+            if (err == -ENOENT) {  // Skip unmapped pages???
+                nr -= 1, va += PGSZ;
+                err = 0;
+                continue;
+            }
+            break;
+        }
+
+        if (pte_isPS(pte)) {
+            span = (pte == PDPTE(PML4I(va), PDPTI(va))) ? NPAGE(PGSZ1GB) : NPTE;
+
+            // a range that only covers part of a large page splits it.
+            if ((va & ((span * PGSZ) - 1)) || nr < span) {
+                if ((err = x86_64_split_page(va)))
+                    break;
+                continue;
+            }
         }
 
         pte->raw &= ~perm_mask;  // Reset permissions
-        pte->raw |= flags;       // Apply new permissions
+        pte->raw |= flags & ~PTE_PS; // Apply new permissions
+        // frames shared with the zero page, the page cache or another
+        // mapping only turn writable through a COW fault.
+        if (_isalloc(pte->raw) && !__page_exclusive(PTE2PHYS(pte)))
+            pte->raw &= ~PTE_W;
         x86_64_tlb_shootdown(rdcr3(), va);
+        nr -= span, va += span * PGSZ;
     }
 
-    return 0;
+    x86_64_tlb_batch_end();
+    return err;
 }
 
 int x86_64_map_n(uintptr_t va, usize sz, int flags) {
@@ -369,8 +977,21 @@ int x86_64_map_n(uintptr_t va, usize sz, int flags) {
     uintptr_t   vr      = va;
     usize       nr      = NPAGE(sz);
     gfp_t  gfp_mask     = GFP_NORMAL | (_iszero(flags) ? GFP_ZERO : 0);
+    const bool  huge    = _isPS(flags) ? true : false;
+
+    flags &= ~PTE_PS;
+
+    x86_64_tlb_batch_begin();
+
+    while (nr) {
+        // PTE_PS asks for 2MiB pages wherever the range allows,
+        // falling back to 4KiB pages when none can be had.
+        if (huge && nr >= NPTE && !PG2MOFF(va) &&
+            !x86_64_map_hugepage(va, flags)) {
+            nr -= NPTE, va += PGSZ2MB;
+            continue;
+        }
 
-    for (; nr; --nr, va += PGSZ) {
         if ((err = pmman.get_page(gfp_mask, (void **)&pa))) {
             goto error;
         }
@@ -378,14 +999,19 @@ int x86_64_map_n(uintptr_t va, usize sz, int flags) {
         // printk("%s:%d: pa: %p\n", __FILE__, __LINE__, pa);
 
         if ((err = x86_64_map(pa, PML4I(va),
-            PDPTI(va), PDI(va), PTI(va), flags | PTE_ALLOC)))
+            PDPTI(va), PDI(va), PTI(va), flags | PTE_ALLOC))) {
+            pmman.free(pa);
             goto error;
+        }
+
+        nr -= 1, va += PGSZ;
     }
 
+    x86_64_tlb_batch_end();
     return 0;
 error:
-    nr = NPAGE(sz) - nr;
-    x86_64_unmap_n(vr, nr * PGSZ);
+    x86_64_unmap_n(vr, va - vr);
+    x86_64_tlb_batch_end();
     return err;
 }
 
@@ -396,6 +1022,12 @@ int x86_64_mount(uintptr_t pa, void **pvp) {
     if (pa == 0 || pvp == NULL)
         return -EINVAL;
 
+    // frames inside the direct map need no temporary mapping.
+    if (x86_64_physmap_covers(PGROUND(pa), PGSZ)) {
+        *pvp = (void *)PHYS2VIRT(PGROUND(pa));
+        return 0;
+    }
+
     if ((va = vmman.alloc(PGSZ)) == 0)
         return -ENOMEM;
 
@@ -411,23 +1043,43 @@ error:
 }
 
 void x86_64_unmount(uintptr_t va) {
-    x86_64_unmap_n(va, PGSZ);
+    // direct-map addresses are permanent, nothing to undo.
+    if (isphysmap_addr(va))
+        return;
+
+    // unmapped along with others at the next purge, one shootdown for all.
+    vmman.free_lazy(va);
 }
 
 void x86_64_unmap_full(void) {
     usize i4 = 0, i3 = 0, i2 = 0, i1 = 0;
 
+    x86_64_tlb_batch_begin();
+
     for (i4 = 0; i4 < PML4I(USTACK); ++i4) {
         if (!pte_isP(PML4E(i4)))
             continue;
         for (i3 = 0; i3 < NPTE; ++i3) {
             if (!pte_isP(PDPTE(i4, i3)))
                 continue;
+            if (pte_isPS(PDPTE(i4, i3))) {
+                x86_64_unmap_1g(i4, i3);
+                continue;
+            }
             for (i2 = 0; i2 < NPTE; ++i2) {
                 if (!pte_isP(PDTE(i4, i3, i2)))
                     continue;
+                if (pte_isPS(PDTE(i4, i3, i2))) {
+                    x86_64_unmap_2m(i4, i3, i2);
+                    continue;
+                }
+                if (!pte_isW(PDTE(i4, i3, i2))) {
+                    x86_64_drop_pt(i4, i3, i2);
+                    continue;
+                }
                 for (i1 = 0; i1 < NPTE; ++i1) {
-                    if (!pte_isP(PTE(i4, i3, i2, i1)))
+                    if (!pte_isP(PTE(i4, i3, i2, i1)) &&
+                        !pte_isswap(PTE(i4, i3, i2, i1)))
                         continue;
                     x86_64_unmap(i4, i3, i2, i1);
                 }
@@ -437,6 +1089,8 @@ void x86_64_unmap_full(void) {
         }
         x86_64_unmap_pdpt(i4);
     }
+
+    x86_64_tlb_batch_end();
 }
 
 void x86_64_fullvm_unmap(uintptr_t pml4) {
@@ -471,11 +1125,38 @@ static int x86_64_kvmcpy(uintptr_t dstp) {
     return 0;
 }
 
+/**
+ * Share the large page at src through dst, both read-only,
+ * so that the first write from either side takes a COW fault.
+ * Every 4KiB frame gets its own reference because COW
+ * breaks the page up before copying.
+ */
+static int x86_64_lazycpy_huge(pte_t *src, pte_t *dst, usize npage) {
+    int             err = 0;
+    const uintptr_t pa  = ALIGN_DOWN(PGROUND(src->raw), npage * PGSZ);
+
+    // Enforce Copy-On-Write by marking page ready-only.
+    src->w = 0;
+
+    dst->raw = src->raw;
+
+    // No need of incrementing MMIO address-space pages.
+    if (ismmio_addr(pa))
+        return 0;
+
+    for (usize i = 0; i < npage; ++i) {
+        if ((err = __page_get(pa + (i * PGSZ))))
+            return err;
+    }
+
+    return 0;
+}
+
 int x86_64_lazycpy(uintptr_t dst, uintptr_t src) {
     int         err     = 0;
     uintptr_t   oldpdbr = 0;
-    usize       i4      = 0, i3 = 0, i2 = 0, i1 = 0;
-    pte_t       *pml4   = NULL, *pdpt = NULL, *pdt = NULL, *pt = NULL;
+    usize       i4      = 0, i3 = 0, i2 = 0;
+    pte_t       *pml4   = NULL, *pdpt = NULL, *pdt = NULL;
 
     if (dst == 0 || src == 0)
         return -EINVAL;
@@ -515,6 +1196,15 @@ int x86_64_lazycpy(uintptr_t dst, uintptr_t src) {
             if (!pte_isP(&pdpt[i3]))
                 continue;
 
+            if (pte_isPS(&pdpt[i3])) {
+                if ((err = x86_64_lazycpy_huge(&pdpt[i3], PDPTE(i4, i3),
+                    NPAGE(PGSZ1GB)))) {
+                    x86_64_unmount((uintptr_t)pdpt);
+                    goto error;
+                }
+                continue;
+            }
+
             // Map this PDT into the destination PDPT.
             if ((err = x86_64_map_pdt(i4, i3, PGOFF(pdpt[i3].raw)))) {
                 x86_64_unmount((uintptr_t)pdpt);
@@ -535,51 +1225,22 @@ int x86_64_lazycpy(uintptr_t dst, uintptr_t src) {
                 if (!pte_isP(&pdt[i2]))
                     continue;
 
-                // Map this PT into the destination PDT.
-                if ((err = x86_64_map_pt(i4, i3, i2, PGOFF(pdt[i2].raw)))) {
-                    x86_64_unmount((uintptr_t)pdt);
-                    x86_64_unmount((uintptr_t)pdpt);
-                    goto error;
-                }
-
-                // create a temporal mount for this PT.
-                if ((err = x86_64_mount(pdt[i2].raw, (void **)&pt))) {
-                    x86_64_unmount((uintptr_t)pdt);
-                    x86_64_unmount((uintptr_t)pdpt);
-                    goto error;
-                }
-
-                /**
-                 * Begin the process of copying the various table entries.
-                 * this 'for' copies only the currently mapped pages/PT
-                 */
-                for (i1 = 0; i1 < NPTE; ++i1) {
-                    if (!pte_isP(&pt[i1]))
-                        continue;
-
-                    // Enforce Copy-On-Write by marking page ready-only.
-                    if (pte_isW(&pt[i1])) {
-                        pt[i1].w = 0;
-                        x86_64_tlb_shootdown(rdcr3(), i2v(i4, i3, i2, i1));
-                    }
-
-                    // Do page copy.
-                    PTE(i4, i3, i2, i1)->raw = pt[i1].raw;
-
-                    // No need of incrementing MMIO address-space pages.                    
-                    if (ismmio_addr(PGROUND(pt[i1].raw)))
-                        continue;
-
-                    // increase the page count on this page.
-                    if ((err = __page_get(PGROUND(pt[i1].raw)))) {
-                        assert(0, "Failed to increament page ref.");
+                if (pte_isPS(&pdt[i2])) {
+                    if ((err = x86_64_lazycpy_huge(&pdt[i2], PDTE(i4, i3, i2),
+                        NPTE))) {
                         x86_64_unmount((uintptr_t)pdt);
                         x86_64_unmount((uintptr_t)pdpt);
                         goto error;
                     }
+                    continue;
                 }
 
-                x86_64_unmount((uintptr_t)pt);
+                /**
+                 * Share the page table instead of copying it,
+                 * its entries are only copied, and write-protected,
+                 * once either side writes to the 2MiB it maps.
+                 */
+                x86_64_share_pt(&pdt[i2], PDTE(i4, i3, i2));
             }
 
             x86_64_unmount((uintptr_t)pdt);
@@ -590,11 +1251,19 @@ int x86_64_lazycpy(uintptr_t dst, uintptr_t src) {
 
     x86_64_switchvm(oldpdbr, NULL);
     x86_64_unmount((uintptr_t)pml4);
+
+    /**
+     * src's pages and page tables were write-protected from inside dst,
+     * so src's stale writable entries are dropped in one go,
+     * here and on every CPU currently running it.
+    */
+    x86_64_tlb_flush_pdbr(src);
     return 0;
 error:
     x86_64_unmap_full();
     x86_64_switchvm(oldpdbr, NULL);
     x86_64_unmount((uintptr_t)pml4);
+    x86_64_tlb_flush_pdbr(src);
     return err;
 }
 
@@ -603,6 +1272,11 @@ int x86_64_memcpypp(uintptr_t pdst, uintptr_t psrc, usize size) {
     usize       len     = 0;
     uintptr_t   vdst    = 0, vsrc = 0;
 
+    if (x86_64_physmap_covers(pdst, size) && x86_64_physmap_covers(psrc, size)) {
+        memcpy((void *)PHYS2VIRT(pdst), (void *)PHYS2VIRT(psrc), size);
+        return 0;
+    }
+
     for (; size; size -= len, psrc += len, pdst += len) {
         if ((err = x86_64_mount(PGROUND(pdst), (void **)&vdst)))
             return err;
@@ -628,6 +1302,11 @@ int x86_64_memcpyvp(uintptr_t pa, uintptr_t va, usize size) {
     usize       len     = 0;
     uintptr_t   vdst    = 0;
 
+    if (x86_64_physmap_covers(pa, size)) {
+        memcpy((void *)PHYS2VIRT(pa), (void *)va, size);
+        return 0;
+    }
+
     for (; size; size -= len, pa += len, va += len) {
         if ((err = x86_64_mount(PGROUND(pa), (void **)&vdst)))
             return err;
@@ -645,6 +1324,11 @@ int x86_64_memcpypv(uintptr_t va, uintptr_t pa, usize size) {
     usize       len     = 0;
     uintptr_t   vsrc    = 0;
 
+    if (x86_64_physmap_covers(pa, size)) {
+        memcpy((void *)va, (void *)PHYS2VIRT(pa), size);
+        return 0;
+    }
+
     for (; size; size -= len, pa += len, va += len) {
         if ((err = x86_64_mount(PGROUND(pa), (void **)&vsrc)))
             return err;
@@ -672,9 +1356,21 @@ int x86_64_getmapping(uintptr_t addr, pte_t **pte) {
     if (!pte_isP(PDPTE(i4, i3)))
         return -ENOENT;
 
+    // 1GiB page, there is no lower level to walk.
+    if (pte_isPS(PDPTE(i4, i3))) {
+        if (pte) *pte = PDPTE(i4, i3);
+        return 0;
+    }
+
     if (!pte_isP(PDTE(i4, i3, i2)))
         return -ENOENT;
 
+    // 2MiB page, there is no lower level to walk.
+    if (pte_isPS(PDTE(i4, i3, i2))) {
+        if (pte) *pte = PDTE(i4, i3, i2);
+        return 0;
+    }
+
     if (!pte_isP(PTE(i4, i3, i2, i1)))
         return -ENOENT;
 
@@ -684,6 +1380,348 @@ int x86_64_getmapping(uintptr_t addr, pte_t **pte) {
     return 0;
 }
 
+int x86_64_getswap(uintptr_t addr, ulong *pslot) {
+    int i4 = PML4I(addr), i3 = PDPTI(addr), i2 = PDI(addr);
+
+    if (!pte_isP(PML4E(i4)) || !pte_isP(PDPTE(i4, i3)) || pte_isPS(PDPTE(i4, i3)))
+        return -ENOENT;
+
+    if (!pte_isP(PDTE(i4, i3, i2)) || pte_isPS(PDTE(i4, i3, i2)))
+        return -ENOENT;
+
+    if (!pte_isswap(PTE(i4, i3, i2, PTI(addr))))
+        return -ENOENT;
+
+    if (pslot)
+        *pslot = PTE2SWP(PTE(i4, i3, i2, PTI(addr)));
+    return 0;
+}
+
+/**
+ * Only frames this mapping allocated and alone references
+ * can go, the zero page and COW-shared frames stay.
+ */
+static bool x86_64_swappable(pte_t *pte) {
+    usize count = 0;
+
+    if (!pte_isP(pte) || !pte_isalloc(pte) || !pte_isU(pte))
+        return false;
+
+    if (iszero_page(PTE2PHYS(pte)) || ismmio_addr(PTE2PHYS(pte)))
+        return false;
+
+    if (__page_getcount(PTE2PHYS(pte), &count) || count != 1)
+        return false;
+
+    // mlock()ed.
+    return !__page_pinned(PTE2PHYS(pte));
+}
+
+/**
+ * Step 'va' to the last page covered by the first absent or large
+ * paging structure above the PTE level, 0 if a page table maps 'va'.
+ */
+static uintptr_t x86_64_skip_table(uintptr_t va) {
+    int i4 = PML4I(va), i3 = PDPTI(va), i2 = PDI(va);
+
+    if (!pte_isP(PML4E(i4)))
+        return ALIGN_DOWN(va, NPTE * PGSZ1GB) + (NPTE * PGSZ1GB) - PGSZ;
+
+    if (!pte_isP(PDPTE(i4, i3)) || pte_isPS(PDPTE(i4, i3)))
+        return ALIGN_DOWN(va, PGSZ1GB) + PGSZ1GB - PGSZ;
+
+    // the pages of a shared table belong to more than one address space.
+    if (!pte_isP(PDTE(i4, i3, i2)) || pte_isPS(PDTE(i4, i3, i2)) ||
+        !pte_isW(PDTE(i4, i3, i2)))
+        return ALIGN_DOWN(va, PGSZ2MB) + PGSZ2MB - PGSZ;
+
+    return 0;
+}
+
+usize x86_64_swapout_range(uintptr_t va, usize sz, usize nr, bool lazyfree) {
+    u64             raw     = 0;
+    ulong           slot    = 0;
+    usize           swapped = 0;
+    uintptr_t       skip    = 0;
+    pte_t           *pte    = NULL;
+    const uintptr_t pdbr    = PGROUND(rdcr3());
+    const uintptr_t end     = PGROUND(va) + PGROUNDUP(sz);
+
+    for (va = PGROUND(va); va < end && swapped < nr; va += PGSZ) {
+        // step over whole tables that map nothing, or map large pages.
+        if ((skip = x86_64_skip_table(va))) {
+            va = skip;
+            continue;
+        }
+
+        pte = PTE(PML4I(va), PDPTI(va), PDI(va), PTI(va));
+        if (!x86_64_swappable(pte))
+            continue;
+
+        // used since the last pass, give it another round.
+        // a stale TLB entry only delays the next A bit, no flush.
+        // MADV_FREE pages not written since go regardless.
+        if (pte->a && !(lazyfree && !pte->d)) {
+            pte->a = 0;
+            continue;
+        }
+
+        // take the page away before compressing it, no CPU
+        // may write to it once the shootdown returns.
+        raw = __atomic_exchange_n(&pte->raw, 0, __ATOMIC_SEQ_CST);
+        x86_64_tlb_shootdown_now(pdbr, va);
+
+        // not written since madvise(MADV_FREE), the contents can go.
+        // the next touch finds an empty PTE and gets a zeroed page.
+        if (lazyfree && !(raw & PTE_D)) {
+            pmman.free(PGROUND(raw));
+            swapped++;
+            continue;
+        }
+
+        if (zram_store(PGROUND(raw), &slot)) {
+            pte->raw = raw;
+            continue;
+        }
+
+        pte->raw = SWP2PTE(slot);
+        pmman.free(PGROUND(raw));
+        swapped++;
+    }
+
+    return swapped;
+}
+
+usize x86_64_migrate_range(uintptr_t va, usize sz, uintptr_t lo, uintptr_t hi,
+    int (*alloc)(void *arg, uintptr_t *ppa), void *arg) {
+    u64             raw     = 0;
+    usize           moved   = 0;
+    uintptr_t       pa      = 0;
+    uintptr_t       skip    = 0;
+    pte_t           *pte    = NULL;
+    const uintptr_t pdbr    = PGROUND(rdcr3());
+    const uintptr_t end     = PGROUND(va) + PGROUNDUP(sz);
+
+    for (va = PGROUND(va); va < end; va += PGSZ) {
+        if ((skip = x86_64_skip_table(va))) {
+            va = skip;
+            continue;
+        }
+
+        pte = PTE(PML4I(va), PDPTI(va), PDI(va), PTI(va));
+        if (!pte_isP(pte) || PTE2PHYS(pte) < lo || PTE2PHYS(pte) >= hi)
+            continue;
+
+        // the frame is ours alone, so this PTE is its only mapping.
+        if (!x86_64_swappable(pte))
+            continue;
+
+        if (alloc(arg, &pa))
+            break;
+
+        // nobody may write the page while it is being copied.
+        raw = __atomic_exchange_n(&pte->raw, 0, __ATOMIC_SEQ_CST);
+        x86_64_tlb_shootdown_now(pdbr, va);
+
+        if (x86_64_memcpypp(pa, PGROUND(raw), PGSZ)) {
+            pte->raw = raw;
+            pmman.free(pa);
+            continue;
+        }
+
+        __page_setmovable(pa);
+        pte->raw = pa | PGOFF(raw);
+        pmman.free(PGROUND(raw));
+        moved++;
+    }
+
+    return moved;
+}
+
+int x86_64_lazyfree_range(uintptr_t va, usize sz) {
+    uintptr_t       skip    = 0;
+    pte_t           *pte    = NULL;
+    const uintptr_t pdbr    = PGROUND(rdcr3());
+    const uintptr_t start   = PGROUND(va);
+    const uintptr_t end     = PGROUND(va) + PGROUNDUP(sz);
+
+    x86_64_tlb_batch_begin();
+
+    for (va = start; va < end; va += PGSZ) {
+        if ((skip = x86_64_skip_table(va))) {
+            va = skip;
+            continue;
+        }
+
+        pte = PTE(PML4I(va), PDPTI(va), PDI(va), PTI(va));
+        if (!x86_64_swappable(pte) || !pte->d)
+            continue;
+
+        __atomic_and_fetch(&pte->raw, ~(u64)PTE_D, __ATOMIC_SEQ_CST);
+        x86_64_tlb_shootdown(pdbr, va);
+    }
+
+    // no CPU is left with a TLB entry that is dirty already,
+    // and would write without setting the D bit we cleared.
+    x86_64_tlb_batch_flush();
+    x86_64_tlb_batch_end();
+    return 0;
+}
+
+bool x86_64_test_and_clear_dirty(uintptr_t va) {
+    pte_t *pte = NULL;
+
+    // can't clear it without a private table, say dirty so it is written anyway.
+    if (x86_64_unshare_pt(va))
+        return x86_64_getmapping(va, &pte) == 0 && (pte->raw & PTE_D);
+
+    if (x86_64_getmapping(va, &pte) || !(pte->raw & PTE_D))
+        return false;
+
+    __atomic_and_fetch(&pte->raw, ~(u64)PTE_D, __ATOMIC_SEQ_CST);
+    x86_64_tlb_shootdown(rdcr3(), va);
+    return true;
+}
+
+int x86_64_pin_range(uintptr_t va, usize sz, bool pin) {
+    int             err     = 0;
+    uintptr_t       skip    = 0;
+    pte_t           *pte    = NULL;
+    const uintptr_t start   = PGROUND(va);
+    const uintptr_t end     = PGROUND(va) + PGROUNDUP(sz);
+
+    for (va = start; va < end; va += PGSZ) {
+        // pinned frames must be ours alone.
+        if ((err = x86_64_unshare_pt(va)))
+            break;
+
+        if ((skip = x86_64_skip_table(va))) {
+            va = skip;
+            continue;
+        }
+
+        pte = PTE(PML4I(va), PDPTI(va), PDI(va), PTI(va));
+        if (!pte_isP(pte) || !pte_isalloc(pte) || iszero_page(PTE2PHYS(pte)))
+            continue;
+
+        if ((err = pin ? __page_pin(PTE2PHYS(pte)) : __page_unpin(PTE2PHYS(pte))))
+            break;
+    }
+
+    // pins are counted, take back the ones this call did take.
+    if (err && pin && va > start)
+        x86_64_pin_range(start, va - start, false);
+
+    return err;
+}
+
+/**
+ * Move the page table mapping [src, src + 2MiB) to 'dst' as a whole,
+ * both 2MiB aligned. Returns -EEXIST if 'dst' already has a table.
+ */
+static int x86_64_move_pt(uintptr_t src, uintptr_t dst) {
+    int         err = 0;
+    const int   s4 = PML4I(src), s3 = PDPTI(src), s2 = PDI(src);
+    const int   d4 = PML4I(dst), d3 = PDPTI(dst), d2 = PDI(dst);
+
+    if ((err = x86_64_map_pdt(d4, d3, PTE_URW)))
+        return err;
+
+    if ((err = x86_64_split_pdpte(d4, d3)))
+        return err;
+
+    if (pte_isP(PDTE(d4, d3, d2)))
+        return -EEXIST;
+
+    PDTE(d4, d3, d2)->raw = PDTE(s4, s3, s2)->raw;
+    PDTE(s4, s3, s2)->raw = 0;
+
+    // the recursive windows onto both tables changed too.
+    invlpg((uintptr_t)PTE(d4, d3, d2, 0));
+    x86_64_tlb_shootdown(rdcr3(), (uintptr_t)PTE(s4, s3, s2, 0));
+    x86_64_tlb_shootdown_range(rdcr3(), src, PGSZ2MB);
+    return 0;
+}
+
+int x86_64_move_range(uintptr_t src, uintptr_t dst, usize sz) {
+    int         err     = 0;
+    u64         raw     = 0;
+    uintptr_t   skip    = 0;
+    usize       nr      = NPAGE(sz);
+    const uintptr_t src0= PGROUND(src), dst0 = PGROUND(dst);
+
+    src = src0, dst = dst0;
+
+    x86_64_tlb_batch_begin();
+
+    while (nr) {
+        int i4 = PML4I(src), i3 = PDPTI(src), i2 = PDI(src);
+
+        // whole page tables, or 2MiB pages, move with a single entry.
+        if (!PG2MOFF(src) && !PG2MOFF(dst) && nr >= NPTE &&
+            pte_isP(PML4E(i4)) && pte_isP(PDPTE(i4, i3)) &&
+            !pte_isPS(PDPTE(i4, i3)) && pte_isP(PDTE(i4, i3, i2))) {
+            if ((err = x86_64_move_pt(src, dst)) == 0) {
+                nr -= NPTE, src += PGSZ2MB, dst += PGSZ2MB;
+                continue;
+            } else if (err != -EEXIST) {
+                goto error;
+            }
+        }
+
+        // a 1GiB or 2MiB page only partly moved is broken up first.
+        if (pte_isP(PML4E(i4)) && pte_isP(PDPTE(i4, i3)) &&
+            (pte_isPS(PDPTE(i4, i3)) ||
+            (pte_isP(PDTE(i4, i3, i2)) && pte_isPS(PDTE(i4, i3, i2))))) {
+            if ((err = x86_64_split_page(src)))
+                goto error;
+        }
+
+        // entries move one at a time out of, and into, private tables only.
+        if ((err = x86_64_unshare_pt(src)))
+            goto error;
+
+        if ((skip = x86_64_skip_table(src))) {
+            skip = NPAGE(skip - src) + 1;
+            skip = skip < nr ? skip : nr;
+            nr -= skip, src += skip * PGSZ, dst += skip * PGSZ;
+            continue;
+        }
+
+        if ((raw = PTE(i4, i3, i2, PTI(src))->raw) != 0) {
+            if ((err = x86_64_map_pt(PML4I(dst), PDPTI(dst), PDI(dst), PTE_URW)))
+                goto error;
+
+            if ((err = x86_64_split_page(dst)))
+                goto error;
+
+            if ((err = x86_64_unshare_pt(dst)))
+                goto error;
+
+            // leftovers of an earlier mapping at 'dst' go first.
+            if (PTE(PML4I(dst), PDPTI(dst), PDI(dst), PTI(dst))->raw &&
+                (err = x86_64_unmap(PML4I(dst), PDPTI(dst), PDI(dst), PTI(dst))))
+                goto error;
+
+            // present or swapped out, the entry moves as is, the frame stays put.
+            PTE(PML4I(dst), PDPTI(dst), PDI(dst), PTI(dst))->raw = raw;
+            PTE(i4, i3, i2, PTI(src))->raw = 0;
+            x86_64_tlb_shootdown(rdcr3(), src);
+        }
+
+        nr -= 1, src += PGSZ, dst += PGSZ;
+    }
+
+    x86_64_tlb_batch_end();
+    return 0;
+error:
+    // put back what already moved, the source tables are all still there.
+    if (src != src0)
+        x86_64_move_range(dst0, src0, src - src0);
+    x86_64_tlb_batch_end();
+    return err;
+}
+
 int x86_64_pml4alloc(uintptr_t *ref) {
     int         err     = 0;
     uintptr_t   pml4    = 0;
@@ -706,5 +1744,10 @@ error:
 }
 
 void x86_64_pml4free(uintptr_t pgdir) {
-    if (pgdir) pmman.free(pgdir);
+    if (pgdir == 0)
+        return;
+
+    // the frame may come back as another root table.
+    x86_64_tlb_forget(pgdir);
+    pmman.free(pgdir);
 }
\ No newline at end of file
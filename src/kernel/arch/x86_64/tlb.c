@@ -0,0 +1,438 @@
+#include <arch/cpu.h>
+#include <arch/traps.h>
+#include <arch/x86_64/asm.h>
+#include <arch/x86_64/lapic.h>
+#include <arch/x86_64/paging.h>
+#include <arch/x86_64/tlb.h>
+#include <bits/errno.h>
+#include <cpuid.h>
+#include <mm/mem.h>
+#include <sync/preempt.h>
+#include <sync/spinlock.h>
+#include <sys/thread.h>
+
+/**
+ * An address space this CPU has cached under PCID (index + 1).
+ * 'stale' says the entries tagged with it can no longer be trusted
+ * and must be flushed the next time the PCID is loaded.
+ */
+typedef struct tlb_pcid {
+    uintptr_t   pdbr;
+    bool        stale;
+} tlb_pcid_t;
+
+/**
+ * Per-CPU TLB state.
+ * 'pdbr' is the address space the CPU runs, shootdowns are only
+ * sent to CPUs running the address space they are about.
+ * 'mbox' collects what other CPUs asked us to invalidate until the
+ * T_TLBSHTDWN handler drains it; requests that pile up are merged.
+ * Each request merged in bumps 'mbox_seq', a drain acknowledges all
+ * it took by moving 'done_seq' up to it once they are flushed.
+ * 'batch' is for code batching without a thread, at boot.
+ * 'pcids' remembers which address spaces may still have entries
+ * in the TLB, CPUs not running them are told so through 'stale'
+ * rather than an IPI. 'lock' covers pdbr, mbox and pcids.
+ */
+static struct tlb_cpu {
+    volatile uintptr_t  pdbr;
+    spinlock_t          lock;
+    tlb_range_t         mbox;
+    u64                 mbox_seq;
+    u64                 done_seq;
+    bool                draining;
+    tlb_batch_t         batch;
+    bool                has_pcid;
+    int                 pcid;       // index in pcids[] loaded, -1 for none.
+    int                 pcid_next;  // next victim when all PCIDs are taken.
+    tlb_pcid_t          pcids[TLB_NPCID];
+    tlb_stats_t         stats;
+} tlb_cpus[NCPU];
+
+/**
+ * Translations every address space shares.
+ * The recursive slot describes the current address space, so an address
+ * in it is only shared when the table it reaches maps the kernel half.
+ */
+static inline bool tlb_isglobal(uintptr_t va) {
+    if (!iskernel_addr(va))
+        return false;
+
+    for (int lvl = 0; lvl < 3 && (PML4I(va) == PML4_Recursion); ++lvl)
+        va <<= 9;
+
+    return (PML4I(va) != PML4_Recursion) && (PML4I(va) >= PML4I(USTACK));
+}
+
+static void tlb_range_merge(tlb_range_t *r, const tlb_range_t *req) {
+    if (!r->pending) {
+        *r = *req;
+        r->pending = true;
+        return;
+    }
+
+    // ranges of different address spaces can only be merged into everything.
+    if (r->pdbr != req->pdbr) {
+        r->pdbr      = 0;
+        r->flush_all = true;
+    }
+
+    if (req->flush_all)
+        r->flush_all = true;
+
+    r->start = (req->start < r->start) ? req->start : r->start;
+    r->end   = (req->end > r->end) ? req->end : r->end;
+
+    if (NPAGE(r->end - r->start) > TLB_FLUSH_THRESHOLD)
+        r->flush_all = true;
+}
+
+/**
+ * Have the PCIDs this CPU is not running forget 'pdbr', all of
+ * them if pdbr == 0. Only matters when PCIDs are on, without them
+ * loading CR3 already dropped every other address space.
+ * Called with self->lock held.
+ */
+static void tlb_pcid_invalidate(struct tlb_cpu *self, uintptr_t pdbr) {
+    if (!self->has_pcid)
+        return;
+
+    for (int i = 0; i < TLB_NPCID; ++i) {
+        if (i == self->pcid || self->pcids[i].pdbr == 0)
+            continue;
+
+        if (pdbr == 0 || self->pcids[i].pdbr == pdbr)
+            self->pcids[i].stale = true;
+    }
+}
+
+static void tlb_flush_local(struct tlb_cpu *self, const tlb_range_t *r) {
+    // kernel translations are tagged with every PCID this CPU used.
+    if (r->pdbr == 0 && self->has_pcid) {
+        spin_lock(&self->lock);
+        tlb_pcid_invalidate(self, 0);
+        spin_unlock(&self->lock);
+    }
+
+    if (r->flush_all || NPAGE(r->end - r->start) > TLB_FLUSH_THRESHOLD) {
+        // without CR3_NOFLUSH this drops the current PCID's entries.
+        wrcr3(rdcr3());
+        self->stats.full_flushes++;
+        return;
+    }
+
+    for (uintptr_t va = r->start; va < r->end; va += PGSZ) {
+        invlpg(va);
+        self->stats.invlpg++;
+    }
+}
+
+/**
+ * Invalidate 'req' on this CPU. When we run another address space
+ * than the one it is about, without PCIDs the switch already flushed
+ * it, with them its PCID goes stale.
+ */
+static void tlb_flush_self(struct tlb_cpu *self, const tlb_range_t *req) {
+    if (req->pdbr == 0 || req->pdbr == PGROUND(rdcr3())) {
+        tlb_flush_local(self, req);
+    } else {
+        spin_lock(&self->lock);
+        tlb_pcid_invalidate(self, req->pdbr);
+        spin_unlock(&self->lock);
+    }
+}
+
+/**
+ * Flush what this CPU has queued in its mailbox and acknowledge it.
+ * Called with interrupts off.
+ */
+static void tlb_drain(struct tlb_cpu *self) {
+    u64         seq = 0;
+    tlb_range_t req;
+
+    // taking self->lock may spin, and spinning polls the mailbox.
+    if (self->draining)
+        return;
+    self->draining = true;
+
+    spin_lock(&self->lock);
+    req = self->mbox;
+    seq = self->mbox_seq;
+    self->mbox.pending = false;
+    spin_unlock(&self->lock);
+
+    // we may have switched away since the request was queued.
+    if (req.pending)
+        tlb_flush_self(self, &req);
+
+    // whoever waits on 'seq' may now free what the request unmapped.
+    __atomic_store_n(&self->done_seq, seq, __ATOMIC_RELEASE);
+    self->draining = false;
+}
+
+/**
+ * Queue 'req' on every other CPU that may hold it, kick them, and wait
+ * until each has flushed it. Called with interrupts off, our own mailbox
+ * is drained while we wait, in case they are waiting on us in turn.
+ */
+static void tlb_send(struct tlb_cpu *self, const tlb_range_t *req) {
+    u64         seq[NCPU]   = {0};
+    const int   ncpus       = cpu_online();
+
+    // our PTE stores must be visible before we look at who runs 'pdbr'.
+    __sync_synchronize();
+
+    for (int id = 0; id < ncpus && id < NCPU; ++id) {
+        struct tlb_cpu *t    = &tlb_cpus[id];
+
+        if (t == self)
+            continue;
+
+        // checked under the lock x86_64_tlb_switch() holds, so a CPU
+        // switching to 'pdbr' either gets the IPI or sees its PCID stale.
+        spin_lock(&t->lock);
+        if (req->pdbr == 0 || t->pdbr == req->pdbr) {
+            tlb_range_merge(&t->mbox, req);
+            seq[id] = ++t->mbox_seq;
+        } else {
+            tlb_pcid_invalidate(t, req->pdbr);
+        }
+        spin_unlock(&t->lock);
+
+        if (seq[id]) {
+            lapic_send_ipi(T_TLBSHTDWN, id);
+            self->stats.ipi_sent++;
+        }
+    }
+
+    for (int id = 0; id < ncpus && id < NCPU; ++id) {
+        while (seq[id] && __atomic_load_n(&tlb_cpus[id].done_seq, __ATOMIC_ACQUIRE) < seq[id]) {
+            if (__atomic_load_n(&self->mbox.pending, __ATOMIC_RELAXED))
+                tlb_drain(self);
+            cpu_pause();
+        }
+    }
+}
+
+/*The batch of the running thread, or of this CPU when there is none.*/
+static tlb_batch_t *tlb_batch(void) {
+    thread_t *thread = current;
+    return thread ? &thread->t_arch.t_tlb : &tlb_cpus[getcpuid()].batch;
+}
+
+void x86_64_tlb_init(void) {
+    u32             a = 0, b = 0, c = 0, d = 0;
+    struct tlb_cpu  *self = NULL;
+
+    pushcli();
+    self = &tlb_cpus[getcpuid()];
+
+    self->pcid      = -1;
+    self->pcid_next = 0;
+    self->has_pcid  = false;
+
+    cpuid(0x1, 0, &a, &b, &c, &d);
+
+    // CR4.PCIDE can only be set while the loaded PCID is 0.
+    if ((c & BS(17)) && !PGOFF(rdcr3())) {
+        wrcr4(rdcr4() | CR4_PCIDE);
+        self->has_pcid = true;
+    }
+
+    popcli();
+}
+
+u64 x86_64_tlb_switch(uintptr_t pdbr) {
+    int             i    = 0;
+    u64             cr3  = PGROUND(pdbr);
+    struct tlb_cpu  *self = &tlb_cpus[getcpuid()];
+
+    spin_lock(&self->lock);
+    self->pdbr = PGROUND(pdbr);
+
+    if (!self->has_pcid) {
+        self->stats.switch_flush++;
+        goto done;
+    }
+
+    for (i = 0; i < TLB_NPCID; ++i) {
+        if (self->pcids[i].pdbr == PGROUND(pdbr))
+            break;
+    }
+
+    if (i < TLB_NPCID && !self->pcids[i].stale) {
+        cr3 |= CR3_NOFLUSH;
+        self->stats.switch_noflush++;
+    } else {
+        // a PCID changing hands, or gone stale, starts out flushed.
+        if (i == TLB_NPCID) {
+            i = self->pcid_next;
+            // never evict the PCID we are switching away from.
+            if (i == self->pcid)
+                i = (i + 1) % TLB_NPCID;
+            self->pcid_next = (i + 1) % TLB_NPCID;
+        }
+
+        self->pcids[i].pdbr  = PGROUND(pdbr);
+        self->pcids[i].stale = false;
+        self->stats.switch_flush++;
+    }
+
+    self->pcid = i;
+    cr3 |= i + 1;
+done:
+    spin_unlock(&self->lock);
+    return cr3;
+}
+
+void x86_64_tlb_forget(uintptr_t pdbr) {
+    pdbr = PGROUND(pdbr);
+
+    for (int id = 0; id < NCPU; ++id) {
+        struct tlb_cpu *t = &tlb_cpus[id];
+
+        spin_lock(&t->lock);
+        for (int i = 0; i < TLB_NPCID; ++i) {
+            if (t->pcids[i].pdbr == pdbr)
+                t->pcids[i] = (tlb_pcid_t){0};
+        }
+        spin_unlock(&t->lock);
+    }
+}
+
+static void tlb_shootdown(uintptr_t pdbr, uintptr_t start, uintptr_t end, bool flush_all, bool now) {
+    struct tlb_cpu  *self = NULL;
+    tlb_batch_t     *batch= NULL;
+    tlb_range_t     req   = {
+        .pdbr       = tlb_isglobal(start) ? 0 : pdbr,
+        .start      = start,
+        .end        = end,
+        .flush_all  = flush_all,
+        .pending    = true,
+    };
+
+    pushcli();
+    self  = &tlb_cpus[getcpuid()];
+    batch = tlb_batch();
+
+    tlb_flush_self(self, &req);
+
+    if (batch->depth && !now) {
+        // only this CPU flushed it, the batch's end takes care of the rest.
+        if (batch->range.pending && batch->last_cpu != getcpuid())
+            batch->moved = true;
+        batch->last_cpu = getcpuid();
+        tlb_range_merge(&batch->range, &req);
+    } else {
+        tlb_send(self, &req);
+    }
+
+    popcli();
+}
+
+void x86_64_tlb_shootdown_range(uintptr_t pdbr, uintptr_t addr, usize size) {
+    if (size == 0)
+        return;
+
+    tlb_shootdown(PGROUND(pdbr), PGROUND(addr), PGROUNDUP(addr + size), false, false);
+}
+
+void x86_64_tlb_shootdown(uintptr_t pdbr, uintptr_t addr) {
+    x86_64_tlb_shootdown_range(pdbr, addr, PGSZ);
+}
+
+void x86_64_tlb_shootdown_now(uintptr_t pdbr, uintptr_t addr) {
+    tlb_shootdown(PGROUND(pdbr), PGROUND(addr), PGROUND(addr) + PGSZ, false, true);
+}
+
+void x86_64_tlb_flush_pdbr(uintptr_t pdbr) {
+    tlb_shootdown(PGROUND(pdbr), 0, USTACK, true, false);
+}
+
+void x86_64_tlb_batch_begin(void) {
+    tlb_batch()->depth++;
+}
+
+void x86_64_tlb_batch_end(void) {
+    tlb_batch_t *batch = tlb_batch();
+
+    assert(batch->depth > 0, "TLB batch ended without a begin.\n");
+
+    if (--batch->depth == 0)
+        x86_64_tlb_batch_flush();
+}
+
+void x86_64_tlb_batch_flush(void) {
+    usize           nfree = 0;
+    tlb_range_t     req;
+    struct tlb_cpu  *self = NULL;
+    tlb_batch_t     *batch= tlb_batch();
+
+    pushcli();
+    self = &tlb_cpus[getcpuid()];
+
+    if (batch->range.pending) {
+        req = batch->range;
+        batch->range.pending = false;
+
+        // the shootdowns issued before we moved were only flushed there.
+        if (batch->moved || batch->last_cpu != getcpuid())
+            tlb_flush_self(self, &req);
+        batch->moved = false;
+
+        tlb_send(self, &req);
+    }
+
+    popcli();
+
+    // every CPU has let go of them now.
+    nfree = batch->nfree;
+    batch->nfree = 0;
+
+    for (usize i = 0; i < nfree; ++i) {
+        if (PGOFF(batch->free[i]))
+            pmman.free_pages(PGROUND(batch->free[i]), PGOFF(batch->free[i]));
+        else
+            pmman.free(batch->free[i]);
+    }
+}
+
+void x86_64_tlb_free(uintptr_t pa, usize order) {
+    tlb_batch_t *batch = tlb_batch();
+
+    // shootdowns outside a batch were all waited for.
+    if (batch->depth == 0) {
+        if (order)
+            pmman.free_pages(PGROUND(pa), order);
+        else
+            pmman.free(PGROUND(pa));
+        return;
+    }
+
+    if (batch->nfree == TLB_BATCH_NFREE)
+        x86_64_tlb_batch_flush();
+
+    batch->free[batch->nfree++] = PGROUND(pa) | order;
+}
+
+void x86_64_tlb_poll(void) {
+    pushcli();
+    if (__atomic_load_n(&tlb_cpus[getcpuid()].mbox.pending, __ATOMIC_RELAXED))
+        tlb_drain(&tlb_cpus[getcpuid()]);
+    popcli();
+}
+
+void x86_64_tlb_shootdown_handler(void) {
+    struct tlb_cpu *self = &tlb_cpus[getcpuid()];
+
+    self->stats.ipi_received++;
+    tlb_drain(self);
+}
+
+int x86_64_tlb_getstats(int cpuid, tlb_stats_t *stats) {
+    if (cpuid < 0 || cpuid >= NCPU || stats == NULL)
+        return -EINVAL;
+
+    *stats = tlb_cpus[cpuid].stats;
+    return 0;
+}
@@ -172,29 +172,47 @@ int bitmap_test(bitmap_t *bitmap, usize pos, usize nbits) {
 
 // Allocate a contiguous range of nbits in the bitmap
 int bitmap_alloc_range(bitmap_t *bitmap, usize nbits, usize *pos) {
+    return bitmap_alloc_range_aligned(bitmap, nbits, 1, 0, pos);
+}
+
+/**
+ * Allocate a contiguous range of nbits whose first bit, counted
+ * from 'base' rather than 0, is a multiple of 'align'. A bitmap of
+ * frames passes the frame number of its bit 0 to get blocks that
+ * are aligned physically.
+ */
+int bitmap_alloc_range_aligned(bitmap_t *bitmap, usize nbits, usize align, usize base, usize *pos) {
     bitmap_lock(bitmap);
 
-    if (nbits == 0 || (nbits > bitmap->bm_size) || !pos) {
+    if (nbits == 0 || (nbits > bitmap->bm_size) || !pos ||
+        align == 0 || (align & (align - 1))) {
         bitmap_unlock(bitmap);
         return -EINVAL; // Invalid input
     }
 
     // Iterate through the bitmap to find a free range of nbits
-    for (usize i = 0; i <= bitmap->bm_size - nbits; ++i) {
-        int range_free = 1;
+    for (usize i = ALIGN_UP(base, align) - base; i <= bitmap->bm_size - nbits; ) {
+        usize busy = nbits;
 
         // Check if the range starting at `i` is free
         for (usize j = 0; j < nbits; ++j) {
             usize index = (i + j) / BITS_PER_USIZE;
             usize bit = (i + j) % BITS_PER_USIZE;
+
+            // skip fully allocated words in one step.
+            if (bit == 0 && (nbits - j) >= BITS_PER_USIZE && bitmap->bm_map[index] == ~0UL) {
+                busy = j + BITS_PER_USIZE - 1;
+                break;
+            }
+
             if (bitmap->bm_map[index] & (1UL << bit)) {
-                range_free = 0;
+                busy = j;
                 break;
             }
         }
 
         // If the range is free, allocate it
-        if (range_free) {
+        if (busy == nbits) {
             for (usize j = 0; j < nbits; ++j) {
                 usize index = (i + j) / BITS_PER_USIZE;
                 usize bit = (i + j) % BITS_PER_USIZE;
@@ -204,6 +222,9 @@ int bitmap_alloc_range(bitmap_t *bitmap, usize nbits, usize *pos) {
             bitmap_unlock(bitmap);
             return 0; // Success
         }
+
+        // Resume at the next aligned position past the busy bit.
+        i = ALIGN_UP(base + i + busy + 1, align) - base;
     }
 
     bitmap_unlock(bitmap);
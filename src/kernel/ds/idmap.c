@@ -0,0 +1,121 @@
+#include <bits/errno.h>
+#include <ds/idmap.h>
+#include <sync/preempt.h>
+
+#define idmap_word(id)  ((id) / BITS_PER_USIZE)
+#define idmap_bit(id)   (1ul << ((id) % BITS_PER_USIZE))
+
+/**
+ * Take up to 'n' free IDs from the bitmap into 'ids', searching from
+ * the cursor and rolling over at the end. Called with the map locked,
+ * returns how many it took.
+ */
+static usize idmap_take(idmap_t *map, int *ids, usize n) {
+    usize   got     = 0;
+    usize   id      = map->im_cursor;
+    usize   span    = map->im_max - map->im_min;
+
+    for (usize scanned = 0; got < n && scanned < span; ++scanned) {
+        // a full word needs no look at its bits.
+        if ((id % BITS_PER_USIZE) == 0 && id + BITS_PER_USIZE <= map->im_max &&
+            scanned + BITS_PER_USIZE <= span && map->im_map[idmap_word(id)] == ~0ul) {
+            id      += BITS_PER_USIZE - 1;
+            scanned += BITS_PER_USIZE - 1;
+        } else if ((map->im_map[idmap_word(id)] & idmap_bit(id)) == 0) {
+            map->im_map[idmap_word(id)] |= idmap_bit(id);
+            ids[got++] = (int)id;
+        }
+
+        if (++id >= map->im_max)
+            id = map->im_min;
+    }
+
+    map->im_cursor = id;
+    return got;
+}
+
+// Clear the bits of the 'n' IDs in 'ids', called with the map locked.
+static void idmap_put(idmap_t *map, const int *ids, usize n) {
+    for (usize i = 0; i < n; ++i)
+        map->im_map[idmap_word((usize)ids[i])] &= ~idmap_bit((usize)ids[i]);
+}
+
+// Lock and return the calling CPU's cache of 'map'.
+static idmap_cache_t *idmap_cache_lock(idmap_t *map) {
+    idmap_cache_t *cache = NULL;
+
+    pushcli();
+    cache = &map->im_cache[getcpuid()];
+    spin_lock(&cache->lock);
+    popcli();
+
+    return cache;
+}
+
+/*Put every ID the CPUs are holding on to back in the bitmap.*/
+static void idmap_drain(idmap_t *map) {
+    for (idmap_cache_t *cache = map->im_cache; cache < &map->im_cache[NCPU]; ++cache) {
+        spin_lock(&cache->lock);
+        spin_lock(&map->im_lock);
+
+        idmap_put(map, cache->free, cache->nfree);
+        idmap_put(map, &cache->alloc[cache->next], cache->nalloc - cache->next);
+
+        spin_unlock(&map->im_lock);
+        cache->nfree = cache->nalloc = cache->next = 0;
+        spin_unlock(&cache->lock);
+    }
+}
+
+int idmap_alloc(idmap_t *map, int *pid) {
+    usize           got     = 0;
+    idmap_cache_t   *cache  = NULL;
+
+    if (map == NULL || pid == NULL)
+        return -EINVAL;
+
+    cache = idmap_cache_lock(map);
+
+    if (cache->next == cache->nalloc) {
+        spin_lock(&map->im_lock);
+        cache->nalloc = idmap_take(map, cache->alloc, IDMAP_BATCH);
+        spin_unlock(&map->im_lock);
+        cache->next = 0;
+    }
+
+    if (cache->next < cache->nalloc) {
+        *pid = cache->alloc[cache->next++];
+        spin_unlock(&cache->lock);
+        return 0;
+    }
+
+    spin_unlock(&cache->lock);
+
+    // the bitmap is full, but the CPUs may be sitting on some.
+    idmap_drain(map);
+
+    spin_lock(&map->im_lock);
+    got = idmap_take(map, pid, 1);
+    spin_unlock(&map->im_lock);
+
+    return got ? 0 : -EAGAIN;
+}
+
+void idmap_free(idmap_t *map, int id) {
+    idmap_cache_t *cache = NULL;
+
+    if (map == NULL || id < 0 || (usize)id < map->im_min || (usize)id >= map->im_max)
+        return;
+
+    cache = idmap_cache_lock(map);
+
+    if (cache->nfree == IDMAP_BATCH) {
+        spin_lock(&map->im_lock);
+        idmap_put(map, cache->free, cache->nfree);
+        spin_unlock(&map->im_lock);
+        cache->nfree = 0;
+    }
+
+    cache->free[cache->nfree++] = id;
+    spin_unlock(&cache->lock);
+}
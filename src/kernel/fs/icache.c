@@ -6,6 +6,33 @@
 #include <mm/page.h>
 #include <string.h>
 
+/*Insert a fresh page under 'pgno', the cache keeps the caller's reference.*/
+static int icache_addpage(icache_t *icache, off_t pgno, page_t *page) {
+    int err = 0;
+
+    icache_btree_lock(icache);
+    err = btree_insert(icache_btree(icache), pgno, page);
+    icache_btree_unlock(icache);
+
+    if (err) {
+        return err;
+    }
+
+    page->icache = icache;
+    page->index  = pgno;
+    icache->pc_nrpages++;
+    page_lru_add(page);
+    return 0;
+}
+
+/*Undo icache_addpage() once the page is out of the btree.*/
+static void icache_droppage(icache_t *icache, page_t *page) {
+    page_lru_del(page);
+    page->icache = NULL;
+    icache->pc_nrpages--;
+    page_put(page);
+}
+
 int icache_alloc(icache_t **ppcp) {
     icache_t *icache = NULL;
 
@@ -42,7 +69,13 @@ void icache_free(icache_t *icache) {
     --icache->pc_refcnt;
 
     if (icache->pc_refcnt <= 0) {
+        page_t *page = NULL;
+
         icache_btree_lock(icache);
+        while ((page = btree_least(icache_btree(icache)))) {
+            btree_delete(icache_btree(icache), page->index);
+            icache_droppage(icache, page);
+        }
         btree_flush(icache_btree(icache));
         icache_btree_unlock(icache);
 
@@ -59,12 +92,137 @@ void icache_free(icache_t *icache) {
     }
 }
 
+int icache_lookup(icache_t *icache, off_t pgno, page_t **ref) {
+    int     err     = 0;
+    page_t  *page   = NULL;
+
+    if (ref == NULL || icache == NULL) {
+        return -EINVAL;
+    }
+
+    icache_assert_locked(icache);
+
+    icache_btree_lock(icache);
+    err = btree_search(icache_btree(icache), pgno, (void **)&page);
+    icache_btree_unlock(icache);
+
+    if (err || page == NULL || !page_isvalid(page)) {
+        return -ENOENT;
+    }
+
+    page_mark_accessed(page);
+    *ref = page;
+    return 0;
+}
+
+int icache_writeback(icache_t *icache, page_t *page) {
+    ssize_t err     = 0;
+    off_t   off     = 0;
+    size_t  size    = 0;
+    uintptr_t paddr = 0;
+    void    *vaddr  = NULL;
+    inode_t *ip     = icache->pc_inode;
+
+    icache_assert_locked(icache);
+
+    if (!page_testflags(page, PG_D)) {
+        return 0;
+    }
+
+    off  = page->index * PGSZ;
+    size = igetsize(ip);
+    size = off >= size ? 0 : (size - off < PGSZ ? size - off : PGSZ);
+
+    if (size && (err = page_get_address(page, (void **)&paddr)) == 0 &&
+        (err = arch_mount(paddr, &vaddr)) == 0) {
+        err = iwrite_data(ip, off, vaddr, size);
+        arch_unmount((uintptr_t)vaddr);
+    }
+
+    if (err < 0) {
+        return err;
+    }
+
+    page_maskdirty(page);
+    return 0;
+}
+
+int icache_evict(icache_t *icache, page_t *page) {
+    int     err     = 0;
+    inode_t *ip     = icache->pc_inode;
+
+    icache_assert_locked(icache);
+
+    // anything beyond the cache's own reference maps the page.
+    if (atomic_read(&page->refcnt) > 1) {
+        return -EBUSY;
+    }
+
+    if (page_testflags(page, PG_D)) {
+        if (ip == NULL || !itrylock(ip)) {
+            return -EBUSY;
+        }
+
+        err = icache_writeback(icache, page);
+        iunlock(ip);
+
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    icache_btree_lock(icache);
+    btree_delete(icache_btree(icache), page->index);
+    icache_btree_unlock(icache);
+
+    icache_droppage(icache, page);
+    return 0;
+}
+
+int icache_migrate(icache_t *icache, page_t *page, page_t *newpage) {
+    int             err     = 0;
+    btree_node_t    *node   = NULL;
+
+    icache_assert_locked(icache);
+
+    // anything beyond the cache's own reference maps the page.
+    if (page->icache != icache || atomic_read(&page->refcnt) > 1) {
+        return -EBUSY;
+    }
+
+    if ((err = arch_memcpypp(page_to_phys(newpage), page_to_phys(page), PGSZ))) {
+        return err;
+    }
+
+    // swap the slot's data in place, a delete and insert could allocate.
+    icache_btree_lock(icache);
+    if ((node = btree_lookup(icache_btree(icache), page->index)) && node->data == page) {
+        node->data = newpage;
+    }
+    icache_btree_unlock(icache);
+
+    if (node == NULL || node->data != newpage) {
+        return -ENOENT;
+    }
+
+    page_lru_del(page);
+    page_setflags(newpage, page->flags & ~(PG_LINKS_MASK | PG_RESERVED |
+        PG_LRU | PG_ACTIVE | PG_REFERENCED | PG_MOVABLE));
+    newpage->icache = icache;
+    newpage->index  = page->index;
+    page_lru_add(newpage);
+
+    page->icache = NULL;
+    page_put(page);
+    return 0;
+}
+
 int icache_getpage(icache_t *icache, off_t pgno, page_t **ref) {
     int     err         = 0;
     ssize_t size        = 0;
     int     new_page    = 0;
     uintptr_t paddr     = 0;
-    char    buffer[PGSZ]= {0};
+    void    *vaddr      = NULL;
     page_t *page        = NULL;
 
     if (ref == NULL || icache == NULL) {
@@ -80,6 +238,7 @@ int icache_getpage(icache_t *icache, off_t pgno, page_t **ref) {
             goto update;
         }
 
+        page_mark_accessed(page);
         goto done;
     }
     icache_btree_unlock(icache);
@@ -92,28 +251,27 @@ int icache_getpage(icache_t *icache, off_t pgno, page_t **ref) {
     new_page = 1;
 
 update:
-    if ((err = (size = iread_data(icache->pc_inode, pgno * PGSZ, buffer, PGSZ))) < 0) {
+    if ((err = page_get_address(page, (void **)&paddr))) {
         goto error;
     }
-    
-    if ((err = page_get_address(page, (void **)&paddr))) {
+
+    // read straight into the cache page, no bounce buffer.
+    if ((err = arch_mount(paddr, &vaddr))) {
         goto error;
     }
 
-    if ((err = arch_memcpyvp(paddr, (uintptr_t)buffer, size))) {
+    size = iread_data(icache->pc_inode, pgno * PGSZ, vaddr, PGSZ);
+    arch_unmount((uintptr_t)vaddr);
+
+    if ((err = size) < 0) {
         goto error;
     }
     
     page_setvalid(page);
     page_maskdirty(page);
 
-    if (new_page) {
-        icache_btree_lock(icache);
-        if ((err = btree_insert(icache_btree(icache), pgno, page))) {
-            icache_btree_unlock(icache);
-            goto error;
-        }
-        icache_btree_unlock(icache);
+    if (new_page && (err = icache_addpage(icache, pgno, page))) {
+        goto error;
     }
 done:
     *ref = page;
@@ -202,12 +360,9 @@ ssize_t icache_write(icache_t *icache, off_t off, const void *buffer, size_t sz)
         }
 
         if (new_page) {
-            icache_btree_lock(icache);
-            if ((err = btree_insert(icache_btree(icache), pgno, page))) {
-                icache_btree_unlock(icache);
+            if ((err = icache_addpage(icache, pgno, page))) {
                 goto error;
             }
-            icache_btree_unlock(icache);
             page_setvalid(page);
             iupdate_size(icache->pc_inode, offset + size);
             new_page = 0;
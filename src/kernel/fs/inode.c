@@ -8,11 +8,30 @@
 #include <fs/stat.h>
 #include <mm/kalloc.h>
 #include <string.h>
+#include <sync/atomic.h>
+#include <sys/exec_cache.h>
+
+// never reused, so (inode, i_gen) names one version of one file
+// even once the inode is freed and its memory handed out again.
+static atomic_t inode_gen = 0;
+
+/*Called with 'ip' locked whenever its data changes.*/
+static void imodified(inode_t *ip) {
+    ip->i_gen = atomic_inc_fetch(&inode_gen);
+
+    if (ip->i_flags & INO_EXEC) {
+        exec_cache_invalidate(ip);
+    }
+}
 
 void ifree(inode_t *ip) {
     iassert_locked(ip);
 
     if (ip->i_refcnt <= 0) {
+        if (ip->i_flags & INO_EXEC) {
+            exec_cache_invalidate(ip);
+        }
+
         iunlink(ip);
         icache_free(ip->i_cache);
         iunlock(ip);
@@ -36,6 +55,7 @@ static int inew(inode_t **pip) {
     }
 
     ip->i_refcnt = 1;
+    ip->i_gen = atomic_inc_fetch(&inode_gen);
     ip->i_lock = SPINLOCK_INIT();
     ip->i_datalock = SPINLOCK_INIT();
     ilock(ip);
@@ -508,8 +528,12 @@ int itruncate(inode_t *ip) {
     if ((err = icheck_op(ip, itruncate))) {
         return err;
     }
-    
-    return ip->i_ops->itruncate(ip);
+
+    if ((err = ip->i_ops->itruncate(ip)) == 0) {
+        imodified(ip);
+    }
+
+    return err;
 }
 
 /* check for file permission */
@@ -615,12 +639,17 @@ ssize_t iwrite(inode_t *ip, off_t off, const void *buf, size_t sz) {
 
     iassert_locked(ip);
     if (ip->i_cache == NULL) {
-        return iwrite_data(ip, off, buf, sz);
+        retval = iwrite_data(ip, off, buf, sz);
+    } else {
+        icache_lock(ip->i_cache);
+        retval = icache_write(ip->i_cache, off, buf, sz);
+        icache_unlock(ip->i_cache);
+    }
+
+    if (retval > 0) {
+        imodified(ip);
     }
 
-    icache_lock(ip->i_cache);    
-    retval = icache_write(ip->i_cache, off, buf, sz);
-    icache_unlock(ip->i_cache);
     return retval;
 }
 
@@ -4,10 +4,29 @@
 #include <fs/tmpfs.h>
 #include <lib/printk.h>
 #include <mm/kalloc.h>
+#include <mm/vmstat.h>
 #include <string.h>
 
 static fs_t *procfs = NULL;
 
+/**
+ * The files under /proc, their text made afresh on every read.
+ * They are found by name, their i-number is their index plus 2.
+ */
+typedef struct procfs_file {
+    const char  *name;
+    usize       (*show)(char *buf, usize size);
+} procfs_file_t;
+
+static procfs_file_t procfs_files[] = {
+    {"meminfo",     vmstat_meminfo},
+    {"buddyinfo",   vmstat_buddyinfo},
+    {"vmstat",      vmstat_show},
+};
+
+// room for the text of any one file.
+#define PROCFS_BUFSZ    (PGSZ * 2)
+
 static iops_t procfs_iops = {
     .iopen      = procfs_iopen,
     .isync      = procfs_isync,
@@ -134,8 +153,33 @@ int procfs_iioctl(inode_t *ip __unused, int req __unused, void *argp __unused) {
     return -ENOSYS;
 }
 
-ssize_t procfs_iread_data(inode_t *ip __unused, off_t off __unused, void *buf __unused, size_t nb __unused) {
-    return -ENOSYS;
+ssize_t procfs_iread_data(inode_t *ip, off_t off, void *buf, size_t nb) {
+    usize           len     = 0;
+    char            *text   = NULL;
+    procfs_file_t   *file   = NULL;
+
+    if (ip == NULL || buf == NULL) {
+        return -EINVAL;
+    }
+
+    if ((file = ip->i_priv) == NULL) {
+        return -EISDIR;
+    }
+
+    if ((text = kmalloc(PROCFS_BUFSZ)) == NULL) {
+        return -ENOMEM;
+    }
+
+    len = file->show(text, PROCFS_BUFSZ);
+    if ((usize)off >= len) {
+        kfree(text);
+        return 0;
+    }
+
+    nb = MIN(len - off, nb);
+    memcpy(buf, text + off, nb);
+    kfree(text);
+    return nb;
 }
 
 ssize_t procfs_iwrite_data(inode_t *ip __unused, off_t off __unused, const void *buf __unused, size_t nb __unused) {
@@ -154,8 +198,36 @@ int procfs_ibind(inode_t *dir __unused, struct dentry *dentry __unused, inode_t
     return -ENOSYS;
 }
 
-int procfs_ilookup(inode_t *dir __unused, const char *fname __unused, inode_t **pipp __unused) {
-    return -ENOSYS;
+int procfs_ilookup(inode_t *dir, const char *fname, inode_t **pipp) {
+    int     err = 0;
+    inode_t *ip = NULL;
+
+    if (dir == NULL || fname == NULL || pipp == NULL) {
+        return -EINVAL;
+    }
+
+    for (usize i = 0; i < NELEM(procfs_files); ++i) {
+        if (strcmp(procfs_files[i].name, fname)) {
+            continue;
+        }
+
+        // no page cache, every read has to see the current numbers.
+        if ((err = ialloc(FS_RGL, I_NOCACHE | I_NORWQUEUES, &ip))) {
+            return err;
+        }
+
+        ip->i_ops   = dir->i_ops;
+        ip->i_sb    = dir->i_sb;
+        ip->i_priv  = &procfs_files[i];
+        ip->i_ino   = i + 2;
+        ip->i_mode  = 0444;
+        ip->i_hlinks= 1;
+
+        *pipp = ip;
+        return 0;
+    }
+
+    return -ENOENT;
 }
 
 int procfs_isymlink(inode_t *ip __unused, inode_t *atdir __unused, const char *symname __unused) {
@@ -166,8 +238,26 @@ int procfs_imknod(inode_t *dir __unused, const char *name __unused, mode_t mode
     return -ENOSYS;
 }
 
-ssize_t procfs_ireaddir(inode_t *dir __unused, off_t off __unused, struct dirent *buf __unused, size_t count __unused) {
-    return -ENOSYS;
+ssize_t procfs_ireaddir(inode_t *dir __unused, off_t off, struct dirent *buf, size_t count) {
+    size_t ncount = 0;
+
+    if (buf == NULL || count == 0) {
+        return -EINVAL;
+    }
+
+    for (usize i = off; i < NELEM(procfs_files) && ncount < count; ++i, ++ncount) {
+        buf[ncount] = (struct dirent) {
+            .d_off      = i,
+            .d_ino      = i + 2,
+            .d_size     = 0,
+            .d_reclen   = sizeof (struct dirent),
+            .d_type     = DT_REG,
+        };
+
+        safestrncpy(buf[ncount].d_name, procfs_files[i].name, sizeof buf[ncount].d_name - 1);
+    }
+
+    return ncount;
 }
 
 int procfs_ilink(const char *oldname __unused, inode_t *dir __unused, const char *newname __unused) {
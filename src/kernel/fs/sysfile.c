@@ -266,6 +266,128 @@ error:
     return err;
 }
 
+/*Put 'file' at 'fd' in the locked 'fctx', closing what was there.*/
+static int fctx_install(file_ctx_t *fctx, int fd, file_t *file) {
+    int     err     = 0;
+    file_t  **tmp   = NULL;
+
+    fctx_assert_locked(fctx);
+
+    if (fd < 0) {
+        return -EBADFD;
+    }
+
+    if (fd >= fctx->fc_nfile) {
+        if ((tmp = krealloc(fctx->fc_files, ((fd + 1) * sizeof (file_t *)))) == NULL) {
+            return -ENOMEM;
+        }
+        memset(&tmp[fctx->fc_nfile], 0, ((fd + 1) - fctx->fc_nfile) * sizeof (file_t *));
+        fctx->fc_files = tmp;
+        fctx->fc_nfile = fd + 1;
+    }
+
+    if (fctx->fc_files[fd]) {
+        flock(fctx->fc_files[fd]);
+        if ((err = fclose(fctx->fc_files[fd]))) {
+            funlock(fctx->fc_files[fd]);
+            return err;
+        }
+    }
+
+    fctx->fc_files[fd] = file;
+    return 0;
+}
+
+int fctx_dup2(file_ctx_t *fctx, int fd1, int fd2) {
+    int     err     = 0;
+    file_t  *file   = NULL;
+
+    fctx_lock(fctx);
+
+    if ((fctx->fc_files == NULL) || (fd1 < 0) || (fd1 >= fctx->fc_nfile) ||
+        ((file = fctx->fc_files[fd1]) == NULL)) {
+        fctx_unlock(fctx);
+        return -EBADFD;
+    }
+
+    if (fd1 == fd2) {
+        fctx_unlock(fctx);
+        return fd2;
+    }
+
+    flock(file);
+    fdup(file);
+    funlock(file);
+
+    if ((err = fctx_install(fctx, fd2, file))) {
+        flock(file);
+        fput(file);
+        funlock(file);
+    }
+
+    fctx_unlock(fctx);
+    return err ? err : fd2;
+}
+
+int fctx_close(file_ctx_t *fctx, int fd) {
+    int     err     = 0;
+    file_t  *file   = NULL;
+
+    fctx_lock(fctx);
+
+    if ((fctx->fc_files == NULL) || (fd < 0) || (fd >= fctx->fc_nfile) ||
+        ((file = fctx->fc_files[fd]) == NULL)) {
+        fctx_unlock(fctx);
+        return -EBADFD;
+    }
+
+    flock(file);
+    if ((err = fclose(file))) {
+        funlock(file);
+    } else {
+        fctx->fc_files[fd] = NULL;
+    }
+
+    fctx_unlock(fctx);
+    return err;
+}
+
+int fctx_open(file_ctx_t *fctx, int fd, const char *pathname, int oflags, mode_t mode) {
+    int         err     = 0;
+    file_t      *file   = NULL;
+    dentry_t    *dentry = NULL;
+
+    if (pathname == NULL) {
+        return -EINVAL;
+    }
+
+    if ((err = vfs_openat(NULL, pathname, oflags, mode, &dentry))) {
+        return err;
+    }
+
+    if ((err = falloc(&file))) {
+        dclose(dentry);
+        return err;
+    }
+
+    file->fops      = NULL;
+    file->f_dentry  = dentry;
+    file->f_oflags  = oflags;
+
+    dunlock(dentry);
+
+    fctx_lock(fctx);
+    if ((err = fctx_install(fctx, fd, file))) {
+        fctx_unlock(fctx);
+        fclose(file);
+        return err;
+    }
+    fctx_unlock(fctx);
+
+    funlock(file);
+    return fd;
+}
+
 int dup(int fd) {
     return file_dup(fd, -1);
 }
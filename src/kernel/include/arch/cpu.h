@@ -71,6 +71,13 @@ extern void cpu_swap_intena(bool *intena);
 
 #define current (cpu_getthread())
 
+/**
+ * Spin-wait hint. Also takes the TLB shootdowns other CPUs queued for
+ * us, the caller may spin with interrupts off while the CPU it waits
+ * on waits for us to acknowledge one.
+ */
+extern void cpu_relax(void);
+
 extern usize cpu_getticks(void);
 extern void  cpu_upticks(void);
 
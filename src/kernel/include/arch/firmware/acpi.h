@@ -106,6 +106,65 @@ typedef struct {
     uint32_t    X_GPE1_BLK[3];
 } __packed acpiFADT_t;
 
+/*System Resource Affinity Table*/
+typedef struct {
+    acpiSDT_t   hdr;
+    uint32_t    rsvd0;          // must be 1.
+    uint64_t    rsvd1;
+    uint8_t     entries[];
+} __packed acpiSRAT_t;
+
+/*SRAT: processor local APIC affinity.*/
+typedef struct {
+    uint8_t     type;
+    uint8_t     len;
+    uint8_t     pxm_lo;         // bits[7:0] of the proximity domain.
+    uint8_t     apic_id;
+    uint32_t    flags;
+    uint8_t     sapic_eid;
+    uint8_t     pxm_hi[3];      // bits[31:8] of the proximity domain.
+    uint32_t    clock_domain;
+} __packed acpiSRAT_lapic_t;
+
+/*SRAT: memory affinity.*/
+typedef struct {
+    uint8_t     type;
+    uint8_t     len;
+    uint32_t    pxm;
+    uint16_t    rsvd0;
+    uint64_t    base;
+    uint64_t    length;
+    uint32_t    rsvd1;
+    uint32_t    flags;
+    uint64_t    rsvd2;
+} __packed acpiSRAT_mem_t;
+
+/*SRAT: processor local x2APIC affinity.*/
+typedef struct {
+    uint8_t     type;
+    uint8_t     len;
+    uint16_t    rsvd0;
+    uint32_t    pxm;
+    uint32_t    x2apic_id;
+    uint32_t    flags;
+    uint32_t    clock_domain;
+    uint32_t    rsvd1;
+} __packed acpiSRAT_x2apic_t;
+
+/*System Locality Information Table*/
+typedef struct {
+    acpiSDT_t   hdr;
+    uint64_t    nlocality;
+    uint8_t     entries[];      // nlocality x nlocality relative distances.
+} __packed acpiSLIT_t;
+
+#define ACPI_SRAT_LAPIC         0
+#define ACPI_SRAT_MEM           1
+#define ACPI_SRAT_X2APIC        2
+
+#define ACPI_SRAT_ENABLED       1   // entry is in use.
+#define ACPI_SRAT_HOTPLUG       2   // memory may be hot-plugged.
+
 #define ACPI_MADT_LAPIC     0
 
 #define ACPI_LAPIC_ENABLED  1
@@ -123,4 +182,7 @@ extern acpiSDT_t *acpi_enumerate(const char *signature);
 
 extern bool acpi_disable_8259A(void);
 
+/// Describe the NUMA nodes in the SRAT and SLIT to mm/numa.c.
+extern int acpi_numa_init(void);
+
 extern int acpi_init(void);
\ No newline at end of file
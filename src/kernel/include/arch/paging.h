@@ -2,6 +2,7 @@
 
 #include <arch/ucontext.h>
 #include <arch/x86_64/paging.h>
+#include <arch/x86_64/tlb.h>
 #include <core/types.h>
 
 typedef struct pagefault_desc {
@@ -34,6 +35,13 @@ extern void dump_tf(mcontext_t *tf, int halt);
  */
 int default_pgf_handler(vmr_t *vmr, pagefault_desc_t *fault);
 
+/**
+ * @brief Fault in every page of [start, end] in 'vmr' ahead of time, as
+ * a write would for private writable regions so that no COW is left.
+ * 'vmr' must belong to the current, locked, address space.
+ */
+int vmr_populate(vmr_t *vmr, uintptr_t start, uintptr_t end);
+
 /**
  * @brief unmap the entire address space of current;y active PDBR.
  * page directory base register (PDBR) is a physical address placed
@@ -84,6 +92,21 @@ extern void arch_fullvm_unmap(uintptr_t pgdir);
  */
 extern int arch_mount(uintptr_t paddr, void **pvp);
 
+/**
+ * @brief map physical memory into the permanent direct map (physmap),
+ * so that it can be reached at PHYS2VIRT(paddr) without arch_mount().
+ *
+ * @param paddr start of the physical range.
+ * @param size size of the physical range in bytes.
+ * @return int 0 on success and non-zero otherwise.
+ */
+extern int arch_physmap_range(uintptr_t paddr, usize size);
+
+/**
+ * @brief is [paddr, paddr + size) reachable through the direct map?
+ */
+extern bool arch_physmap_covers(uintptr_t paddr, usize size);
+
 /**
  * @brief 
  * 
@@ -92,12 +115,15 @@ extern int arch_mount(uintptr_t paddr, void **pvp);
 extern void arch_do_page_fault(mcontext_t *trapframe);
 
 /**
- * @brief 
+ * @brief Unmap [vaddr, vaddr + sz), freeing the frames the mappings allocated.
  * 
  * @param vaddr 
  * @param sz 
+ * @return 0, or -ENOMEM if a large page or a shared page table only
+ * partly covered by the range could not be split off. What came before
+ * it is unmapped already.
  */
-extern void arch_unmap_n(uintptr_t vaddr, usize sz);
+extern int arch_unmap_n(uintptr_t vaddr, usize sz);
 
 /**
  * @brief
@@ -110,6 +136,20 @@ int arch_mprotect(uintptr_t vaddr, usize sz, int flags);
 */
 extern int arch_lazycpy(uintptr_t dst, uintptr_t src);
 
+/**
+ * @brief Take a private copy of the page table covering 'vaddr'
+ * if the current address space shares it with others since fork().
+ * 
+ * @return int 0 on success and non-zero otherwise.
+ */
+extern int arch_unshare_pt(uintptr_t vaddr);
+
+/**
+ * @brief Let go of the page tables the current address space shares
+ * with others, without copying them. For an address space going away.
+ */
+extern void arch_drop_shared(void);
+
 /**
  * @brief 
  * 
@@ -130,7 +170,7 @@ extern int arch_pagealloc(usize sz, uintptr_t *addr);
 /**
  * 
 */
-extern void arch_unmap(int i4, int i3, int i2, int i1);
+extern int arch_unmap(int i4, int i3, int i2, int i1);
 
 /**
  * @brief 
@@ -198,6 +238,23 @@ extern int arch_memcpypv(uintptr_t vaddr, uintptr_t paddr, usize size);
  */
 extern int arch_map_i(uintptr_t vaddr, uintptr_t paddr, usize sz, int flags);
 
+/**
+ * @brief Back the 2MiB aligned 'vaddr' with a single large page.
+ * 
+ * @param vaddr 2MiB aligned virtual address.
+ * @param flags 
+ * @return int 0 on success, -EEXIST if smaller pages are already mapped there.
+ */
+extern int arch_map_hugepage(uintptr_t vaddr, int flags);
+
+/**
+ * @brief Split the large page mapping 'vaddr', if any, down to 4KiB pages.
+ * 
+ * @param vaddr 
+ * @return int 
+ */
+extern int arch_split_page(uintptr_t vaddr);
+
 /**
  * @brief 
  * 
@@ -221,4 +278,84 @@ extern int arch_memcpypp(uintptr_t pdst, uintptr_t psrc, usize size);
  */
 extern int arch_map(uintptr_t frame, int i4, int i3, int i2, int i1, int flags);
 
-extern void arch_tlbshootdown(uintptr_t pdbr, uintptr_t vaddr);
\ No newline at end of file
+/**
+ * @brief Get the swap slot 'vaddr' was swapped out to.
+ * 
+ * @return int 0 on success, -ENOENT if 'vaddr' is not swapped out.
+ */
+extern int arch_getswap(uintptr_t vaddr, ulong *pslot);
+
+/**
+ * @brief Swap out up to 'nr' cold private pages of
+ * [vaddr, vaddr + sz) in the current address space.
+ * 
+ * @return usize the number of pages swapped out.
+ */
+extern usize arch_swapout_range(uintptr_t vaddr, usize sz, usize nr, bool lazyfree);
+
+/**
+ * @brief Move the private pages of [vaddr, vaddr + sz) in the current
+ * address space that sit in physical [lo, hi) to frames from 'alloc'.
+ * 
+ * @return usize the number of pages moved.
+ */
+extern usize arch_migrate_range(uintptr_t vaddr, usize sz, uintptr_t lo, uintptr_t hi,
+    int (*alloc)(void *arg, uintptr_t *ppa), void *arg);
+
+/**
+ * @brief Mark the private pages of [vaddr, vaddr + sz) clean,
+ * for swap-out to drop instead of compress while they stay so.
+ * 
+ * @return int 0 on success.
+ */
+extern int arch_lazyfree_range(uintptr_t vaddr, usize sz);
+
+/**
+ * @brief Clear the dirty bit of the page mapped at 'vaddr'.
+ * 
+ * @return bool whether the page was dirty.
+ */
+extern bool arch_test_and_clear_dirty(uintptr_t vaddr);
+
+/**
+ * @brief Pin (or unpin) the frames mapped in [vaddr, vaddr + sz).
+ */
+extern int arch_pin_range(uintptr_t vaddr, usize sz, bool pin);
+
+/**
+ * @brief Move the mappings of [src, src + sz) to 'dst' without copying.
+ */
+extern int arch_move_range(uintptr_t src, uintptr_t dst, usize sz);
+
+extern void arch_tlbshootdown(uintptr_t pdbr, uintptr_t vaddr);
+
+/**
+ * @brief Invalidate [vaddr, vaddr + size) in 'pdbr' on every CPU running it.
+ */
+extern void arch_tlbshootdown_range(uintptr_t pdbr, uintptr_t vaddr, usize size);
+
+/**
+ * @brief Defer the shootdown IPIs issued until arch_tlbbatch_end()
+ * and send them merged into one request per CPU. The end waits for
+ * every CPU to acknowledge them, and only then frees the frames the
+ * batch unmapped. Interrupts stay as they are.
+ */
+extern void arch_tlbbatch_begin(void);
+extern void arch_tlbbatch_end(void);
+
+/**
+ * @brief Send what the current batch deferred so far and wait for every
+ * CPU to acknowledge it, even inside an enclosing batch whose end would
+ * otherwise be the one to do it.
+ */
+extern void arch_tlbbatch_flush(void);
+
+/**
+ * @brief Handle a TLB shootdown IPI sent by another CPU.
+ */
+extern void arch_tlbshootdown_handler(void);
+
+/**
+ * @brief Copy out the TLB counters of CPU 'cpuid'.
+ */
+extern int arch_tlbgetstats(int cpuid, tlb_stats_t *stats);
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <arch/ucontext.h>
 #include <arch/x86_64/thread.h>
+#include <arch/x86_64/tlb.h>
 #include <sys/_signal.h>
 
 extern const ulong ARCH_NSIG_NESTED;   // Maximum allowed nested signals per-thread.
@@ -30,6 +31,7 @@ typedef struct arch_thread_t {
     uc_stack_t  t_kstack;       // kernel stack description.
     uc_stack_t  t_ustack;       // user stack description.
     uc_stack_t  t_altstack;     // if SA_ONSTACK is set for a signal handler, use this stack.
+    tlb_batch_t t_tlb;          // shootdowns, and frees, deferred by this thread.
 } arch_thread_t;
 
 /**
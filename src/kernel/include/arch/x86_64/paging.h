@@ -37,7 +37,17 @@
 #define _isremap(f)             ((f) & PTE_REMAP)
 #define _isalloc(f)             ((f) & PTE_ALLOC)
 
+/**
+ * A non-present PTE with PTE_SWP set is a swap entry,
+ * the frame bits then carry the zram slot holding the page.
+ */
+#define PTE_SWP                 BS(9)
+#define _isswap(f)              (!_isP(f) && ((f) & PTE_SWP))
+#define SWP2PTE(slot)           (((u64)(slot) << 12) | PTE_SWP)
+#define PTE2SWP(pte)            ((ulong)((pte)->raw >> 12))
+
 #define pte_isP(pte)        (_isP((pte)->raw))      // is present?
+#define pte_isswap(pte)     (_isswap((pte)->raw))   // is a swap entry?
 #define pte_isW(pte)        (_isW((pte)->raw))      // is writable?
 #define pte_isU(pte)        (_isU((pte)->raw))      // is a user page?
 #define pte_isPS(pte)       (_isPS((pte)->raw))     // is page size flags set?
@@ -112,6 +122,10 @@ typedef union viraddr {
 #define PTE2FLAGS(pte)          ((uint)((pte) ? PGOFF((pte)->raw) : 0))
 #define PTE2PHYS(pte)           ((uintptr_t)((pte) ? PGROUND((pte)->raw) : 0))
 
+// page-frame orders backing a 2MiB and a 1GiB page.
+#define PG2MORDER               9
+#define PG1GORDER               18
+
 /**
  * @brief
  *
@@ -133,12 +147,12 @@ int x86_64_map(uintptr_t frame, int i4, int i3, int i2, int i1, int flags);
 /**
  * 
 */
-void x86_64_unmap(int i4, int i3, int i2, int i1);
+int x86_64_unmap(int i4, int i3, int i2, int i1);
 
 /**
  * 
 */
-void x86_64_unmap_n(uintptr_t v, usize sz);
+int x86_64_unmap_n(uintptr_t v, usize sz);
 
 /**
  * 
@@ -150,6 +164,38 @@ int x86_64_map_i(uintptr_t v, uintptr_t p, usize sz, int flags);
 */
 int x86_64_map_n(uintptr_t v, usize sz, int flags);
 
+/**
+ * Map the 2MiB page at 'p' with a single PDTE.
+ * Returns -EEXIST if 4KiB mappings already live under it.
+*/
+int x86_64_map_2m(uintptr_t p, int i4, int i3, int i2, int flags);
+
+/**
+ * Map the 1GiB page at 'p' with a single PDPTE.
+ * Returns -ENOTSUP if the CPU has no 1GiB pages.
+*/
+int x86_64_map_1g(uintptr_t p, int i4, int i3, int flags);
+
+/**
+ * Allocate 2MiB of naturally aligned frames and map them at 'v'.
+*/
+int x86_64_map_hugepage(uintptr_t v, int flags);
+
+/**
+ * Break up any large page that maps 'v' so that 'v' gets its own 4KiB PTE.
+*/
+int x86_64_split_page(uintptr_t v);
+
+/**
+ * Map physical memory [pa, pa + size) into the permanent direct map.
+*/
+int x86_64_physmap_range(uintptr_t pa, usize size);
+
+/**
+ * Is [pa, pa + size) reachable through the direct map?
+*/
+bool x86_64_physmap_covers(uintptr_t pa, usize size);
+
 /**
  * 
 */
@@ -181,6 +227,17 @@ void x86_64_fullvm_unmap (uintptr_t pml4);
 */
 int x86_64_lazycpy(uintptr_t dst, uintptr_t src);
 
+/**
+ * Give the current address space its own copy of the page table
+ * it shares with others through fork(), if any, for 'v'.
+*/
+int x86_64_unshare_pt(uintptr_t v);
+
+/**
+ * Drop every page table the current address space shares with others.
+*/
+void x86_64_drop_shared(void);
+
 /**
  * 
 */
@@ -201,6 +258,56 @@ int x86_64_memcpypv(uintptr_t v, uintptr_t p, usize size);
 */
 int x86_64_getmapping(uintptr_t addr, pte_t **pte);
 
+/**
+ * Return in '*pslot' the swap slot recorded in the PTE of 'addr',
+ * -ENOENT if 'addr' is not swapped out.
+*/
+int x86_64_getswap(uintptr_t addr, ulong *pslot);
+
+/**
+ * Swap out up to 'nr' cold private pages in [v, v + sz) of the
+ * current address space, returns how many went out. A page is cold
+ * when its accessed bit stayed clear since the previous pass.
+ * With 'lazyfree' pages left clean since x86_64_lazyfree_range()
+ * are dropped rather than compressed.
+*/
+usize x86_64_swapout_range(uintptr_t v, usize sz, usize nr, bool lazyfree);
+
+/**
+ * Move the private pages in [v, v + sz) of the current address space
+ * whose frames sit in physical [lo, hi) to frames 'alloc' hands out,
+ * copying them and pointing their PTEs at the copies. Stops when
+ * 'alloc' fails.
+ * Returns how many pages were moved.
+*/
+usize x86_64_migrate_range(uintptr_t v, usize sz, uintptr_t lo, uintptr_t hi,
+    int (*alloc)(void *arg, uintptr_t *ppa), void *arg);
+
+/**
+ * Clear the dirty bit of the private pages in [v, v + sz), so that
+ * swap-out can tell which were written since. Returns 0.
+*/
+int x86_64_lazyfree_range(uintptr_t v, usize sz);
+
+/**
+ * Clear the dirty bit of the page mapped at 'v',
+ * returns whether it was set.
+*/
+bool x86_64_test_and_clear_dirty(uintptr_t v);
+
+/**
+ * Take or drop one pin on every 4KiB frame mapped in [v, v + sz),
+ * the zero page aside. A failed pin drops the pins it took.
+*/
+int x86_64_pin_range(uintptr_t v, usize sz, bool pin);
+
+/**
+ * Move the mappings of [src, src + sz) to [dst, dst + sz), in the
+ * current address space. Frames and swap entries are not copied,
+ * whole page tables move when both ends are 2MiB aligned.
+*/
+int x86_64_move_range(uintptr_t src, uintptr_t dst, usize sz);
+
 /**
  * 
 */
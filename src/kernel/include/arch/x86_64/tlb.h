@@ -0,0 +1,130 @@
+#pragma once
+
+#include <core/defs.h>
+#include <core/types.h>
+
+// above this many pages a whole-TLB flush is cheaper than invlpg.
+#define TLB_FLUSH_THRESHOLD     32
+
+/**
+ * PCIDs each CPU hands out to the address spaces it runs,
+ * PCID 0 is left to whatever was loaded at boot.
+ */
+#define TLB_NPCID               8
+
+// CR4.PCIDE and the CR3 bit that keeps the incoming PCID's entries.
+#define CR4_PCIDE               BS(17)
+#define CR3_NOFLUSH             (1ull << 63)
+
+/**
+ * A pending invalidation.
+ * Kernel ranges carry pdbr == 0 since every address space shares them.
+ */
+typedef struct tlb_range {
+    uintptr_t   pdbr;
+    uintptr_t   start;      // first page.
+    uintptr_t   end;        // one past the last page.
+    bool        flush_all;
+    bool        pending;
+} tlb_range_t;
+
+// frames a batch holds on to before it flushes early to free them.
+#define TLB_BATCH_NFREE         32
+
+/**
+ * Shootdowns deferred between x86_64_tlb_batch_begin() and _end(),
+ * and the frames they unmapped, which may only be freed once every
+ * CPU has dropped its translations. Each thread has its own, a batch
+ * runs with interrupts on and may sleep, or move to another CPU.
+ */
+typedef struct tlb_batch {
+    int         depth;
+    int         last_cpu;   // CPU the last shootdown was issued on.
+    bool        moved;      // some were issued on another CPU.
+    tlb_range_t range;
+    usize       nfree;
+    uintptr_t   free[TLB_BATCH_NFREE];  // frame | order.
+} tlb_batch_t;
+
+typedef struct tlb_stats {
+    usize   ipi_sent;       // T_TLBSHTDWN IPIs sent by this CPU.
+    usize   ipi_received;   // T_TLBSHTDWN IPIs handled by this CPU.
+    usize   invlpg;         // single-page invalidations done by this CPU.
+    usize   full_flushes;   // whole-TLB flushes done by this CPU.
+    usize   switch_noflush; // address-space switches that kept the TLB.
+    usize   switch_flush;   // address-space switches that flushed it.
+} tlb_stats_t;
+
+/**
+ * Enable PCIDs on this CPU if it has them.
+ * Must run while CR3 still carries PCID 0.
+*/
+extern void x86_64_tlb_init(void);
+
+/**
+ * Record that this CPU is about to run the address space
+ * rooted at 'pdbr' and return the value to load into CR3.
+ * Must be called with interrupts off, right before the switch.
+*/
+extern u64 x86_64_tlb_switch(uintptr_t pdbr);
+
+/**
+ * Drop every PCID bound to 'pdbr' on all CPUs,
+ * called before the root table is freed and possibly reused.
+*/
+extern void x86_64_tlb_forget(uintptr_t pdbr);
+
+/**
+ * Invalidate [addr, addr + size) in the address space 'pdbr' on this CPU
+ * and on every other CPU that has 'pdbr' loaded. Kernel addresses are
+ * invalidated everywhere. Returns once every CPU has acknowledged it,
+ * unless a batch defers it.
+*/
+extern void x86_64_tlb_shootdown_range(uintptr_t pdbr, uintptr_t addr, usize size);
+
+/**
+ * Invalidate a page as above, never deferred by a batch,
+ * for callers about to read or reuse the frame it mapped.
+*/
+extern void x86_64_tlb_shootdown_now(uintptr_t pdbr, uintptr_t addr);
+
+/**
+ * Flush every user translation of 'pdbr' wherever it is loaded.
+*/
+extern void x86_64_tlb_flush_pdbr(uintptr_t pdbr);
+
+/**
+ * Between these two calls shootdowns only invalidate locally,
+ * the IPIs are merged into a single range and sent by the last
+ * x86_64_tlb_batch_end(), which waits for them to be acknowledged.
+ * Batches nest, and leave interrupts alone.
+*/
+extern void x86_64_tlb_batch_begin(void);
+extern void x86_64_tlb_batch_end(void);
+
+/**
+ * Send what the current batch deferred, wait for every CPU
+ * to acknowledge it, then free the frames it held on to.
+*/
+extern void x86_64_tlb_batch_flush(void);
+
+/**
+ * Free 2^order frames at 'pa' that were mapped until now, once no
+ * CPU can reach them through a stale TLB entry: right away outside
+ * a batch, since shootdowns are waited for, at its flush inside one.
+*/
+extern void x86_64_tlb_free(uintptr_t pa, usize order);
+
+/**
+ * Handle a shootdown queued for this CPU, if there is one.
+ * For code spinning with interrupts off, which would otherwise
+ * keep the CPU that sent it waiting.
+*/
+extern void x86_64_tlb_poll(void);
+
+/**
+ * T_TLBSHTDWN handler.
+*/
+extern void x86_64_tlb_shootdown_handler(void);
+
+extern int x86_64_tlb_getstats(int cpuid, tlb_stats_t *stats);
\ No newline at end of file
@@ -91,6 +91,7 @@
 #define G2MiB(x)                ((size_t)(x) * KiB(1))   // convert GiB from to MiB.
 
 #define PGSZ                    (0x1000ull)
+#define PGSHIFT                 (12)
 #define PAGESZ                  (PGSZ)
 #define PGMASK                  (PGSZ - 1)
 #define PAGEMASK                (PGMASK)
@@ -115,6 +116,7 @@
 #define is_aligned4k(p)         ((((uint64_t)(p)) & 0xfff) == 0)
 
 #define MAGIC_RETADDR           (-1ul)
+#define MAGIC_PLTRESOLVE        (-2ul)  // GOT[2] of a lazily bound binary, see elf_plt_resolve().
 #define MEMMDEV                 ((uintptr_t)0xFE000000ull)
 #define ismmio_addr(x)          ((((uintptr_t)(x)) >= MEMMDEV) && (((uintptr_t)(x)) < GiB(4)))
 
@@ -147,6 +149,22 @@
 
 #define iskernel_addr(x)        ((uintptr_t)(x) >= VMA_BASE)
 
+#if defined __x86_64__
+    // base of the permanent direct map of all physical memory (PML4E[272]).
+    #define PHYSMAP_BASE        ((uintptr_t)0xFFFF880000000000ull)
+    // largest amount of physical memory the direct map can cover (64TiB).
+    #define PHYSMAP_SIZE        ((uintptr_t)0x0000400000000000ull)
+#endif
+
+// convert a physical address to its direct-map(physmap) virtual address.
+#define PHYS2VIRT(p)            ((uintptr_t)(p) + PHYSMAP_BASE)
+
+// convert a direct-map(physmap) virtual address to a physical address.
+#define VIRT2PHYS(v)            ((uintptr_t)(v) - PHYSMAP_BASE)
+
+#define isphysmap_addr(x)       (((uintptr_t)(x) >= PHYSMAP_BASE) && \
+                                 ((uintptr_t)(x) < (PHYSMAP_BASE + PHYSMAP_SIZE)))
+
 // page size used for a 2MiB page
 #define PGSZ2MB                 (MiB(2))
 #define PGSZ1GB                 (GiB(1))
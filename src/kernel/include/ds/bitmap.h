@@ -32,6 +32,7 @@ extern int bitmap_set(bitmap_t *bitmap, usize pos, usize nbits);
 extern int bitmap_unset(bitmap_t *bitmap, usize pos, usize nbits);
 extern int bitmap_test(bitmap_t *bitmap, usize pos, usize nbits);
 extern int bitmap_alloc_range(bitmap_t *bitmap, usize nbits, usize *pos);
+extern int bitmap_alloc_range_aligned(bitmap_t *bitmap, usize nbits, usize align, usize base, usize *pos);
 
 /**
  * Dumps the entire bitmap in hexadecimal format.
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <arch/cpu.h>
+#include <core/types.h>
+#include <ds/bitmap.h>
+#include <sync/spinlock.h>
+
+/**
+ * ID allocator.
+ * A bitmap of the IDs in [min, max), searched from a cursor that
+ * rolls over, so a freed ID comes back only once every other ID has
+ * been handed out after it. Each CPU keeps a batch of IDs taken from
+ * the bitmap and a batch of freed ones not yet put back. Most
+ * allocations and frees touch only the local batch.
+ */
+
+#define IDMAP_BATCH     16  // IDs a CPU takes from, or gives back to, the bitmap at once.
+
+typedef struct idmap_cache {
+    usize       next;               // next of 'alloc' to hand out.
+    usize       nalloc;             // IDs in 'alloc'.
+    usize       nfree;              // IDs in 'free'.
+    int         alloc[IDMAP_BATCH]; // taken from the bitmap, not yet handed out.
+    int         free[IDMAP_BATCH];  // freed, their bits are still set.
+    spinlock_t  lock;
+} idmap_cache_t;
+
+typedef struct idmap {
+    usize           im_min;         // lowest ID.
+    usize           im_max;         // IDs are below this.
+    usize           im_cursor;      // where the next search of the bitmap starts.
+    usize           *im_map;        // a bit is set while its ID is in use or cached.
+    spinlock_t      im_lock;        // protects the bitmap and cursor.
+    idmap_cache_t   im_cache[NCPU];
+} idmap_t;
+
+// An idmap_t of the IDs in [min, max), for a definition at file scope.
+#define IDMAP(name, min, max) idmap_t name = {                             \
+    .im_min     = (min),                                                    \
+    .im_max     = (max),                                                    \
+    .im_cursor  = (min),                                                    \
+    .im_map     = (usize[((max) + BITS_PER_USIZE - 1) / BITS_PER_USIZE]){0},\
+}
+
+// Allocate an ID from 'map', -EAGAIN if all of them are in use.
+extern int  idmap_alloc(idmap_t *map, int *pid);
+
+// Give 'id' back to 'map'.
+extern void idmap_free(idmap_t *map, int id);
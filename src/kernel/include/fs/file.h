@@ -104,6 +104,15 @@ extern void fctx_free(file_ctx_t *fctx);
 extern void file_close_all(void);
 extern int  file_copy(file_ctx_t *dst, file_ctx_t *src);
 
+/**
+ * dup2(), close() and open() on the file table 'fctx' rather than
+ * the caller's, for posix_spawn() to set up a child's descriptors.
+ * Path lookups are still relative to the caller's directories.
+ */
+extern int  fctx_dup2(file_ctx_t *fctx, int fd1, int fd2);
+extern int  fctx_close(file_ctx_t *fctx, int fd);
+extern int  fctx_open(file_ctx_t *fctx, int fd, const char *pathname, int oflags, mode_t mode);
+
 extern int  file_get(int fd, file_t **ref);
 
 extern int  dup(int fd);
@@ -117,6 +117,7 @@ int vfs_resolve_path(const char *pathname, dentry_t *dir, cred_t *cred, int ofla
 
 int vfs_lookup(const char *fn, cred_t *cred, int oflags, dentry_t **pdp);
 int vfs_lookupat(const char *pathname, dentry_t *dir, cred_t *__cred, int oflags, dentry_t **pdp);
+int vfs_openat(dentry_t *dir, const char *pathname, int oflags, mode_t mode, dentry_t **pdp);
 
 int vfs_mknod(const char *pathname, cred_t *cred, mode_t mode, dev_t dev);
 int vfs_mknodat(dentry_t *dir, const char *pathname, cred_t *cred, mode_t mode, dev_t dev);
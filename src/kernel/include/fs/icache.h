@@ -41,5 +41,25 @@ typedef struct icache_t {
 int icache_alloc(icache_t **ppcp);
 void icache_free(icache_t *icache);
 int icache_getpage(icache_t *icache, off_t pgno, page_t **page);
+int icache_lookup(icache_t *icache, off_t pgno, page_t **page);
+
+/**
+ * Drop 'page' from the cache, writing it back first if it is dirty.
+ * Fails with -EBUSY if the page is mapped or the inode is locked.
+ */
+int icache_evict(icache_t *icache, page_t *page);
+
+/**
+ * Write 'page' back to the inode if it is dirty,
+ * with both the cache and its inode locked.
+ */
+int icache_writeback(icache_t *icache, page_t *page);
+
+/**
+ * Copy 'page' into the fresh frame 'newpage' and have the cache hold
+ * that instead, dropping the cache's reference on 'page'.
+ * Fails with -EBUSY if the page is mapped, it would not move with us.
+ */
+int icache_migrate(icache_t *icache, page_t *page, page_t *newpage);
 ssize_t icache_read(icache_t *icache, off_t off, void *buf, size_t size);
 ssize_t icache_write(icache_t *icache, off_t off, const void *buf, size_t size);
\ No newline at end of file
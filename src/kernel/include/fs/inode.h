@@ -60,7 +60,9 @@ typedef struct inode {
     size_t          i_size;     // Inode's data size.
     
     #define INO_PTMX    0x0001
+    #define INO_EXEC    0x0002  // the exec cache holds an image of this file.
     int             i_flags;    // Inode flags.
+    ulong           i_gen;      // Generation, changes on every write and truncate.
     ssize_t         i_refcnt;   // Number of references to this inode.
     ssize_t         i_hlinks;   // Number of hard links to this inode. 
 
@@ -114,6 +116,7 @@ typedef struct iops {
 #define iassert(ip)         ({ assert((ip), "No inode"); })
 #define ilock(ip)           ({ iassert(ip); spin_lock(&(ip)->i_lock); })
 #define iunlock(ip)         ({ iassert(ip); spin_unlock(&(ip)->i_lock); })
+#define itrylock(ip)        ({ iassert(ip); spin_trylock(&(ip)->i_lock); })
 #define iislocked(ip)       ({ iassert(ip); spin_islocked(&(ip)->i_lock); })
 #define iassert_locked(ip)  ({ iassert(ip); spin_assert_locked(&(ip)->i_lock); })
 
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <core/types.h>
+
+/**
+ * LZ4 block format, compatible with the reference implementation's
+ * LZ4_compress_default()/LZ4_decompress_safe() for inputs up to 64KiB.
+ */
+
+#define LZ4_MAX_INPUT       65536
+
+// worst-case compressed size of 'n' bytes.
+#define LZ4_BOUND(n)        ((n) + ((n) / 255) + 16)
+
+// scratch space lz4_compress() needs, callers keep it per CPU.
+#define LZ4_HASHLOG         12
+#define LZ4_WRKMEM_SIZE     ((1 << LZ4_HASHLOG) * sizeof (u16))
+
+/**
+ * Compress 'srclen' bytes of 'src' into at most 'dstcap' bytes of 'dst'.
+ * Returns the compressed size, -E2BIG if it does not fit in 'dstcap'.
+ */
+extern int lz4_compress(const void *src, usize srclen, void *dst, usize dstcap, void *wrkmem);
+
+/**
+ * Decompress 'srclen' bytes of 'src' into at most 'dstcap' bytes of 'dst'.
+ * Returns the decompressed size, -EINVAL on malformed input.
+ */
+extern int lz4_decompress(const void *src, usize srclen, void *dst, usize dstcap);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <core/types.h>
+#include <mm/zone.h>
+
+/**
+ * Memory compaction.
+ * Moves movable pages out of the bottom of a zone into free frames
+ * at its top, so the naturally aligned blocks high-order allocations
+ * need open up again. Movable are page cache pages nobody maps and
+ * private user pages (PG_MOVABLE) a single PTE maps. There is no
+ * reverse map, the PTEs of the latter are found by walking the
+ * address spaces, the way swap-out does.
+ */
+
+#define COMPACT_MAX_BLOCKS          16  // blocks one call tries to clear before it gives up.
+#define COMPACT_PROACTIVE_ORDER     9   // 2MiB, what huge pages need.
+#define COMPACT_PROACTIVE_THRESHOLD 500 // fragmentation index kcompactd works down to.
+
+/**
+ * Clear a free, aligned block of 2^order frames in 'zone'.
+ * Returns 0 once one is free, -ENOMEM if the zone has too few
+ * free frames or none of the blocks tried could be emptied,
+ * -EBUSY if another compaction is running.
+ */
+extern int  compact_zone(zone_t *zone, usize order);
+
+/**
+ * Kick kcompactd, called by the page allocator when a
+ * high-order request fails and by kswapd after reclaim.
+ */
+extern void compaction_wakeup(void);
@@ -10,6 +10,7 @@ struct pmman {
     void        (*free)(uintptr_t);   // free a 4K page.
     int         (*get_page)(gfp_t gfp, void **ppa);
     int         (*get_pages)(gfp_t gfp, size_t order, void **ppa);
+    void        (*free_pages)(uintptr_t pa, size_t order); // drop a ref on 2^order pages.
     size_t      (*mem_used)(void); // used space (in KBs).
     size_t      (*mem_free)(void); // free space (in KBs).
 };
@@ -24,6 +25,7 @@ struct vmman {
     int (*init)(void);
     uintptr_t (*alloc)(size_t); // allocate an 'n'(kib), address is page aligned and size must be a multiple of 4Kib
     void (*free)(uintptr_t);    // deallocates a region of virtual memory
+    void (*free_lazy)(uintptr_t); // same, but the region is still mapped, it is unmapped later in a batch
     size_t (*getfreesize)(void);      //returns available virtual memory space
     size_t (*getinuse)(void); // returns the size of used virtual memory space
 };
@@ -31,6 +31,8 @@
 #include <mm/vm_region.h>
 
 #define MMAP_USER                   1
+#define MMAP_LOCKFUTURE             2   // mlockall(MCL_FUTURE), new regions start locked.
+#define MMAP_LOCKONFAULT            4   // with MMAP_LOCKFUTURE, lock pages as they fault in.
 
 /*Page size*/
 #ifndef PAGESZ
@@ -58,9 +60,10 @@
 typedef struct mmap {
     int        flags;       // memory map flags.
     long       refs;        // reference count.
+    long       users;       // processes running on it, more than one only across vfork().
     void       *priv;       // private data.
     vmr_t      *arg;        // region designated for argument vector.
-    vmr_t      *env;        // region designated for environment varaibles.
+    vmr_t      *env;        // region designated for environment varaibles, NULL if it shares 'arg'.
     vmr_t      *heap;       // region dedicated to the heap.
     uintptr_t   brk;        // brk position.
     uintptr_t   pgdir;      // page directory.
@@ -69,7 +72,10 @@ typedef struct mmap {
     size_t      used_space; // Avalable space, may be non-contigous.
     vmr_t      *vmr_head;   // head of list of virtual memory mapping.
     vmr_t      *vmr_tail;   // tail of list of virtual memory mapping.
+    vmr_t      *vmr_root;   // root of the gap-augmented tree indexing the list above.
+    vmr_t      *vmr_cache;  // last region returned by mmap_find().
     void       *entry; // entry of the image loaded in this mmap.
+    struct exec_image *image; // image whose PLT is bound lazily, if any.
     spinlock_t  lock;
 } mmap_t;
 
@@ -127,6 +133,41 @@ extern vmr_t *mmap_find_vmr_next(mmap_t *mmap, uintptr_t addr, vmr_t **pnext);
 extern vmr_t *mmap_find_vmr_prev(mmap_t *mmap, uintptr_t addr, vmr_t **pprev);
 extern vmr_t *mmap_find_vmr_overlap(mmap_t *mmap, uintptr_t start, uintptr_t end);
 
+/**
+ * VMR tree: an AVL tree keyed by vmr->start that mirrors the ordered
+ * vmr_head/vmr_tail list. Every node also carries the largest hole
+ * preceding any region in its subtree, so that address lookup and
+ * hole finding are both O(log n). The list stays authoritative for
+ * neighbours; a node's hole is measured from vmr->prev.
+ */
+
+/*Index 'r', already linked into the list, in the tree.*/
+extern void vmr_tree_insert(mmap_t *mmap, vmr_t *r);
+
+/*Drop 'r' from the tree.*/
+extern void vmr_tree_remove(mmap_t *mmap, vmr_t *r);
+
+/*Refresh the tree after the bounds of 'r' changed in place.*/
+extern void vmr_tree_update(mmap_t *mmap, vmr_t *r);
+
+/*Region containing 'addr', or NULL.*/
+extern vmr_t *vmr_tree_find(mmap_t *mmap, uintptr_t addr);
+
+/*First region starting above 'addr', or NULL.*/
+extern vmr_t *vmr_tree_next(mmap_t *mmap, uintptr_t addr);
+
+/*Last region ending below 'addr', or NULL.*/
+extern vmr_t *vmr_tree_prev(mmap_t *mmap, uintptr_t addr);
+
+/*Lowest region starting at or above 'addr' preceded by a hole of at least 'size'.*/
+extern vmr_t *vmr_tree_fit_after(mmap_t *mmap, uintptr_t addr, size_t size);
+
+/*Highest region starting at or below 'addr' preceded by a hole of at least 'size'.*/
+extern vmr_t *vmr_tree_fit_before(mmap_t *mmap, uintptr_t addr, size_t size);
+
+/*Size of the hole immediately below 'r'.*/
+extern size_t vmr_tree_gap(vmr_t *r);
+
 /*Begin search at the Start of the Address Space*/
 #define __whence_start  0
 
@@ -143,6 +184,39 @@ extern int mmap_alloc_vmr(mmap_t *mmap, size_t len, int prot, int flags, vmr_t *
 
 int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot);
 
+/*Is all of [start, end] mapped? 0 if so, -ENOMEM otherwise.*/
+extern int mmap_range_mapped(mmap_t *mmap, uintptr_t start, uintptr_t end);
+
+/**
+ * Fault in [start, end] of the current, locked 'mmap' for writing, so
+ * that the kernel can write to it without faulting while it holds the
+ * lock, which the fault handler would take again. -EFAULT if any of it
+ * is not mapped writable.
+ */
+extern int mmap_prefault_write(mmap_t *mmap, uintptr_t start, uintptr_t end);
+
+/**
+ * madvise(), msync(), mlock() and mremap() on the current address space.
+ * All are called with 'mmap' locked, and split regions as needed
+ * so that a change of attributes applies to the given range only.
+ */
+extern int mmap_advise(mmap_t *mmap, uintptr_t addr, size_t len, int advice);
+extern int mmap_sync(mmap_t *mmap, uintptr_t addr, size_t len, int flags);
+
+/*MLOCK_ONFAULT in 'flags' locks pages as they fault in rather than now.*/
+extern int mmap_mlock(mmap_t *mmap, uintptr_t addr, size_t len, int flags);
+extern int mmap_munlock(mmap_t *mmap, uintptr_t addr, size_t len);
+extern int mmap_mlockall(mmap_t *mmap, int flags);
+extern int mmap_munlockall(mmap_t *mmap);
+
+/**
+ * Resize [old, old + oldsz), moving it if MREMAP_MAYMOVE allows,
+ * to 'newaddr' with MREMAP_FIXED. '*paddr' gets where it ended up.
+ * Pages move with their page tables, nothing is copied.
+ */
+extern int mmap_remap(mmap_t *mmap, uintptr_t old, size_t oldsz, size_t newsz,
+    int flags, uintptr_t newaddr, uintptr_t *paddr);
+
 /// @brief 
 /// @param mm 
 /// @return 
@@ -171,18 +245,34 @@ extern int mmap_clone(mmap_t *mmap, mmap_t **pclone);
 extern int mmap_set_focus(mmap_t *mmap, uintptr_t *ref);
 
 /**
- * @brief 
- * 
- * @param mmap 
- * @param argv 
- * @param envv 
- * @param pargv 
- * @param pargc 
- * @param penvv 
- * @return int 
+ * An argument list and environment staged for a new image.
+ * 'ea_buf' holds both vectors, argv's then envp's, each NULL
+ * terminated, followed by the strings. The vectors hold offsets
+ * of the strings into 'ea_buf', not addresses, so the whole of it
+ * can be copied to wherever the image gets it and fixed up there.
  */
-extern int mmap_copy_arglist(mmap_t *mmap, char *const argv[],
-    char *const envv[], int *pargc, char *const*pargp[], char *const *penvp[]);
+typedef struct exec_args {
+    int     ea_argc;    // strings in argv.
+    int     ea_envc;    // strings in envp.
+    usize   ea_size;    // bytes used in 'ea_buf'.
+    char    *ea_buf;    // vectors, then strings.
+} exec_args_t;
+
+/**
+ * @brief Copy the staged 'args' into a region of 'mmap'.
+ *
+ * One region gets both vectors and the strings, in a single copy,
+ * 'mmap' must be in focus.
+ *
+ * @param mmap the address space of the new image.
+ * @param args argv and envp, as exec_args_copy() staged them.
+ * @param[out] pargc number of arguments.
+ * @param[out] pargp argv, as the image sees it.
+ * @param[out] penvp envp, as the image sees it.
+ * @return 0 on success, or a negative error code.
+ */
+extern int mmap_copy_args(mmap_t *mmap, const exec_args_t *args,
+    int *pargc, char *const *pargp[], char *const *penvp[]);
 
 extern int mmap_mapin(mmap_t *mm, vmr_t *r);
 
@@ -208,6 +298,29 @@ extern int mmap_mapin(mmap_t *mm, vmr_t *r);
 #define MAP_FIXED                   0x1000
 
 
+/*madvise() advice.*/
+#define MADV_NORMAL                 0
+#define MADV_RANDOM                 1
+#define MADV_SEQUENTIAL             2
+#define MADV_WILLNEED               3
+#define MADV_DONTNEED               4
+#define MADV_FREE                   8
+
+/*mremap() flags.*/
+#define MREMAP_MAYMOVE              0x0001
+#define MREMAP_FIXED                0x0002
+
+/*msync() flags.*/
+#define MS_ASYNC                    0x0001
+#define MS_INVALIDATE               0x0002
+#define MS_SYNC                     0x0004
+
+/*mlock2() and mlockall() flags.*/
+#define MLOCK_ONFAULT               0x0001
+#define MCL_CURRENT                 0x0001
+#define MCL_FUTURE                  0x0002
+#define MCL_ONFAULT                 0x0004
+
 #define __flags_locked(flags)       ((flags) & MAP_LOCK)
 #define __flags_user(flags)         ((flags) & MAP_USER)
 #define __flags_zero(flags)         ((flags) & MAP_ZERO)
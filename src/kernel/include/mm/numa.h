@@ -0,0 +1,74 @@
+#pragma once
+
+#include <core/types.h>
+#include <mm/gfp.h>
+#include <sync/atomic.h>
+
+/**
+ * NUMA topology, as the firmware's SRAT and SLIT describe it.
+ * Without them the machine is a single node, node 0,
+ * holding all of memory and every CPU.
+ */
+
+#define NNUMA                   4   // most memory nodes supported.
+#define NUMA_NMEMBLK            16  // most memory ranges in the SRAT.
+
+#define NUMA_LOCAL_DISTANCE     10  // SLIT distance of a node to itself.
+#define NUMA_REMOTE_DISTANCE    20  // assumed when there is no SLIT.
+
+/*A physical memory range and the node it belongs to.*/
+typedef struct numa_memblk {
+    int         node;
+    uintptr_t   start;
+    usize       size;
+} numa_memblk_t;
+
+/// Called by the firmware parser, before numa_init() returns.
+extern int  numa_add_memblk(int node, uintptr_t start, usize size);
+extern int  numa_add_cpu(int node, int cpuid);
+extern void numa_set_distance(int from, int to, u8 distance);
+
+/// Discover the nodes, falls back to a single node on failure.
+extern int  numa_init(void);
+
+extern int  numa_node_count(void);
+extern bool numa_node_online(int node);
+extern u8   numa_distance(int from, int to);
+
+// node of CPU 'cpuid'.
+extern int  numa_cpu_node(int cpuid);
+
+// node of the calling CPU.
+extern int  numa_local_node(void);
+
+// memory ranges, ordered by address.
+extern usize numa_memblk_count(void);
+extern const numa_memblk_t *numa_memblk_get(usize i);
+
+/**
+ * Memory allocation policy of a process.
+ * The values follow set_mempolicy(2).
+ */
+#define MPOL_DEFAULT            0   // the node of the CPU allocating.
+#define MPOL_PREFERRED          1   // the first node in the mask, others when it is full.
+#define MPOL_BIND               2   // only the nodes in the mask, nearest first.
+#define MPOL_INTERLEAVE         3   // round-robin over the nodes in the mask.
+#define MPOL_MAX                4
+
+typedef struct mempolicy {
+    int             mode;
+    ulong           nodes;  // mask of the nodes the mode applies to.
+    atomic_ulong    ilnext; // MPOL_INTERLEAVE: the next node to use.
+} mempolicy_t;
+
+#define MEMPOLICY_DEFAULT()     ((mempolicy_t){.mode = MPOL_DEFAULT})
+
+// validate and set '*pol', 'nodes' is ignored by MPOL_DEFAULT.
+extern int  mempolicy_set(mempolicy_t *pol, int mode, ulong nodes);
+
+/**
+ * Fill 'nodes' with the nodes an allocation from zone 'whence'
+ * should try, in order, under the calling process' policy.
+ * Returns how many were filled in.
+ */
+extern int  numa_alloc_nodes(gfp_t gfp, int whence, int nodes[NNUMA]);
@@ -6,22 +6,24 @@
 #include <mm/gfp.h>
 
 #define MAX_PAGE_ORDER      64
-
-typedef enum {
-    PGWM_RESERVED  = 0xFEEF5434C0DEDEEDull,
-    PGWM_DMA_POOL  = 0xBADDCAFEBEEFBABEull,
-    PGWM_NORM_POOL = 0xBADDBEEFC0DEFEEDull,
-    PGWM_HOLE_POOL = 0xBADDC0DEDEAFBED2ull,
-    PGWM_HIGH_POOL = 0xBADDBABE2000BEEFull,
-} page_watermark_t;
-
+#define NR_ORDER            11  // block orders the statistics tell apart, 4KiB to 4MiB.
+
+/**
+ * One per page frame, 64 bytes and aligned to them so that
+ * no frame's counters ever share a cache line with another's.
+ * The top bits of 'flags' say where the frame is: its memmap
+ * section, its zone and its NUMA node, see PG_LINKS_MASK.
+ */
 typedef struct page {
     ulong            flags;
     atomic_ulong     refcnt;
     atomic_ulong     mapcnt;
     icache_t         *icache;
-    page_watermark_t watermark;
-} __packed page_t;
+    off_t            index;     // page number within 'icache'.
+    queue_node_t     lru;       // link on the active or inactive LRU.
+} __aligned(64) page_t;
+
+_Static_assert(sizeof (page_t) == 64, "page_t must fill exactly one cache line");
 
 #define PG_X            BS(0)   // page is executable.
 #define PG_R            BS(1)   // page is readable.
@@ -34,8 +36,37 @@ typedef struct page {
 #define PG_WRITEBACK    BS(7)   // page needs writeback
 #define PG_SWAPPABLE    BS(8)   // page swapping is allowed.
 #define PG_SWAPPED      BS(9)   // page is swapped out.
-#define PG_L            BS(10)  // page is locked in memory.
 #define PG_C            BS(11)  // page is cached.
+#define PG_LRU          BS(12)  // page is on an LRU list.
+#define PG_ACTIVE       BS(13)  // page is on the active LRU list.
+#define PG_REFERENCED   BS(14)  // page was used since the LRU last looked.
+#define PG_RESERVED     BS(15)  // firmware or kernel image, never handed out.
+#define PG_MOVABLE      BS(16)  // private user frame, compaction may move it.
+
+/**
+ * Where the frame is, set when the memmap is built and kept
+ * across page_resetflags(): bits [44, 57) hold the section,
+ * [58, 60) the zone index and [60, 62) the node.
+ */
+#define PG_SECTION_SHIFT    44
+#define PG_SECTION_BITS     13
+#define PG_ZONE_SHIFT       58
+#define PG_ZONE_BITS        2
+#define PG_NODE_SHIFT       60
+#define PG_NODE_BITS        2
+
+#define PG_FIELD(flags, f)  (((flags) >> PG_##f##_SHIFT) & (BS(PG_##f##_BITS) - 1))
+#define PG_LINKS(sec, zi, node) (((ulong)(sec) << PG_SECTION_SHIFT) | \
+                             ((ulong)(zi) << PG_ZONE_SHIFT) | ((ulong)(node) << PG_NODE_SHIFT))
+#define PG_LINKS_MASK       PG_LINKS(BS(PG_SECTION_BITS) - 1, BS(PG_ZONE_BITS) - 1, BS(PG_NODE_BITS) - 1)
+
+/**
+ * How many mlock()ed mappings pin the frame in memory, bits [24, 44).
+ * Cleared by page_resetflags() along with the other state flags.
+ */
+#define PG_PIN_SHIFT        24
+#define PG_PIN_BITS         20
+#define PG_PIN_MASK         ((BS(PG_PIN_BITS) - 1) << PG_PIN_SHIFT)
 
 #define PG_RX           (PG_R | PG_X)
 #define PG_RW           (PG_R | PG_W)
@@ -43,7 +74,7 @@ typedef struct page {
 
 #define page_assert(page)           ({ assert(page, "Invalid page pointer.\n"); })
 
-#define page_resetflags(page)       ({ (page)->flags =    0; })
+#define page_resetflags(page)       ({ (page)->flags &= PG_LINKS_MASK | PG_RESERVED; })
 #define page_testflags(page, f)     ({ (page)->flags &   (f); })             // get page flags.
 #define page_setflags(page, f)      ({ (page)->flags |=  (f); })
 #define page_maskflags(page, f)     ({ (page)->flags &= ~(f); })
@@ -90,19 +121,51 @@ typedef struct page {
 #define page_refcnt(page)           ({ (page)->refcnt; })
 #define page_virtual(page)          ({ (page)->virtual; })
 
-#define page_index(page, zone)      ({ ((page) - (zone)->pages); })
-#define page_addr(page, zone)       ({ (zone)->start + (page_index(page, zone) * PGSZ); })
-#define page_end(page, npage, zone) ({ page_addr(page, zone) + (npage * PGSZ); })
+/**
+ * The memmap.
+ * page_t's are indexed by page frame number, in sections of 128MiB
+ * of physical memory. Only sections with memory in them are backed,
+ * so holes in the physical address space cost one pointer each.
+ */
+#define MEMMAP_SECTION_SHIFT    27
+#define MEMMAP_MAXPHYS_SHIFT    (MEMMAP_SECTION_SHIFT + PG_SECTION_BITS)   // 1TiB.
+#define MEMMAP_NSECTION         BS(PG_SECTION_BITS)
+#define PFN_SECTION_SHIFT       (MEMMAP_SECTION_SHIFT - PGSHIFT)
+#define PAGES_PER_SECTION       BS(PFN_SECTION_SHIFT)
+
+extern page_t *memmap_sections[MEMMAP_NSECTION];
+
+#define PFN(pa)                 ((uintptr_t)(pa) >> PGSHIFT)
+#define PFN2PHYS(pfn)           ((uintptr_t)(pfn) << PGSHIFT)
+
+#define page_section(page)      ({ PG_FIELD((page)->flags, SECTION); })
+#define page_zonei(page)        ({ PG_FIELD((page)->flags, ZONE); })
+#define page_node(page)         ({ PG_FIELD((page)->flags, NODE); })
 
-static inline page_watermark_t page_watermark(page_t *page) {
-    return page->watermark;
+// the page_t of frame 'pfn', NULL if the memmap does not cover it.
+static inline page_t *pfn_to_page(uintptr_t pfn) {
+    page_t *map = NULL;
+
+    if ((pfn >> PFN_SECTION_SHIFT) >= MEMMAP_NSECTION)
+        return NULL;
+
+    map = memmap_sections[pfn >> PFN_SECTION_SHIFT];
+    return map ? map + (pfn & (PAGES_PER_SECTION - 1)) : NULL;
 }
 
-static inline void page_set_watermark(page_t *page, page_watermark_t wm) {
-    page->watermark = wm;
+static inline uintptr_t page_to_pfn(page_t *page) {
+    const usize sec = page_section(page);
+    return (sec << PFN_SECTION_SHIFT) + (page - memmap_sections[sec]);
 }
 
-int page_check_watermark(uintptr_t vaddr);
+#define phys_to_page(pa)            ({ pfn_to_page(PFN(pa)); })
+#define page_to_phys(page)          ({ PFN2PHYS(page_to_pfn(page)); })
+
+// index of 'page' in its zone's bitmap.
+#define page_index(page, zone)      ({ page_to_pfn(page) - PFN((zone)->start); })
+
+// check that the frame mapped at 'vaddr' is allocated and not reserved.
+int page_check(uintptr_t vaddr);
 
 extern usize get_page_order(usize size_in_bytes);
 
@@ -134,3 +197,56 @@ extern int page_get_address(page_t *page, void **ppa);
 
 extern int page_getcount(page_t *page, usize *pcnt);
 extern int __page_getcount(uintptr_t paddr, usize *pcnt);
+
+/**
+ * Is the frame at 'paddr' owned by a single mapping? Not if it is
+ * the zero page, a page-cache page or still has other references,
+ * a private mapping must copy such a frame before writing to it.
+ */
+extern bool __page_exclusive(uintptr_t paddr);
+
+/**
+ * Take or drop a pin on the frame at 'paddr' for mlock(), one per
+ * locked mapping of it. Swap-out and compaction leave the frame
+ * alone until the last pin is dropped.
+ */
+extern int  __page_pin(uintptr_t paddr);
+extern int  __page_unpin(uintptr_t paddr);
+extern bool __page_pinned(uintptr_t paddr);
+
+/**
+ * Mark the frame at 'paddr' as backing a private user mapping
+ * (PG_MOVABLE), the only frames besides page cache pages that
+ * compaction will try to move. The zero page and page-cache
+ * pages are left alone. Freeing the frame clears it.
+ */
+extern void __page_setmovable(uintptr_t paddr);
+
+/**
+ * Take a reference on the shared, read-only zero page
+ * and return its physical address in '*ppa'.
+ */
+extern int zero_page_get(uintptr_t *ppa);
+extern bool iszero_page(uintptr_t paddr);
+// number of faults served by the zero page.
+extern usize zero_page_hits(void);
+
+/**
+ * Page cache LRU.
+ * Cache pages start on the inactive list, a second use while there
+ * promotes them to the active list. Reclaim evicts from the tail of
+ * the inactive list and refills it from the tail of the active one.
+ */
+extern void page_lru_add(page_t *page);
+extern void page_lru_del(page_t *page);
+extern void page_mark_accessed(page_t *page);
+// pages on both lists.
+extern usize page_lru_count(void);
+// scan up to 'nr_scan' pages, return how many were freed.
+extern usize page_lru_shrink(usize nr_scan);
+/**
+ * Move the contents and cache slot of the unmapped cache page
+ * 'page' over to the fresh frame 'newpage'. Only tries the locks,
+ * -EBUSY if they are taken or the page is mapped or on its way out.
+ */
+extern int page_lru_migrate(page_t *page, page_t *newpage);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <core/types.h>
+#include <ds/queue.h>
+#include <sync/atomic.h>
+
+/**
+ * A cache that can give memory back under pressure.
+ * 'count' returns how many objects the cache could free right now,
+ * 'scan' looks at up to 'nr_scan' of them and returns the number of
+ * pages it actually freed. Neither may block on a lock the allocator
+ * can hold, callers only ever use trylocks on the reclaim path.
+ */
+typedef struct shrinker {
+    const char      *name;
+    usize           (*count)(struct shrinker *shrinker);
+    usize           (*scan)(struct shrinker *shrinker, usize nr_scan);
+    atomic_t        users;  // shrink_memory() passes running it.
+    queue_node_t    node;
+} shrinker_t;
+
+/**
+ * Each pass asks a shrinker to scan count >> priority objects,
+ * starting at this priority and going down to 0 (everything)
+ * until enough pages are freed.
+ */
+#define RECLAIM_PRIORITY    12
+
+extern int  register_shrinker(shrinker_t *shrinker);
+extern void unregister_shrinker(shrinker_t *shrinker);
+
+/**
+ * Run the registered shrinkers until 'nr_pages' pages
+ * are freed or they run out of things to free.
+ * Returns the number of pages freed.
+ */
+extern usize shrink_memory(usize nr_pages);
+
+/**
+ * Kick kswapd, called by the page allocator
+ * when a zone drops below its low watermark.
+ */
+extern void reclaim_wakeup(void);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <mm/reclaim.h>
+
+/**
+ * Anonymous memory swap.
+ * Cold private pages are compressed into zram and their PTEs
+ * replaced by swap entries, default_pgf_handler() brings them
+ * back on the next touch.
+ */
+
+// the shrinker kswapd uses to push cold anonymous pages out.
+extern shrinker_t swap_shrinker;
@@ -31,6 +31,11 @@ typedef struct vmr {
     uintptr_t   end;       // Ending address of this memory region.
     vm_region_t *prev;     // Previous memory object in the list of memory regions.
     vm_region_t *next;     // Next memory object in the list of memory regions.
+    vm_region_t *left;     // Lower addresses in the mmap's VMR tree.
+    vm_region_t *right;    // Higher addresses in the mmap's VMR tree.
+    vm_region_t *parent;   // Parent in the mmap's VMR tree.
+    int         height;    // Height of this subtree (AVL balancing).
+    size_t      max_gap;   // Largest hole preceding any region in this subtree.
 } vm_region_t, vmr_t;
 
 #define VM_EXEC                     0x0001
@@ -41,6 +46,10 @@ typedef struct vmr {
 #define VM_FILE                     0x0020
 #define VM_GROWSDOWN                0x0100
 #define VM_DONTEXPAND               0x0200
+#define VM_LOCKED                   0x0400  // mlock()ed, pages stay resident.
+#define VM_SEQ_READ                 0x0800  // MADV_SEQUENTIAL, read ahead harder.
+#define VM_RAND_READ                0x1000  // MADV_RANDOM, do not read ahead.
+#define VM_LAZYFREE                 0x2000  // MADV_FREE, clean pages may be dropped.
 
 
 #define __vm_mask_exec(flags)       ((flags) &= ~VM_EXEC)
@@ -84,6 +93,9 @@ typedef struct vmr {
 /*Can be expanded*/
 #define __vm_can_expand(flags)      (!__vm_dontexpand(flags))
 
+/*Locked in memory*/
+#define __vm_locked(flags)          ((flags) & VM_LOCKED)
+
 /*Expansion edge grows downwards*/
 #define __vm_growsdown(flags)       ((flags) & VM_GROWSDOWN)
 
@@ -168,6 +180,10 @@ static inline bool __vmr_growsup(vm_region_t *vmr) {
     return __vm_growsup(vmr->flags) ? true : false;
 }
 
+static inline bool __vmr_locked(vm_region_t *vmr) {
+    return __vm_locked(vmr->flags) ? true : false;
+}
+
 /*Is memory region a stack?*/
 static inline bool __vmr_isstack(vm_region_t *vmr) {
     return __vmr_growsdown(vmr);
@@ -230,4 +246,10 @@ extern void vmr_free(vmr_t *region);
 extern void vmr_dump(vmr_t *region, int index);
 extern int  vmr_copy(vmr_t *rdst, vmr_t *rsrc);
 extern int  vmr_clone(vmr_t *src, vmr_t **pclone);
-extern int  vmr_split(vmr_t *region, uintptr_t addr, vmr_t **pvmr);
\ No newline at end of file
+extern int  vmr_split(vmr_t *region, uintptr_t addr, vmr_t **pvmr);
+
+/**
+ * Split 'region' so that its part inside [start, end] stands alone,
+ * '*pvmr' gets that part. 'region' must be mapped in and overlap the range.
+ */
+extern int  vmr_isolate(vmr_t *region, uintptr_t start, uintptr_t end, vmr_t **pvmr);
\ No newline at end of file
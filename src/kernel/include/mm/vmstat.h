@@ -0,0 +1,54 @@
+#pragma once
+
+#include <core/types.h>
+#include <mm/page.h>
+#include <sync/atomic.h>
+
+/**
+ * Memory manager event counters and latency histograms,
+ * shown in /proc/vmstat. They are bumped with atomics only,
+ * so counting never takes a lock on the paths it measures.
+ */
+
+#define VMSTAT_NGFP         5   // GFP_WHENCE() classes, __GFP_ANY to __GFP_HIGHMEM.
+#define LATENCY_NBUCKET     32  // log2 buckets of TSC cycles.
+
+typedef struct latency_hist {
+    atomic_ulong    bucket[LATENCY_NBUCKET];    // [i] counts samples of [2^i, 2^(i+1)) cycles.
+    atomic_ulong    count;                      // samples taken.
+    atomic_ulong    cycles;                     // sum of all samples.
+} latency_hist_t;
+
+typedef struct vmstat {
+    atomic_ulong    pgalloc[VMSTAT_NGFP];       // successful page_alloc_n() calls, by GFP class.
+    atomic_ulong    pgalloc_fail[VMSTAT_NGFP];  // failed ones.
+    atomic_ulong    pgalloc_fail_order[NR_ORDER];// failed ones by order, the last counts larger too.
+    atomic_ulong    pgalloc_pages;              // frames handed out.
+    atomic_ulong    pgalloc_zero;               // of which zero-filled.
+    atomic_ulong    pgalloc_remote;             // calls served past the first node tried.
+    atomic_ulong    pgfree;                     // frames given back to their zone.
+    atomic_ulong    kswapd_wakeups;             // times kswapd was signalled.
+    atomic_ulong    pgreclaim;                  // pages freed by the shrinkers.
+    atomic_ulong    vmalloc_purges;             // lazy kernel unmaps purged.
+    atomic_ulong    compact_stall;              // high-order allocations that compacted directly.
+    atomic_ulong    compact_success;            // compactions that freed a block.
+    atomic_ulong    compact_fail;               // and those that did not.
+    atomic_ulong    compact_migrated;           // pages moved by compaction.
+    atomic_ulong    kcompactd_wakeups;          // times kcompactd was signalled.
+    latency_hist_t  page_alloc_lat;             // page_alloc_n() and friends.
+    latency_hist_t  kmalloc_lat;                // kmalloc().
+} vmstat_t;
+
+extern vmstat_t vmstat;
+
+#define vmstat_inc(f)           ({ atomic_inc(&vmstat.f); })
+#define vmstat_add(f, n)        ({ atomic_add(&vmstat.f, (n)); })
+#define vmstat_order(order)     ((order) < NR_ORDER ? (order) : NR_ORDER - 1)
+
+extern void latency_hist_add(latency_hist_t *hist, u64 cycles);
+
+/// Render /proc/meminfo, /proc/buddyinfo and /proc/vmstat into 'buf',
+/// returning the length, truncated to fit 'size' with its terminator.
+extern usize vmstat_meminfo(char *buf, usize size);
+extern usize vmstat_buddyinfo(char *buf, usize size);
+extern usize vmstat_show(char *buf, usize size);
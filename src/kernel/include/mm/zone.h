@@ -5,23 +5,32 @@
 #include <sync/spinlock.h>
 #include <ds/queue.h>
 #include <ds/bitmap.h>
+#include <mm/numa.h>
 #include <mm/page.h>
 
 #define NZONE   4
 
+/**
+ * Every NUMA node has its own set of NZONE zones,
+ * those of node 'n' at zones[n * NZONE]. A zone
+ * a node has no memory in is left empty.
+ */
+#define NZONES  (NNUMA * NZONE)
+
 typedef struct zone_t {
     usize       size;       // size of zone in bytes.
     uintptr_t   start;      // start address of this zone.
     bitmap_t    bitmap;     // zone's bitmap.
-    page_t      *pages;     // array of pages.
     usize       npages;     // No. of pages in this zone.
     usize       upages;     // No. of used pages in this zone.
+    usize       pages_low;  // kswapd is woken below this many free pages.
+    usize       pages_high; // and reclaims until this many are free.
     u64         flags;      // zone flags.
     queue_t     queue;
     spinlock_t  lock;       // zone lock for synchronization.
 } zone_t;
 
-extern zone_t zones[NZONE];
+extern zone_t zones[NZONES];
 extern const char *str_zone[];
 
 /////////////////////////
@@ -33,6 +42,9 @@ extern const char *str_zone[];
 #define ZONEi_HOLE              2   // zone from 2GiB-4GiB.
 #define ZONEi_HIGH              3   // zone from 4GiB and beyond.
 
+// zone 'zi' of 'node'.
+#define node_zone(node, zi)     (&zones[(node) * NZONE + (zi)])
+
 // assert zone is valid and not a nullptr.
 #define zone_assert(z)          ({ assert(z, "No zone."); })
 
@@ -48,9 +60,9 @@ extern const char *str_zone[];
 // ensure zone is locked before proceeding.
 #define zone_assert_locked(z)   ({ zone_assert(z); spin_assert_locked(&(z)->lock); })
 
-#define zone_assert_isnotkernel(zone, page) ({                             \
-    assert(!is_kernel_addr(page_addr(page, zone)),                         \
-           "Page(%p) is a builtin-kernel page.\n", page_addr(page, zone)); \
+#define zone_assert_isnotkernel(page) ({                             \
+    assert(!is_kernel_addr(page_to_phys(page)),                      \
+           "Page(%p) is a builtin-kernel page.\n", page_to_phys(page)); \
 })
 
 ///////////////////////////////////////////////////
@@ -67,8 +79,12 @@ extern const char *str_zone[];
 
 #define zone_size(z)            ({ zone_assert(z); (z)->size; })
 #define zone_start(z)           ({ zone_assert(z); (z)->start; })
-#define zone_pages(z)           ({ zone_assert(z); (z)->pages; })
 #define zone_end(z)             ({ zone_assert(z); (z)->start + (z)->size; })
+#define zone_start_pfn(z)       ({ zone_assert(z); PFN((z)->start); })
+#define zone_free_pages(z)      ({ zone_assert(z); (z)->npages - (z)->upages; })
+
+// true when the zone has dropped below its low watermark.
+#define zone_below_low(z)       ({ zone_free_pages(z) < (z)->pages_low; })
 
 /// get the zone struct in which page resides.
 /// on success return locked zone is ppz.
@@ -80,21 +96,56 @@ extern int getzone_bypage(page_t *page, zone_t **ppz);
 /// else an error is returned to indicate the error.
 extern int getzone_byaddr(uintptr_t paddr, usize size, zone_t **ppz);
 
-extern int getzone_byindex(int z_index, zone_t **ref);
+/// get zone 'z_index' of 'node', returned locked in ref.
+extern int getzone_byindex(int node, int z_index, zone_t **ref);
 
+// the kind of zone, one of ZONEi_*.
 static inline int getzone_index(zone_t *zone) {
-    return zone - zones;
+    return (zone - zones) % NZONE;
 }
 
-static inline void page_verify_watermark(page_t *page, zone_t *zone) {
-    const uintptr_t addr = page_addr(page, zone);
-    const page_watermark_t watermark = page_watermark(page);
+// the NUMA node the zone's memory is on.
+static inline int getzone_node(zone_t *zone) {
+    return (zone - zones) / NZONE;
+}
 
-    bool has_watermark = watermark == PGWM_RESERVED || watermark == PGWM_DMA_POOL ||
-                         watermark == PGWM_NORM_POOL || watermark == PGWM_HOLE_POOL || watermark == PGWM_HIGH_POOL;
+// the zone 'page' is in, straight from its flags.
+static inline zone_t *page_zone(page_t *page) {
+    return node_zone(page_node(page), page_zonei(page));
+}
 
-    assert(watermark != PGWM_RESERVED && has_watermark, "Watermark breach [%p: watermark: %p]\n", addr, watermark);
+// the page at 'index' in the zone.
+static inline page_t *zone_page(zone_t *zone, usize index) {
+    return pfn_to_page(zone_start_pfn(zone) + index);
 }
 
+static inline void page_verify(page_t *page, zone_t *zone) {
+    assert(!page_testflags(page, PG_RESERVED) && page_zone(page) == zone,
+        "Page(%p) is reserved or not in zone %p\n", page_to_phys(page), zone);
+}
+
+/**
+ * Take the highest free frame of 'zone' whose index is at least
+ * 'floor' and below '*pcursor', and leave '*pcursor' on it, so the
+ * next call goes on from there. Compaction uses this to fill the
+ * top of the zone with the pages it moves out of the bottom.
+ */
+extern int zone_alloc_highest(zone_t *zone, usize floor, usize *pcursor, page_t **ppage);
+
 /// Initialize physical memory zones.
 extern int zones_init(void);
+
+/**
+ * Count the free, naturally aligned blocks of 'zone' by order, each
+ * free page in the largest block it is part of, the way a buddy
+ * allocator would hold them. Lock free, so only a snapshot.
+ */
+extern void zone_free_blocks(zone_t *zone, usize counts[NR_ORDER]);
+
+/**
+ * How much a failure to allocate 2^order pages, given the free blocks
+ * in 'counts', would be down to fragmentation rather than lack of
+ * memory, in thousandths: 0 none free, towards 1000 fragmented,
+ * -1000 when a large enough block is free.
+ */
+extern int zone_fragmentation_index(const usize counts[NR_ORDER], int order);
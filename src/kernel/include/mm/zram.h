@@ -0,0 +1,41 @@
+#pragma once
+
+#include <core/types.h>
+
+/**
+ * Compressed in-memory store backing anonymous swap.
+ * A page goes in LZ4 compressed and comes back out through the slot
+ * number recorded in the swap entry that replaced its PTE. Slots are
+ * reference counted since fork() copies swap entries as they are.
+ */
+
+typedef struct zram_stats {
+    usize   stored;         // slots in use.
+    usize   same_filled;    // of which hold a page repeating one word.
+    usize   compr_bytes;    // bytes of compressed data held.
+    usize   rejected;       // pages that did not compress well enough.
+    usize   loads;          // pages decompressed back in.
+} zram_stats_t;
+
+/**
+ * Pages compressing to more than this are not worth
+ * the CPU time and stay resident.
+ */
+#define ZRAM_MAX_CLEN       ((PGSZ * 3) / 4)
+
+/**
+ * Compress the page frame at 'paddr' into a new slot.
+ * Returns -E2BIG for pages that do not compress well enough.
+ */
+extern int  zram_store(uintptr_t paddr, ulong *pslot);
+
+// decompress 'slot' into the page frame at 'paddr'.
+extern int  zram_load(ulong slot, uintptr_t paddr);
+
+// take another reference on 'slot'.
+extern int  zram_dup(ulong slot);
+
+// drop a reference on 'slot', freeing it with the last one.
+extern void zram_free(ulong slot);
+
+extern void zram_getstats(zram_stats_t *stats);
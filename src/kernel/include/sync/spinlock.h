@@ -70,7 +70,7 @@ extern bool spin_trylock(spinlock_t *lk);
                                                             \
         arch_raw_lock_release(&(lk)->guard);                \
         popcli();                                           \
-        cpu_pause();                                        \
+        cpu_relax();                                        \
         pushcli();                                          \
         arch_raw_lock_acquire(&(lk)->guard);                \
     }                                                       \
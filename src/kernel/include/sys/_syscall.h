@@ -8,9 +8,11 @@
 #include <sys/_ptrace.h>
 #include <sys/syscall_nums.h>
 #include <sys/_socket.h>
+#include <sys/spawn.h>
 #include <sys/thread.h>
 #include <sys/_time.h>
 #include <sys/_utsname.h>
+#include <sys/_wait.h>
 
 void do_syscall(ucontext_t *uctx);
 
@@ -78,11 +80,14 @@ extern int      sys_park(void);
 extern int      sys_unpark(tid_t);
 
 extern pid_t    sys_fork(void);
+extern pid_t    sys_vfork(void);
 extern pid_t    sys_getpid(void);
 extern pid_t    sys_getppid(void);
 extern void     sys_exit(int status);
 extern pid_t    sys_waitpid(pid_t __pid, int *__stat_loc, int __options);
+extern int      sys_waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options);
 extern int      sys_execve(const char *pathname, char *const argv[], char *const envp[]);
+extern pid_t    sys_spawn(const char *path, const spawn_file_action_t *actions, int nactions, char *const argv[], char *const envp[]);
 extern long     sys_ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data);
 extern pid_t    sys_wait4(pid_t pid, int *wstatus, int options, void /*struct rusage*/ *rusage);
 
@@ -156,9 +161,11 @@ extern int      sys_munlock(const void *addr, size_t len);
 extern int      sys_mlockall(int flags);
 extern int      sys_munlockall(void);
 extern int      sys_madvise(void *addr, size_t length, int advice);
-extern void     *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
+extern void     *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address);
 extern int      sys_msync(void *addr, size_t length, int flags);
 extern void     *sys_sbrk(intptr_t increment);
+extern int      sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+extern int      sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags);
 
 extern int      sys_getrlimit(int resource, void /*struct rlimit*/ *rlim);
 extern int      sys_setrlimit(int resource, const void /*struct rlimit*/ *rlim);
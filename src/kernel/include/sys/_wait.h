@@ -71,4 +71,17 @@ extern pid_t wait (int *__stat_loc);
 
    This function is a cancellation point and therefore not marked with
    __THROW.  */
-extern pid_t waitpid (pid_t __pid, int *__stat_loc, int __options);
\ No newline at end of file
+extern pid_t waitpid (pid_t __pid, int *__stat_loc, int __options);
+
+/* A child reaped by `waitbatch'.  */
+typedef struct wait_entry {
+   pid_t we_pid;     /* Process ID of the child.  */
+   int   we_status;  /* Its status, as `waitpid' stores it.  */
+} wait_entry_t;
+
+/* Reap up to NENT children matching PID, as `waitpid' does, into ENTS.
+   Only the first one is waited for unless WNOHANG is in OPTIONS, the
+   rest are the matching children that have already exited.  At most
+   512 are reaped per call.  Return how many were reaped, or -EFAULT,
+   with none reaped, if ENTS is not writable for them.  */
+extern int waitbatch (pid_t __pid, wait_entry_t *__ents, int __nent, int __options);
\ No newline at end of file
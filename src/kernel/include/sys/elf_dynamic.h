@@ -0,0 +1,48 @@
+#pragma once
+
+#include <arch/ucontext.h>
+#include <fs/inode.h>
+#include <mm/mmap.h>
+#include <sys/exec_cache.h>
+
+/**
+ * In-kernel ELF dynamic linker.
+ * Undefined symbols of a binary are bound against a global index of
+ * the symbols the kernel registers, hashed with the GNU hash function
+ * and fronted by a bloom filter. Names it does not hold are looked up
+ * through the binary's own DT_GNU_HASH or DT_HASH table.
+ *
+ * PLT slots are bound lazily: GOT[2] points at MAGIC_PLTRESOLVE, the
+ * fault the first call through a slot takes is handed to
+ * elf_plt_resolve(), which binds it and sends the call on its way.
+ */
+
+#define MAX_SYMBOLS         1024    // most symbols the kernel registers.
+#define KSYM_NBUCKET        256     // buckets in the global index, a power of 2.
+#define KSYM_BLOOM_WORDS    64      // 4096 bits of bloom filter.
+#define KSYM_BLOOM_SHIFT    6       // second bloom bit, as in DT_GNU_HASH.
+
+/**
+ * Register a symbol for binaries to bind to.
+ * 'name' is not copied and must stay valid, kernel symbol names are
+ * string literals. Returns -EEXIST if it is already registered.
+ */
+extern int  register_symbol(const char *name, void *addr);
+
+// Lookup a symbol in the global symbol index.
+extern void *resolve_symbol(const char *name);
+
+/**
+ * Copy the tables the dynamic section 'dyn' of the locked 'binary'
+ * points at into 'img'. The segments of 'img' must be laid out.
+ */
+extern int  elf_dynamic_parse(inode_t *binary, exec_image_t *img, const Elf64_Dyn *dyn);
+
+/**
+ * Apply the relocations of 'img', just loaded into the locked and
+ * focused 'mmap', and set its PLT up for lazy binding.
+ */
+extern int  elf_relocate(exec_image_t *img, mmap_t *mmap);
+
+/*Bind the PLT slot a call to MAGIC_PLTRESOLVE asks for, 0 if it did.*/
+extern int  elf_plt_resolve(mcontext_t *trapframe);
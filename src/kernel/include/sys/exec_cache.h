@@ -0,0 +1,85 @@
+#pragma once
+
+#include <core/types.h>
+#include <ds/queue.h>
+#include <fs/inode.h>
+#include <sys/_elf.h>
+
+/**
+ * Exec image cache.
+ * Holds what the ELF loader parses out of a binary: its header, the
+ * layout of its PT_LOAD segments as a template of the regions to map,
+ * and what it found in PT_DYNAMIC. A binary launched again is loaded
+ * from the template with no iread() of its headers.
+ *
+ * Entries are keyed by inode and generation. Every write and truncate
+ * of the inode gives it a new generation and drops its entry. The
+ * least recently used entries go once the cache is over its memory cap.
+ */
+
+#define EXEC_CACHE_MAX_BYTES    (64 * 1024) // memory the cache may hold on to.
+
+/*A region to map for one PT_LOAD segment, laid out as elf_loader() maps it.*/
+typedef struct exec_segment {
+    uintptr_t   es_start;   // page aligned.
+    usize       es_size;    // page rounded.
+    int         es_prot;
+    off_t       es_file_pos;
+    usize       es_filesz;
+    usize       es_memsz;
+} exec_segment_t;
+
+typedef struct exec_image {
+    inode_t         *ei_inode;  // key, only compared, holds no reference.
+    ulong           ei_gen;     // key, ei_inode's i_gen when parsed.
+    atomic_t        ei_refcnt;  // the cache's reference and the loaders'.
+    usize           ei_bytes;   // memory charged to the cache.
+    queue_node_t    ei_lru;     // on the LRU, most recently used at the head.
+
+    Elf64_Ehdr      ei_ehdr;
+    int             ei_nseg;
+    exec_segment_t  *ei_segs;
+
+    /**
+     * Kernel copies of the tables PT_DYNAMIC points at, read from
+     * the file so that relocating never faults on the image itself.
+     * All NULL in a binary that is not dynamically linked.
+     */
+    Elf64_Sym       *ei_symtab;
+    u64             ei_nsym;
+    char            *ei_strtab;     // NUL terminated, even if the file's is not.
+    usize           ei_strsz;
+    Elf64_Rela      *ei_rela;       // DT_RELA, applied at load.
+    u64             ei_rela_count;
+    Elf64_Rela      *ei_jmprel;     // DT_JMPREL, bound lazily unless ei_bindnow.
+    u64             ei_jmprel_count;
+    Elf64_Addr      ei_pltgot;      // user address of the GOT.
+    bool            ei_bindnow;
+    u32             *ei_gnu_hash;   // the object's DT_GNU_HASH, or NULL.
+    u32             *ei_hash;       // its DT_HASH, used when there is no DT_GNU_HASH.
+} exec_image_t;
+
+// a new image with room for 'nseg' segments and a reference for the caller.
+extern int  exec_image_alloc(int nseg, exec_image_t **pimg);
+
+// another reference to 'img', which may be NULL.
+extern exec_image_t *exec_image_get(exec_image_t *img);
+
+/**
+ * Find the image of the locked 'binary' at its current generation.
+ * Returns -ENOENT on a miss, on a hit '*pimg' holds a reference
+ * dropped with exec_cache_put().
+ */
+extern int  exec_cache_lookup(inode_t *binary, exec_image_t **pimg);
+
+/**
+ * Cache 'img', parsed from the locked 'binary', making room for it.
+ * The caller keeps its reference. Returns -EEXIST if another
+ * loader got there first, the image is then only the caller's.
+ */
+extern int  exec_cache_insert(inode_t *binary, exec_image_t *img);
+
+extern void exec_cache_put(exec_image_t *img);
+
+/*Drop the image of the locked 'ip', called when its data changes.*/
+extern void exec_cache_invalidate(inode_t *ip);
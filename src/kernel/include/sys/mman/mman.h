@@ -8,5 +8,19 @@ extern void *mmap(void *__addr, size_t __len, int __prot,
 
 extern int munmap(void *addr, size_t length);
 extern int mprotect(void *addr, size_t len, int prot);
+extern int madvise(void *addr, size_t len, int advice);
+extern int msync(void *addr, size_t len, int flags);
+extern void *mremap(void *old_address, size_t old_size,
+                    size_t new_size, int flags, void *new_address);
+
+extern int mlock(const void *addr, size_t len);
+extern int mlock2(const void *addr, size_t len, unsigned int flags);
+extern int munlock(const void *addr, size_t len);
+extern int mlockall(int flags);
+extern int munlockall(void);
+
+extern int set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+extern int get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode,
+                    void *addr, unsigned long flags);
 
 extern void *sbrk(intptr_t increment);
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <sys/proc.h>
+#include <sys/thread.h>
+
+/**
+ * PID, PGID and TID lookup tables.
+ * Processes are hashed on their PID and again on their process group,
+ * threads on their TID, chained through links embedded in proc_t and
+ * thread_t. Each bucket has its own lock, lookups of different IDs
+ * never meet and none of them takes procQ's or the global thread
+ * queue's lock.
+ *
+ * Insertion and removal may be called with the task locked, so a
+ * lookup, which holds the bucket, only ever trylocks the task it
+ * found and starts over if that fails.
+ */
+
+#define PIDHASH_NBUCKET     1024    // buckets per table, a power of 2.
+
+// Hash the locked 'proc' on its PID and process group.
+extern int  pidhash_insert(proc_t *proc);
+
+// Take the locked 'proc' out of both process tables.
+extern void pidhash_remove(proc_t *proc);
+
+// Move the locked 'proc' to process group 'pgid'.
+extern void pidhash_setpgid(proc_t *proc, pid_t pgid);
+
+/**
+ * Find the process 'pid'. If 'ref' is not NULL the process is
+ * returned in it locked and with a reference held.
+ * -EDEADLK if the caller already holds its lock.
+ */
+extern int  pidhash_find(pid_t pid, proc_t **ref);
+
+/**
+ * Find a process in process group 'pgid', as pidhash_find() does.
+ * Members of the group the caller has locked are passed over.
+ */
+extern int  pgidhash_find(pid_t pgid, proc_t **ref);
+
+// Hash the locked 'thread' on its TID.
+extern int  tidhash_insert(thread_t *thread);
+
+// Take the locked 'thread' out of the TID table.
+extern void tidhash_remove(thread_t *thread);
+
+/**
+ * Find the thread 'tid', returned locked in '*ptp' if 'ptp' is not NULL.
+ * -EDEADLK if the caller already holds its lock.
+ */
+extern int  tidhash_find(tid_t tid, thread_t **ptp);
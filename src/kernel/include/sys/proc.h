@@ -5,6 +5,7 @@
 #include <ds/queue.h>
 #include <fs/cred.h>
 #include <mm/mmap.h>
+#include <mm/numa.h>
 #include <sync/cond.h>
 #include <sync/spinlock.h>
 #include <sys/thread.h>
@@ -49,11 +50,19 @@ typedef struct __proc_t {
     thread_t        *main_thread;
 
     queue_node_t    proc_qnode;
+    proc_t          *pid_hnext;     // next in the PID table's bucket.
+    proc_t          *pgid_hnext;    // next in the PGID table's bucket.
 
     queue_node_t    child_qnode;
     queue_t         children;       // process' children queue.
 
+    queue_node_t    exit_qnode;     // on the parent's 'exited' queue.
+    queue_t         exited;         // children that exited and were not waited for, oldest first.
+
     cond_t          child_event;    // process' child wait-event condition.
+    cond_t          vfork_event;    // a vfork()ed child gave our address space back.
+
+    mempolicy_t     mempolicy;      // NUMA nodes the process' memory comes from.
 
     spinlock_t      lock;           // lock to protect this structure.
 } proc_t;
@@ -65,6 +74,7 @@ typedef struct __proc_t {
 #define PROC_KILLED             BS(2)   // process killed.
 #define PROC_ORPHANED           BS(3)   // process was orphaned by parent.
 #define PROC_REAP               BS(5)   // process struct marked for reaping.
+#define PROC_VFORKED            BS(6)   // process runs on its parent's address space.
 
 #define curproc                 ({ current ? current->t_proc : (proc_t *)NULL; })                //
 
@@ -201,12 +211,49 @@ extern int procQ_remove(proc_t *proc);
 extern int procQ_search_bypid(pid_t pid, proc_t **ref);
 extern int procQ_search_bypgid(pid_t pgid, proc_t **ref);
 
+/**
+ * Take or drop a use of 'id' as a PID, process group or session.
+ * procQ_remove() only hands a PID out again after the last use.
+ */
+extern void proc_pid_get(pid_t id);
+extern void proc_pid_put(pid_t id);
+
+// Move the locked 'proc' to session 'sid'.
+extern void proc_setsid(proc_t *proc, pid_t sid);
+
 extern void proc_free(proc_t *proc);
 extern int proc_init(const char *initpath);
 extern int do_fork(proc_t *child, proc_t *parent);
 extern int proc_alloc(const char *name, proc_t **pref);
 extern int exec_load_image(const char *pathname, mmap_t *mmap);
 
+// what copy_proc() does with the parent's address space.
+#define COPY_PROC_FORK          0   // copy it, fork().
+#define COPY_PROC_VFORK         1   // share it, vfork().
+#define COPY_PROC_SPAWN         2   // leave it be, the child keeps its own empty one.
+
+/**
+ * Make the locked 'child' a child of the locked 'parent',
+ * with a copy of its file table, credentials and memory policy.
+ */
+extern int copy_proc(proc_t *child, proc_t *parent, int how);
+
+/**
+ * Undo proc_alloc() and copy_proc(), or as much of it as was done,
+ * for a 'child' of 'parent' that never ran: take it off the parent's
+ * children and procQ, drop its reference on the parent and free it
+ * along with its main thread, giving its PID and TID back. Called
+ * with both locked, returns with 'parent' still locked.
+ */
+extern void discard_proc(proc_t *child, proc_t *parent);
+
+/**
+ * Called with 'proc' locked by a vfork()ed child once it no longer
+ * runs on its parent's address space, at exec() or exit().
+ * Does nothing if 'proc' was not vfork()ed.
+ */
+extern void vfork_done(proc_t *proc);
+
 /**
  * @brief Describes flags to search for the child.
  * using int proc_get_child();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <core/types.h>
+
+/**
+ * posix_spawn(): start a program in a new process without fork().
+ * The child gets a copy of the caller's file table, to which the file
+ * actions are applied in order, and a fresh address space the image is
+ * loaded straight into. Nothing of the caller's address space is copied.
+ */
+
+#define SPAWN_NACTION           16  // most file actions one spawn() takes.
+
+#define SPAWN_FA_CLOSE          0   // close(sfa_fd).
+#define SPAWN_FA_DUP2           1   // dup2(sfa_srcfd, sfa_fd).
+#define SPAWN_FA_OPEN           2   // open(sfa_path, sfa_oflags, sfa_mode) as sfa_fd.
+
+typedef struct spawn_file_action {
+    int         sfa_type;
+    int         sfa_fd;     // descriptor acted on, the new one for dup2 and open.
+    int         sfa_srcfd;  // SPAWN_FA_DUP2: descriptor to duplicate.
+    int         sfa_oflags; // SPAWN_FA_OPEN: open flags.
+    mode_t      sfa_mode;   // SPAWN_FA_OPEN: mode of a file it creates.
+    const char  *sfa_path;  // SPAWN_FA_OPEN: path, relative to the caller's cwd.
+} spawn_file_action_t;
+
+/**
+ * Run 'path' in a new child of the calling process.
+ * Returns the child's pid, or an error if the child
+ * could not be set up, in which case it never runs.
+ */
+extern pid_t spawn(const char *path, const spawn_file_action_t *actions,
+    int nactions, char *const argv[], char *const envp[]);
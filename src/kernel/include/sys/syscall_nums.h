@@ -61,6 +61,9 @@
 #define SYS_ptrace              65  // long sys_ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data);
 #define SYS_execve              66  // int sys_execve(const char *pathname, char *const argv[], char *const envp[]);
 #define SYS_wait4               67  // pid_t sys_wait4(pid_t pid, int *wstatus, int options, void /*struct rusage*/ *rusage);
+#define SYS_vfork               68  // pid_t sys_vfork(void);
+#define SYS_spawn               69  // pid_t sys_spawn(const char *path, const spawn_file_action_t *actions, int nactions, char *const argv[], char *const envp[]);
+#define SYS_waitbatch           70  // int sys_waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options);
 
 /* Thread management syscalls */
 
@@ -111,6 +114,8 @@
 #define SYS_mremap              141  // void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
 #define SYS_madvise             142  // int sys_madvise(void *addr, size_t length, int advice);
 #define SYS_sbrk                143  // void *sys_sbrk(intptr_t increment);
+#define SYS_set_mempolicy       144  // int sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+#define SYS_get_mempolicy       145  // int sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags);
 
 /** Miscelleneous syscalls */
 
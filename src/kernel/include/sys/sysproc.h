@@ -1,8 +1,10 @@
 #pragma once
 
 #include <core/types.h>
+#include <sys/spawn.h>
 
 pid_t fork(void);
+pid_t vfork(void);
 void exit(int status);
 pid_t getpid(void);
 pid_t getppid(void);
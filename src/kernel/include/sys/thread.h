@@ -8,6 +8,7 @@
 #include <fs/fs.h>
 #include <fs/file.h>
 #include <mm/mmap.h>
+#include <mm/reclaim.h>
 #include <sync/cond.h>
 #include <sync/event.h>
 #include <sync/spinlock.h>
@@ -28,11 +29,28 @@ extern queue_t *global_thread_queue;
 #define KSTACK_SIZE     KiB(32)
 #define KSTACK_MAXSIZE  KiB(256)
 
+/**
+ * @brief Freed KSTACK_SIZE stacks each CPU keeps, still mapped,
+ * for the next thread it creates. */
+#define KSTACK_CACHE_MAX    8
+
+/**
+ * @brief Gives the cached kernel stacks back under memory pressure. */
+extern shrinker_t kstack_shrinker;
+
+/**
+ * @brief Most bytes argv and envp, strings and vectors, may take. */
+#define EXEC_ARGS_MAX   MiB(2)
+
 /**
  * @brief User stack size. */
 #define USTACK_SIZE     KiB(32)
 #define USTACK_MAXSIZE  KiB(512)
 
+/**
+ * @brief Threads that can exist at once, TIDs are below this. */
+#define NTHREAD         (65536)
+
 /*=====================================================================
  *  Thread and Process States
  *====================================================================*/
@@ -107,6 +125,7 @@ typedef struct thread_sched_t {
     int         ts_priority;    /**< Scheduling priority (can be static or dynamic) */
     cpu_t       *ts_proc;       /**< Pointer to the current processor */
     cpu_affin_t ts_affin;       /**< CPU affinity information */
+    int         ts_node;        /**< Home NUMA node, where the thread last ran */
 
 
     /* Additional metrics for advanced scheduling could be added here:
@@ -173,6 +192,7 @@ typedef struct thread_t {
 
     queue_node_t    t_global_qnode; /**< Global Queue node for this thread */
     queue_node_t    t_group_qnode;  /**< Queue node for this thread group */
+    thread_t        *t_tid_hnext;   /**< Next in the TID table's bucket */
 
     queue_t         *t_run_queue;
     queue_node_t    t_run_qnode;    /**< Run Queue node for this thread */
@@ -401,7 +421,22 @@ extern tid_t    thread_self(void);
 extern int      thread_cancel(tid_t tid);
 extern void     thread_exit(uintptr_t status);
 extern int      thread_join(tid_t tid, thread_info_t *info, void **prp);
-extern int      thread_execve(thread_t *thread, char *const argp[], char *const envp[]);
+extern int      thread_execve(thread_t *thread, const exec_args_t *args);
+
+/**
+ * @brief Stage 'argv' and 'envv' for thread_execve().
+ *
+ * Measures the strings, then copies them straight from the caller
+ * into one buffer sized for all of them, and their vectors. Both must
+ * be readable, the caller's address space still in focus.
+ *
+ * @return 0 on success, -E2BIG if they take more than EXEC_ARGS_MAX,
+ * or -ENOMEM.
+ */
+extern int      exec_args_copy(char *const argv[], char *const envv[], exec_args_t *args);
+
+// Free what exec_args_copy() staged in 'args'.
+extern void     exec_args_free(exec_args_t *args);
 extern int      thread_create(thread_attr_t *attr, thread_entry_t entry, void *arg, int cflags, thread_t **ptp);
 
 extern int      current_check_interrupted(wakeup_t *preason);
@@ -447,6 +482,7 @@ extern int      thread_alloc(usize stack_size, int cflags, thread_t **ptp);
 extern int      builtin_thread_init(void);
 
 extern pid_t    fork(void);
+extern pid_t    vfork(void);
 extern pid_t    getpid(void);
 extern void     exit(int status);
 extern pid_t    getppid(void);
@@ -0,0 +1,176 @@
+#include <bits/errno.h>
+#include <lib/lz4.h>
+#include <string.h>
+
+#define LZ4_MINMATCH        4
+#define LZ4_MFLIMIT         12  // a match may not start in the last 12 bytes.
+#define LZ4_LASTLITERALS    5   // and the last 5 bytes are always literals.
+#define LZ4_MAX_OFFSET      65535
+#define LZ4_RUN_MASK        15
+
+static inline u32 lz4_read32(const u8 *p) {
+    u32 v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline u32 lz4_hash(u32 v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASHLOG);
+}
+
+/*Emit the 255-byte continuation of a length that saturated its nibble.*/
+static inline u8 *lz4_write_len(u8 *op, usize len) {
+    for (len -= LZ4_RUN_MASK; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (u8)len;
+    return op;
+}
+
+/*Token, length bytes and literals of a sequence carrying 'litlen' literals.*/
+static inline usize lz4_literals_size(usize litlen) {
+    return 1 + (litlen / 255) + 1 + litlen;
+}
+
+int lz4_compress(const void *src, usize srclen, void *dst, usize dstcap, void *wrkmem) {
+    usize       litlen  = 0, mlen = 0;
+    u16         *table  = wrkmem;
+    const u8    *base   = src;
+    const u8    *ip     = base, *anchor = base, *ref = NULL, *mp = NULL;
+    const u8    *iend   = base + srclen;
+    const u8    *mflimit    = iend - LZ4_MFLIMIT;
+    const u8    *matchlimit = iend - LZ4_LASTLITERALS;
+    u8          *op     = dst, *token = NULL;
+    u8          *oend   = (u8 *)dst + dstcap;
+
+    if (src == NULL || dst == NULL || wrkmem == NULL || srclen > LZ4_MAX_INPUT)
+        return -EINVAL;
+
+    if (srclen <= LZ4_MFLIMIT)
+        goto last_literals;
+
+    memset(table, 0, LZ4_WRKMEM_SIZE);
+    table[lz4_hash(lz4_read32(ip++))] = 0;
+
+    while (ip < mflimit) {
+        const u32 h = lz4_hash(lz4_read32(ip));
+
+        ref      = base + table[h];
+        table[h] = (u16)(ip - base);
+
+        if ((ip - ref) > LZ4_MAX_OFFSET || lz4_read32(ref) != lz4_read32(ip)) {
+            ip++;
+            continue;
+        }
+
+        // grow the match backwards over literals we have not emitted.
+        while (ip > anchor && ref > base && ip[-1] == ref[-1])
+            ip--, ref--;
+
+        for (mp = ip + LZ4_MINMATCH; mp < matchlimit && *mp == ref[mp - ip]; ++mp);
+
+        litlen = ip - anchor;
+        mlen   = mp - ip - LZ4_MINMATCH;
+
+        if ((usize)(oend - op) < lz4_literals_size(litlen) + 2 + (mlen / 255) + 1)
+            return -E2BIG;
+
+        token  = op++;
+        *token = (u8)((litlen >= LZ4_RUN_MASK ? LZ4_RUN_MASK : litlen) << 4);
+        if (litlen >= LZ4_RUN_MASK)
+            op = lz4_write_len(op, litlen);
+
+        memcpy(op, anchor, litlen);
+        op += litlen;
+
+        *op++ = (u8)((ip - ref) & 0xFF);
+        *op++ = (u8)((ip - ref) >> 8);
+
+        *token |= (u8)(mlen >= LZ4_RUN_MASK ? LZ4_RUN_MASK : mlen);
+        if (mlen >= LZ4_RUN_MASK)
+            op = lz4_write_len(op, mlen);
+
+        ip = anchor = mp;
+
+        // index the tail of the match so back-to-back repeats are found.
+        if (ip < mflimit)
+            table[lz4_hash(lz4_read32(ip - 2))] = (u16)(ip - 2 - base);
+    }
+
+last_literals:
+    litlen = iend - anchor;
+
+    if ((usize)(oend - op) < lz4_literals_size(litlen))
+        return -E2BIG;
+
+    token  = op++;
+    *token = (u8)((litlen >= LZ4_RUN_MASK ? LZ4_RUN_MASK : litlen) << 4);
+    if (litlen >= LZ4_RUN_MASK)
+        op = lz4_write_len(op, litlen);
+
+    memcpy(op, anchor, litlen);
+    op += litlen;
+
+    return (int)(op - (u8 *)dst);
+}
+
+/*Read the continuation bytes of a saturated length into '*plen'.*/
+static inline int lz4_read_len(const u8 **pip, const u8 *iend, usize *plen) {
+    u8 b = 0;
+
+    do {
+        if (*pip >= iend)
+            return -EINVAL;
+        b = *(*pip)++;
+        *plen += b;
+    } while (b == 255);
+
+    return 0;
+}
+
+int lz4_decompress(const void *src, usize srclen, void *dst, usize dstcap) {
+    u8          token   = 0;
+    usize       len     = 0, off = 0;
+    const u8    *ip     = src, *iend = (const u8 *)src + srclen, *m = NULL;
+    u8          *op     = dst, *oend = (u8 *)dst + dstcap;
+
+    if (src == NULL || dst == NULL)
+        return -EINVAL;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        if ((len = token >> 4) == LZ4_RUN_MASK && lz4_read_len(&ip, iend, &len))
+            return -EINVAL;
+
+        if (len > (usize)(iend - ip) || len > (usize)(oend - op))
+            return -EINVAL;
+
+        memcpy(op, ip, len);
+        op += len, ip += len;
+
+        // the last sequence has no match.
+        if (ip == iend)
+            break;
+
+        if ((iend - ip) < 2)
+            return -EINVAL;
+
+        off = ip[0] | ((usize)ip[1] << 8);
+        ip += 2;
+
+        if (off == 0 || off > (usize)(op - (u8 *)dst))
+            return -EINVAL;
+
+        if ((len = token & LZ4_RUN_MASK) == LZ4_RUN_MASK && lz4_read_len(&ip, iend, &len))
+            return -EINVAL;
+
+        if ((len += LZ4_MINMATCH) > (usize)(oend - op))
+            return -EINVAL;
+
+        // byte by byte, the match may overlap what it produces.
+        for (m = op - off; len--; )
+            *op++ = *m++;
+    }
+
+    return (int)(op - (u8 *)dst);
+}
@@ -0,0 +1,298 @@
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <mm/compaction.h>
+#include <mm/mmap.h>
+#include <mm/page.h>
+#include <mm/vmstat.h>
+#include <mm/zone.h>
+#include <sync/atomic.h>
+#include <sync/cond.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+
+/**
+ * *******************************************************************
+ * @brief   Memory compaction and kcompactd.                          *
+ * *******************************************************************/
+
+/**
+ * State of one compaction of 'zone'.
+ * Blocks are cleared from the bottom of the zone up while the frames
+ * their pages move to are taken from the top down, from 'free_cursor'.
+ * 'floor' is the end of the block being cleared, nothing moves below it.
+ */
+typedef struct compact_control {
+    zone_t  *zone;
+    usize   floor;
+    usize   free_cursor;
+    usize   migrated;
+} compact_control_t;
+
+// one compaction at a time, two would only trade pages.
+static SPINLOCK(compact_lock);
+
+static COND_VAR(kcompactd_wait);
+static atomic_t kcompactd_running = 0;
+static atomic_t kcompactd_pending = 0;
+
+static int compact_alloc(void *arg, uintptr_t *ppa) {
+    int                 err     = 0;
+    page_t              *page   = NULL;
+    compact_control_t   *cc     = arg;
+
+    if ((err = zone_alloc_highest(cc->zone, cc->floor, &cc->free_cursor, &page)))
+        return err;
+
+    *ppa = page_to_phys(page);
+    return 0;
+}
+
+/**
+ * Look at the 'npage' frames from 'index' on and count the page
+ * cache pages and private user pages in use there, in '*pcache'
+ * and '*panon'. Returns -EBUSY if any in-use frame is neither,
+ * a block holding one can never be freed. Lock free, the counts
+ * are only a guide to what is worth trying.
+ */
+static int compact_block_scan(zone_t *zone, usize index, usize npage,
+    usize *pcache, usize *panon) {
+    ulong   flags   = 0;
+    usize   count   = 0;
+    page_t  *page   = NULL;
+
+    *pcache = *panon = 0;
+
+    for (usize i = index; i < index + npage; ++i) {
+        page  = zone_page(zone, i);
+        count = atomic_read(&page->refcnt);
+        flags = atomic_read(&page->flags);
+
+        if (count == 0)
+            continue;
+
+        if (count > 1 || (flags & (PG_RESERVED | PG_PIN_MASK)))
+            return -EBUSY;
+
+        if (page->icache)
+            *pcache += 1;
+        else if (flags & PG_MOVABLE)
+            *panon += 1;
+        else
+            return -EBUSY;
+    }
+
+    return 0;
+}
+
+/*Only regions whose pages nobody else can see, faulted in by us.*/
+static bool vmr_movable(vmr_t *vmr) {
+    if (__vmr_shared(vmr) || __vmr_locked(vmr))
+        return false;
+
+    return vmr->vmops == NULL || vmr->vmops->fault_handler == NULL;
+}
+
+/*Called with mmap locked.*/
+static usize compact_mmap(compact_control_t *cc, mmap_t *mmap, uintptr_t lo, uintptr_t hi) {
+    usize       moved   = 0;
+    uintptr_t   oldpdbr = 0;
+
+    if (mmap->pgdir == 0)
+        return 0;
+
+    arch_switch_pgdir(mmap->pgdir, &oldpdbr);
+
+    for (vmr_t *vmr = mmap->vmr_head; vmr; vmr = vmr->next) {
+        if (vmr_movable(vmr))
+            moved += arch_migrate_range(__vmr_start(vmr), __vmr_size(vmr),
+                lo, hi, compact_alloc, cc);
+    }
+
+    arch_switch_pgdir(oldpdbr, NULL);
+    return moved;
+}
+
+/**
+ * Move the private user pages in physical [lo, hi) out, up to 'nr'.
+ * Without a reverse map every address space has to be looked through.
+ */
+static usize compact_anon(compact_control_t *cc, uintptr_t lo, uintptr_t hi, usize nr) {
+    usize   moved   = 0;
+    proc_t  *proc   = NULL;
+
+    // the allocator may call us with the process queue held.
+    if (!queue_trylock(procQ))
+        return 0;
+
+    foreach_process(procQ, proc) {
+        if (proc == curproc || !spin_trylock(&proc->lock))
+            continue;
+
+        if (proc_testflags(proc, PROC_USER) && proc->mmap && mmap_trylock(proc->mmap)) {
+            moved += compact_mmap(cc, proc->mmap, lo, hi);
+            mmap_unlock(proc->mmap);
+        }
+
+        proc_unlock(proc);
+
+        if (moved >= nr)
+            break;
+    }
+
+    queue_unlock(procQ);
+    return moved;
+}
+
+/*Move the page cache pages of the block out, one at a time.*/
+static usize compact_cache(compact_control_t *cc, usize index, usize npage) {
+    usize       moved   = 0;
+    uintptr_t   pa      = 0;
+    page_t      *page   = NULL;
+
+    for (usize i = index; i < index + npage; ++i) {
+        page = zone_page(cc->zone, i);
+
+        if (page->icache == NULL || atomic_read(&page->refcnt) != 1)
+            continue;
+
+        if (compact_alloc(cc, &pa))
+            break;
+
+        if (page_lru_migrate(page, phys_to_page(pa))) {
+            __page_free(pa);
+            continue;
+        }
+
+        moved++;
+    }
+
+    return moved;
+}
+
+/*Try to empty the block of 'npage' frames at 'index', 0 if it is.*/
+static int compact_block(compact_control_t *cc, usize index, usize npage) {
+    usize       ncache  = 0;
+    usize       nanon   = 0;
+    uintptr_t   lo      = page_to_phys(zone_page(cc->zone, index));
+
+    if (compact_block_scan(cc->zone, index, npage, &ncache, &nanon))
+        return -EBUSY;
+
+    cc->floor = index + npage;
+
+    if (ncache)
+        cc->migrated += compact_cache(cc, index, npage);
+
+    if (nanon)
+        cc->migrated += compact_anon(cc, lo, lo + npage * PGSZ, nanon);
+
+    // pages freed under us are just as good.
+    for (usize i = index; i < index + npage; ++i) {
+        if (atomic_read(&zone_page(cc->zone, i)->refcnt))
+            return -EBUSY;
+    }
+
+    return 0;
+}
+
+int compact_zone(zone_t *zone, usize order) {
+    int                 err     = -ENOMEM;
+    usize               tried   = 0;
+    usize               npage   = BS(order);
+    compact_control_t   cc      = {0};
+
+    if (zone == NULL || order == 0 || order >= NR_ORDER)
+        return -EINVAL;
+
+    // too little free for the block, that is reclaim's job.
+    if (zone->npages == 0 || zone_free_pages(zone) < npage)
+        return -ENOMEM;
+
+    if (!spin_trylock(compact_lock))
+        return -EBUSY;
+
+    cc.zone         = zone;
+    cc.free_cursor  = zone->npages;
+
+    // blocks are aligned physically, as the allocator wants them.
+    // stop where the two scanners meet, past it we would move pages down.
+    for (usize index = ALIGN_UP(zone_start_pfn(zone), npage) - zone_start_pfn(zone);
+        index + npage <= cc.free_cursor &&
+        tried < COMPACT_MAX_BLOCKS; index += npage) {
+        usize ncache = 0, nanon = 0;
+
+        if (compact_block_scan(zone, index, npage, &ncache, &nanon))
+            continue;
+
+        // a free block turned up since the allocation failed.
+        if (ncache + nanon == 0) {
+            err = 0;
+            break;
+        }
+
+        tried++;
+        if ((err = compact_block(&cc, index, npage)) == 0)
+            break;
+
+        err = -ENOMEM;
+    }
+
+    spin_unlock(compact_lock);
+
+    vmstat_add(compact_migrated, cc.migrated);
+    if (err)
+        vmstat_inc(compact_fail);
+    else
+        vmstat_inc(compact_success);
+
+    return err;
+}
+
+void compaction_wakeup(void) {
+    if (!atomic_read(&kcompactd_running))
+        return;
+
+    // one signal per round, kcompactd clears this before it looks at the zones.
+    if (atomic_xchg(&kcompactd_pending, 1) == 0) {
+        vmstat_inc(kcompactd_wakeups);
+        cond_signal(kcompactd_wait);
+    }
+}
+
+/**
+ * Compact the zones where a huge page would fail for fragmentation
+ * rather than lack of memory. Returns how many blocks it opened up.
+ */
+static usize compact_proactive(void) {
+    usize   opened  = 0;
+    zone_t  *zone   = NULL;
+    usize   counts[NR_ORDER];
+
+    for (zone = zones; zone < &zones[NZONES]; ++zone) {
+        if (zone->npages == 0)
+            continue;
+
+        zone_free_blocks(zone, counts);
+        if (zone_fragmentation_index(counts, COMPACT_PROACTIVE_ORDER) <
+            COMPACT_PROACTIVE_THRESHOLD)
+            continue;
+
+        if (compact_zone(zone, COMPACT_PROACTIVE_ORDER) == 0)
+            opened++;
+    }
+
+    return opened;
+}
+
+static void kcompactd(void) {
+    atomic_write(&kcompactd_running, 1);
+
+    loop_and_yield() {
+        atomic_write(&kcompactd_pending, 0);
+
+        // sleep when no zone is fragmented or nothing could be moved,
+        // the next failed high-order allocation or reclaim wakes us.
+        if (compact_proactive() == 0)
+            cond_wait(kcompactd_wait, NULL, NULL);
+    }
+} BUILTIN_THREAD(kcompactd, kcompactd, NULL);
@@ -221,8 +221,10 @@ static struct liballoc_major *allocate_new_page(unsigned int size)
 }
 
 #include <lib/printk.h>
+#include <dev/tsc.h>
+#include <mm/vmstat.h>
 
-void *PREFIX(malloc)(size_t req_size)
+static void *liballoc_malloc(size_t req_size)
 {
 	int startedBet = 0;
 	unsigned long long bestSize = 0;
@@ -252,7 +254,7 @@ void *PREFIX(malloc)(size_t req_size)
 // FLUSH();
 #endif
 		liballoc_unlock();
-		return PREFIX(malloc)(1);
+		return liballoc_malloc(1);
 	}
 
 	if (l_memRoot == NULL)
@@ -555,6 +557,15 @@ void *PREFIX(malloc)(size_t req_size)
 	return NULL;
 }
 
+void *PREFIX(malloc)(size_t req_size)
+{
+	time_t start = tsc_get();
+	void *p = liballoc_malloc(req_size);
+
+	latency_hist_add(&vmstat.kmalloc_lat, tsc_get() - start);
+	return p;
+}
+
 void PREFIX(free)(void *ptr)
 {
 	struct liballoc_minor *min;
@@ -0,0 +1,209 @@
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <fs/icache.h>
+#include <fs/inode.h>
+#include <mm/mmap.h>
+
+/**
+ * *******************************************************************
+ * @brief   madvise() and msync().                                   *
+ * *******************************************************************/
+
+/*Validate and page align [addr, addr + len), '*pend' gets the last byte.*/
+static int mmap_range(mmap_t *mmap, uintptr_t addr, size_t len, uintptr_t *pend) {
+    if (mmap == NULL || !__isaligned(addr) || len == 0) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    *pend = addr + PGROUNDUP(len) - 1;
+
+    if (*pend < addr || !__valid_addr(*pend)) {
+        return -ENOMEM;
+    }
+
+    return mmap_range_mapped(mmap, addr, *pend);
+}
+
+/*Read the file pages behind [start, end] of 'vmr' into the page cache.*/
+static int vmr_willneed(vmr_t *vmr, uintptr_t start, uintptr_t end) {
+    int     err     = 0;
+    page_t  *page   = NULL;
+    usize   size    = 0;
+    off_t   pgno    = 0, last = 0;
+
+    if (!__vmr_filebacked(vmr) || vmr->file->i_cache == NULL) {
+        return 0;
+    }
+
+    ilock(vmr->file);
+
+    // no further than the end of the file.
+    if ((size = igetsize(vmr->file)) != 0) {
+        pgno = (start - __vmr_start(vmr) + vmr->file_pos) / PGSZ;
+        last = (end - __vmr_start(vmr) + vmr->file_pos) / PGSZ;
+        last = last < (size - 1) / PGSZ ? last : (size - 1) / PGSZ;
+
+        icache_lock(vmr->file->i_cache);
+        for (; pgno <= last; ++pgno) {
+            if ((err = icache_getpage(vmr->file->i_cache, pgno, &page))) {
+                break;
+            }
+        }
+        icache_unlock(vmr->file->i_cache);
+    }
+
+    iunlock(vmr->file);
+    return err;
+}
+
+int mmap_advise(mmap_t *mmap, uintptr_t addr, size_t len, int advice) {
+    int         err = 0;
+    vmr_t       *r  = NULL;
+    uintptr_t   end = 0, start = 0, last = 0;
+
+    if ((err = mmap_range(mmap, addr, len, &end))) {
+        return err;
+    }
+
+    // reject the advice before touching anything.
+    for (start = addr; start <= end; start = __vmr_upper_bound(r)) {
+        r = mmap_find(mmap, start);
+
+        switch (advice) {
+        case MADV_NORMAL:
+        case MADV_RANDOM:
+        case MADV_SEQUENTIAL:
+        case MADV_WILLNEED:
+            break;
+        case MADV_DONTNEED:
+            if (__vmr_locked(r)) {
+                return -EINVAL;
+            }
+            break;
+        case MADV_FREE:
+            // only private anonymous memory can be thrown away unseen.
+            if (__vmr_locked(r) || __vmr_shared(r) || r->file || r->vmops) {
+                return -EINVAL;
+            }
+            break;
+        default:
+            return -EINVAL;
+        }
+    }
+
+    for (start = addr; start <= end; start = last + 1) {
+        r       = mmap_find(mmap, start);
+        last    = r->end < end ? r->end : end;
+
+        switch (advice) {
+        case MADV_WILLNEED:
+            if ((err = vmr_willneed(r, start, last))) {
+                return err;
+            }
+            continue;
+        case MADV_DONTNEED:
+            // the next touch faults in zeroes, or the file's contents.
+            if ((err = arch_unmap_n(start, (last - start) + 1))) {
+                return err;
+            }
+            continue;
+        }
+
+        if ((err = vmr_isolate(r, start, last, &r))) {
+            return err;
+        }
+
+        switch (advice) {
+        case MADV_NORMAL:
+            r->flags &= ~(VM_SEQ_READ | VM_RAND_READ);
+            break;
+        case MADV_RANDOM:
+            r->flags &= ~VM_SEQ_READ;
+            r->flags |= VM_RAND_READ;
+            break;
+        case MADV_SEQUENTIAL:
+            r->flags &= ~VM_RAND_READ;
+            r->flags |= VM_SEQ_READ;
+            break;
+        case MADV_FREE:
+            // pages stay mapped until reclaim finds them still clean.
+            r->flags |= VM_LAZYFREE;
+            arch_lazyfree_range(start, (last - start) + 1);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Hand the dirty bits of the shared file pages mapped in [start, end]
+ * over to the page cache, and write them back if 'sync'.
+ */
+static int vmr_sync(vmr_t *vmr, uintptr_t start, uintptr_t end, bool sync) {
+    int     err     = 0;
+    page_t  *page   = NULL;
+    icache_t *icache= NULL;
+
+    if (!__vmr_shared(vmr) || !__vmr_filebacked(vmr) ||
+        (icache = vmr->file->i_cache) == NULL || PGOFF(vmr->file_pos)) {
+        return 0;
+    }
+
+    ilock(vmr->file);
+    icache_lock(icache);
+
+    for (uintptr_t va = start; va <= end; va += PGSZ) {
+        if (!arch_test_and_clear_dirty(va)) {
+            continue;
+        }
+
+        if (icache_lookup(icache, (va - __vmr_start(vmr) + vmr->file_pos) / PGSZ, &page)) {
+            continue;
+        }
+
+        page_setdirty(page);
+
+        if (sync && (err = icache_writeback(icache, page))) {
+            break;
+        }
+    }
+
+    icache_unlock(icache);
+    iunlock(vmr->file);
+
+    return err;
+}
+
+int mmap_sync(mmap_t *mmap, uintptr_t addr, size_t len, int flags) {
+    int         err = 0;
+    vmr_t       *r  = NULL;
+    uintptr_t   end = 0;
+
+    if (flags & ~(MS_ASYNC | MS_SYNC | MS_INVALIDATE)) {
+        return -EINVAL;
+    }
+
+    if ((flags & MS_ASYNC) && (flags & MS_SYNC)) {
+        return -EINVAL;
+    }
+
+    if ((err = mmap_range(mmap, addr, len, &end))) {
+        return err;
+    }
+
+    // MS_ASYNC only marks the cache pages dirty, they go out when
+    // evicted. MS_INVALIDATE has nothing to do: mappings of the cache
+    // see every write to the file already.
+    for (uintptr_t start = addr; start <= end; start = __vmr_upper_bound(r)) {
+        r = mmap_find(mmap, start);
+
+        if ((err = vmr_sync(r, start, r->end < end ? r->end : end, flags & MS_SYNC))) {
+            return err;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,164 @@
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <mm/mmap.h>
+
+/**
+ * *******************************************************************
+ * @brief   mlock() and friends.                                     *
+ * VM_LOCKED keeps swap-out away from a region. Every frame mapped   *
+ * in one holds a pin of that mapping: taken here for what is there  *
+ * already, by handle_vmr_fault() for what faults in later, and      *
+ * dropped on munlock() or when the region is unmapped.              *
+ * *******************************************************************/
+
+/*Lock or unlock the regions in [addr, end], splitting off what is outside.*/
+static int mmap_setlocked(mmap_t *mmap, uintptr_t addr, uintptr_t end, bool lock, bool onfault) {
+    int         err     = 0;
+    vmr_t       *r      = NULL;
+    uintptr_t   last    = 0;
+
+    mmap_assert_locked(mmap);
+
+    if ((err = mmap_range_mapped(mmap, addr, end))) {
+        return err;
+    }
+
+    for (uintptr_t start = addr; start <= end; start = last + 1) {
+        r       = mmap_find(mmap, start);
+        last    = r->end < end ? r->end : end;
+
+        if (__vmr_locked(r) != lock && (err = vmr_isolate(r, start, last, &r))) {
+            return err;
+        }
+
+        if (!lock) {
+            if (__vmr_locked(r)) {
+                r->flags &= ~VM_LOCKED;
+                arch_pin_range(start, (last - start) + 1, false);
+            }
+            continue;
+        }
+
+        // a region locked already holds its pins.
+        if (!__vmr_locked(r)) {
+            if ((err = arch_pin_range(start, (last - start) + 1, true))) {
+                return err;
+            }
+            r->flags |= VM_LOCKED;
+        }
+
+        // MLOCK_ONFAULT: swap-out keeps away all the same.
+        // stacks too, faulting one in whole would map its guard page.
+        if (onfault || __vmr_isstack(r)) {
+            continue;
+        }
+
+        // the faults pin what they map.
+        if ((err = vmr_populate(r, start, last))) {
+            return err == -EFAULT ? -ENOMEM : err;
+        }
+    }
+
+    return 0;
+}
+
+/*Page align [addr, addr + len), the start rounded down as mlock() allows.*/
+static int mlock_range(uintptr_t *paddr, size_t len, uintptr_t *pend) {
+    uintptr_t addr = *paddr;
+
+    if (len == 0) {
+        return -EINVAL;
+    }
+
+    *paddr  = PGROUND(addr);
+    *pend   = PGROUNDUP(addr + len) - 1;
+
+    if (*pend < *paddr || !__valid_addr(*pend)) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+int mmap_mlock(mmap_t *mmap, uintptr_t addr, size_t len, int flags) {
+    int         err = 0;
+    uintptr_t   end = 0;
+
+    if (mmap == NULL || (flags & ~MLOCK_ONFAULT)) {
+        return -EINVAL;
+    }
+
+    if ((err = mlock_range(&addr, len, &end))) {
+        return err;
+    }
+
+    return mmap_setlocked(mmap, addr, end, true, flags & MLOCK_ONFAULT);
+}
+
+int mmap_munlock(mmap_t *mmap, uintptr_t addr, size_t len) {
+    int         err = 0;
+    uintptr_t   end = 0;
+
+    if (mmap == NULL) {
+        return -EINVAL;
+    }
+
+    if ((err = mlock_range(&addr, len, &end))) {
+        return err;
+    }
+
+    return mmap_setlocked(mmap, addr, end, false, false);
+}
+
+int mmap_mlockall(mmap_t *mmap, int flags) {
+    int     err     = 0;
+    vmr_t   *next   = NULL;
+
+    if (mmap == NULL || flags == 0 || (flags & ~(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT))) {
+        return -EINVAL;
+    }
+
+    if (flags == MCL_ONFAULT) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    if (flags & MCL_FUTURE) {
+        mmap->flags |= MMAP_LOCKFUTURE;
+        mmap->flags = (flags & MCL_ONFAULT) ?
+            (mmap->flags | MMAP_LOCKONFAULT) : (mmap->flags & ~MMAP_LOCKONFAULT);
+    }
+
+    if (!(flags & MCL_CURRENT)) {
+        return 0;
+    }
+
+    for (vmr_t *r = mmap->vmr_head; r; r = next) {
+        next = r->next;
+        if ((err = mmap_setlocked(mmap, r->start, r->end, true, flags & MCL_ONFAULT))) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+int mmap_munlockall(mmap_t *mmap) {
+    vmr_t *next = NULL;
+
+    if (mmap == NULL) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    mmap->flags &= ~(MMAP_LOCKFUTURE | MMAP_LOCKONFAULT);
+
+    for (vmr_t *r = mmap->vmr_head; r; r = next) {
+        next = r->next;
+        mmap_setlocked(mmap, r->start, r->end, false, false);
+    }
+
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <mm/kalloc.h>
 #include <mm/mem.h>
 #include <mm/mmap.h>
+#include <sys/exec_cache.h>
 
 void vmr_dump(vmr_t *r, int i) {
     printk("memory %4d: [0x%08p : 0x%08p] %13ld [%7s] [%s%s%s%s] [%s-%s] refs: %ld|\n", i,
@@ -98,11 +99,12 @@ int mmap_alloc(mmap_t **ref) {
     }
     
     if ((mmap = kzalloc(sizeof *mmap)) == NULL) {
-        pmman.free(pgdir);
+        arch_putpgdir(pgdir);
         return -ENOMEM;
     }
 
     mmap->pgdir     = pgdir;
+    mmap->users     = 1;
     mmap->flags     = MMAP_USER;
     mmap->guard     = PAGESZ;
     mmap->lock      = SPINLOCK_INIT();
@@ -121,9 +123,7 @@ int mmap_alloc(mmap_t **ref) {
 }
 
 int mmap_mapin(mmap_t *mm, vmr_t *r) {
-    int         err  = 0;
-    uintptr_t   addr = 0;
-    usize       hole = 0;
+    vmr_t       *prev = NULL, *next = NULL;
 
     // Validate the input parameters
     if (mm == NULL || r == NULL) {
@@ -142,83 +142,40 @@ int mmap_mapin(mmap_t *mm, vmr_t *r) {
         return -EINVAL;
     }
 
-    addr = __vmr_start(r);
-
     // Ensure that the new region does not overlap with existing regions
-    while (addr <= __vmr_end(r)) {
-        if (mmap_find(mm, addr)) {
-            return -EEXIST;
-        }
-
-        if ((err = mmap_getholesize(mm, addr, &hole))) {
-            return err;
-        }
-
-        addr += hole;
-
-        // Prevent an endless loop in case of errors in hole size calculation
-        assert(hole, "Endless loop");
+    if (mmap_find(mm, __vmr_start(r))) {
+        return -EEXIST;
     }
 
-    // If the list is empty, initialize it with the new region
-    if (mm->vmr_head == NULL) {
-        r->refs += 2;  // Increment references by 2: one for mm->vmr_head and one for mm->vmr_tail
-        mm->vmr_head = mm->vmr_tail = r;
-
-        mm->refs++;  // Increment mmap references
-        r->mmap = mm;
-        mm->used_space += __vmr_size(r);
-        return 0;
+    next = vmr_tree_next(mm, __vmr_start(r));
+    if (next && (next->start <= __vmr_end(r))) {
+        return -EEXIST;
     }
 
-    // Insert the new region into the sorted list
-    forlinked(node, mm->vmr_head, node->next) {
-        // Check if the new node should be inserted before the current node
-        if (r->start < node->start) {
-            // Insert 'r' before 'node'
-            r->next = node;
-            r->prev = node->prev;
+    // Insert the new region into the sorted list, right before 'next'.
+    prev    = next ? next->prev : mm->vmr_tail;
+    r->prev = prev;
+    r->next = next;
 
-            if (node->prev) {
-                node->prev->next = r;
-                r->refs++;
-            } else {
-                // If there is no previous node, 'r' becomes the new head of the list
-                mm->vmr_head = r;
-                node++;
-                r->refs++;
-            }
-
-            node->prev = r;
-            r->refs++;  // Increment reference for the new node
-
-            r->mmap = mm;
-            mm->refs++;
-            mm->used_space += __vmr_size(r);
-            return 0;
-        }
+    if (prev) {
+        prev->next = r;
+    } else {
+        mm->vmr_head = r;
     }
 
-    // If the loop completes without inserting, 'r' should be inserted at the end
-    r->next = NULL;
-    r->prev = mm->vmr_tail;
-
-    if (mm->vmr_tail) {
-        mm->vmr_tail->next = r;
-        r->refs++;
-        mm->vmr_tail++;
+    if (next) {
+        next->prev = r;
     } else {
-        // If the list was empty, 'r' becomes the new head
-        mm->vmr_head = r;
-        r->refs++;
+        mm->vmr_tail = r;
     }
 
-    mm->vmr_tail = r;
-    r->refs++;  // Increment reference for the new node
-    
+    r->refs += 2;  // one for the link from the left and one for the link from the right.
+
     r->mmap = mm;
     mm->refs++;
     mm->used_space += __vmr_size(r);
+
+    vmr_tree_insert(mm, r);
     return 0;
 }
 
@@ -244,15 +201,13 @@ int mmap_contains(mmap_t *mmap, vmr_t *r) {
 
     mmap_assert_locked(mmap);
 
-    forlinked(tmp, mmap->vmr_head, tmp->next) {
-        if (tmp == r) {
-            return 1;
-        }
-    }
-    return 0;
+    return vmr_tree_find(mmap, r->start) == r;
 }
 
 int mmap_remove(mmap_t *mmap, vmr_t *r) {
+    int   err   = 0;
+    vmr_t *next = NULL;
+
     if (mmap == NULL || r == NULL) {
         return -EINVAL;
     }
@@ -263,6 +218,19 @@ int mmap_remove(mmap_t *mmap, vmr_t *r) {
         return -ENOENT;
     }
 
+    // the pins a locked region holds go with its mappings.
+    if (__vmr_locked(r)) {
+        arch_pin_range(r->start, __vmr_size(r), false);
+        r->flags &= ~VM_LOCKED;
+    }
+
+    // the region stays, partly unmapped, if a large page could not be split.
+    if ((err = arch_unmap_n(r->start, __vmr_size(r)))) {
+        return err;
+    }
+
+    next = r->next;
+
     if (r->prev) {
         r->prev->next = r->next;
         r->refs--;
@@ -293,6 +261,13 @@ int mmap_remove(mmap_t *mmap, vmr_t *r) {
         }
     }
 
+    vmr_tree_remove(mmap, r);
+    vmr_tree_update(mmap, next); // the hole below 'next' now spans 'r' too.
+
+    if (mmap->vmr_cache == r) {
+        mmap->vmr_cache = NULL;
+    }
+
     r->refs--;
     r->mmap = NULL;
     mmap->refs--;
@@ -307,24 +282,29 @@ int mmap_remove(mmap_t *mmap, vmr_t *r) {
         mmap->env = NULL;
     }
 
-    arch_unmap_n(r->start, __vmr_size(r));
     vmr_free(r);
     return 0;
 }
 
 vmr_t *mmap_find(mmap_t *mmap, uintptr_t addr) {
+    vmr_t *r = NULL;
+
     if (mmap == NULL) {
         return NULL;
     }
 
     mmap_assert_locked(mmap);
 
-    forlinked(tmp, mmap->vmr_head, tmp->next) {
-        if (addr >= tmp->start && addr <= tmp->end)
-            return tmp;
+    // faults tend to hit the same region over and over.
+    if ((r = mmap->vmr_cache) && addr >= r->start && addr <= r->end) {
+        return r;
     }
 
-    return NULL;
+    if ((r = vmr_tree_find(mmap, addr))) {
+        mmap->vmr_cache = r;
+    }
+
+    return r;
 }
 
 int mmap_find_stack(mmap_t *mmap, uintptr_t addr, vmr_t **pvp) {
@@ -379,13 +359,7 @@ vmr_t *mmap_find_vmr_next(mmap_t *mmap, uintptr_t addr, vmr_t **pnext) {
         return r;
     }
 
-    forlinked(tmp, mmap->vmr_head, tmp->next) {
-        if (addr < tmp->start) {
-            *pnext = tmp;
-            return NULL;
-        }
-    }
-
+    *pnext = vmr_tree_next(mmap, addr);
     return NULL;
 }
 
@@ -405,12 +379,7 @@ vmr_t *mmap_find_vmr_prev(mmap_t *mmap, uintptr_t addr, vmr_t **pprev) {
         return r;
     }
 
-    forlinked(tmp, mmap->vmr_tail, tmp->prev) {
-        if (tmp->end < addr) {
-            *pprev = tmp;
-            return NULL;
-        }
-    }
+    *pprev = vmr_tree_prev(mmap, addr);
     return NULL;
 }
 
@@ -431,6 +400,66 @@ vmr_t *mmap_find_vmr_overlap(mmap_t *mmap, uintptr_t start, uintptr_t end) {
     return NULL;
 }
 
+int mmap_range_mapped(mmap_t *mmap, uintptr_t start, uintptr_t end) {
+    vmr_t *r = NULL;
+
+    if (mmap == NULL || end < start) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    for (uintptr_t addr = start; (r = mmap_find(mmap, addr)); addr = __vmr_upper_bound(r)) {
+        if (r->end >= end) {
+            return 0;
+        }
+    }
+
+    return -ENOMEM;
+}
+
+int mmap_prefault_write(mmap_t *mmap, uintptr_t start, uintptr_t end) {
+    int     err     = 0;
+    vmr_t   *r      = NULL;
+    pte_t   *pte    = NULL;
+
+    if (mmap == NULL || end < start) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    for (uintptr_t addr = start; addr <= end; addr = __vmr_upper_bound(r)) {
+        if ((r = mmap_find(mmap, addr)) == NULL || !__vmr_write(r)) {
+            return -EFAULT;
+        }
+
+        if ((err = vmr_populate(r, addr, r->end < end ? r->end : end))) {
+            return err;
+        }
+
+        if (r->end >= end) {
+            break;
+        }
+    }
+
+    // shared mappings are only faulted in, one still write-protected
+    // would fault on the write this is meant to make safe.
+    for (uintptr_t va = PGROUND(start); va <= end; va += PGSZ) {
+        if (arch_getmapping(va, &pte)) {
+            return -EFAULT;
+        }
+
+#if defined(__x86_64__)
+        if (!pte_isW(pte)) {
+            return -EFAULT;
+        }
+#endif
+    }
+
+    return 0;
+}
+
 int mmap_getholesize(mmap_t *mmap, uintptr_t addr, size_t *plen) {
     vmr_t *next = NULL;
 
@@ -486,6 +515,7 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len) {
             if (vmr->start == start) {
                 if (__vmr_size(vmr) > len) {
                     vmr->start += len;
+                    vmr_tree_update(mmap, vmr);
                     len = 0;
                 }
                 else if (__vmr_size(vmr) < len) {
@@ -496,6 +526,7 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len) {
             }
             else if (vmr->end == start) {
                 vmr->end -= 1;
+                vmr_tree_update(mmap, vmr);
             }
             else
                 vmr_split(vmr, start, NULL);
@@ -514,8 +545,13 @@ int mmap_unmap(mmap_t *mmap, uintptr_t start, size_t len) {
     return 0;
 }
 
+/*Size of the hole between the last region and the end of the address space.*/
+static size_t mmap_tail_holesize(mmap_t *mmap) {
+    return (mmap->limit + 1) - (mmap->vmr_tail ? __vmr_upper_bound(mmap->vmr_tail) : 0);
+}
+
 int mmap_find_hole(mmap_t *mmap, size_t size, uintptr_t *paddr, int whence) {
-    size_t  holesz = 0;  // Variable to store the size of the current hole
+    vmr_t   *r = NULL;  // region right above the hole found, if any.
 
     // Validate input parameters
     if (mmap == NULL || paddr == NULL || size == 0) {
@@ -528,58 +564,30 @@ int mmap_find_hole(mmap_t *mmap, size_t size, uintptr_t *paddr, int whence) {
 
     // If searching from the start of the memory region
     if (whence == __whence_start) {
-        // Get the size of the hole at the very beginning
-        mmap_getholesize(mmap, 0, &holesz);
-        if (holesz >= size) {
-            *paddr = 0;  // If the hole is large enough, return 0 as the address
+        // Lowest hole that is large enough.
+        if ((r = vmr_tree_fit_after(mmap, 0, size))) {
+            *paddr = r->prev ? __vmr_upper_bound(r->prev) : 0;  // Return the start of the hole
             return 0;
         }
 
-        // Iterate over the VMR list to find a suitable hole
-        forlinked(tmp, mmap->vmr_head, __vmr_next(tmp)) {
-            if (__vmr_next(tmp)) {
-                holesz = __vmr_next(tmp)->start - __vmr_upper_bound(tmp);
-                if (holesz >= size) {
-                    *paddr = __vmr_upper_bound(tmp);  // Return the start of the hole
-                    return 0;
-                }
-            } else {
-                // Get the size of the hole after the last VMR
-                mmap_getholesize(mmap, __vmr_upper_bound(tmp), &holesz);
-                if (holesz >= size) {
-                    *paddr = __vmr_upper_bound(tmp);  // Return the start of the hole
-                    return 0;
-                }
-            }
+        // Get the size of the hole after the last VMR
+        if (mmap_tail_holesize(mmap) >= size) {
+            *paddr = mmap->vmr_tail ? __vmr_upper_bound(mmap->vmr_tail) : 0;
+            return 0;
         }
     } 
     // If searching from the end of the memory region
     else if (whence == __whence_end) {
         // Get the size of the hole at the very end
-        mmap_getholesize(mmap, mmap->limit + 1 - size, &holesz);
-        if (holesz >= size) {
+        if (mmap_tail_holesize(mmap) >= size) {
             *paddr = mmap->limit + 1 - size;  // Return the end of the hole
             return 0;
         }
 
-        // Iterate over the VMR list in reverse to find a suitable hole
-        forlinked(tmp, mmap->vmr_tail, __vmr_prev(tmp)) {
-            if (__vmr_prev(tmp)) {
-                holesz = tmp->start - __vmr_upper_bound(__vmr_prev(tmp));
-                if (holesz >= size) {
-                    *paddr = tmp->start - size;  // Return the end of the hole
-                    return 0;
-                }
-            } else {
-                // Check if there is space before the first VMR
-                if (__vmr_lower_bound(tmp) > (uintptr_t)NULL) {
-                    holesz = tmp->start;
-                    if (holesz >= size) {
-                        *paddr = tmp->start - size;  // Return the end of the hole
-                        return 0;
-                    }
-                }
-            }
+        // Highest hole that is large enough.
+        if ((r = vmr_tree_fit_before(mmap, mmap->limit, size))) {
+            *paddr = r->start - size;  // Return the end of the hole
+            return 0;
         }
     }
 
@@ -590,6 +598,7 @@ int mmap_find_hole(mmap_t *mmap, size_t size, uintptr_t *paddr, int whence) {
 int mmap_find_holeat(mmap_t *mmap, uintptr_t addr, size_t size, uintptr_t *paddr, int whence) {
     size_t  holesz      = 0;        // Variable to store the size of the current hole
     vmr_t   *near_vmr   = NULL;     // Pointer to the nearest VMR (Virtual Memory Region)
+    vmr_t   *fit        = NULL;     // Region right above a hole that is large enough.
 
     // Validate input parameters
     if (mmap == NULL || paddr == NULL || size == 0) {
@@ -629,20 +638,16 @@ int mmap_find_holeat(mmap_t *mmap, uintptr_t addr, size_t size, uintptr_t *paddr
             }
         }
 
-        // Iterate over the VMR list to find a suitable hole
-        forlinked(tmp, near_vmr, __vmr_next(tmp)) {
-            if (__vmr_next(tmp)) {
-                holesz = __vmr_next(tmp)->start - __vmr_upper_bound(tmp);
-                if (holesz >= size) {
-                    *paddr = __vmr_upper_bound(tmp);  // Return the start of the hole
-                    return 0;
-                }
-            } else {
-                mmap_getholesize(mmap, __vmr_upper_bound(tmp), &holesz);  // Check the hole after the last VMR
-                if (holesz >= size) {
-                    *paddr = __vmr_upper_bound(tmp);
-                    return 0;
-                }
+        // Lowest suitable hole above the current VMR.
+        if (near_vmr) {
+            if ((fit = vmr_tree_fit_after(mmap, near_vmr->start + 1, size))) {
+                *paddr = __vmr_upper_bound(fit->prev);  // Return the start of the hole
+                return 0;
+            }
+
+            if (mmap_tail_holesize(mmap) >= size) { // Check the hole after the last VMR
+                *paddr = __vmr_upper_bound(mmap->vmr_tail);
+                return 0;
             }
         }
     } else if (whence == __whence_end) { // If searching from the end
@@ -662,6 +667,12 @@ int mmap_find_holeat(mmap_t *mmap, uintptr_t addr, size_t size, uintptr_t *paddr
                     return 0;
                 }
             }
+
+            // Highest suitable hole below the current VMR.
+            if ((fit = vmr_tree_fit_before(mmap, near_vmr->start, size))) {
+                *paddr = fit->start - size;  // Return the end of the hole
+                return 0;
+            }
         } else {
             // Check the hole at the very end of the address space
             mmap_getholesize(mmap, (mmap->limit + 1) - size, &holesz);
@@ -670,19 +681,6 @@ int mmap_find_holeat(mmap_t *mmap, uintptr_t addr, size_t size, uintptr_t *paddr
                 return 0;
             }
         }
-
-        // Iterate over the VMR list in reverse to find a suitable hole
-        forlinked(tmp, near_vmr, __vmr_prev(tmp)) {
-            // printk("vmr: [%p<-%p->%p]\n", tmp->prev, tmp, tmp->next);
-            // vmr_dump(tmp, 0);
-            if (__vmr_prev(tmp)) {
-                holesz = tmp->start - __vmr_upper_bound(__vmr_prev(tmp));
-                if (holesz >= size) {
-                    *paddr = tmp->start - size;  // Return the end of the hole
-                    return 0;
-                }
-            }
-        }
     }
 
     // Fallback to a general hole search if no specific hole is found
@@ -864,6 +862,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, isize incr) {
             
             if (holesz >= (size_t)incr) {
                 r->end = (r->start + (usize)newsz) - 1;
+                vmr_tree_update(mmap, r);
                 return 0;
             }
             return -ENOMEM;
@@ -877,6 +876,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, isize incr) {
 
         /*Reduce the size of the region*/
         r->end -= (usize)oldsz - (usize)newsz;
+        vmr_tree_update(mmap, r);
         
         return 0;
     } else if (__vmr_growsdown(r)) {
@@ -889,6 +889,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, isize incr) {
 
             if (holesz >= (size_t)incr) {
                 r->start = hole_addr;
+                vmr_tree_update(mmap, r);
                 return 0;
             }
 
@@ -903,6 +904,7 @@ int mmap_vmr_expand(mmap_t *mmap, vmr_t *r, isize incr) {
 
         /*Reduce the size of the region*/
         r->start += (usize)oldsz - (usize)newsz;
+        vmr_tree_update(mmap, r);
 
         return 0;
     }
@@ -975,17 +977,21 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot) {
         if (r->start == addr) {
             r->end          = end;
             split0->start   = __vmr_upper_bound(r);
+            vmr_tree_update(mmap, r);
             if ((err = mmap_mapin(mmap, split0))) {
                 r->end = split0->end;
+                vmr_tree_update(mmap, r);
                 vmr_free(split0);
                 return err;
             }
         } else if (r->end == end) {
             r->start    = addr;
             split0->end = __vmr_lower_bound(r);
+            vmr_tree_update(mmap, r);
 
             if ((err = mmap_mapin(mmap, split0))) {
                 r->start = split0->start;
+                vmr_tree_update(mmap, r);
                 vmr_free(split0);
                 return err;
             }
@@ -996,24 +1002,28 @@ int mmap_protect(mmap_t *mmap, uintptr_t addr, size_t len, int prot) {
             }
 
             *split1       = *r;
-            split0->refs  = 0;
+            split1->refs  = 0;
             split1->prev  = split1->next = NULL;
 
             r->start      = addr;
             split0->end   = __vmr_lower_bound(r);
             r->end        = end;
             split1->start = __vmr_upper_bound(r);
+            vmr_tree_update(mmap, r);
 
+            // only the bounds are restored on failure, 'r' stays linked in.
             if ((err = mmap_mapin(mmap, split0))) {
-                *r = tmp;
+                r->start = tmp.start, r->end = tmp.end;
+                vmr_tree_update(mmap, r);
                 vmr_free(split0);
                 vmr_free(split1);
                 return err;
             }
 
             if ((err = mmap_mapin(mmap, split1))) {
-                *r = tmp;
+                r->start = tmp.start, r->end = tmp.end;
                 mmap_remove(mmap, split0);
+                vmr_tree_update(mmap, r);
                 vmr_free(split0);
                 vmr_free(split1);
                 return err;
@@ -1054,6 +1064,20 @@ int mmap_clean(mmap_t *mmap) {
         mmap_set_focus(mmap, &oldpgdir);
     }
 
+    // locked regions drop their pins while every frame they
+    // pinned is still reachable, shared tables included.
+    forlinked(r, mmap->vmr_head, r->next) {
+        if (__vmr_locked(r)) {
+            arch_pin_range(r->start, __vmr_size(r), false);
+            r->flags &= ~VM_LOCKED;
+        }
+    }
+
+    // page tables shared since fork() go as they are, there is no
+    // point in copying them only to empty them. Exit and exec after
+    // fork() never touch the pages they map.
+    arch_drop_shared();
+
     if ((err = mmap_unmap(mmap, 0, (mmap->limit) + 1))) {
         if (oldpgdir) {
             arch_switch_pgdir(oldpgdir, NULL);
@@ -1075,6 +1099,11 @@ int mmap_clean(mmap_t *mmap) {
     mmap->priv          = NULL;
     mmap->vmr_head      = NULL;
     mmap->vmr_tail      = NULL;
+    mmap->vmr_root      = NULL;
+    mmap->vmr_cache     = NULL;
+
+    exec_cache_put(mmap->image);
+    mmap->image         = NULL;
 
     mmap->pgdir         = pgdir;
     mmap->flags         = MMAP_USER;
@@ -1094,11 +1123,17 @@ void mmap_free(mmap_t *mmap) {
 
     mmap_recursive_lock(mmap);
 
+    // a vfork()ed child handing the address space back to its parent.
+    if (--mmap->users > 0) {
+        mmap_unlock(mmap);
+        return;
+    }
+
     mmap_clean(mmap);
 
     if (mmap->refs <= 0) {
         if (mmap->pgdir) {
-            pmman.free(mmap->pgdir);
+            arch_putpgdir(mmap->pgdir);
         }
         mmap_unlock(mmap);
         kfree(mmap);
@@ -1119,7 +1154,8 @@ int mmap_copy(mmap_t *dst, mmap_t *src) {
     mmap_assert_locked(src);
     mmap_assert_locked(dst);
 
-    dst->flags      = src->flags;
+    // memory locks are not inherited, the pins stay with 'src'.
+    dst->flags      = src->flags & ~(MMAP_LOCKFUTURE | MMAP_LOCKONFAULT);
     dst->limit      = src->limit;
     dst->guard  = src->guard;
     
@@ -1127,13 +1163,17 @@ int mmap_copy(mmap_t *dst, mmap_t *src) {
     dst->used_space = 0;
     dst->priv       = NULL;
     dst->vmr_head   = dst->vmr_tail = NULL;
+    dst->vmr_root   = dst->vmr_cache = NULL;
     dst->heap       = dst->arg = dst->env = NULL;
+    dst->image      = exec_image_get(src->image);
 
     forlinked(tmp, src->vmr_head, tmp->next) {
         if ((err = vmr_clone(tmp, &vmr))) {
             return err;
         }
 
+        vmr->flags &= ~VM_LOCKED;
+
         if ((err = mmap_mapin(dst, vmr))) {
             vmr_free(vmr);
             return err;
@@ -1195,87 +1235,44 @@ int mmap_set_focus(mmap_t *mmap, uintptr_t *ref) {
     return 0;
 }
 
-static int mmap_copy_list(mmap_t *mmap, char *svec[], int *pcnt, char *const *pvec[], vmr_t **pvmr) {
-    if (!mmap || pvmr == NULL) {
-        return -EINVAL;
-    }
-
-    /** POSIX says, argv[argc] MUST be null-terminated,
-     * so incase of 'argc == 0',
-     * starting at argc = 1 here is comformant to POSIX.
-     **/
-    int count = 1;
-
-    size_t region_size = 0, strbuf_size = 0;
+int mmap_copy_args(mmap_t *mmap, const exec_args_t *args,
+    int *pargc, char *const *pargp[], char *const *penvp[]) {
+    int     err     = 0;
+    char    **vec   = NULL;
+    vmr_t   *vmr    = NULL;
 
-    /** Count the number of arguments in the argv array. */
-    foreach(arg, svec) {
-        count    += 1;
-        strbuf_size += strlen(arg) + 1;
+    if (!mmap || !args || !args->ea_buf || !pargp || !penvp) {
+        return -EINVAL;
     }
 
-    /// Add size required to hold the actual array of (char *) pointers.
-    /// Ensure the size is page aligned at 4KiB.
-    region_size = ALIGN4KUP(strbuf_size + (count * (sizeof (char *))));
+    mmap_assert_locked(mmap);
 
     /** Allocate a private vmr that is non-expandable.
      * This region must be read/write.
-     * This region is meant to hold the argument's list.
+     * It holds both argv and envp, and their strings.
     */
-    vm_region_t *vec_vmr;
     int flags = MAP_PRIVATE | MAP_DONTEXPAND;
-    int err = mmap_alloc_mapped_vmr(mmap, 0, region_size, PROT_RW, flags, &vec_vmr);
-    if (err) {
+    if ((err = mmap_alloc_mapped_vmr(mmap, 0, ALIGN4KUP(args->ea_size), PROT_RW, flags, &vmr))) {
         return err;
     }
 
-    *pvmr = vec_vmr;
-
-    char **vec = (char **)ALIGN_UP(__vmr_start(vec_vmr) + strbuf_size, 16);
-    assert(&vec[count] < (char **)__vmr_end(vec_vmr),
-           "Space allocated for argv array too small\n");
-
-    char *buf = (char *)__vmr_start(vec_vmr);
+    memcpy((void *)__vmr_start(vmr), args->ea_buf, args->ea_size);
 
-    int index = 0;
-    foreach (arg, svec) {
-        size_t arglen = strlen(arg) + 1;
-        safestrncpy(buf, arg, arglen);
-        vec[index++] = buf;
-        buf += arglen;
+    // the vectors hold offsets into the staging area, make them addresses.
+    vec = (char **)__vmr_start(vmr);
+    for (int i = 0; i < args->ea_argc + args->ea_envc + 2; ++i) {
+        if (vec[i]) {
+            vec[i] = (char *)(__vmr_start(vmr) + (uintptr_t)vec[i]);
+        }
     }
 
-    vec[count] = NULL; // In the case of argv, POSIX says argv[argc] == NULL.
-
-    if (pcnt) *pcnt = count - 1;
-
-    *pvec = vec;
-
-    // foreach(arg, vec) printk("arg: %p, arg: %s\n", arg, arg);
-
-    // printk("count: %d, vec: %p\n", count - 1, vec);
-
-    return 0;
-}
-
-int mmap_copy_arglist(mmap_t *mmap, char *const __argv[], char *const __envv[],
-    int *pargc, char *const *pargp[], char *const *penvp[]) {
+    mmap->arg = vmr;
+    mmap->env = NULL;
 
-    vmr_t *argv_vmr = NULL;
-    int err = mmap_copy_list(mmap, (char **)__argv, pargc, pargp, &argv_vmr);
-    if (err) {
-        return err;
-    }
+    if (pargc) *pargc = args->ea_argc;
 
-    vmr_t *envv_vmr = NULL;
-    err = mmap_copy_list(mmap, (char **)__envv, NULL, penvp, &envv_vmr);
-    if (err) {
-        mmap_remove(mmap, argv_vmr);
-        return err;
-    }
-
-    mmap->arg = argv_vmr;
-    mmap->env = envv_vmr;
+    *pargp = vec;
+    *penvp = &vec[args->ea_argc + 1];
 
     return 0;
 }
@@ -1321,40 +1318,69 @@ int vmr_can_split(vmr_t *r, uintptr_t addr) {
 int vmr_split(vmr_t *r, uintptr_t addr, vmr_t **pvmr) {
     int     err     = 0;
     vmr_t   *new    = NULL;
+    usize   off     = 0;
 
     if (r == NULL || !vmr_can_split(r, addr)) {
         return -EINVAL;
     }
     
-    *pvmr = NULL;
+    if (pvmr) *pvmr = NULL;
 
     if ((err = vmr_alloc(&new))) {
         return err;
     }
 
+    // the upper half keeps everything the region was mapped with.
+    vmr_copy(new, r);
+    new->priv   = r->priv;
     new->start  = addr;
-    new->end    = r->end;
-    new->file   = r->file;
-    new->flags  = r->flags;
-    new->vflags = r->vflags;
 
+    off = addr - r->start;
     if (new->file) {
-        new->file_pos += addr - r->start;
+        new->file_pos += off;
     }
 
+    new->filesz = r->filesz > off ? r->filesz - off : 0;
+    new->memsz  = r->memsz  > off ? r->memsz  - off : 0;
+
     r->end      = addr - 1;
 
     if ((err = mmap_mapin(r->mmap, new))) {
+        r->end = new->end;
         vmr_free(new);
         return err;
     }
 
+    r->filesz   = r->filesz > off ? off : r->filesz;
+    r->memsz    = r->memsz  > off ? off : r->memsz;
+    vmr_tree_update(r->mmap, r);
+
     if (pvmr) {
         *pvmr = new;
     }
     return 0;
 }
 
+int vmr_isolate(vmr_t *r, uintptr_t start, uintptr_t end, vmr_t **pvmr) {
+    int     err = 0;
+    vmr_t   *mid = r;
+
+    if (r == NULL || pvmr == NULL || start > r->end || end < r->start) {
+        return -EINVAL;
+    }
+
+    if (start > r->start && (err = vmr_split(r, start, &mid))) {
+        return err;
+    }
+
+    if (end < mid->end && (err = vmr_split(mid, end + 1, NULL))) {
+        return err;
+    }
+
+    *pvmr = mid;
+    return 0;
+}
+
 int vmr_copy(vmr_t *rdst, vmr_t *rsrc) {
     if (rdst == NULL || rsrc == NULL) {
         return -EINVAL;
@@ -1369,6 +1395,7 @@ int vmr_copy(vmr_t *rdst, vmr_t *rsrc) {
     rdst->mmap  = NULL;
     rdst->priv  = NULL;
     rdst->next  = rdst->prev = NULL;
+    rdst->left  = rdst->right = rdst->parent = NULL;
     return 0;
 }
 
@@ -0,0 +1,182 @@
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <mm/mmap.h>
+
+/**
+ * *******************************************************************
+ * @brief   mremap().                                                *
+ * A region grows in place when the hole above it allows, otherwise  *
+ * its page tables are moved to a new hole, never its pages copied.  *
+ * *******************************************************************/
+
+/*Unmap whatever is mapped in [start, end], splitting regions that straddle it.*/
+static int mmap_punch(mmap_t *mmap, uintptr_t start, uintptr_t end) {
+    int     err = 0;
+    vmr_t   *r  = NULL;
+
+    while ((r = mmap_find(mmap, start)) || (r = vmr_tree_next(mmap, start))) {
+        if (r->start > end) {
+            break;
+        }
+
+        if ((err = vmr_isolate(r, start, end, &r))) {
+            return err;
+        }
+
+        start = __vmr_upper_bound(r);
+        mmap_remove(mmap, r);
+
+        if (start > end) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*Grow 'r' by 'incr' bytes into the hole right above it, if there is room.*/
+static int vmr_grow_inplace(mmap_t *mmap, vmr_t *r, size_t incr) {
+    size_t holesz = 0;
+
+    if (!__vmr_growsup(r) || __vmr_dontexpand(r)) {
+        return -ENOMEM;
+    }
+
+    if (mmap_getholesize(mmap, __vmr_upper_bound(r), &holesz) || holesz < incr) {
+        return -ENOMEM;
+    }
+
+    r->end += incr;
+    mmap->used_space += incr;
+    vmr_tree_update(mmap, r);
+    return 0;
+}
+
+/*Move the isolated region 'r' to [newaddr, newaddr + newsz).*/
+static int vmr_move(mmap_t *mmap, vmr_t *r, uintptr_t newaddr, size_t newsz, vmr_t **pnew) {
+    int     err     = 0;
+    vmr_t   *new    = NULL;
+    size_t  oldsz   = __vmr_size(r);
+
+    if ((err = vmr_clone(r, &new))) {
+        return err;
+    }
+
+    new->priv   = r->priv;
+    new->start  = newaddr;
+    new->end    = newaddr + newsz - 1;
+
+    if ((err = mmap_mapin(mmap, new))) {
+        vmr_free(new);
+        return err;
+    }
+
+    if ((err = arch_move_range(r->start, newaddr, oldsz < newsz ? oldsz : newsz))) {
+        mmap_remove(mmap, new);
+        return err;
+    }
+
+    // drops whatever did not fit in a smaller 'new'.
+    mmap_remove(mmap, r);
+    *pnew = new;
+    return 0;
+}
+
+int mmap_remap(mmap_t *mmap, uintptr_t old, size_t oldsz, size_t newsz,
+    int flags, uintptr_t newaddr, uintptr_t *paddr) {
+    int         err = 0;
+    vmr_t       *r  = NULL;
+    uintptr_t   end = 0;
+
+    if (mmap == NULL || paddr == NULL || !__isaligned(old)) {
+        return -EINVAL;
+    }
+
+    if ((flags & ~(MREMAP_MAYMOVE | MREMAP_FIXED)) ||
+        ((flags & MREMAP_FIXED) && !(flags & MREMAP_MAYMOVE))) {
+        return -EINVAL;
+    }
+
+    if (oldsz == 0 || newsz == 0) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    oldsz   = PGROUNDUP(oldsz);
+    newsz   = PGROUNDUP(newsz);
+    end     = old + oldsz - 1;
+
+    if (flags & MREMAP_FIXED) {
+        if (!__isaligned(newaddr) || !__valid_addr(newaddr + newsz - 1)) {
+            return -EINVAL;
+        }
+
+        // the two ranges may not overlap.
+        if (newaddr <= end && old <= newaddr + newsz - 1) {
+            return -EINVAL;
+        }
+    }
+
+    // all of the old range must be one mapping.
+    if ((r = mmap_find(mmap, old)) == NULL || r->end < end) {
+        return -EFAULT;
+    }
+
+    if (!(flags & MREMAP_FIXED)) {
+        if (newsz <= oldsz) {
+            if (newsz < oldsz && (err = mmap_punch(mmap, old + newsz, end))) {
+                return err;
+            }
+
+            *paddr = old;
+            return 0;
+        }
+
+        if (r->end == end && !vmr_grow_inplace(mmap, r, newsz - oldsz)) {
+            goto grown;
+        }
+    }
+
+    if (!(flags & MREMAP_MAYMOVE)) {
+        return -ENOMEM;
+    }
+
+    // regions the address space keeps track of by pointer stay where they are.
+    if (r->vmops || __vmr_isstack(r) || r == mmap->heap ||
+        r == mmap->arg || r == mmap->env) {
+        return -EINVAL;
+    }
+
+    if (flags & MREMAP_FIXED) {
+        if ((err = mmap_punch(mmap, newaddr, newaddr + newsz - 1))) {
+            return err;
+        }
+    } else if ((err = mmap_find_hole(mmap, newsz, &newaddr, __whence_start))) {
+        return err;
+    }
+
+    if ((err = vmr_isolate(r, old, end, &r))) {
+        return err;
+    }
+
+    if ((err = vmr_move(mmap, r, newaddr, newsz, &r))) {
+        return err;
+    }
+
+    if (newsz <= oldsz) {
+        *paddr = newaddr;
+        return 0;
+    }
+
+    old = newaddr;
+grown:
+    // the part added to a locked region is locked too,
+    // the faults pin what they map.
+    if (__vmr_locked(r) && !(mmap->flags & MMAP_LOCKONFAULT)) {
+        vmr_populate(r, old + oldsz, old + newsz - 1);
+    }
+
+    *paddr = old;
+    return 0;
+}
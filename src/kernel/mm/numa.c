@@ -0,0 +1,232 @@
+#include <arch/cpu.h>
+#include <arch/firmware/acpi.h>
+#include <bits/errno.h>
+#include <core/debug.h>
+#include <mm/numa.h>
+#include <mm/zone.h>
+#include <string.h>
+#include <sys/proc.h>
+
+static struct numa_node {
+    bool    online;
+    ulong   cpus;                   // mask of the CPUs on this node.
+    u8      distance[NNUMA];
+} numa_nodes[NNUMA];
+
+static numa_memblk_t    numa_memblks[NUMA_NMEMBLK];
+static usize            numa_nmemblk    = 0;
+static int              numa_nnodes     = 1;
+static int              numa_cpus[NCPU] = {0};
+
+int numa_add_memblk(int node, uintptr_t start, usize size) {
+    usize i = 0;
+
+    if (node < 0 || node >= NNUMA || size == 0) {
+        return -EINVAL;
+    }
+
+    if (numa_nmemblk >= NUMA_NMEMBLK) {
+        return -ENOSPC;
+    }
+
+    // keep them ordered by address, there are only a handful.
+    for (i = numa_nmemblk; i > 0 && numa_memblks[i - 1].start > start; --i) {
+        numa_memblks[i] = numa_memblks[i - 1];
+    }
+
+    numa_memblks[i] = (numa_memblk_t){.node = node, .start = start, .size = size};
+    numa_nmemblk++;
+    numa_nodes[node].online = true;
+    return 0;
+}
+
+int numa_add_cpu(int node, int cpuid) {
+    if (node < 0 || node >= NNUMA || cpuid < 0 || cpuid >= NCPU) {
+        return -EINVAL;
+    }
+
+    numa_cpus[cpuid] = node;
+    numa_nodes[node].cpus |= BS(cpuid);
+    return 0;
+}
+
+void numa_set_distance(int from, int to, u8 distance) {
+    if (from < 0 || from >= NNUMA || to < 0 || to >= NNUMA) {
+        return;
+    }
+
+    numa_nodes[from].distance[to] = distance;
+}
+
+/*Start over as one node, with the default distances.*/
+static void numa_reset(void) {
+    for (int from = 0; from < NNUMA; ++from) {
+        numa_nodes[from] = (struct numa_node){0};
+        for (int to = 0; to < NNUMA; ++to) {
+            numa_nodes[from].distance[to] = from == to ?
+                NUMA_LOCAL_DISTANCE : NUMA_REMOTE_DISTANCE;
+        }
+    }
+
+    memset(numa_cpus, 0, sizeof numa_cpus);
+    numa_nmemblk = 0;
+    numa_nnodes  = 1;
+}
+
+int numa_init(void) {
+    int err = 0;
+
+    numa_reset();
+
+    if ((err = acpi_numa_init()) == 0) {
+        numa_nnodes = 0;
+        for (int node = 0; node < NNUMA; ++node) {
+            numa_nnodes += numa_nodes[node].online;
+        }
+    }
+
+    // node ids are handed out densely from 0, a gap means a bad table.
+    if (err || numa_nnodes < 2 || !numa_nodes[numa_nnodes - 1].online) {
+        numa_reset();
+        numa_nodes[0].online = true;
+        numa_nodes[0].cpus   = ~0ul;
+        return err == -ENOENT ? 0 : err;
+    }
+
+    printk("NUMA: %d nodes, %d memory ranges.\n", numa_nnodes, numa_nmemblk);
+    return 0;
+}
+
+int numa_node_count(void) {
+    return numa_nnodes;
+}
+
+bool numa_node_online(int node) {
+    return node >= 0 && node < NNUMA && numa_nodes[node].online;
+}
+
+u8 numa_distance(int from, int to) {
+    if (!numa_node_online(from) || !numa_node_online(to)) {
+        return 0xFF;
+    }
+
+    return numa_nodes[from].distance[to];
+}
+
+int numa_cpu_node(int cpuid) {
+    return cpuid >= 0 && cpuid < NCPU ? numa_cpus[cpuid] : 0;
+}
+
+int numa_local_node(void) {
+    return numa_cpu_node(getcpuid());
+}
+
+usize numa_memblk_count(void) {
+    return numa_nmemblk;
+}
+
+const numa_memblk_t *numa_memblk_get(usize i) {
+    return i < numa_nmemblk ? &numa_memblks[i] : NULL;
+}
+
+static ulong numa_online_mask(void) {
+    ulong mask = 0;
+
+    for (int node = 0; node < NNUMA; ++node) {
+        if (numa_nodes[node].online) {
+            mask |= BS(node);
+        }
+    }
+
+    return mask;
+}
+
+int mempolicy_set(mempolicy_t *pol, int mode, ulong nodes) {
+    if (pol == NULL || mode < 0 || mode >= MPOL_MAX) {
+        return -EINVAL;
+    }
+
+    if (mode == MPOL_DEFAULT) {
+        nodes = 0;
+    } else if (nodes == 0 || (nodes & ~numa_online_mask())) {
+        return -EINVAL;
+    }
+
+    pol->mode   = mode;
+    pol->nodes  = nodes;
+    atomic_write(&pol->ilnext, 0);
+    return 0;
+}
+
+/*The 'nth' node set in 'mask', counting from 0 and wrapping around.*/
+static int numa_nth_node(ulong mask, ulong nth) {
+    ulong count = 0;
+
+    for (int node = 0; node < NNUMA; ++node) {
+        count += (mask & BS(node)) != 0;
+    }
+
+    nth %= count;
+
+    for (int node = 0; node < NNUMA; ++node) {
+        if ((mask & BS(node)) && nth-- == 0) {
+            return node;
+        }
+    }
+
+    return 0;
+}
+
+/*The node in 'mask' nearest to 'from'.*/
+static int numa_nearest_node(ulong mask, int from) {
+    int nearest = -1;
+
+    for (int node = 0; node < NNUMA; ++node) {
+        if ((mask & BS(node)) && (nearest < 0 ||
+            numa_distance(from, node) < numa_distance(from, nearest))) {
+            nearest = node;
+        }
+    }
+
+    return nearest;
+}
+
+int numa_alloc_nodes(gfp_t gfp __unused, int whence, int nodes[NNUMA]) {
+    int         n       = 0;
+    int         first   = numa_local_node();
+    ulong       allowed = numa_online_mask();
+    proc_t      *proc   = NULL;
+    mempolicy_t *pol    = NULL;
+
+    if (numa_nnodes < 2) {
+        nodes[0] = 0;
+        return 1;
+    }
+
+    // DMA buffers go wherever the device can reach, policy or not.
+    if (whence != ZONEi_DMA && (proc = curproc) != NULL) {
+        pol = &proc->mempolicy;
+
+        // a racy read at worst uses the old policy once more.
+        switch (pol->mode) {
+        case MPOL_PREFERRED:
+            first   = numa_nth_node(pol->nodes, 0);
+            break;
+        case MPOL_BIND:
+            allowed = pol->nodes;
+            first   = numa_nearest_node(allowed, first);
+            break;
+        case MPOL_INTERLEAVE:
+            first   = numa_nth_node(pol->nodes, atomic_fetch_inc(&pol->ilnext));
+            break;
+        }
+    }
+
+    // then the rest of the allowed nodes, nearest to 'first' first.
+    for (nodes[n++] = first, allowed &= ~BS(first); allowed; ++n) {
+        nodes[n] = numa_nearest_node(allowed, first);
+        allowed &= ~BS(nodes[n]);
+    }
+
+    return n;
+}
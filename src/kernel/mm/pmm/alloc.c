@@ -1,6 +1,10 @@
 #include <arch/paging.h>
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <dev/tsc.h>
+#include <mm/compaction.h>
+#include <mm/reclaim.h>
+#include <mm/vmstat.h>
 #include <mm/zone.h>
 #include <string.h>
 #include <sys/thread.h>
@@ -35,10 +39,8 @@ static int zero_fill_page(zone_t *zone, page_t *page, int whence) {
 
     zone_assert(zone);
 
-    paddr   = zone->start + ((page - zone->pages) * PGSZ);
-
-    // printk("%p: watermark: %p\n", page_addr(page, zone), page_watermark(page));
-    page_verify_watermark(page, zone);
+    paddr   = page_to_phys(page);
+    page_verify(page, zone);
 
     if ((whence == ZONEi_HOLE) || (whence == ZONEi_HIGH)) {
         // Handle high memory or hole zone
@@ -81,8 +83,94 @@ static inline int gfp_to_zone_index(gfp_t gfp) {
     }
 }
 
+/**
+ * Take a block of 2^order frames from the locked 'zone', aligned
+ * physically, not just within the zone, zones need not start on
+ * the boundary of a large page.
+ * A high order can fail with plenty of memory free, scattered in
+ * small pieces, so the zone is compacted once before giving up.
+ * Returns with the zone still locked.
+ */
+static int zone_alloc_block(zone_t *zone, gfp_t gfp, usize order, usize *pindex) {
+    int err = 0;
+
+    err = bitmap_alloc_range_aligned(&zone->bitmap, BS(order), BS(order), zone_start_pfn(zone), pindex);
+    if (err != -ENOSPC || order == 0)
+        return err;
+
+    // the background thread carries on where we leave off.
+    compaction_wakeup();
+
+    // atomic callers may hold locks the page walk would try.
+    if (gfp & __GFP_ATOMIC)
+        return err;
+
+    zone_unlock(zone);
+    vmstat_inc(compact_stall);
+    err = compact_zone(zone, order);
+    zone_lock(zone);
+
+    if (err)
+        return -ENOSPC;
+
+    return bitmap_alloc_range_aligned(&zone->bitmap, BS(order), BS(order), zone_start_pfn(zone), pindex);
+}
+
+int zone_alloc_highest(zone_t *zone, usize floor, usize *pcursor, page_t **ppage) {
+    usize   word    = 0;
+    usize   bits    = 0;
+    usize   index   = 0;
+    usize   freemap = 0;
+    page_t  *page   = NULL;
+
+    zone_lock(zone);
+
+    // every writer of the bitmap holds the zone lock, so read it directly.
+    for (index = MIN(*pcursor, zone->npages); index > floor; index = word * BITS_PER_USIZE) {
+        word    = (index - 1) / BITS_PER_USIZE;
+        bits    = (index - 1) % BITS_PER_USIZE + 1;
+        freemap = ~zone->bitmap.bm_map[word];
+
+        // only the frames below 'index'.
+        if (bits < BITS_PER_USIZE)
+            freemap &= BS(bits) - 1;
+
+        if (freemap == 0)
+            continue;
+
+        index = word * BITS_PER_USIZE + (BITS_PER_USIZE - 1 - __builtin_clzl(freemap));
+        if (index < floor)
+            break;
+
+        assert_eq(bitmap_set(&zone->bitmap, index, 1), 0,
+            "Bitmap set failed for zone %p index %lu\n", zone, index);
+
+        page = zone_page(zone, index);
+        page_verify(page, zone);
+
+        assert(!atomic_read(&page->refcnt),
+            "Page: [%p] already has refcnt: %ld??\n",
+            page_to_phys(page), page->refcnt
+        );
+
+        atomic_inc(&page->refcnt);
+        zone->upages += 1;
+
+        *pcursor = index;
+        *ppage   = page;
+        zone_unlock(zone);
+        return 0;
+    }
+
+    *pcursor = floor;
+    zone_unlock(zone);
+    return -ENOMEM;
+}
+
 /**
  * Allocate a contiguous range of page frames.
+ * The nodes are tried in the order the memory policy gives,
+ * usually the allocating CPU's own node first, then by distance.
  *
  * @param gfp GFP flags specifying allocation type.
  * @param order Number of contiguous pages as a power of 2.
@@ -93,10 +181,14 @@ static inline int gfp_to_zone_index(gfp_t gfp) {
 static int do_page_alloc_n(gfp_t gfp, usize order, page_t **ppage, void **ppaddr) {
     int         err     = 0;
     int         whence  = 0;
+    int         nnodes  = 0;
+    bool        low     = false;
     usize       index   = 0;
     page_t      *page   = NULL;
     zone_t      *zone   = NULL;
     usize       npage   = BS(order);
+    time_t      start   = tsc_get();
+    int         nodes[NNUMA];
 
     if ((err = validate_input(gfp, order, ppage, ppaddr)))
         return err;
@@ -104,41 +196,47 @@ static int do_page_alloc_n(gfp_t gfp, usize order, page_t **ppage, void **ppaddr
     if ((whence = err = gfp_to_zone_index(gfp)) < 0)
         return err;
 
-    loop() {
-        if ((err = getzone_byindex(whence, &zone)))
-            return err;
+    nnodes  = numa_alloc_nodes(gfp, whence, nodes);
+    err     = -EINVAL;
+
+    for (int i = 0; i < nnodes; ++i) {
+        // not every node has every kind of zone.
+        if (getzone_byindex(nodes[i], whence, &zone))
+            continue;
 
-        if ((err = bitmap_alloc_range(&zone->bitmap, npage, &index))) {
+        // Blocks are naturally aligned to their size so that higher orders
+        // can back 2MiB/1GiB mappings without any physical fix-ups.
+        if ((err = zone_alloc_block(zone, gfp, order, &index))) {
             err = err == -ENOSPC ? -ENOMEM : err;
-            debug("Failed to allocate page-frame: %s\n", strerror(err));
             zone_unlock(zone);
-            return err;
+            reclaim_wakeup();
+            continue;
         }
 
-        for (page = &zone->pages[index]; npage--; ++page) {
-            assert(!OVERLAPS(page_addr(page, zone), PGSZ,
+        // a block may span memmap sections, step through it by frame number.
+        for (usize pfn = zone_start_pfn(zone) + index; npage--; ++pfn) {
+            page = pfn_to_page(pfn);
+
+            assert(!OVERLAPS(PFN2PHYS(pfn), PGSZ,
                 bootinfo.kern_base, bootinfo.kern_size),
-                "Page: [%p] Overlaps the kernel image.\n",
-                page_addr(page, zone)
+                "Page: [%p] Overlaps the kernel image.\n", PFN2PHYS(pfn)
             );
 
             assert(!atomic_read(&page->refcnt),
                 "Page: [%p] already has refcnt: %ld??\n",
-                page_addr(page, zone), page->refcnt
+                PFN2PHYS(pfn), page->refcnt
             );
 
             atomic_inc(&page->refcnt);
 
-            // printk("Watermark [%p: watermark: %p]\n", page_addr(page, zone), page_watermark(page));
-
-            page_verify_watermark(page, zone);
+            page_verify(page, zone);
 
             // does caller want a zero-filled page?
             if (gfp & GFP_ZERO) {
                 if ((err = zero_fill_page(zone, page, whence))) {
                     // catch error.
                     assert(0, "Failed to zero-fill page[%p]. error: %d\n",
-                        page_addr(page, zone), err
+                        PFN2PHYS(pfn), err
                     );
                     zone_unlock(zone);
                     return err;
@@ -147,17 +245,38 @@ static int do_page_alloc_n(gfp_t gfp, usize order, page_t **ppage, void **ppaddr
         }
 
         zone->upages += BS(order);
-        page    = &zone->pages[index];
+        page    = zone_page(zone, index);
+
+        vmstat_inc(pgalloc[GFP_WHENCE(gfp)]);
+        vmstat_add(pgalloc_pages, BS(order));
+        if (gfp & GFP_ZERO)
+            vmstat_add(pgalloc_zero, BS(order));
+        if (i > 0)
+            vmstat_inc(pgalloc_remote);
         
         if (ppage)
             *ppage  = page;
         
         if (ppaddr)
-            *ppaddr = (void *)page_addr(page, zone);
-        
+            *ppaddr = (void *)page_to_phys(page);
+
+        low = zone_below_low(zone);
         zone_unlock(zone);
+
+        // let kswapd refill the zone before we run out.
+        if (low)
+            reclaim_wakeup();
+
+        latency_hist_add(&vmstat.page_alloc_lat, tsc_get() - start);
         return 0;
     }
+
+    vmstat_inc(pgalloc_fail[GFP_WHENCE(gfp)]);
+    vmstat_inc(pgalloc_fail_order[vmstat_order(order)]);
+    latency_hist_add(&vmstat.page_alloc_lat, tsc_get() - start);
+
+    debug("Failed to allocate page-frame: %s\n", strerror(err));
+    return err;
 }
 
 int page_alloc_n(gfp_t gfp, usize order, page_t **pp) {
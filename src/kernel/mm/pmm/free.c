@@ -1,44 +1,44 @@
 #include <arch/paging.h>
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <mm/vmstat.h>
 #include <mm/zone.h>
 #include <sys/thread.h>
 
+/**
+ * Drop a reference to each of the 2^order frames from 'page', or from
+ * 'addr' if 'page' is NULL. References come and go without the zone
+ * lock, it is only taken to hand a frame whose last one went back to
+ * the bitmap.
+ */
 static void do_page_free_n(page_t *page, uintptr_t addr, usize order) {
     int     err     = 0;
-    usize   pos     = 0;
     zone_t  *zone   = NULL;
     usize   npage   = BS(order);
 
     assert(order <= 64, "Requested order(%d) is greater than 64.\n", order);
 
     if (page == NULL) {
-        assert_eq(err = getzone_byaddr(addr, npage * PGSZ, &zone), 0,
-            "Couldn't get zone by addr(%p). error: %d\n", addr, err    
-        );
-
-        page = &zone->pages[(addr - zone->start) / PGSZ];
-        if (!atomic_read(&page->refcnt) ||
-                !bitmap_test(&zone->bitmap, page - zone->pages, 1)) {
+        page = phys_to_page(addr);
+        if (page == NULL || !atomic_read(&page->refcnt)) {
             assert(0, "Page(%p): couldn't take a reference to the page handle.\n", addr);
         }
     } else {
-        assert(!(err = getzone_bypage(page, &zone)),
-            "Couldn't get zone by page[%p]. error: %d\n", page, err
-        );
+        addr = page_to_phys(page);
     }
 
-    zone_assert_isnotkernel(zone, page);
+    zone = page_zone(page);
+    zone_assert_isnotkernel(page);
 
-    if (page_end(page, npage, zone) >= zone_end(zone)) {
+    if ((addr < zone_start(zone)) || (addr + (npage * PGSZ) > zone_end(zone))) {
         debug("Out of ZONE deallocation.\nNo page was deallocated.\n");
-        zone_unlock(zone);
         return;
     }
 
-    for (pos = page - zone->pages; npage != 0; --npage, ++page, ++pos) {
+    // a block may span memmap sections, step through it by frame number.
+    for (usize pfn = PFN(addr); npage != 0; --npage, page = pfn_to_page(++pfn)) {
         assert(atomic_read(&page->refcnt),
-            "Double free detected for page[%p].\n", page_addr(page, zone)
+            "Double free detected for page[%p].\n", page_to_phys(page)
         );
 
         /// page still has some references to it.
@@ -46,8 +46,9 @@ static void do_page_free_n(page_t *page, uintptr_t addr, usize order) {
         if (atomic_dec_fetch(&page->refcnt))
             continue;
 
-        assert_eq(err = bitmap_unset(&zone->bitmap, pos, 1), 0,
-            "Bitmap unset failed for page[%p]. error: %d\n", page_addr(page, zone) , err
+        zone_lock(zone);
+        assert_eq(err = bitmap_unset(&zone->bitmap, page_index(page, zone), 1), 0,
+            "Bitmap unset failed for page[%p]. error: %d\n", page_to_phys(page), err
         );
 
         page_resetflags(page);
@@ -56,9 +57,10 @@ static void do_page_free_n(page_t *page, uintptr_t addr, usize order) {
         zone->upages    -= 1;
 
         page->icache    = NULL;
-    }
+        zone_unlock(zone);
 
-    zone_unlock(zone);
+        vmstat_inc(pgfree);
+    }
 }
 
 void page_free_n(page_t *page, usize order) {
@@ -0,0 +1,183 @@
+#include <bits/errno.h>
+#include <core/debug.h>
+#include <fs/icache.h>
+#include <mm/page.h>
+#include <sync/atomic.h>
+
+/**
+ * Page cache LRU lists, most recently used at the head.
+ * Both are covered by their queue locks, always taken inactive first.
+ * PG_LRU, PG_ACTIVE and PG_REFERENCED change with atomics since
+ * the rest of page->flags is updated under the owning icache's lock.
+ *
+ * There is no reverse map from a page to the PTEs mapping it, so the
+ * hardware accessed bits cannot be harvested. Instead a cache hit sets
+ * PG_REFERENCED, and a page with references beyond the cache's own
+ * is mapped somewhere and treated as referenced on every scan.
+ */
+static QUEUE(lru_active);
+static QUEUE(lru_inactive);
+
+#define lru_lock()      ({ queue_lock(lru_inactive); queue_lock(lru_active); })
+#define lru_unlock()    ({ queue_unlock(lru_active); queue_unlock(lru_inactive); })
+
+#define lru_setflags(page, f)   ({ atomic_or(&(page)->flags, (f)); })
+#define lru_maskflags(page, f)  ({ atomic_and(&(page)->flags, ~(ulong)(f)); })
+#define lru_testflags(page, f)  ({ atomic_read(&(page)->flags) & (f); })
+
+#define lru_list(page)  (lru_testflags(page, PG_ACTIVE) ? lru_active : lru_inactive)
+
+// mapped pages hold a reference on top of the cache's.
+#define lru_page_mapped(page)   ({ atomic_read(&(page)->refcnt) > 1; })
+
+static void lru_move(page_t *page, queue_t *dst) {
+    embedded_queue_detach(lru_list(page), &page->lru);
+
+    if (dst == lru_active)
+        lru_setflags(page, PG_ACTIVE);
+    else
+        lru_maskflags(page, PG_ACTIVE);
+
+    embedded_enqueue_head(dst, &page->lru, QUEUE_DUPLICATES);
+}
+
+void page_lru_add(page_t *page) {
+    page_assert(page);
+
+    lru_lock();
+    if (!lru_testflags(page, PG_LRU)) {
+        lru_maskflags(page, PG_ACTIVE | PG_REFERENCED);
+        lru_setflags(page, PG_LRU);
+        page->lru = (queue_node_t){.data = page};
+        embedded_enqueue_head(lru_inactive, &page->lru, QUEUE_DUPLICATES);
+    }
+    lru_unlock();
+}
+
+void page_lru_del(page_t *page) {
+    page_assert(page);
+
+    lru_lock();
+    if (lru_testflags(page, PG_LRU)) {
+        embedded_queue_detach(lru_list(page), &page->lru);
+        lru_maskflags(page, PG_LRU | PG_ACTIVE | PG_REFERENCED);
+    }
+    lru_unlock();
+}
+
+void page_mark_accessed(page_t *page) {
+    page_assert(page);
+
+    // first use since the last scan only sets the referenced bit.
+    if (!lru_testflags(page, PG_REFERENCED)) {
+        lru_setflags(page, PG_REFERENCED);
+        return;
+    }
+
+    if (lru_testflags(page, PG_ACTIVE) || !lru_testflags(page, PG_LRU))
+        return;
+
+    // a second one on the inactive list earns a promotion.
+    lru_lock();
+    if (lru_testflags(page, PG_LRU) && !lru_testflags(page, PG_ACTIVE)) {
+        lru_move(page, lru_active);
+        lru_maskflags(page, PG_REFERENCED);
+    }
+    lru_unlock();
+}
+
+usize page_lru_count(void) {
+    return lru_active->q_count + lru_inactive->q_count;
+}
+
+/**
+ * Keep the active list no larger than the inactive one.
+ * Referenced pages at the tail of the active list get
+ * another round there, the rest are demoted.
+ * Called with both lists locked.
+ */
+static void lru_balance(usize nr_scan) {
+    page_t *page = NULL;
+
+    for (; nr_scan && lru_active->q_count > lru_inactive->q_count; --nr_scan) {
+        page = queue_node_get_container(lru_active->tail, page_t, lru);
+
+        if (lru_testflags(page, PG_REFERENCED) || lru_page_mapped(page)) {
+            lru_maskflags(page, PG_REFERENCED);
+            lru_move(page, lru_active);
+            continue;
+        }
+
+        lru_move(page, lru_inactive);
+    }
+}
+
+usize page_lru_shrink(usize nr_scan) {
+    int         err     = 0;
+    usize       freed   = 0;
+    page_t      *page   = NULL;
+    icache_t    *icache = NULL;
+
+    lru_lock();
+    lru_balance(nr_scan);
+
+    for (; nr_scan && lru_inactive->tail; --nr_scan) {
+        page = queue_node_get_container(lru_inactive->tail, page_t, lru);
+
+        if (lru_testflags(page, PG_REFERENCED) || lru_page_mapped(page)) {
+            lru_maskflags(page, PG_REFERENCED);
+            lru_move(page, lru_active);
+            continue;
+        }
+
+        // icache_free() empties the LRU of its pages under our lock
+        // before freeing the cache, so 'icache' is still alive here.
+        // Lock order is icache then LRU, so only try.
+        if ((icache = page->icache) == NULL || !spin_trylock(&icache->pc_lock)) {
+            lru_move(page, lru_inactive);
+            continue;
+        }
+
+        embedded_queue_detach(lru_inactive, &page->lru);
+        lru_maskflags(page, PG_LRU | PG_ACTIVE | PG_REFERENCED);
+        lru_unlock();
+
+        if ((err = icache_evict(icache, page)) == 0) {
+            freed++;
+        } else {
+            // dirty and could not be written back, or in use, keep it around.
+            lru_lock();
+            lru_setflags(page, PG_LRU | PG_ACTIVE);
+            embedded_enqueue_head(lru_active, &page->lru, QUEUE_DUPLICATES);
+            lru_unlock();
+        }
+
+        icache_unlock(icache);
+        lru_lock();
+    }
+
+    lru_unlock();
+    return freed;
+}
+
+int page_lru_migrate(page_t *page, page_t *newpage) {
+    int         err     = 0;
+    icache_t    *icache = NULL;
+
+    page_assert(page);
+    page_assert(newpage);
+
+    // as in page_lru_shrink(), the LRU keeps 'icache' alive
+    // until we hold its lock, and that can only be tried.
+    lru_lock();
+    if (!lru_testflags(page, PG_LRU) || (icache = page->icache) == NULL ||
+        !spin_trylock(&icache->pc_lock)) {
+        lru_unlock();
+        return -EBUSY;
+    }
+    lru_unlock();
+
+    err = icache_migrate(icache, page, newpage);
+    icache_unlock(icache);
+    return err;
+}
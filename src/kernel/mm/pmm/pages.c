@@ -18,6 +18,7 @@ struct pmman pmman = {
     .mem_free   = mem_free,
     .get_page   = __page_alloc,
     .get_pages  = __page_alloc_n,
+    .free_pages = __page_free_n,
     .init       = physical_memory_init,
 };
 
@@ -57,96 +58,60 @@ size_t mem_used(void) {
     return (size / 1024);
 }
 
+/**
+ * Reference counts live in the page_t, found straight from the
+ * frame number, so none of these take the zone lock. A frame that
+ * is handed out always has a count, which is what they check
+ * instead of the zone bitmap. Only a drop to zero, in the free
+ * path, locks the zone to give the frame back.
+ */
 int page_increment(page_t *page) {
-    int     err     = 0;
-    zone_t  *zone   = NULL;
-
     if (page == NULL)
         return -EINVAL;
 
-    if ((err = getzone_bypage(page, &zone)))
-        return err;
-
-    assert(bitmap_test(&zone->bitmap, page_index(page, zone), 1),
+    assert(atomic_read(&page->refcnt),
         "[Warning]: Increment refcnt on unallocated page(%p).\n"
-        "[Advise]: Please use one of the alloc funcs.\n", page_addr(page, zone)
+        "[Advise]: Please use one of the alloc funcs.\n", page_to_phys(page)
     );
 
     atomic_inc(&page->refcnt);
-    zone_unlock(zone);
     return 0;
 }
 
 int page_decrement(page_t *page) {
-    int     err     = 0;
-    zone_t  *zone   = NULL;
-
     if (page == NULL)
         return -EINVAL;
 
-    if ((err = getzone_bypage(page, &zone)))
-        return err;
-    
-    assert(bitmap_test(&zone->bitmap, page_index(page, zone), 1),
-        "[Warning]: Decrement refcnt on unallocated page(%p).\n", page_addr(page, zone)
+    assert(atomic_read(&page->refcnt),
+        "[Warning]: Decrement refcnt on unallocated page(%p).\n", page_to_phys(page)
     );
-    
-    if (atomic_dec_fetch(&page->refcnt) == 0) {
-        assert(!(err = bitmap_unset(&zone->bitmap, page_index(page, zone), 1)),
-            "[ERROR] unsetting bit(%d) page(%p).\n", page_index(page, zone), page_addr(page, zone)
-        );
-    }
-    zone_unlock(zone);
+
+    page_free(page);
     return 0;
 }
 
 int __page_increment(uintptr_t paddr) {
-    int     err     = 0;
-    usize   index   = 0;
-    zone_t  *zone   = NULL;
+    page_t *page = NULL;
 
     if (!paddr)
         return -EINVAL;
 
-    if ((err = getzone_byaddr(paddr, PGSZ, &zone)))
-        return err;
-
-    index = (paddr - zone->start) / PGSZ;
+    if ((page = phys_to_page(paddr)) == NULL)
+        return -ENOENT;
 
-    assert(bitmap_test(&zone->bitmap, index, 1),
-        "[Warning]: Increment refcnt on unallocated page(%p).\n"
-        "[Advise]: Please use one of the alloc funcs.\n", paddr
-    );
-
-    atomic_inc(&zone->pages[index].refcnt);
-    zone_unlock(zone);
-    return 0;
+    return page_increment(page);
 }
 
 int __page_decrement(uintptr_t paddr) {
-    int     err     = 0;
-    usize   index   = 0;
-    zone_t  *zone   = NULL;
+    page_t *page = NULL;
 
     if (!paddr)
         return -EINVAL;
 
-    if ((err = getzone_byaddr(paddr, PGSZ, &zone)))
-        return err;
-
-    index = (paddr - zone->start) / PGSZ;
-
-    assert(bitmap_test(&zone->bitmap, index, 1),
-        "[Warning]: Decrement refcnt on unallocated page(%p).\n", paddr
-    );
+    if ((page = phys_to_page(paddr)) == NULL)
+        return -ENOENT;
 
-    if (atomic_dec_fetch(&zone->pages[index].refcnt) == 0) {
-        assert(!(err = bitmap_unset(&zone->bitmap, index, 1)),
-            "[ERROR] unsetting bit(%d) page(%p).\n", index, paddr
-        );
-    }
-    zone_unlock(zone);
-    return 0;
+    return page_decrement(page);
 }
 
 int page_get(page_t *page) {
@@ -170,54 +135,101 @@ int __page_put(uintptr_t paddr) {
 }
 
 int page_get_address(page_t *page, void **ppa) {
-    int     err = 0;
-    zone_t  *zone  = NULL;
-
     if (page == NULL || ppa == NULL)
         return -EINVAL;
-    
-    if ((err = getzone_bypage(page, &zone)))
-        return err;
-    
-    // convert the page to a physical address.
-    *ppa = (void *)page_addr(page, zone);
-    // or simply: *ppa = page->phys_addr; ?
 
-    zone_unlock(zone);
+    // convert the page to a physical address.
+    *ppa = (void *)page_to_phys(page);
     return 0;
 }
 
 int page_getcount(page_t *page, usize *pcnt) {
-    int     err = 0;
-    zone_t  *zone  = NULL;
-
     if (page == NULL || pcnt == NULL)
         return -EINVAL;
 
-    if ((err = getzone_bypage(page, &zone)))
-        return err;
-    
     *pcnt = atomic_read(&page->refcnt);
-    zone_unlock(zone);
     return 0;
 }
 
 int __page_getcount(uintptr_t paddr, usize *pcnt) {
-    int     err = 0;
-    zone_t  *zone   = NULL;
+    page_t *page = NULL;
 
     if (!paddr || pcnt == NULL)
         return -EINVAL;
 
-    if ((err = getzone_byaddr(paddr, PGSZ, &zone)))
-        return err;
+    if ((page = phys_to_page(paddr)) == NULL)
+        return -ENOENT;
+
+    *pcnt = atomic_read(&page->refcnt);
+    return 0;
+}
+
+bool __page_exclusive(uintptr_t paddr) {
+    page_t *page = NULL;
+
+    if (!paddr || iszero_page(paddr))
+        return false;
+
+    if ((page = phys_to_page(paddr)) == NULL)
+        return true;
+
+    return (page->icache == NULL) && (atomic_read(&page->refcnt) == 1);
+}
+
+/*Take or drop one mlock() pin on the frame at 'paddr'.*/
+static int page_set_pinned(uintptr_t paddr, bool pin) {
+    page_t  *page   = NULL;
+    ulong   flags   = 0;
+    ulong   pins    = 0;
+
+    if (!paddr)
+        return -EINVAL;
+
+    if ((page = phys_to_page(paddr)) == NULL)
+        return -ENOENT;
+
+    flags = atomic_read(&page->flags);
+    do {
+        pins = PG_FIELD(flags, PIN);
+        if (pin ? pins == BS(PG_PIN_BITS) - 1 : pins == 0)
+            return pin ? -EOVERFLOW : -EINVAL;
+    } while (!atomic_cmpxchg(&page->flags, &flags,
+        pin ? flags + BS(PG_PIN_SHIFT) : flags - BS(PG_PIN_SHIFT)));
 
-    *pcnt = atomic_read(&zone->pages[(paddr - zone->start) / PGSZ].refcnt);
-    zone_unlock(zone);
     return 0;
 }
 
-int page_check_watermark(uintptr_t vaddr) {
+int __page_pin(uintptr_t paddr) {
+    return page_set_pinned(paddr, true);
+}
+
+int __page_unpin(uintptr_t paddr) {
+    return page_set_pinned(paddr, false);
+}
+
+bool __page_pinned(uintptr_t paddr) {
+    page_t *page = NULL;
+
+    if (!paddr || (page = phys_to_page(paddr)) == NULL)
+        return false;
+
+    return atomic_read(&page->flags) & PG_PIN_MASK;
+}
+
+void __page_setmovable(uintptr_t paddr) {
+    page_t *page = NULL;
+
+    if (!paddr || iszero_page(paddr) || (page = phys_to_page(paddr)) == NULL)
+        return;
+
+    // page-cache pages are shared with the cache, not the mapping's to move.
+    if (page->icache || (atomic_read(&page->flags) & PG_RESERVED))
+        return;
+
+    atomic_or(&page->flags, PG_MOVABLE);
+}
+
+int page_check(uintptr_t vaddr) {
     pte_t *pte;
 
     int err = arch_getmapping(vaddr, &pte);
@@ -225,21 +237,12 @@ int page_check_watermark(uintptr_t vaddr) {
 
     const uintptr_t paddr = PTE2PHYS(pte);
 
-    zone_t *zone = NULL;
-    err = getzone_byaddr(paddr, PGSZ, &zone);
-    if (err) return err;
-    
-    page_t *page = &zone->pages[(paddr - zone->start) / PGSZ];
-    if (!atomic_read(&page->refcnt) || !bitmap_test(&zone->bitmap, page - zone->pages, 1)) {
-        zone_unlock(zone);
+    page_t *page = phys_to_page(paddr);
+    if (page == NULL || !atomic_read(&page->refcnt)) {
         debug("Access to page handle denied.\n");;
         return -EACCES;
     }
-    
-    printk("%p->%p: %p\n", vaddr, paddr, page_watermark(page));
-
-    page_verify_watermark(page, zone);
-    zone_unlock(zone);
 
+    page_verify(page, page_zone(page));
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,53 @@
+#include <bits/errno.h>
+#include <mm/mem.h>
+#include <mm/page.h>
+#include <sync/atomic.h>
+#include <sync/spinlock.h>
+
+/**
+ * The shared zero page.
+ * Read faults on private anonymous memory map this one frame
+ * read-only instead of allocating and clearing a page of their own,
+ * the first write then gets a private frame through COW.
+ * It holds a reference of its own so it is never freed.
+ */
+static atomic_ulong zero_page   = 0;
+static atomic_ulong zero_hits   = 0;
+static SPINLOCK(zero_lock);
+
+int zero_page_get(uintptr_t *ppa) {
+    int err = 0;
+
+    if (ppa == NULL)
+        return -EINVAL;
+
+    if (atomic_read(&zero_page) == 0) {
+        spin_lock(zero_lock);
+        if (atomic_read(&zero_page) == 0) {
+            uintptr_t pa = 0;
+            if ((err = pmman.get_page(GFP_NORMAL | GFP_ZERO, (void **)&pa))) {
+                spin_unlock(zero_lock);
+                return err;
+            }
+            atomic_write(&zero_page, pa);
+        }
+        spin_unlock(zero_lock);
+    }
+
+    // the caller's mapping holds a reference, dropped again on unmap.
+    if ((err = __page_get(atomic_read(&zero_page))))
+        return err;
+
+    atomic_inc(&zero_hits);
+    *ppa = atomic_read(&zero_page);
+    return 0;
+}
+
+bool iszero_page(uintptr_t pa) {
+    const uintptr_t zero = atomic_read(&zero_page);
+    return (zero != 0) && (PGROUND(pa) == zero);
+}
+
+usize zero_page_hits(void) {
+    return atomic_read(&zero_hits);
+}
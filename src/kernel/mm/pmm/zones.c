@@ -6,7 +6,12 @@
 #include <string.h>
 #include <sys/thread.h>
 
-zone_t zones[NZONE];
+zone_t zones[NZONES];
+
+page_t *memmap_sections[MEMMAP_NSECTION];
+
+_Static_assert(NNUMA <= BS(PG_NODE_BITS), "page_t flags are too narrow for NNUMA");
+_Static_assert(NZONE <= BS(PG_ZONE_BITS), "page_t flags are too narrow for NZONE");
 
 const char *str_zone[] = {
     "DMA", "NORM", "HOLE", "HIGH", NULL,
@@ -14,16 +19,15 @@ const char *str_zone[] = {
 
 void zone_dump(zone_t *zone) {
     assert(zone, "zerror: No physical memory zone specified\n");
-    printk("\nZONE: %s\n"
-            "Array:  %16p\n"
+    printk("\nZONE: %s (node %d)\n"
             "Size:   %16d KiB\n"
             "Free:   %16d pages\n"
             "Used:   %16d pages\n"
             "Total:  %16d pages\n"
             "Start:  %16p\n"
             "End:    %16p\n",
-            str_zone[zone - zones],
-            zone->pages,
+            str_zone[getzone_index(zone)],
+            getzone_node(zone),
             zone->size / KiB(1),
             zone->npages - zone->upages,
             zone->upages,
@@ -34,50 +38,50 @@ void zone_dump(zone_t *zone) {
 }
 
 
+/*Lock and return the zone of 'page' if [paddr, paddr + size) lies within it.*/
+static int getzone_bylinks(page_t *page, uintptr_t paddr, usize size, zone_t **ppz) {
+    zone_t *zone = NULL;
+
+    if (page == NULL) {
+        return -ENOENT;
+    }
+
+    zone = page_zone(page);
+    zone_lock(zone);
+    if ((paddr >= zone->start) && zone_isvalid(zone) &&
+            ((paddr + size) <= (zone->start + zone->size))) {
+        *ppz = zone;
+        return 0;
+    }
+    zone_unlock(zone);
+
+    return -ENOENT;
+}
+
 int getzone_byaddr(uintptr_t paddr, usize size, zone_t **ppz) {
     if (ppz == NULL) {
         return -EINVAL;
     }
-    
-    for (zone_t *zone = zones; zone < &zones[NZONE]; ++zone) {
-        zone_lock(zone);
-        if ((paddr >= zone->start) && zone_isvalid(zone) &&
-                ((paddr + size) <= (zone->start + zone->size))) {
-            *ppz = zone;
-            return 0;
-        }
-        zone_unlock(zone);
-    }
 
-    return -ENOENT;
+    return getzone_bylinks(phys_to_page(paddr), paddr, size, ppz);
 }
 
 int getzone_bypage(page_t *page, zone_t **ppz) {
     if (page == NULL || ppz == NULL) {
         return -EINVAL;
     }
-    
-    for (zone_t *zone = zones; zone < &zones[NZONE]; ++zone) {
-        zone_lock(zone);
-        if ((page >= zone->pages) && zone_isvalid(zone) &&
-                (page < &zone->pages[zone->npages])) {
-            *ppz = zone;
-            return 0;
-        }
-        zone_unlock(zone);
-    }
 
-    return -ENOENT;
+    return getzone_bylinks(page, page_to_phys(page), PGSZ, ppz);
 }
 
-int getzone_byindex(int zone_i, zone_t **ref) {
+int getzone_byindex(int node, int zone_i, zone_t **ref) {
     zone_t *zone = NULL;
 
-    if ((zone_i < 0) || (zone_i > (int)NELEM(zones))) {
+    if ((zone_i < 0) || (zone_i >= NZONE) || (node < 0) || (node >= NNUMA)) {
         return -EINVAL;
     }
 
-    zone = &zones[zone_i];
+    zone = node_zone(node, zone_i);
     zone_lock(zone);
     // printk("requesting zone(%d): %p ,flags: %d\n", zone_i, zone, zone->flags);
     if (!zone_isvalid(zone)) {
@@ -89,6 +93,58 @@ int getzone_byindex(int zone_i, zone_t **ref) {
     return 0;
 }
 
+/**
+ * Back the memmap sections covering [start, start + size) that are
+ * not yet backed. Every page_t starts out on node 0, with its section
+ * already in its flags, zone_link_pages() fills in the rest.
+ */
+static int memmap_populate(uintptr_t start, usize size) {
+    page_t *map = NULL;
+    usize   sec = 0;
+    usize   end = 0;
+
+    end = (PFN(start + size - 1) >> PFN_SECTION_SHIFT);
+    if (end >= MEMMAP_NSECTION) {
+        return -ERANGE;
+    }
+
+    for (sec = PFN(start) >> PFN_SECTION_SHIFT; sec <= end; ++sec) {
+        if (memmap_sections[sec]) {
+            continue;
+        }
+
+        if ((map = boot_alloc(PAGES_PER_SECTION * sizeof (page_t), PGSZ)) == NULL) {
+            return -ENOMEM;
+        }
+
+        for (usize idx = 0; idx < PAGES_PER_SECTION; ++idx) {
+            map[idx] = (page_t) {
+                .flags      = PG_LINKS(sec, 0, 0),
+                .mapcnt     = 0,
+                .refcnt     = 0,
+                .icache     = NULL,
+                .index      = 0,
+                .lru        = (queue_node_t){0},
+            };
+        }
+
+        memmap_sections[sec] = map;
+    }
+
+    return 0;
+}
+
+/*Point the page_t's of 'zone' back at it.*/
+static void zone_link_pages(zone_t *zone) {
+    page_t *page = NULL;
+
+    for (usize idx = 0; idx < zone->npages; ++idx) {
+        page = zone_page(zone, idx);
+        page->flags = PG_LINKS(page_section(page), getzone_index(zone), getzone_node(zone)) |
+            (page->flags & ~PG_LINKS_MASK);
+    }
+}
+
 static inline int zone_alloc_buffers(zone_t *zone) {
     if (!zone_size(zone)) {
         return 0;
@@ -102,34 +158,93 @@ static inline int zone_alloc_buffers(zone_t *zone) {
     int err = bitmap_init(&zone->bitmap, (usize *)bitmap, zone->npages);
     if (err) return err;
 
-    size_t size = PGROUNDUP(zone->npages * sizeof(page_t));
-    const page_t *pages = (page_t *)boot_alloc(size, PGSZ);
-    if (!pages) return -ENOMEM;
-
-    page_watermark_t watermark;
-    switch (getzone_index(zone)) {
-        case ZONEi_DMA:  watermark = PGWM_DMA_POOL; break;
-        case ZONEi_NORM: watermark = PGWM_NORM_POOL; break;
-        case ZONEi_HOLE: watermark = PGWM_HOLE_POOL; break;
-        case ZONEi_HIGH: watermark = PGWM_HIGH_POOL; break;
+    if ((err = memmap_populate(zone->start, zone->size))) {
+        return err;
     }
 
-    zone->pages = (page_t *)pages;
-    for (usize idx = 0; idx < zone->npages; ++idx) {
-        zone->pages[idx] = (page_t) {
-            .flags      = 0,
-            .mapcnt     = 0,
-            .refcnt     = 0,
-            .icache     = NULL,
-            .watermark  = watermark
-        };
-    }
+    zone_link_pages(zone);
 
     // mark zone as valid for use.
     zone_flags_set(zone, ZONE_VALID);
     return 0;
 }
 
+/*Are the 'n' pages from 'idx' all free? 'idx' is aligned to 'n'.*/
+static bool zone_block_isfree(zone_t *zone, usize idx, usize n) {
+    const usize *map = zone->bitmap.bm_map;
+
+    if (idx + n > zone->npages) {
+        return false;
+    }
+
+    if (n < BITS_PER_USIZE) {
+        return !(map[idx / BITS_PER_USIZE] & ((BS(n) - 1) << (idx % BITS_PER_USIZE)));
+    }
+
+    for (usize w = idx / BITS_PER_USIZE; w < (idx + n) / BITS_PER_USIZE; ++w) {
+        if (map[w]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void zone_free_blocks(zone_t *zone, usize counts[NR_ORDER]) {
+    int     order = 0;
+    usize   idx   = 0;
+
+    memset(counts, 0, NR_ORDER * sizeof counts[0]);
+
+    if (!zone_isvalid(zone)) {
+        return;
+    }
+
+    while (idx < zone->npages) {
+        // a word with every page in use has nothing to count.
+        if (!(idx % BITS_PER_USIZE) && zone->bitmap.bm_map[idx / BITS_PER_USIZE] == ~0ul) {
+            idx += BITS_PER_USIZE;
+            continue;
+        }
+
+        for (order = NR_ORDER - 1; order >= 0; --order) {
+            if (!(idx & (BS(order) - 1)) && zone_block_isfree(zone, idx, BS(order))) {
+                break;
+            }
+        }
+
+        if (order < 0) {
+            idx += 1;
+            continue;
+        }
+
+        counts[order] += 1;
+        idx += BS(order);
+    }
+}
+
+int zone_fragmentation_index(const usize counts[NR_ORDER], int order) {
+    usize blocks = 0, pages = 0, suitable = 0;
+
+    for (int o = 0; o < NR_ORDER; ++o) {
+        blocks += counts[o];
+        pages  += counts[o] << o;
+        if (o >= order) {
+            suitable += counts[o];
+        }
+    }
+
+    if (blocks == 0) {
+        return 0;
+    }
+
+    if (suitable) {
+        return -1000;
+    }
+
+    return 1000 - (int)((1000 + ((pages * 1000) >> order)) / blocks);
+}
+
 static inline int zone_set_address_range(zone_t *zone, uintptr_t addr, usize size) {
     // enure that the previous zone is initialize before this one.
     if ((getzone_index(zone) > 0) && !((zone - 1)->flags & ZONE_VALID)) {
@@ -168,7 +283,7 @@ static int zone_enumerate(zone_t *zone, usize *memsz) {
     usize size = 0;
     uintptr_t addr = 0;
 
-    switch (zone - zones) {
+    switch (getzone_index(zone)) {
     case ZONEi_DMA:
         addr = 0; // DMA zone starts at 0x0
         size = (*memsz > M2KiB(16)) ? MiB(16) : KiB(*memsz);
@@ -245,6 +360,20 @@ static int initialize_memory_zone(zone_t *zone, usize *memsz) {
     return 0;
 }
 
+/**
+ * Free-page watermarks, 1/64th of the zone for 'low' kept
+ * between 32 pages and 4MiB, 'high' twice that.
+ */
+static void zone_set_watermarks(zone_t *zone) {
+    usize low = zone->npages / 64;
+
+    low = low < 32 ? 32 : low;
+    low = low > NPAGE(MiB(4)) ? NPAGE(MiB(4)) : low;
+
+    zone->pages_low  = zone->npages ? low : 0;
+    zone->pages_high = zone->pages_low * 2;
+}
+
 // Helper function to process pages within a memory range
 static int mark_reserved_pages(zone_t *zone, uintptr_t addr, usize size) {
     usize   np      = 0;
@@ -254,9 +383,9 @@ static int mark_reserved_pages(zone_t *zone, uintptr_t addr, usize size) {
         return -EINVAL;
     }
 
-    page = zone->pages + NPAGE(addr - zone->start);
-    for (np = NPAGE(size); np; --np, page++, addr += PGSZ) {
-        bitmap_set(&zone->bitmap, page - zone->pages, 1);
+    for (np = NPAGE(size); np; --np, addr += PGSZ) {
+        page = phys_to_page(addr);
+        bitmap_set(&zone->bitmap, page_index(page, zone), 1);
 
         if (page->refcnt == 0) {
             zone->upages += 1; // Increment number of used pages.
@@ -267,8 +396,7 @@ static int mark_reserved_pages(zone_t *zone, uintptr_t addr, usize size) {
 
         page->refcnt += 1;
         page->mapcnt += 1;
-        page->watermark = PGWM_RESERVED;
-        page_setflags(page, PG_R | PG_X); // Read and exec only.
+        page_setflags(page, PG_RESERVED | PG_R | PG_X); // Read and exec only.
     }
 
     return 0;
@@ -312,11 +440,18 @@ int zones_init(void) {
 
     // printk("Initializing memory zones...\n");
 
-    // Initialize zones.
+    // Initialize zones, all memory starts out on node 0.
     for (zone = zones; zone < &zones[NZONE]; ++zone) {
         if ((err = initialize_memory_zone(zone, &memsz))) {
             return err;
         }
+
+        zone_set_watermarks(zone);
+    }
+
+    // the other nodes get theirs once the SRAT can be read.
+    for (; zone < &zones[NZONES]; ++zone) {
+        initialize_zone_struct(zone);
     }
 
     // Process memory map regions.
@@ -332,6 +467,99 @@ int zones_init(void) {
     return 0;
 }
 
+/**
+ * Hand the part of 'zone' from 'addr' up over to 'tail', the zone of the
+ * same kind on another node. Both keep slices of the same bitmap, 'addr'
+ * is rounded up to a whole bitmap word so that they do not share one, and
+ * the tail's page_t's are re-linked to its node.
+ * Called at boot, before anything else looks at the zones.
+ */
+static int zone_carve(zone_t *zone, uintptr_t addr, zone_t *tail) {
+    usize off = 0;
+
+    zone_assert_locked(zone);
+    zone_assert_locked(tail);
+
+    off = ALIGN_UP(NPAGE(addr - zone->start), BITS_PER_USIZE);
+    if (off >= zone->npages || zone_isvalid(tail)) {
+        return -EINVAL;
+    }
+
+    tail->start     = zone->start + (off * PGSZ);
+    tail->size      = zone->size - (off * PGSZ);
+    tail->npages    = zone->npages - off;
+    tail->bitmap    = (bitmap_t){
+        .bm_map     = zone->bitmap.bm_map + (off / BITS_PER_USIZE),
+        .bm_size    = tail->npages,
+    };
+    spinlock_init(&tail->bitmap.bm_lock);
+    tail->upages    = bitmap_count_set(&tail->bitmap);
+    zone_flags_set(tail, ZONE_VALID);
+    zone_link_pages(tail);
+
+    zone->size          = off * PGSZ;
+    zone->npages        = off;
+    zone->bitmap.bm_size= off;
+    zone->upages       -= tail->upages;
+
+    // nothing left, the whole zone was on the other node.
+    if (off == 0) {
+        zone->start = 0;
+        zone_flags_mask(zone, ZONE_VALID);
+    }
+
+    zone_set_watermarks(zone);
+    zone_set_watermarks(tail);
+    return 0;
+}
+
+/**
+ * Split the zones along the node boundaries in the SRAT.
+ * Where a memory range enters a zone, that zone is carved and the
+ * rest of it, up to the next range, moves to the range's node. A range
+ * whose node already has that zone stays where it is, a zone covers
+ * one contiguous span, so interleaved ranges go to the first node seen.
+ */
+static void zones_numa_init(void) {
+    uintptr_t           lo      = 0, hi = 0;
+    zone_t              *zone   = NULL;
+    zone_t              *tail   = NULL;
+    const numa_memblk_t *blk    = NULL;
+    uintptr_t           bounds[NZONE][2] = {0};
+
+    if (numa_node_count() < 2) {
+        return;
+    }
+
+    // where each kind of zone was before any carving.
+    for (int zi = 0; zi < NZONE; ++zi) {
+        bounds[zi][0] = zone_start(node_zone(0, zi));
+        bounds[zi][1] = zone_end(node_zone(0, zi));
+    }
+
+    for (usize i = 0; (blk = numa_memblk_get(i)); ++i) {
+        for (int zi = 0; zi < NZONE; ++zi) {
+            lo = PGROUNDUP(blk->start > bounds[zi][0] ? blk->start : bounds[zi][0]);
+            hi = blk->start + blk->size < bounds[zi][1] ? blk->start + blk->size : bounds[zi][1];
+
+            if (lo >= hi || getzone_byaddr(lo, PGSZ, &zone)) {
+                continue;
+            }
+
+            if ((tail = node_zone(blk->node, zi)) != zone) {
+                zone_lock(tail);
+                if (zone_carve(zone, lo, tail) == 0) {
+                    debug("NUMA: zone %s of node %d from %p\n",
+                        str_zone[zi], blk->node, tail->start);
+                }
+                zone_unlock(tail);
+            }
+
+            zone_unlock(zone);
+        }
+    }
+}
+
 static int zones_protect_sections(void) {
     static atomic_ulong inits = -1;
 
@@ -370,6 +598,35 @@ static int zones_protect_sections(void) {
     return 0;
 }
 
+/**
+ * Direct-map the RAM the memory map reports inside 'zone', each range
+ * rounded in to 2MiB boundaries so that none of the MMIO around it ends
+ * up mapped write-back and global. Frames left out are still reached
+ * through temporary mappings.
+ */
+static int zone_physmap(zone_t *zone) {
+    int         err     = 0;
+    uintptr_t   start   = 0;
+    uintptr_t   end     = 0;
+    boot_mmap_t *map    = bootinfo.mmap;
+
+    for (usize i = 0; i < bootinfo.mmapcnt; ++i) {
+        if (map[i].type != MULTIBOOT_MEMORY_AVAILABLE)
+            continue;
+
+        start   = ALIGN_UP(MAX(V2LO(map[i].addr), zone_start(zone)), PGSZ2MB);
+        end     = ALIGN_DOWN(MIN(V2LO(map[i].addr) + map[i].size, zone_end(zone)), PGSZ2MB);
+
+        if (start >= end)
+            continue;
+
+        if ((err = arch_physmap_range(start, end - start)))
+            return err;
+    }
+
+    return 0;
+}
+
 int physical_memory_init(void) {
     int         err  = 0;
     uintptr_t   addr = 0;
@@ -377,6 +634,16 @@ int physical_memory_init(void) {
     if ((err = zones_init())) {
         return 0;
     }
+
+    // Build the permanent direct map of every zone's RAM so that
+    // arch_mount()/arch_unmount() reduce to plain address offsets.
+    for (zone_t *zone = zones; zone < &zones[NZONES]; ++zone) {
+        if (zone->size == 0) continue;
+
+        assert_eq(err = zone_physmap(zone), 0,
+            "Failed to direct-map zone %s, err: %d\n", str_zone[getzone_index(zone)], err
+        );
+    }
     
     usize size = GiB(2) - PGROUNDUP(zones[ZONEi_NORM].size);
     if ((long)size > 0) {
@@ -395,10 +662,19 @@ int physical_memory_init(void) {
         }
     }
 
+    // PTE_PS: the framebuffer is large and physically contiguous,
+    // let it use 2MiB pages where it is suitably aligned.
     arch_map_i(bootinfo.fb.addr, V2LO(bootinfo.fb.addr),
-        bootinfo.fb.size, PTE_KRW | PTE_WTCD
+        bootinfo.fb.size, PTE_KRW | PTE_WTCD | PTE_PS
     );
 
+    // ACPI tables anywhere below 4GiB are reachable from here on.
+    if ((err = numa_init())) {
+        printk("NUMA: ignoring bad SRAT, err: %d\n", err);
+    }
+
+    zones_numa_init();
+
     zones_protect_sections();
 
     return 0;
@@ -0,0 +1,166 @@
+#include <bits/errno.h>
+#include <core/debug.h>
+#include <mm/compaction.h>
+#include <mm/page.h>
+#include <mm/reclaim.h>
+#include <mm/swap.h>
+#include <mm/vmstat.h>
+#include <mm/zone.h>
+#include <sync/atomic.h>
+#include <sync/cond.h>
+#include <sys/thread.h>
+
+/**
+ * *******************************************************************
+ * @brief   Shrinker registry and kswapd.                            *
+ * *******************************************************************/
+
+static QUEUE(shrinkers);
+
+static COND_VAR(kswapd_wait);
+static atomic_t kswapd_running = 0;
+static atomic_t kswapd_pending = 0;
+
+int register_shrinker(shrinker_t *shrinker) {
+    int err = 0;
+
+    if (shrinker == NULL || shrinker->count == NULL || shrinker->scan == NULL)
+        return -EINVAL;
+
+    queue_lock(shrinkers);
+    shrinker->node.data = shrinker;
+    err = embedded_enqueue(shrinkers, &shrinker->node, QUEUE_UNIQUE);
+    queue_unlock(shrinkers);
+    return err;
+}
+
+void unregister_shrinker(shrinker_t *shrinker) {
+    if (shrinker == NULL)
+        return;
+
+    // a shrinker being run stays linked, shrinker_next() steps off it.
+    queue_lock(shrinkers);
+    while (atomic_read(&shrinker->users)) {
+        queue_unlock(shrinkers);
+        sched_yield();
+        queue_lock(shrinkers);
+    }
+    embedded_queue_remove(shrinkers, &shrinker->node);
+    queue_unlock(shrinkers);
+}
+
+/**
+ * Step from 'prev' to the next registered shrinker, or to the first one
+ * if 'prev' is NULL. The shrinker returned holds a user reference, so
+ * it stays linked while it runs without the queue lock held, and the
+ * one on 'prev' is dropped.
+ */
+static shrinker_t *shrinker_next(shrinker_t *prev) {
+    queue_node_t    *node   = NULL;
+    shrinker_t      *next   = NULL;
+
+    queue_lock(shrinkers);
+    node = prev ? prev->node.next : shrinkers->head;
+    if (node) {
+        next = queue_node_get_container(node, shrinker_t, node);
+        atomic_inc(&next->users);
+    }
+
+    if (prev)
+        atomic_dec(&prev->users);
+    queue_unlock(shrinkers);
+    return next;
+}
+
+usize shrink_memory(usize nr_pages) {
+    usize       freed    = 0;
+    usize       nr_scan  = 0;
+    shrinker_t  *shrinker = NULL;
+
+    for (int prio = RECLAIM_PRIORITY; prio >= 0 && freed < nr_pages; --prio) {
+        // scan() writes back, compresses and allocates, so it
+        // runs without the queue lock held.
+        for (shrinker = shrinker_next(NULL); shrinker; shrinker = shrinker_next(shrinker)) {
+            if ((nr_scan = shrinker->count(shrinker) >> prio) == 0)
+                continue;
+
+            freed += shrinker->scan(shrinker, nr_scan);
+            if (freed >= nr_pages) {
+                atomic_dec(&shrinker->users);
+                break;
+            }
+        }
+    }
+
+    vmstat_add(pgreclaim, freed);
+    return freed;
+}
+
+void reclaim_wakeup(void) {
+    if (!atomic_read(&kswapd_running))
+        return;
+
+    // one signal per round, kswapd clears this before it looks at the zones.
+    if (atomic_xchg(&kswapd_pending, 1) == 0) {
+        vmstat_inc(kswapd_wakeups);
+        cond_signal(kswapd_wait);
+    }
+}
+
+/*Pages needed to bring every zone back to its high watermark.*/
+static usize reclaim_target(void) {
+    usize   target  = 0;
+    usize   nfree   = 0;
+    zone_t  *zone   = NULL;
+
+    for (zone = zones; zone < &zones[NZONES]; ++zone) {
+        if (zone->npages == 0)
+            continue;
+
+        // a racy read is fine, we only need an estimate.
+        nfree = zone_free_pages(zone);
+        if (nfree < zone->pages_high)
+            target += zone->pages_high - nfree;
+    }
+
+    return target;
+}
+
+static usize pagecache_count(shrinker_t *shrinker __unused) {
+    return page_lru_count();
+}
+
+static usize pagecache_scan(shrinker_t *shrinker __unused, usize nr_scan) {
+    return page_lru_shrink(nr_scan);
+}
+
+static shrinker_t pagecache_shrinker = {
+    .name   = "pagecache",
+    .count  = pagecache_count,
+    .scan   = pagecache_scan,
+};
+
+static void kswapd(void) {
+    usize target = 0;
+
+    // page cache first, it is cheaper to drop than to compress.
+    register_shrinker(&pagecache_shrinker);
+    register_shrinker(&swap_shrinker);
+    register_shrinker(&kstack_shrinker);
+
+    atomic_write(&kswapd_running, 1);
+
+    loop_and_yield() {
+        atomic_write(&kswapd_pending, 0);
+
+        // sleep when balanced or when nothing could be freed,
+        // the next allocation below a low watermark wakes us.
+        if ((target = reclaim_target()) == 0 || shrink_memory(target) == 0) {
+            cond_wait(kswapd_wait, NULL, NULL);
+            continue;
+        }
+
+        // what reclaim frees is scattered, let kcompactd gather it.
+        compaction_wakeup();
+    }
+} BUILTIN_THREAD(kswapd, kswapd, NULL);
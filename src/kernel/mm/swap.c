@@ -0,0 +1,142 @@
+#include <arch/paging.h>
+#include <mm/mmap.h>
+#include <mm/page.h>
+#include <mm/swap.h>
+#include <mm/zone.h>
+#include <sys/proc.h>
+
+/**
+ * *******************************************************************
+ * @brief   Swap-out of cold anonymous pages to zram.                 *
+ * *******************************************************************/
+
+// where the last scan stopped, the next resumes after it.
+static pid_t swap_cursor = 0;
+
+/*Only regions whose pages nobody else can see, faulted in by us.*/
+static bool vmr_swappable(vmr_t *vmr) {
+    if (__vmr_shared(vmr) || __vmr_locked(vmr))
+        return false;
+
+    return vmr->vmops == NULL || vmr->vmops->fault_handler == NULL;
+}
+
+/*Called with mmap locked.*/
+static usize swap_out_mmap(mmap_t *mmap, usize nr) {
+    usize       swapped = 0;
+    uintptr_t   oldpdbr = 0;
+
+    if (mmap->pgdir == 0)
+        return 0;
+
+    arch_switch_pgdir(mmap->pgdir, &oldpdbr);
+
+    for (vmr_t *vmr = mmap->vmr_head; vmr && swapped < nr; vmr = vmr->next) {
+        if (vmr_swappable(vmr))
+            swapped += arch_swapout_range(__vmr_start(vmr), __vmr_size(vmr),
+                nr - swapped, vmr->flags & VM_LAZYFREE);
+    }
+
+    arch_switch_pgdir(oldpdbr, NULL);
+    return swapped;
+}
+
+static usize swap_count(shrinker_t *shrinker __unused) {
+    usize used = 0, cached = page_lru_count();
+
+    // anonymous pages are not tracked, whatever is in use
+    // and is not page cache is the most there could be.
+    for (zone_t *zone = zones; zone < &zones[NZONES]; ++zone)
+        used += zone->upages;
+
+    return used > cached ? used - cached : 0;
+}
+
+/**
+ * Pin the user process with the lowest pid above 'after', NULL if
+ * there is none. The reference keeps it around once procQ is let
+ * go, so that nothing slow happens with the queue locked.
+ */
+static proc_t *swap_next(pid_t after) {
+    proc_t  *proc = NULL;
+    proc_t  *next = NULL;
+
+    queue_lock(procQ);
+    do {
+        // the last pick was busy, look past it.
+        if (next)
+            after = next->pid;
+        next = NULL;
+
+        foreach_process(procQ, proc) {
+            if (proc == curproc || proc->pid <= after)
+                continue;
+
+            if (next && proc->pid >= next->pid)
+                continue;
+
+            if (!spin_trylock(&proc->lock))
+                continue;
+
+            if (proc_testflags(proc, PROC_USER) && proc->mmap)
+                next = proc;
+            proc_unlock(proc);
+        }
+    } while (next && !spin_trylock(&next->lock));
+
+    if (next) {
+        proc_getref(next);
+        proc_unlock(next);
+    }
+
+    queue_unlock(procQ);
+    return next;
+}
+
+static usize swap_scan(shrinker_t *shrinker __unused, usize nr_scan) {
+    usize   swapped = 0;
+    bool    wrapped = false;
+    pid_t   start   = swap_cursor;
+    pid_t   last    = swap_cursor;
+    mmap_t  *mmap   = NULL;
+    proc_t  *proc   = NULL;
+
+    // first the processes after the cursor, then wrap around.
+    while (swapped < nr_scan) {
+        if ((proc = swap_next(last)) == NULL) {
+            if (wrapped)
+                break;
+            wrapped = true, last = 0;
+            continue;
+        }
+
+        if (wrapped && proc->pid > start) {
+            proc_free(proc);
+            break;
+        }
+
+        last = proc->pid;
+
+        // the mmap lock alone keeps the address space from going away.
+        proc_lock(proc);
+        if ((mmap = proc->mmap) && !mmap_trylock(mmap))
+            mmap = NULL;
+        proc_unlock(proc);
+
+        if (mmap) {
+            swapped += swap_out_mmap(mmap, nr_scan - swapped);
+            mmap_unlock(mmap);
+        }
+
+        proc_free(proc);
+    }
+
+    swap_cursor = last;
+    return swapped;
+}
+
+shrinker_t swap_shrinker = {
+    .name   = "swap",
+    .count  = swap_count,
+    .scan   = swap_scan,
+};
@@ -1,3 +1,4 @@
+#include <arch/cpu.h>
 #include <arch/paging.h>
 #include <bits/errno.h>
 #include <boot/boot.h>
@@ -5,80 +6,236 @@
 #include <lib/printk.h>
 #include <string.h>
 #include <mm/mem.h>
+#include <mm/vmstat.h>
 #include <sync/spinlock.h>
 #include <sys/thread.h>
 
+/**
+ * *******************************************************************
+ * @brief   Kernel virtual address allocator.                        *
+ * Free ranges sit in two AVL trees, one by address for coalescing   *
+ * and one by size for best fit, used ranges in a third by address.  *
+ * Freed mappings may be left in place and purged in batches, and    *
+ * each CPU keeps a block of single pages for arch_mount().          *
+ * *******************************************************************/
+
+#define VM_BYADDR               0   // free and used trees, ordered by base.
+#define VM_BYSIZE               1   // free tree, ordered by size then base.
+#define VM_NTREE                2
+
+typedef struct vm_link {
+    struct node_t   *left;
+    struct node_t   *right;
+    struct node_t   *parent;
+    int             height;
+} vm_link_t;
+
 typedef struct node_t {
-    struct node_t   *prev;
     uintptr_t       base;
     size_t          size;
-    struct node_t   *next;
+    vm_link_t       link[VM_NTREE];
+    struct node_t   *next;  // on the free node pool or the lazy list.
 } node_t;
 
 #define node_assert(node)       ({ assert(node, "No vm node."); })
 #define node_get_len(node)      ({ node_assert(node); (node)->size; })
-#define node_get_start(node)    ({ node_assert(node); (node)->start; })
+#define node_get_start(node)    ({ node_assert(node); (node)->base; })
+
+#define vm_link(node, w)        ((node)->link[w])
 
 #define KHEAPSIZE               kheap_size
 #define KHEAPBASE               (V2HI(GiB(4)))
-#define NNODES                  (KHEAPSIZE / PGSZ)
+
+// lazily freed bytes allowed before they are purged.
+#define VM_LAZY_MAX             MiB(4)
+
+/**
+ * A CPU's private run of pages for single-page allocations.
+ * A freed page stays mapped and 'dirty' until the next purge,
+ * which unmaps it and makes it 'free' again.
+ */
+#define VM_BLOCK_NPAGE          64
+#define VM_BLOCK_SIZE           (VM_BLOCK_NPAGE * PGSZ)
+
+typedef struct vm_block {
+    spinlock_t  lock;
+    uintptr_t   base;   // set once, 0 until the first allocation.
+    ulong       free;   // pages that can be handed out.
+    ulong       dirty;  // freed pages still mapped.
+} vm_block_t;
 
 static SPINLOCK(lock);
-static usize    kheap_size      = 0;
-static atomic_t initialized     = 0;
-static size_t   used_memsz      = 0;
-static node_t   *free_node_list = NULL;
-static node_t   *usedvmr_list   = NULL;
-static node_t   *freevmr_list   = NULL;
-static node_t   *nodes          = NULL;
+static usize      kheap_size      = 0;
+static atomic_t   initialized     = 0;
+static size_t     used_memsz      = 0;
+static size_t     lazy_memsz      = 0;
+static usize      free_node_count = 0;
+static node_t     *free_node_list = NULL;
+static node_t     *usedvmr_tree   = NULL;
+static node_t     *freevmr_byaddr = NULL;
+static node_t     *freevmr_bysize = NULL;
+static node_t     *lazyvmr_list   = NULL;
+static vm_block_t vm_blocks[NCPU];
 
 #define vm_lock()               ({ spin_lock(lock); })
 #define vm_unlock()             ({ spin_unlock(lock); })
 #define vm_islocked()           ({ spin_islocked(lock); })
 #define vm_assert_locked()      ({ spin_assert_locked(lock); })
 
-static void node_dump(node_t *node, size_t i) {
-    if (node->prev && node->next) {
-        printk("%8.8ld: [%16p:%8ld KiB]<-[%16p:%8ld KiB]->[%16p:%8ld KiB]\n", i,
-            (void *)node->prev->base, node->prev->size / KiB(1),
-            (void *)node->base, node->size / KiB(1),
-            (void *)node->next->base, node->next->size / KiB(1)
-        );
-    } else if (node->prev) {
-        printk("%8.8ld: [%16p:%8ld KiB]<-[%16p:%8ld KiB]->[null]\n", i,
-            (void *)node->prev->base, node->prev->size / KiB(1),
-            (void *)node->base, node->size / KiB(1)
-        );
-    } else if (node->next) {
-        printk("%8.8ld: [null]<-[%16p:%8ld KiB]->[%16p:%8ld KiB]\n", i,
-            (void *)node->base, node->size / KiB(1),
-            (void *)node->next->base, node->next->size / KiB(1)
-        );
+static inline int vm_height(node_t *n, int w) {
+    return n ? vm_link(n, w).height : 0;
+}
+
+static inline int vm_balance(node_t *n, int w) {
+    return vm_height(vm_link(n, w).left, w) - vm_height(vm_link(n, w).right, w);
+}
+
+static inline bool vm_less(node_t *a, node_t *b, int w) {
+    if (w == VM_BYSIZE && a->size != b->size)
+        return a->size < b->size;
+    return a->base < b->base;
+}
+
+static void vm_recalc(node_t *n, int w) {
+    vm_link(n, w).height = 1 + (int)MAX(vm_height(vm_link(n, w).left, w),
+        vm_height(vm_link(n, w).right, w));
+}
+
+/*Put 'new' where 'old' hangs off its parent.*/
+static void vm_replace(node_t **root, int w, node_t *old, node_t *new) {
+    node_t *parent = vm_link(old, w).parent;
+
+    if (parent == NULL)
+        *root = new;
+    else if (vm_link(parent, w).left == old)
+        vm_link(parent, w).left = new;
+    else
+        vm_link(parent, w).right = new;
+
+    if (new) vm_link(new, w).parent = parent;
+}
+
+static node_t *vm_rotate_left(node_t **root, int w, node_t *x) {
+    node_t *y = vm_link(x, w).right;
+
+    vm_replace(root, w, x, y);
+    if ((vm_link(x, w).right = vm_link(y, w).left))
+        vm_link(vm_link(x, w).right, w).parent = x;
+    vm_link(y, w).left   = x;
+    vm_link(x, w).parent = y;
+
+    vm_recalc(x, w);
+    vm_recalc(y, w);
+    return y;
+}
+
+static node_t *vm_rotate_right(node_t **root, int w, node_t *x) {
+    node_t *y = vm_link(x, w).left;
+
+    vm_replace(root, w, x, y);
+    if ((vm_link(x, w).left = vm_link(y, w).right))
+        vm_link(vm_link(x, w).left, w).parent = x;
+    vm_link(y, w).right  = x;
+    vm_link(x, w).parent = y;
+
+    vm_recalc(x, w);
+    vm_recalc(y, w);
+    return y;
+}
+
+/*Walk from 'n' to the root restoring heights and the AVL invariant.*/
+static void vm_rebalance(node_t **root, int w, node_t *n) {
+    for (; n; n = vm_link(n, w).parent) {
+        vm_recalc(n, w);
+
+        if (vm_balance(n, w) > 1) {
+            if (vm_balance(vm_link(n, w).left, w) < 0)
+                vm_rotate_left(root, w, vm_link(n, w).left);
+            n = vm_rotate_right(root, w, n);
+        } else if (vm_balance(n, w) < -1) {
+            if (vm_balance(vm_link(n, w).right, w) > 0)
+                vm_rotate_right(root, w, vm_link(n, w).right);
+            n = vm_rotate_left(root, w, n);
+        }
+    }
+}
+
+static void vm_tree_insert(node_t **root, int w, node_t *n) {
+    node_t *parent = NULL, **link = root;
+
+    vm_assert_locked();
+
+    while (*link) {
+        parent = *link;
+        link   = vm_less(n, parent, w) ? &vm_link(parent, w).left : &vm_link(parent, w).right;
+    }
+
+    vm_link(n, w) = (vm_link_t){.parent = parent, .height = 1};
+    *link = n;
+
+    vm_rebalance(root, w, parent);
+}
+
+static void vm_tree_remove(node_t **root, int w, node_t *n) {
+    node_t *fix = NULL, *succ = NULL;
+
+    vm_assert_locked();
+
+    if (vm_link(n, w).left && vm_link(n, w).right) {
+        // splice in the in-order successor, it has no left child.
+        for (succ = vm_link(n, w).right; vm_link(succ, w).left; succ = vm_link(succ, w).left);
+
+        if (vm_link(succ, w).parent != n) {
+            fix = vm_link(succ, w).parent;
+            vm_replace(root, w, succ, vm_link(succ, w).right);
+            vm_link(succ, w).right = vm_link(n, w).right;
+            vm_link(vm_link(succ, w).right, w).parent = succ;
+        } else {
+            fix = succ;
+        }
+
+        vm_replace(root, w, n, succ);
+        vm_link(succ, w).left = vm_link(n, w).left;
+        vm_link(vm_link(succ, w).left, w).parent = succ;
     } else {
-        printk("%8.8ld: [null]<-[%16p:%8ld KiB]->[null]\n", i,
-            (void *)node->base, node->size / KiB(1)
-        );
+        fix = vm_link(n, w).parent;
+        vm_replace(root, w, n, vm_link(n, w).left ? vm_link(n, w).left : vm_link(n, w).right);
     }
+
+    vm_link(n, w) = (vm_link_t){0};
+    vm_rebalance(root, w, fix);
+}
+
+static void node_dump(node_t *node, size_t i) {
+    printk("%8.8ld: [%16p:%8ld KiB]\n", i, (void *)node->base, node->size / KiB(1));
+}
+
+static void dump_tree(node_t *n, int w, size_t *pi) {
+    if (n == NULL)
+        return;
+
+    dump_tree(vm_link(n, w).left, w, pi);
+    node_dump(n, (*pi)++);
+    dump_tree(vm_link(n, w).right, w, pi);
 }
 
-static void dump_list(node_t *list, const char *list_name) {
+static void dump_list(node_t *tree, const char *list_name) {
     size_t i = 0;
     printk("virtual memory regions:[%s]\n-START-\n", list_name);
-    forlinked(node, list, node->next)
-        node_dump(node, i++);
+    dump_tree(tree, VM_BYADDR, &i);
     printk("-END(%ld nodes)-\n\n", i);
 }
 
 void dump_free_node_list(void) {
-    dump_list(free_node_list, "FREE NODES");
+    printk("virtual memory regions:[FREE NODES]: %ld nodes\n\n", free_node_count);
 }
 
 void dump_freevmr_list(void) {
-    dump_list(freevmr_list, "FREE VMR");
+    dump_list(freevmr_byaddr, "FREE VMR");
 }
 
 void dump_usedvmr_list(void) {
-    dump_list(usedvmr_list, "USED VMR");
+    dump_list(usedvmr_tree, "USED VMR");
 }
 
 void dump_all_lists(void) {
@@ -87,18 +244,27 @@ void dump_all_lists(void) {
     dump_usedvmr_list();
 }
 
+/*Nodes come a page at a time, as the trees need them.*/
 static node_t *free_node_get(void) {
-    node_t *node = NULL;
+    node_t  *node = NULL;
+    void    *pa   = NULL;
 
     vm_assert_locked();
 
-    if (free_node_list == NULL)
-        return NULL;
+    if (free_node_list == NULL) {
+        if (pmman.get_page(GFP_NORMAL, &pa))
+            return NULL;
 
-    node  = free_node_list;
+        for (node = (node_t *)V2HI(pa); node + 1 <= (node_t *)(V2HI(pa) + PGSZ); ++node) {
+            node->next      = free_node_list;
+            free_node_list  = node;
+            free_node_count++;
+        }
+    }
 
-    if ((free_node_list  = node->next))
-        free_node_list->prev = NULL;
+    node            = free_node_list;
+    free_node_list  = node->next;
+    free_node_count--;
 
     *node = (node_t) {0};
     return node;
@@ -107,145 +273,145 @@ static node_t *free_node_get(void) {
 static void free_node_put(node_t *node) {
     node_assert(node);
     vm_assert_locked();
-    *node       = (node_t) {0};
-    node->next  = free_node_list;
-    if (free_node_list)
-        free_node_list->prev = node;
+    *node           = (node_t) {0};
+    node->next      = free_node_list;
     free_node_list  = node;
+    free_node_count++;
 }
 
-static int can_merge_prev(node_t *node, node_t *prev) {
-    node_assert(node);
+static int usedvmr_find(uintptr_t base, node_t **ppn) {
+    node_t *n = usedvmr_tree;
+
     vm_assert_locked();
-    if (prev == NULL)
-        return 0;
-    return (prev->base + prev->size) == node->base;
+
+    if (base == 0 || ppn == NULL)
+        return -EINVAL;
+
+    while (n && n->base != base)
+        n = base < n->base ? vm_link(n, VM_BYADDR).left : vm_link(n, VM_BYADDR).right;
+
+    if (n == NULL)
+        return -ENOENT;
+
+    *ppn = n;
+    return 0;
 }
 
-static int can_merge_next(node_t *node, node_t *next) {
-    node_assert(node);
-    vm_assert_locked();
-    if (next == NULL)
-        return 0;
-    return (node->base + node->size) == next->base;
+static void freevmr_take(node_t *node) {
+    vm_tree_remove(&freevmr_byaddr, VM_BYADDR, node);
+    vm_tree_remove(&freevmr_bysize, VM_BYSIZE, node);
 }
 
-static void usedvmr_put(node_t *node) {
-    node_t *tail = NULL;
+/*Return 'node' to the free trees, merged with whatever free range touches it.*/
+static void freevmr_put(node_t *node) {
+    node_t *prev = NULL, *next = NULL;
+
     node_assert(node);
     vm_assert_locked();
 
-    node->next = NULL;
-    node->prev = NULL;
-
-    forlinked(next, usedvmr_list, next->next) {
-        if (node->base < next->base) {
-            node->next = next;
-            if (next->prev) {
-                next->prev->next = node;
-            } else usedvmr_list = node;
-            node->prev  = next->prev;
-            next->prev = node;
-            return;
+    for (node_t *n = freevmr_byaddr; n; ) {
+        if (n->base < node->base) {
+            prev = n;
+            n = vm_link(n, VM_BYADDR).right;
+        } else {
+            next = n;
+            n = vm_link(n, VM_BYADDR).left;
         }
-        tail = next;
     }
 
-    if (tail) {
-        tail->next = node;
-        node->prev = tail;
-    } else usedvmr_list = node;
-}
-
-static int usedvmr_find(uintptr_t base, node_t **ppn) {
-    vm_assert_locked();
+    if (prev && (prev->base + prev->size) == node->base) {
+        freevmr_take(prev);
+        node->base  = prev->base;
+        node->size += prev->size;
+        free_node_put(prev);
+    }
 
-    if (base == 0 || ppn == NULL)
-        return -EINVAL;
-    
-    forlinked(node, usedvmr_list, node->next) {
-        if (base == node->base) {
-            *ppn = node;
-            return 0;
-        }
+    if (next && (node->base + node->size) == next->base) {
+        freevmr_take(next);
+        node->size += next->size;
+        free_node_put(next);
     }
 
-    return -ENOENT;
+    vm_tree_insert(&freevmr_byaddr, VM_BYADDR, node);
+    vm_tree_insert(&freevmr_bysize, VM_BYSIZE, node);
 }
 
-static void freevmr_put(node_t *node) {
-    node_t *prev = NULL, *next = freevmr_list;
+/*Best fit: the smallest free range of at least 'size' bytes, lowest first.*/
+static int freevmr_get(size_t size, node_t **ppn) {
+    node_t *best = NULL;
 
-    node_assert(node);
     vm_assert_locked();
 
-    node->next = NULL;
-    node->prev = NULL;
+    if (size == 0 || ppn == NULL)
+        return -EINVAL;
 
-    // Traverse the list to find the correct insertion point based on node->base
-    while (next && next->base < node->base) {
-        prev = next;
-        next = next->next;
+    for (node_t *n = freevmr_bysize; n; ) {
+        if (n->size >= size) {
+            best = n;
+            n = vm_link(n, VM_BYSIZE).left;
+        } else n = vm_link(n, VM_BYSIZE).right;
     }
 
-    // Check if we can merge with the prev node
-    if (prev && can_merge_prev(node, prev)) {
-        prev->size += node->size;
-        // Try to merge prev with the next (next) node if possible
-        if (next && can_merge_next(prev, next)) {
-            prev->size += next->size;
-            prev->next = next->next;
-            if (next->next) {
-                next->next->prev = prev;
-            }
-            free_node_put(next);
-        }
-        free_node_put(node);
-        return;
-    }
+    if (best == NULL)
+        return -ENOMEM;
 
-    // Check if we can merge with the next node
-    if (next && can_merge_next(node, next)) {
-        next->size += node->size;
-        next->base -= node->size;
-        if (prev) {
-            prev->next = next;
-        } else {
-            freevmr_list = next;
-        }
-        next->prev = prev;
-        free_node_put(node);
-        return;
-    }
+    *ppn = best;
+    return 0;
+}
 
-    // If no merge happened, insert the node between prev and next
-    node->next = next;
-    node->prev = prev;
+/**
+ * Unmap everything freed lazily, the lazy list and the dirty pages
+ * of every CPU's block, under one TLB batch so that it costs a single
+ * shootdown. The ranges can only be handed out again after this.
+ */
+static void vmm_purge(void) {
+    node_t  *list = NULL, *next = NULL;
+    ulong   purged[NCPU] = {0};
 
-    if (next) {
-        next->prev = node;
-    }
+    vm_lock();
+    list            = lazyvmr_list;
+    lazyvmr_list    = NULL;
+    lazy_memsz      = 0;
+    vm_unlock();
 
-    if (prev) {
-        prev->next = node;
-    } else {
-        freevmr_list = node;  // New node becomes the head if prev is NULL
+    for (int i = 0; i < NCPU; ++i) {
+        spin_lock(&vm_blocks[i].lock);
+        purged[i] = vm_blocks[i].dirty;
+        vm_blocks[i].dirty = 0;
+        spin_unlock(&vm_blocks[i].lock);
     }
-}
 
-static int freevmr_get(size_t size, node_t **ppn) {
-    vm_assert_locked();
+    arch_tlbbatch_begin();
 
-    if (size == 0 || ppn == NULL)
-        return -EINVAL;
+    forlinked(node, list, node->next)
+        arch_unmap_n(node->base, node->size);
 
-    forlinked(node, freevmr_list, node->next) {
-        if (node->size >= size) {
-            *ppn = node;
-            return 0;
+    for (int i = 0; i < NCPU; ++i) {
+        for (int bit = 0; bit < VM_BLOCK_NPAGE; ++bit) {
+            if (purged[i] & BS(bit))
+                arch_unmap_n(vm_blocks[i].base + (bit * PGSZ), PGSZ);
         }
     }
-    return -ENOMEM;
+
+    // no CPU may still translate through the old mappings once the
+    // ranges are handed out again, not even if we run in a caller's batch.
+    arch_tlbbatch_flush();
+    arch_tlbbatch_end();
+    vmstat_inc(vmalloc_purges);
+
+    vm_lock();
+    for (node_t *node = list; node; node = next) {
+        next = node->next;
+        used_memsz -= node->size;
+        freevmr_put(node);
+    }
+    vm_unlock();
+
+    for (int i = 0; i < NCPU; ++i) {
+        spin_lock(&vm_blocks[i].lock);
+        vm_blocks[i].free |= purged[i];
+        spin_unlock(&vm_blocks[i].lock);
+    }
 }
 
 static int vmm_init(void) {
@@ -272,29 +438,17 @@ static int vmm_init(void) {
      * robust way reserving memory is implemented.*/
     kheap_size = KiB(bootinfo.total) * 2;
 
-    u64 order = get_page_order(NNODES * sizeof(node_t));
-    void *addr;
-    assert_eq(err = pmman.get_pages(GFP_NORMAL, order, &addr), 0,
-        "Error[%d]: initializing physical memory manager.\n", err
-    );
-
-    nodes = (node_t *)V2HI(addr);
-
-    memset(nodes, 0, sizeof nodes);
-
-    for (node  = nodes; node < &nodes[NNODES]; node++) {
-        if (node > nodes)
-            node->prev = node - 1;
-        if ((node + 1) < &nodes[NNODES])
-            node->next = node + 1;
+    for (int i = 0; i < NCPU; ++i) {
+        vm_blocks[i] = (vm_block_t){0};
+        spinlock_init(&vm_blocks[i].lock);
     }
 
-    free_node_list = nodes;
+    assert(node = free_node_get(),
+        "Error[%d]: allocating virtual memory nodes.\n", -ENOMEM
+    );
 
-    *(node = free_node_get()) = (node_t) {
-        .base = KHEAPBASE,
-        .size = KHEAPSIZE,
-    };
+    node->base = KHEAPBASE;
+    node->size = KHEAPSIZE;
 
     freevmr_put(node);
 
@@ -303,44 +457,49 @@ static int vmm_init(void) {
     return 0;
 }
 
-static int alloc(size_t size, void **ppv) {
+static int alloc_range(size_t size, void **ppv) {
     int     err = 0;
-    node_t *node = NULL, *split = NULL;
-    node_t *prev = NULL, *next = NULL;
+    node_t  *node = NULL, *split = NULL;
+    bool    purged = false;
 
-    if (!atomic_read(&initialized)) {
-        debug("requested size: %d KB\n", B2KiB(size));
-        vmm_init();
-    }
+    if (size == 0 || ppv == NULL)
+        return -EINVAL;
 
+retry:
     vm_lock();
 
     if ((err = freevmr_get(size, &split))) {
+        // what is waiting to be purged may be enough.
+        if (!purged && lazyvmr_list) {
+            vm_unlock();
+            vmm_purge();
+            purged = true;
+            goto retry;
+        }
+
         vm_unlock();
         return err;
     }
 
     if (split->size > size) {
-        node_assert(node = free_node_get());
+        if ((node = free_node_get()) == NULL) {
+            vm_unlock();
+            return -ENOMEM;
+        }
+
+        // the remainder keeps its place by address, not by size.
+        vm_tree_remove(&freevmr_bysize, VM_BYSIZE, split);
         node->base  = split->base;
+        node->size  = size;
         split->base += size;
         split->size -= size;
-        node->size  = size;
-        *ppv = (void *)node->base;
-        usedvmr_put(node);
-    } else if (split->size == size) {
-        next = split->next;
-        prev = split->prev;
-
-        if (next)
-            next->prev = prev;
-        if (prev)
-            prev->next = next;
-        else freevmr_list = next;
-
-        *ppv = (void *)split->base;
-        usedvmr_put(split);
-    } else assert(0, "Failed to get correct sized vmr_node");
+        vm_tree_insert(&freevmr_bysize, VM_BYSIZE, split);
+    } else {
+        freevmr_take(node = split);
+    }
+
+    vm_tree_insert(&usedvmr_tree, VM_BYADDR, node);
+    *ppv = (void *)node->base;
 
     // printk("%s(): %s:%d: virtual: %p: %X\n", __func__, __FILE__, __LINE__, *ppv, size);
     used_memsz += size;
@@ -348,29 +507,121 @@ static int alloc(size_t size, void **ppv) {
     return 0;
 }
 
+static void free(void *addr);
+
+/*A page from this CPU's block, carved from the trees the first time.*/
+static int vm_block_alloc(void **ppv) {
+    int         bit     = 0;
+    void        *base   = NULL;
+    bool        purged  = false;
+    vm_block_t  *block  = &vm_blocks[getcpuid()];
+
+    if (block->base == 0) {
+        if (alloc_range(VM_BLOCK_SIZE, &base))
+            return -ENOMEM;
+
+        spin_lock(&block->lock);
+        if (block->base == 0) {
+            block->base = (uintptr_t)base;
+            block->free = ~0ul;
+            base = NULL;
+        }
+        spin_unlock(&block->lock);
+
+        // lost a race for it, give ours back.
+        if (base) free(base);
+    }
+
+retry:
+    spin_lock(&block->lock);
+
+    if (block->free == 0) {
+        bool dirty = block->dirty != 0;
+        spin_unlock(&block->lock);
+
+        if (!dirty || purged)
+            return -ENOMEM;
+
+        vmm_purge();
+        purged = true;
+        goto retry;
+    }
+
+    bit = __builtin_ctzl(block->free);
+    block->free &= ~BS(bit);
+    spin_unlock(&block->lock);
+
+    *ppv = (void *)(block->base + (bit * PGSZ));
+    return 0;
+}
+
+/*Give back a page if it is from a CPU's block, true if it was.*/
+static bool vm_block_free(uintptr_t addr, bool lazy) {
+    ulong       bit     = 0;
+    vm_block_t  *block  = NULL;
+
+    for (block = vm_blocks; block < &vm_blocks[NCPU]; ++block) {
+        if (block->base && addr >= block->base && addr < block->base + VM_BLOCK_SIZE)
+            break;
+    }
+
+    if (block == &vm_blocks[NCPU])
+        return false;
+
+    bit = BS((addr - block->base) / PGSZ);
+
+    spin_lock(&block->lock);
+    assert(!(block->free & bit) && !(block->dirty & bit),
+        "Double free of virtual page %p.\n", addr);
+
+    if (lazy)
+        block->dirty |= bit;
+    else
+        block->free  |= bit;
+    spin_unlock(&block->lock);
+    return true;
+}
+
+static int alloc(size_t size, void **ppv) {
+    if (!atomic_read(&initialized)) {
+        debug("requested size: %d KB\n", B2KiB(size));
+        vmm_init();
+    }
+
+    // single pages, mostly arch_mount(), come from this CPU's block.
+    if (size == PGSZ && !vm_block_alloc(ppv))
+        return 0;
+
+    return alloc_range(size, ppv);
+}
+
+/*Take the used range at 'addr' out of the used tree.*/
+static node_t *usedvmr_take(uintptr_t addr) {
+    node_t *node = NULL;
+
+    if (usedvmr_find(addr, &node))
+        return NULL;
+
+    vm_tree_remove(&usedvmr_tree, VM_BYADDR, node);
+    return node;
+}
+
 static void free(void *addr) {
-    int err = 0;
-    node_t *node = NULL, *next = NULL;
+    node_t *node = NULL;
 
     assert(addr, "cannot free nullptr");
 
+    if (vm_block_free((uintptr_t)addr, false))
+        return;
+
     vm_lock();
 
-    if ((err = usedvmr_find((uintptr_t)addr, &node))) {
+    if ((node = usedvmr_take((uintptr_t)addr)) == NULL) {
         vm_unlock();
         return;
     }
 
     // printk("%s(): %s:%d: virtual: %p: %X\n", __func__, __FILE__, __LINE__, addr, node->size);
-    next = node->next;
-
-    if (node->prev)
-        node->prev->next = next;
-    else usedvmr_list = next;
-
-    if (next)
-        next->prev = node->prev;
-
     used_memsz -= node->size;
 
     freevmr_put(node);
@@ -381,6 +632,36 @@ void vmm_free(uintptr_t addr) {
     free((void *)addr);
 }
 
+/**
+ * Free the range at 'addr' with its mapping still in place.
+ * It is unmapped, and its frames dropped, by the next purge.
+ */
+void vmm_free_lazy(uintptr_t addr) {
+    node_t  *node   = NULL;
+    bool    purge   = false;
+
+    assert(addr, "cannot free nullptr");
+
+    if (vm_block_free(addr, true))
+        return;
+
+    vm_lock();
+
+    if ((node = usedvmr_take(addr)) == NULL) {
+        vm_unlock();
+        return;
+    }
+
+    node->next      = lazyvmr_list;
+    lazyvmr_list    = node;
+    lazy_memsz     += node->size;
+    purge           = lazy_memsz >= VM_LAZY_MAX;
+    vm_unlock();
+
+    if (purge)
+        vmm_purge();
+}
+
 uintptr_t vmm_alloc(size_t size) {
     uintptr_t   addr    = 0;
     alloc(size, (void **)&addr);
@@ -422,6 +703,7 @@ struct vmman vmman = {
     .init        = vmm_init,
     .free        = vmm_free,
     .alloc       = vmm_alloc,
+    .free_lazy   = vmm_free_lazy,
     .getinuse    = vmm_getinuse,
     .getfreesize = vmm_getfreesize,
 };
\ No newline at end of file
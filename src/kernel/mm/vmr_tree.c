@@ -0,0 +1,241 @@
+#include <core/debug.h>
+#include <mm/mmap.h>
+
+/**
+ * *******************************************************************
+ * @brief   VMR tree: gap-augmented AVL tree over an mmap's regions.  *
+ * *******************************************************************/
+
+static inline int vmr_height(vmr_t *n) {
+    return n ? n->height : 0;
+}
+
+static inline int vmr_balance(vmr_t *n) {
+    return vmr_height(n->left) - vmr_height(n->right);
+}
+
+size_t vmr_tree_gap(vmr_t *r) {
+    return r->start - (r->prev ? __vmr_upper_bound(r->prev) : 0);
+}
+
+/*Recompute the height and max_gap of 'n' from its children.*/
+static void vmr_tree_recalc(vmr_t *n) {
+    size_t gap = vmr_tree_gap(n);
+
+    if (n->left && n->left->max_gap > gap)
+        gap = n->left->max_gap;
+
+    if (n->right && n->right->max_gap > gap)
+        gap = n->right->max_gap;
+
+    n->max_gap = gap;
+    n->height  = 1 + (int)MAX(vmr_height(n->left), vmr_height(n->right));
+}
+
+static void vmr_tree_propagate(vmr_t *n) {
+    for (; n; n = n->parent)
+        vmr_tree_recalc(n);
+}
+
+/*Put 'new' where 'old' hangs off its parent.*/
+static void vmr_tree_replace(mmap_t *mmap, vmr_t *old, vmr_t *new) {
+    if (old->parent == NULL)
+        mmap->vmr_root = new;
+    else if (old->parent->left == old)
+        old->parent->left = new;
+    else
+        old->parent->right = new;
+
+    if (new) new->parent = old->parent;
+}
+
+static vmr_t *vmr_rotate_left(mmap_t *mmap, vmr_t *x) {
+    vmr_t *y = x->right;
+
+    vmr_tree_replace(mmap, x, y);
+    if ((x->right = y->left))
+        x->right->parent = x;
+    y->left   = x;
+    x->parent = y;
+
+    vmr_tree_recalc(x);
+    vmr_tree_recalc(y);
+    return y;
+}
+
+static vmr_t *vmr_rotate_right(mmap_t *mmap, vmr_t *x) {
+    vmr_t *y = x->left;
+
+    vmr_tree_replace(mmap, x, y);
+    if ((x->left = y->right))
+        x->left->parent = x;
+    y->right  = x;
+    x->parent = y;
+
+    vmr_tree_recalc(x);
+    vmr_tree_recalc(y);
+    return y;
+}
+
+/*Walk from 'n' to the root restoring heights, gaps and the AVL invariant.*/
+static void vmr_tree_rebalance(mmap_t *mmap, vmr_t *n) {
+    for (; n; n = n->parent) {
+        vmr_tree_recalc(n);
+
+        if (vmr_balance(n) > 1) {
+            if (vmr_balance(n->left) < 0)
+                vmr_rotate_left(mmap, n->left);
+            n = vmr_rotate_right(mmap, n);
+        } else if (vmr_balance(n) < -1) {
+            if (vmr_balance(n->right) > 0)
+                vmr_rotate_right(mmap, n->right);
+            n = vmr_rotate_left(mmap, n);
+        }
+    }
+}
+
+void vmr_tree_insert(mmap_t *mmap, vmr_t *r) {
+    vmr_t *parent = NULL, **link = &mmap->vmr_root;
+
+    mmap_assert_locked(mmap);
+
+    while (*link) {
+        parent = *link;
+        link   = (r->start < parent->start) ? &parent->left : &parent->right;
+    }
+
+    r->left   = r->right = NULL;
+    r->parent = parent;
+    r->height = 1;
+    *link     = r;
+
+    vmr_tree_rebalance(mmap, r);
+
+    // the hole below our successor just shrank.
+    vmr_tree_propagate(r->next);
+}
+
+void vmr_tree_remove(mmap_t *mmap, vmr_t *r) {
+    vmr_t *fix = NULL, *succ = NULL;
+
+    mmap_assert_locked(mmap);
+
+    if (r->left && r->right) {
+        // splice in the in-order successor, it has no left child.
+        for (succ = r->right; succ->left; succ = succ->left);
+
+        if (succ->parent != r) {
+            fix = succ->parent;
+            vmr_tree_replace(mmap, succ, succ->right);
+            succ->right = r->right;
+            succ->right->parent = succ;
+        } else {
+            fix = succ;
+        }
+
+        vmr_tree_replace(mmap, r, succ);
+        succ->left = r->left;
+        succ->left->parent = succ;
+    } else {
+        fix = r->parent;
+        vmr_tree_replace(mmap, r, r->left ? r->left : r->right);
+    }
+
+    r->left = r->right = r->parent = NULL;
+    r->height = 0, r->max_gap = 0;
+
+    vmr_tree_rebalance(mmap, fix);
+}
+
+void vmr_tree_update(mmap_t *mmap, vmr_t *r) {
+    if (r == NULL)
+        return;
+
+    mmap_assert_locked(mmap);
+
+    vmr_tree_propagate(r);
+    vmr_tree_propagate(r->next);
+}
+
+vmr_t *vmr_tree_find(mmap_t *mmap, uintptr_t addr) {
+    vmr_t *n = mmap->vmr_root;
+
+    while (n) {
+        if (addr < n->start)
+            n = n->left;
+        else if (addr > n->end)
+            n = n->right;
+        else
+            return n;
+    }
+
+    return NULL;
+}
+
+vmr_t *vmr_tree_next(mmap_t *mmap, uintptr_t addr) {
+    vmr_t *n = mmap->vmr_root, *best = NULL;
+
+    while (n) {
+        if (addr < n->start) {
+            best = n;
+            n = n->left;
+        } else n = n->right;
+    }
+
+    return best;
+}
+
+vmr_t *vmr_tree_prev(mmap_t *mmap, uintptr_t addr) {
+    vmr_t *n = mmap->vmr_root, *best = NULL;
+
+    while (n) {
+        if (n->end < addr) {
+            best = n;
+            n = n->right;
+        } else n = n->left;
+    }
+
+    return best;
+}
+
+static vmr_t *do_fit_after(vmr_t *n, uintptr_t addr, size_t size) {
+    vmr_t *r = NULL;
+
+    if (n == NULL || n->max_gap < size)
+        return NULL;
+
+    if (n->start >= addr) {
+        if ((r = do_fit_after(n->left, addr, size)))
+            return r;
+        if (vmr_tree_gap(n) >= size)
+            return n;
+    }
+
+    return do_fit_after(n->right, addr, size);
+}
+
+static vmr_t *do_fit_before(vmr_t *n, uintptr_t addr, size_t size) {
+    vmr_t *r = NULL;
+
+    if (n == NULL || n->max_gap < size)
+        return NULL;
+
+    if (n->start <= addr) {
+        if ((r = do_fit_before(n->right, addr, size)))
+            return r;
+        if (vmr_tree_gap(n) >= size)
+            return n;
+    }
+
+    return do_fit_before(n->left, addr, size);
+}
+
+vmr_t *vmr_tree_fit_after(mmap_t *mmap, uintptr_t addr, size_t size) {
+    mmap_assert_locked(mmap);
+    return do_fit_after(mmap->vmr_root, addr, size);
+}
+
+vmr_t *vmr_tree_fit_before(mmap_t *mmap, uintptr_t addr, size_t size) {
+    mmap_assert_locked(mmap);
+    return do_fit_before(mmap->vmr_root, addr, size);
+}
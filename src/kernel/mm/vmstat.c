@@ -0,0 +1,147 @@
+#include <arch/cpu.h>
+#include <arch/paging.h>
+#include <boot/boot.h>
+#include <lib/printk.h>
+#include <mm/mem.h>
+#include <mm/vmstat.h>
+#include <mm/zone.h>
+#include <mm/zram.h>
+
+vmstat_t vmstat;
+
+static const char *str_gfp[VMSTAT_NGFP] = {
+    "any", "dma", "normal", "hole", "high",
+};
+
+void latency_hist_add(latency_hist_t *hist, u64 cycles) {
+    int bucket = cycles ? 63 - __builtin_clzl(cycles) : 0;
+
+    atomic_inc(&hist->bucket[bucket < LATENCY_NBUCKET ? bucket : LATENCY_NBUCKET - 1]);
+    atomic_inc(&hist->count);
+    atomic_add(&hist->cycles, cycles);
+}
+
+// append to 'buf', 'len' keeps counting past 'size' so truncation is visible.
+#define emit(fmt, ...) ({                                               \
+    if (len < size)                                                     \
+        len += snprintf(buf + len, size - len, fmt, ##__VA_ARGS__);     \
+})
+
+#define emit_done()     ({ len < size ? len : size - 1; })
+
+usize vmstat_meminfo(char *buf, usize size) {
+    usize           len  = 0;
+    zram_stats_t    zram = {0};
+
+    zram_getstats(&zram);
+
+    emit("MemTotal:       %8lu kB\n", (ulong)bootinfo.total);
+    emit("MemFree:        %8lu kB\n", (ulong)pmman.mem_free());
+    emit("MemUsed:        %8lu kB\n", (ulong)pmman.mem_used());
+    emit("Cached:         %8lu kB\n", (ulong)page_lru_count() * (PGSZ / KiB(1)));
+    emit("VmallocTotal:   %8lu kB\n", (ulong)(vmman.getinuse() + vmman.getfreesize()) / KiB(1));
+    emit("VmallocUsed:    %8lu kB\n", (ulong)vmman.getinuse() / KiB(1));
+    emit("ZramStored:     %8lu kB\n", (ulong)zram.stored * (PGSZ / KiB(1)));
+    emit("ZramCompressed: %8lu kB\n", (ulong)zram.compr_bytes / KiB(1));
+    emit("ZramSameFilled: %8lu kB\n", (ulong)zram.same_filled * (PGSZ / KiB(1)));
+    return emit_done();
+}
+
+usize vmstat_buddyinfo(char *buf, usize size) {
+    usize   len = 0;
+    zone_t  *zone = NULL;
+    usize   counts[NR_ORDER];
+
+    for (zone = zones; zone < &zones[NZONES]; ++zone) {
+        if (!zone_isvalid(zone))
+            continue;
+
+        zone_free_blocks(zone, counts);
+
+        emit("Node %d, zone %6s", getzone_node(zone), str_zone[getzone_index(zone)]);
+        for (int order = 0; order < NR_ORDER; ++order)
+            emit(" %6lu", counts[order]);
+        emit("\n");
+
+        // how fragmented the zone is for each order, in thousandths.
+        emit("Node %d, zone %6s fragindex", getzone_node(zone), str_zone[getzone_index(zone)]);
+        for (int order = 0; order < NR_ORDER; ++order)
+            emit(" %5d", zone_fragmentation_index(counts, order));
+        emit("\n");
+    }
+
+    return emit_done();
+}
+
+static usize emit_latency(char *buf, usize size, usize len, const char *name, latency_hist_t *hist) {
+    ulong count = atomic_read(&hist->count);
+
+    emit("%s_count %lu\n", name, count);
+    emit("%s_avg_cycles %lu\n", name, count ? atomic_read(&hist->cycles) / count : 0ul);
+
+    // only the buckets with samples, named by their lower bound in log2 cycles.
+    for (int i = 0; i < LATENCY_NBUCKET; ++i) {
+        if ((count = atomic_read(&hist->bucket[i])))
+            emit("%s_log2_%d %lu\n", name, i, count);
+    }
+
+    return len;
+}
+
+usize vmstat_show(char *buf, usize size) {
+    usize           len  = 0;
+    tlb_stats_t     tlb  = {0}, sum = {0};
+    zram_stats_t    zram = {0};
+
+    for (int i = 0; i < VMSTAT_NGFP; ++i)
+        emit("pgalloc_%s %lu\n", str_gfp[i], atomic_read(&vmstat.pgalloc[i]));
+
+    for (int i = 0; i < VMSTAT_NGFP; ++i)
+        emit("pgalloc_fail_%s %lu\n", str_gfp[i], atomic_read(&vmstat.pgalloc_fail[i]));
+
+    for (int i = 0; i < NR_ORDER; ++i)
+        emit("pgalloc_fail_order_%d %lu\n", i, atomic_read(&vmstat.pgalloc_fail_order[i]));
+
+    emit("pgalloc_pages %lu\n",   atomic_read(&vmstat.pgalloc_pages));
+    emit("pgalloc_zero %lu\n",    atomic_read(&vmstat.pgalloc_zero));
+    emit("pgalloc_remote %lu\n",  atomic_read(&vmstat.pgalloc_remote));
+    emit("pgfree %lu\n",          atomic_read(&vmstat.pgfree));
+    emit("kswapd_wakeups %lu\n",  atomic_read(&vmstat.kswapd_wakeups));
+    emit("pgreclaim %lu\n",       atomic_read(&vmstat.pgreclaim));
+    emit("vmalloc_purges %lu\n",  atomic_read(&vmstat.vmalloc_purges));
+    emit("compact_stall %lu\n",   atomic_read(&vmstat.compact_stall));
+    emit("compact_success %lu\n", atomic_read(&vmstat.compact_success));
+    emit("compact_fail %lu\n",    atomic_read(&vmstat.compact_fail));
+    emit("compact_migrated %lu\n",atomic_read(&vmstat.compact_migrated));
+    emit("kcompactd_wakeups %lu\n", atomic_read(&vmstat.kcompactd_wakeups));
+    emit("zero_page_hits %lu\n",  (ulong)zero_page_hits());
+
+    zram_getstats(&zram);
+    emit("zram_stored %lu\n",       (ulong)zram.stored);
+    emit("zram_same_filled %lu\n",  (ulong)zram.same_filled);
+    emit("zram_compr_bytes %lu\n",  (ulong)zram.compr_bytes);
+    emit("zram_rejected %lu\n",     (ulong)zram.rejected);
+    emit("zram_loads %lu\n",        (ulong)zram.loads);
+
+    for (int cpuid = 0; cpuid < NCPU; ++cpuid) {
+        if (arch_tlbgetstats(cpuid, &tlb))
+            continue;
+        sum.ipi_sent        += tlb.ipi_sent;
+        sum.ipi_received    += tlb.ipi_received;
+        sum.invlpg          += tlb.invlpg;
+        sum.full_flushes    += tlb.full_flushes;
+        sum.switch_noflush  += tlb.switch_noflush;
+        sum.switch_flush    += tlb.switch_flush;
+    }
+
+    emit("tlb_ipi_sent %lu\n",       (ulong)sum.ipi_sent);
+    emit("tlb_ipi_received %lu\n",   (ulong)sum.ipi_received);
+    emit("tlb_invlpg %lu\n",         (ulong)sum.invlpg);
+    emit("tlb_full_flushes %lu\n",   (ulong)sum.full_flushes);
+    emit("tlb_switch_noflush %lu\n", (ulong)sum.switch_noflush);
+    emit("tlb_switch_flush %lu\n",   (ulong)sum.switch_flush);
+
+    len = emit_latency(buf, size, len, "page_alloc_latency", &vmstat.page_alloc_lat);
+    len = emit_latency(buf, size, len, "kmalloc_latency", &vmstat.kmalloc_lat);
+    return emit_done();
+}
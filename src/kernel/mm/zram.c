@@ -0,0 +1,225 @@
+#include <arch/cpu.h>
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <lib/lz4.h>
+#include <mm/kalloc.h>
+#include <mm/zram.h>
+#include <string.h>
+#include <sync/preempt.h>
+#include <sync/spinlock.h>
+
+/**
+ * A compressed page.
+ * Same-filled pages (mostly all zeroes) keep no data, only 'fill'.
+ * A free slot reuses 'fill' to link to the next free one.
+ */
+typedef struct zram_slot {
+    void    *data;
+    usize   len;
+    ulong   refs;
+    ulong   fill;
+} zram_slot_t;
+
+#define ZRAM_NOSLOT         (~0ul)
+#define ZRAM_SLOTS_CHUNK    512
+
+/**
+ * Compression scratch, one per CPU so that compressing
+ * needs no lock, used with interrupts off. The output goes
+ * straight to a buffer the caller allocated beforehand.
+ */
+static struct zram_pcpu {
+    u8  wrkmem[LZ4_WRKMEM_SIZE];
+} zram_pcpu[NCPU];
+
+static zram_slot_t  *zram_slots     = NULL;
+static usize        zram_nslots     = 0;
+static ulong        zram_free_head  = ZRAM_NOSLOT;
+static zram_stats_t zram_stats      = {0};
+static SPINLOCK(zram_lock);
+
+/*Grow the slot table by a chunk, called with zram_lock held.*/
+static int zram_grow(void) {
+    zram_slot_t *slots  = NULL;
+    usize       nslots  = zram_nslots + ZRAM_SLOTS_CHUNK;
+
+    if ((slots = krealloc(zram_slots, nslots * sizeof *slots)) == NULL)
+        return -ENOMEM;
+
+    // chain the new slots onto the free list, lowest first.
+    for (usize i = nslots; i-- > zram_nslots; ) {
+        slots[i] = (zram_slot_t){.fill = zram_free_head};
+        zram_free_head = i;
+    }
+
+    zram_slots  = slots;
+    zram_nslots = nslots;
+    return 0;
+}
+
+static int zram_slot_alloc(void *data, usize len, ulong fill, ulong *pslot) {
+    int     err  = 0;
+    ulong   slot = 0;
+
+    spin_lock(zram_lock);
+    if (zram_free_head == ZRAM_NOSLOT && (err = zram_grow())) {
+        spin_unlock(zram_lock);
+        return err;
+    }
+
+    slot           = zram_free_head;
+    zram_free_head = zram_slots[slot].fill;
+
+    zram_slots[slot] = (zram_slot_t){
+        .data   = data,
+        .len    = len,
+        .refs   = 1,
+        .fill   = fill,
+    };
+
+    zram_stats.stored++;
+    zram_stats.compr_bytes += len;
+    if (data == NULL)
+        zram_stats.same_filled++;
+    spin_unlock(zram_lock);
+
+    *pslot = slot;
+    return 0;
+}
+
+/*Is the page one word repeated? Such pages are stored without data.*/
+static bool zram_same_filled(const ulong *words, ulong *pfill) {
+    for (usize i = 1; i < PGSZ / sizeof *words; ++i) {
+        if (words[i] != words[0])
+            return false;
+    }
+
+    *pfill = words[0];
+    return true;
+}
+
+int zram_store(uintptr_t paddr, ulong *pslot) {
+    int     err   = 0;
+    int     len   = 0;
+    ulong   fill  = 0;
+    void    *va   = NULL;
+    void    *data = NULL;
+    void    *tmp  = NULL;
+
+    if (pslot == NULL)
+        return -EINVAL;
+
+    if ((err = arch_mount(PGROUND(paddr), &va)))
+        return err;
+
+    if (zram_same_filled(va, &fill)) {
+        arch_unmount((uintptr_t)va);
+        return zram_slot_alloc(NULL, 0, fill, pslot);
+    }
+
+    // the allocator is not to be called with interrupts off,
+    // so room for the largest result we keep is taken up front.
+    if ((data = kmalloc(ZRAM_MAX_CLEN)) == NULL) {
+        arch_unmount((uintptr_t)va);
+        return -ENOMEM;
+    }
+
+    pushcli();
+    len = lz4_compress(va, PGSZ, data, ZRAM_MAX_CLEN, zram_pcpu[getcpuid()].wrkmem);
+    popcli();
+
+    arch_unmount((uintptr_t)va);
+
+    if (len < 0) {
+        kfree(data);
+
+        spin_lock(zram_lock);
+        zram_stats.rejected++;
+        spin_unlock(zram_lock);
+        return len;
+    }
+
+    // give back what the page did not need, keep the lot if we can't.
+    if ((tmp = krealloc(data, len)) != NULL)
+        data = tmp;
+
+    if ((err = zram_slot_alloc(data, len, 0, pslot)))
+        kfree(data);
+    return err;
+}
+
+int zram_load(ulong slot, uintptr_t paddr) {
+    int         err  = 0;
+    void        *va  = NULL;
+    zram_slot_t s    = {0};
+
+    spin_lock(zram_lock);
+    if (slot >= zram_nslots || zram_slots[slot].refs == 0) {
+        spin_unlock(zram_lock);
+        return -EINVAL;
+    }
+    // the caller's reference keeps 'data' alive after we let go.
+    s = zram_slots[slot];
+    zram_stats.loads++;
+    spin_unlock(zram_lock);
+
+    if ((err = arch_mount(PGROUND(paddr), &va)))
+        return err;
+
+    if (s.data == NULL) {
+        for (usize i = 0; i < PGSZ / sizeof s.fill; ++i)
+            ((ulong *)va)[i] = s.fill;
+    } else if (lz4_decompress(s.data, s.len, va, PGSZ) != PGSZ) {
+        err = -EIO;
+    }
+
+    arch_unmount((uintptr_t)va);
+    return err;
+}
+
+int zram_dup(ulong slot) {
+    spin_lock(zram_lock);
+    if (slot >= zram_nslots || zram_slots[slot].refs == 0) {
+        spin_unlock(zram_lock);
+        return -EINVAL;
+    }
+
+    zram_slots[slot].refs++;
+    spin_unlock(zram_lock);
+    return 0;
+}
+
+void zram_free(ulong slot) {
+    void *data = NULL;
+
+    spin_lock(zram_lock);
+    if (slot >= zram_nslots || zram_slots[slot].refs == 0) {
+        spin_unlock(zram_lock);
+        return;
+    }
+
+    if (--zram_slots[slot].refs == 0) {
+        data = zram_slots[slot].data;
+
+        zram_stats.stored--;
+        zram_stats.compr_bytes -= zram_slots[slot].len;
+        if (data == NULL)
+            zram_stats.same_filled--;
+
+        zram_slots[slot] = (zram_slot_t){.fill = zram_free_head};
+        zram_free_head   = slot;
+    }
+    spin_unlock(zram_lock);
+
+    if (data)
+        kfree(data);
+}
+
+void zram_getstats(zram_stats_t *stats) {
+    if (stats == NULL)
+        return;
+
+    spin_lock(zram_lock);
+    *stats = zram_stats;
+    spin_unlock(zram_lock);
+}
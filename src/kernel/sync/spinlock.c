@@ -53,7 +53,7 @@ void spin_acquire(spinlock_t *lk) {
 
         arch_raw_lock_release(&(lk)->guard);
         popcli();
-        cpu_pause();
+        cpu_relax();
         pushcli();
         arch_raw_lock_acquire(&(lk)->guard);
     }
@@ -6,218 +6,230 @@
 #include <string.h>
 #include <sys/_elf.h>
 #include <sys/binary_loader.h>
+#include <sys/elf_dynamic.h>
+#include <sys/exec_cache.h>
 
-// Global symbol table for dynamic linking (can be extended with a hash map for efficiency).
-typedef struct symtab_entry {
-    char *name;
-    void *addr;
-} symtab_entry_t;
-
-#define MAX_SYMBOLS     1024
-static int              symb_cnt = 0;
-static symtab_entry_t   symb_tab[MAX_SYMBOLS];
-
-int elf_check(inode_t *binary) {
-    Elf64_Ehdr h;
-
-    if (binary == NULL) {
+static int elf_check_header(const Elf64_Ehdr *h) {
+    if ((h->e_ident[EI_MAG0] != 0x7f) || (h->e_ident[EI_MAG1] != 'E')||
+        (h->e_ident[EI_MAG2] != 'L')  || (h->e_ident[EI_MAG3] != 'F')) {
         return -EINVAL;
     }
 
-    iassert_locked(binary);
-    if (iread(binary, 0, &h, sizeof h) != sizeof h) {
-        return -EAGAIN;
-    }
-
-    if ((h.e_ident[EI_MAG0] != 0x7f) || (h.e_ident[EI_MAG1] != 'E')||
-        (h.e_ident[EI_MAG2] != 'L')  || (h.e_ident[EI_MAG3] != 'F')) {
-        return -EINVAL;
-    }
-
-    if (h.e_ident[EI_CLASS]   != ELFCLASS64  ||
-        h.e_ident[EI_DATA]    != ELFDATA2LSB ||
-        h.e_ident[EI_VERSION] != EV_CURRENT) {
+    if (h->e_ident[EI_CLASS]   != ELFCLASS64  ||
+        h->e_ident[EI_DATA]    != ELFDATA2LSB ||
+        h->e_ident[EI_VERSION] != EV_CURRENT) {
         return -EINVAL;
     }
 
     return 0;
 }
 
-// Register a symbol in the global symbol table.
-int register_symbol(const char *name, void *addr) {
-    if (symb_cnt >= MAX_SYMBOLS) {
-        return -ENOMEM;
-    }
-
-    if (!(symb_tab[symb_cnt].name = strdup(name))) {
-        return -ENOMEM;
+/*Lay out the region a PT_LOAD segment is mapped into.*/
+static int elf_segment(const Elf64_Phdr *hdr, exec_segment_t *seg) {
+    // the loader only maps whole pages, so a segment must sit
+    // at the same offset into a page in memory as in the file.
+    const usize pgoff = PGOFF(hdr->p_vaddr);
+    if (pgoff != PGOFF(hdr->p_offset)) {
+        return -ENOEXEC;
+    }
+
+    seg->es_start   = ALIGN4K(hdr->p_vaddr);
+    seg->es_size    = PGROUNDUP(hdr->p_memsz + pgoff);
+    seg->es_prot    = (hdr->p_flags & PF_X ? PROT_X : 0) |
+                      (hdr->p_flags & PF_W ? PROT_W : 0) |
+                      (hdr->p_flags & PF_R ? PROT_R : 0);
+
+    /**
+     * Start the file-backed part of the region where the region
+     * starts, on a page boundary in the file. Each whole page of it
+     * is then a page of the binary's page cache, which faults map
+     * read-only into every process running the binary rather than
+     * copying it. Writes to a data segment break a page off through
+     * COW, text is never written and stays shared.
+     */
+    seg->es_memsz       = hdr->p_memsz  + pgoff;
+    seg->es_filesz      = hdr->p_filesz + pgoff;
+    seg->es_file_pos    = hdr->p_offset - pgoff;
+
+    // nothing in a read-only segment has to read as zero, so its
+    // last, partial page can come from the cache too.
+    if (!(hdr->p_flags & PF_W) && hdr->p_memsz <= hdr->p_filesz) {
+        seg->es_filesz  = seg->es_size;
     }
 
-    symb_tab[symb_cnt].addr = addr;
-    symb_cnt++;
     return 0;
 }
 
-// Lookup a symbol in the global symbol table.
-void *resolve_symbol(const char *name) {
-    for (int i = 0; i < symb_cnt; i++) {
-        if (string_eq(symb_tab[i].name, name)) {
-            return symb_tab[i].addr;
-        }
-    }
-
-    return NULL;
-}
-
-// ELF Loader for Executables and Shared Libraries.
-int elf_loader(inode_t *binary, mmap_t *mmap) {
-    int         err         = 0;
-    u64         memsz       = 0;
-    u64         rela_count  = 0;
-    Elf64_Ehdr   elf        = {0};
-    Elf64_Dyn   *dyn        = NULL;
-    Elf64_Phdr  *phdr       = NULL;
-    Elf64_Rela  *rela       = NULL;
-    Elf64_Sym   *symtab     = NULL;
-    char        *strtab     = NULL;
-
-    if (binary == NULL) {
-        return -EINVAL;
-    }
-
-    iassert_locked(binary);
-    mmap_assert_locked(mmap);
+/*Read and parse the headers of the locked 'binary' into a new image.*/
+static int elf_parse(inode_t *binary, exec_image_t **pimg) {
+    isize       err     = 0;
+    int         nseg    = 0;
+    usize       phsz    = 0;
+    Elf64_Ehdr  elf     = {0};
+    Elf64_Dyn   *dyn    = NULL;
+    Elf64_Phdr  *phdr   = NULL;
+    exec_image_t *img   = NULL;
 
     // Read ELF Header.
     if ((err = iread(binary, 0, &elf, sizeof elf)) != sizeof elf) {
+        return err < 0 ? err : -EAGAIN;
+    }
+
+    if ((err = elf_check_header(&elf))) {
         return err;
     }
 
     // Allocate and read program headers.
-    if (!(phdr = kmalloc(elf.e_phentsize * elf.e_phnum))) {
-        return -ENOMEM;
+    phsz = elf.e_phentsize * elf.e_phnum;
+    if (elf.e_phentsize != sizeof *phdr || !(phdr = kmalloc(phsz))) {
+        return elf.e_phentsize != sizeof *phdr ? -ENOEXEC : -ENOMEM;
     }
 
-    if ((err = iread(binary, elf.e_phoff, phdr, elf.e_phentsize * elf.e_phnum))
-        != (elf.e_phentsize * elf.e_phnum)) {
+    if ((err = iread(binary, elf.e_phoff, phdr, phsz)) != (isize)phsz) {
         printk("%s:%d: Failed to read program headers.\n", __FILE__, __LINE__);
+        err = err < 0 ? err : -ENOEXEC;
         goto error;
     }
 
-    // Load segments.
     for (u64 i = 0; i < elf.e_phnum; ++i) {
-        vmr_t       *vmr = NULL;
-        Elf64_Phdr  *hdr = &phdr[i];
-
-        if (hdr->p_type == PT_LOAD) {
+        nseg += phdr[i].p_type == PT_LOAD;
+    }
 
-            // printk("elf_phdr[%d]: [%s] addr: %p, off: %p, memsz: %ld, filesz: %ld\n",
-            //     hdr-phdr, (hdr->p_flags & 7) == 7 ? "rwx" :
-            //     (hdr->p_flags & 7) == 6 ? "rw_" : (hdr->p_flags & 7) == 5 ? "r_x" :
-            //     (hdr->p_flags & 7) == 4 ? "r__" : (hdr->p_flags & 7) == 3 ? "_wx" :
-            //     (hdr->p_flags & 7) == 2 ? "_w_" : (hdr->p_flags & 7) == 1 ? "__x" : "___",
-            //     hdr->p_vaddr, hdr->p_offset, hdr->p_memsz, hdr->p_filesz
-            // );
+    if ((err = exec_image_alloc(nseg, &img))) {
+        goto error;
+    }
 
-            memsz    = PGROUNDUP(hdr->p_memsz);
-            int prot =  (hdr->p_flags & PF_X ? PROT_X : 0) |
-                        (hdr->p_flags & PF_W ? PROT_W : 0) |
-                        (hdr->p_flags & PF_R ? PROT_R : 0);
+    img->ei_ehdr = elf;
 
-            int flags = MAP_PRIVATE | MAP_DONTEXPAND | MAP_FIXED;
+    for (u64 i = 0, n = 0; i < elf.e_phnum; ++i) {
+        Elf64_Phdr *hdr = &phdr[i];
 
-            if ((err = mmap_map_region(mmap, ALIGN4K(hdr->p_vaddr), memsz, prot, flags, &vmr))) {
-                printk("%s:%d: Failed to map region[%p: %d]. err: %d\n", __FILE__, __LINE__, hdr->p_vaddr, memsz, err);
+        if (hdr->p_type == PT_LOAD) {
+            if ((err = elf_segment(hdr, &img->ei_segs[n++]))) {
                 goto error;
             }
-
-            vmr->file       = binary;
-            vmr->memsz      = hdr->p_memsz;
-            vmr->filesz     = hdr->p_filesz;
-            vmr->file_pos   = hdr->p_offset;
-        } else if (hdr->p_type == PT_DYNAMIC) { // Allocate and read the dynamic section.
-            u64 dyn_size = hdr->p_filesz;
-
-            if (!(dyn = kmalloc(dyn_size))) {
+        } else if (hdr->p_type == PT_DYNAMIC && dyn == NULL) {
+            // Allocate and read the dynamic section.
+            if (!(dyn = kzalloc(hdr->p_filesz + sizeof *dyn))) {
                 err = -ENOMEM;
                 goto error;
             }
 
-            if (iread(binary, hdr->p_offset, dyn, dyn_size) != (isize)dyn_size) {
+            if (iread(binary, hdr->p_offset, dyn, hdr->p_filesz) != (isize)hdr->p_filesz) {
                 err = -EIO;
                 goto error;
             }
         }
     }
 
-    // mmap_dump_list(*proc->mmap);
+    // the zeroed entry past the section ends a table missing DT_NULL.
+    if (dyn && (err = elf_dynamic_parse(binary, img, dyn))) {
+        goto error;
+    }
+
+    kfree(dyn);
+    kfree(phdr);
 
-    // Process dynamic section.
+    *pimg = img;
+    return 0;
+error:
     if (dyn) {
-        for (u64 i = 0; dyn[i].d_tag != DT_NULL; i++) {
-            switch (dyn[i].d_tag) {
-            case DT_SYMTAB:
-                symtab      = (Elf64_Sym *)(elf.e_entry + dyn[i].d_un.d_ptr);
-                break;
-            case DT_STRTAB:
-                strtab      = (char *)(elf.e_entry + dyn[i].d_un.d_ptr);
-                break;
-            case DT_RELA:
-                rela        = (Elf64_Rela *)(elf.e_entry + dyn[i].d_un.d_ptr);
-                break;
-            case DT_RELASZ:
-                rela_count  = dyn[i].d_un.d_val / sizeof(Elf64_Rela);
-                break;
-            }
-        }
+        kfree(dyn);
+    }
+
+    exec_cache_put(img);
+    kfree(phdr);
+    return err;
+}
+
+/**
+ * Get the parsed image of the locked 'binary', from the
+ * exec cache if it is there, otherwise parse and cache it.
+ */
+static int elf_get_image(inode_t *binary, exec_image_t **pimg) {
+    int err = 0;
+
+    if (exec_cache_lookup(binary, pimg) == 0) {
+        return 0;
     }
 
-    // Apply relocations.
-    if (rela && symtab && strtab) {
-        for (u64 i = 0; i < rela_count; i++) {
-            void        *sym_addr   = NULL;
-            Elf64_Rela  *rel        = &rela[i];
-            Elf64_Sym   *sym        = &symtab[ELF64_R_SYM(rel->r_info)];
-            void        *rel_addr   = (void *)(elf.e_entry + rel->r_offset);
-            const char  *sym_name   = strtab + sym->st_name;
+    if ((err = elf_parse(binary, pimg))) {
+        return err;
+    }
 
-            if (!(sym_addr = resolve_symbol(sym_name))) {
-                printk("Unresolved symbol: %s\n", sym_name);
-                err = -EINVAL;
-                goto error;
-            }
+    // losing a race or a full cache only costs the next exec a parse.
+    exec_cache_insert(binary, *pimg);
+    return 0;
+}
 
-            switch (ELF64_R_TYPE(rel->r_info)) {
-            case R_X86_64_RELATIVE:
-                *(Elf64_Addr *)rel_addr = elf.e_entry + rel->r_addend;
-                break;
-            case R_X86_64_GLOB_DAT:
-            case R_X86_64_JUMP_SLOT:
-                *(Elf64_Addr *)rel_addr = (Elf64_Addr)sym_addr;
-                break;
-            default:
-                printk("Unsupported relocation type: %d\n", ELF64_R_TYPE(rel->r_info));
-                err = -EINVAL;
-                goto error;
-            }
-        }
+int elf_check(inode_t *binary) {
+    int          err = 0;
+    exec_image_t *img = NULL;
+
+    if (binary == NULL) {
+        return -EINVAL;
     }
 
-    kfree(dyn);
-    kfree(phdr);
+    iassert_locked(binary);
 
-    mmap->entry = (thread_entry_t)elf.e_entry;
+    // parsing here leaves the image cached for elf_loader().
+    if ((err = elf_get_image(binary, &img))) {
+        return err;
+    }
 
+    exec_cache_put(img);
     return 0;
-error:
-    if (phdr) {
-        kfree(phdr);
+}
+
+// ELF Loader for Executables and Shared Libraries.
+int elf_loader(inode_t *binary, mmap_t *mmap) {
+    int          err    = 0;
+    exec_image_t *img   = NULL;
+
+    if (binary == NULL) {
+        return -EINVAL;
     }
 
-    if (dyn) {
-        kfree(dyn);
+    iassert_locked(binary);
+    mmap_assert_locked(mmap);
+
+    if ((err = elf_get_image(binary, &img))) {
+        return err;
     }
 
+    // Load segments, one region per entry of the image's template.
+    for (exec_segment_t *seg = img->ei_segs; seg < &img->ei_segs[img->ei_nseg]; ++seg) {
+        vmr_t       *vmr    = NULL;
+        const int   flags   = MAP_PRIVATE | MAP_DONTEXPAND | MAP_FIXED;
+
+        if ((err = mmap_map_region(mmap, seg->es_start, seg->es_size, seg->es_prot, flags, &vmr))) {
+            printk("%s:%d: Failed to map region[%p: %d]. err: %d\n", __FILE__, __LINE__, seg->es_start, seg->es_size, err);
+            goto error;
+        }
+
+        vmr->file       = binary;
+        vmr->flags     |= VM_FILE;
+        vmr->memsz      = seg->es_memsz;
+        vmr->filesz     = seg->es_filesz;
+        vmr->file_pos   = seg->es_file_pos;
+    }
+
+    // Apply relocations, PLT slots are left for their first call.
+    // Writing them faults pages of the binary in, which locks it.
+    iunlock(binary);
+    err = elf_relocate(img, mmap);
+    ilock(binary);
+
+    if (err) {
+        goto error;
+    }
+
+    mmap->entry = (thread_entry_t)img->ei_ehdr.e_entry;
+
+    exec_cache_put(img);
+    return 0;
+error:
+    exec_cache_put(img);
     mmap_clean(mmap);
     printk("error: %d occurred while trying to load ELF file\n", err);
     return err;
@@ -0,0 +1,608 @@
+#include <arch/paging.h>
+#include <bits/errno.h>
+#include <core/debug.h>
+#include <core/defs.h>
+#include <mm/kalloc.h>
+#include <string.h>
+#include <sync/atomic.h>
+#include <sync/spinlock.h>
+#include <sys/elf_dynamic.h>
+#include <sys/thread.h>
+
+/**
+ * *******************************************************************
+ * @brief   Global symbol index.                                      *
+ * *******************************************************************/
+
+typedef struct ksym {
+    const char  *name;
+    void        *addr;
+    u32         hash;
+    struct ksym *next;
+} ksym_t;
+
+#define KSYM_BLOOM_BITS     (KSYM_BLOOM_WORDS * 64)
+
+// entries are only ever added, lookups walk the buckets without the lock.
+static SPINLOCK(ksym_lock);
+static usize    nksym = 0;
+static ksym_t   ksyms[MAX_SYMBOLS];
+static ksym_t   *ksym_buckets[KSYM_NBUCKET];
+static ulong    ksym_bloom[KSYM_BLOOM_WORDS];
+
+// the GNU hash, what DT_GNU_HASH tables are built with.
+static u32 elf_gnu_hash(const char *name) {
+    u32 hash = 5381;
+
+    for (const u8 *c = (const u8 *)name; *c; ++c) {
+        hash = (hash << 5) + hash + *c;
+    }
+
+    return hash;
+}
+
+// the System V hash of DT_HASH tables.
+static u32 elf_sysv_hash(const char *name) {
+    u32 hash = 0, high = 0;
+
+    for (const u8 *c = (const u8 *)name; *c; ++c) {
+        hash = (hash << 4) + *c;
+        if ((high = hash & 0xf0000000)) {
+            hash ^= high >> 24;
+        }
+        hash &= ~high;
+    }
+
+    return hash;
+}
+
+static bool ksym_bloom_test(u32 hash) {
+    const u32 bit0 = hash % KSYM_BLOOM_BITS;
+    const u32 bit1 = (hash >> KSYM_BLOOM_SHIFT) % KSYM_BLOOM_BITS;
+
+    return (atomic_read(&ksym_bloom[bit0 / 64]) & BS(bit0 % 64)) &&
+           (atomic_read(&ksym_bloom[bit1 / 64]) & BS(bit1 % 64));
+}
+
+static ksym_t *ksym_lookup(const char *name, u32 hash) {
+    // most names a binary asks for are not kernel symbols.
+    if (!ksym_bloom_test(hash)) {
+        return NULL;
+    }
+
+    for (ksym_t *ks = atomic_read(&ksym_buckets[hash % KSYM_NBUCKET]); ks; ks = ks->next) {
+        if (ks->hash == hash && string_eq(ks->name, name)) {
+            return ks;
+        }
+    }
+
+    return NULL;
+}
+
+int register_symbol(const char *name, void *addr) {
+    ksym_t      *ks     = NULL;
+    u32         hash    = 0;
+
+    if (name == NULL) {
+        return -EINVAL;
+    }
+
+    hash = elf_gnu_hash(name);
+
+    spin_lock(ksym_lock);
+    if (ksym_lookup(name, hash)) {
+        spin_unlock(ksym_lock);
+        return -EEXIST;
+    }
+
+    if (nksym >= MAX_SYMBOLS) {
+        spin_unlock(ksym_lock);
+        return -ENOMEM;
+    }
+
+    ks  = &ksyms[nksym++];
+    *ks = (ksym_t){
+        .name = name,
+        .addr = addr,
+        .hash = hash,
+        .next = ksym_buckets[hash % KSYM_NBUCKET],
+    };
+
+    // bloom bits first, a lookup must not turn away a symbol in the index.
+    atomic_or(&ksym_bloom[(hash % KSYM_BLOOM_BITS) / 64], BS(hash % 64));
+    atomic_or(&ksym_bloom[((hash >> KSYM_BLOOM_SHIFT) % KSYM_BLOOM_BITS) / 64],
+        BS((hash >> KSYM_BLOOM_SHIFT) % 64));
+    atomic_write(&ksym_buckets[hash % KSYM_NBUCKET], ks);
+    spin_unlock(ksym_lock);
+
+    return 0;
+}
+
+void *resolve_symbol(const char *name) {
+    ksym_t *ks = name ? ksym_lookup(name, elf_gnu_hash(name)) : NULL;
+    return ks ? ks->addr : NULL;
+}
+
+/**
+ * *******************************************************************
+ * @brief   The object's own symbol tables.                           *
+ * *******************************************************************/
+
+static const char *elf_symname(const exec_image_t *img, const Elf64_Sym *sym) {
+    return sym->st_name < img->ei_strsz ? img->ei_strtab + sym->st_name : "";
+}
+
+static const Elf64_Sym *elf_gnu_lookup(const exec_image_t *img, const char *name) {
+    const u32   hash    = elf_gnu_hash(name);
+    const u32   *ht     = img->ei_gnu_hash;
+    const u32   nbucket = ht[0], symoffset = ht[1], nbloom = ht[2], shift = ht[3];
+    const u64   *bloom  = (const u64 *)&ht[4];
+    const u32   *bucket = (const u32 *)&bloom[nbloom];
+    const u32   *chain  = &bucket[nbucket];
+    const u64   mask    = BS(hash % 64) | BS((hash >> shift) % 64);
+
+    if ((bloom[(hash / 64) % nbloom] & mask) != mask) {
+        return NULL;
+    }
+
+    for (u64 i = bucket[hash % nbucket]; i >= symoffset && i < img->ei_nsym; ++i) {
+        const Elf64_Sym *sym = &img->ei_symtab[i];
+
+        if ((chain[i - symoffset] | 1) == (hash | 1) && string_eq(elf_symname(img, sym), name)) {
+            return sym;
+        }
+
+        // the low bit ends a chain.
+        if (chain[i - symoffset] & 1) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static const Elf64_Sym *elf_sysv_lookup(const exec_image_t *img, const char *name) {
+    const u32   *ht     = img->ei_hash;
+    const u32   nbucket = ht[0], nchain = ht[1];
+    const u32   *bucket = &ht[2];
+    const u32   *chain  = &bucket[nbucket];
+    u32         hops    = 0;
+
+    // 'hops' keeps a chain that loops back on itself finite.
+    for (u32 i = bucket[elf_sysv_hash(name) % nbucket];
+        i != STN_UNDEF && i < nchain && i < img->ei_nsym && hops++ < nchain; i = chain[i]) {
+        if (string_eq(elf_symname(img, &img->ei_symtab[i]), name)) {
+            return &img->ei_symtab[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*A definition of 'name' in the object, through its own hash table.*/
+static const Elf64_Sym *elf_object_lookup(const exec_image_t *img, const char *name) {
+    const Elf64_Sym *sym = NULL;
+
+    if (img->ei_gnu_hash) {
+        sym = elf_gnu_lookup(img, name);
+    } else if (img->ei_hash) {
+        sym = elf_sysv_lookup(img, name);
+    }
+
+    return sym && sym->st_shndx != SHN_UNDEF ? sym : NULL;
+}
+
+/**
+ * Bind symbol 'symix' of 'img'. A kernel symbol of the same name takes
+ * precedence, as the first object in the lookup scope does, then the
+ * object's own definition. An unresolved weak reference binds to 0.
+ */
+static int elf_bind(const exec_image_t *img, u64 symix, Elf64_Addr *paddr) {
+    const Elf64_Sym *sym    = NULL;
+    const Elf64_Sym *def    = NULL;
+    const char      *name   = NULL;
+    ksym_t          *ks     = NULL;
+
+    if (symix == STN_UNDEF || symix >= img->ei_nsym) {
+        return -ENOEXEC;
+    }
+
+    sym  = &img->ei_symtab[symix];
+    name = elf_symname(img, sym);
+
+    if ((ks = ksym_lookup(name, elf_gnu_hash(name)))) {
+        *paddr = (Elf64_Addr)ks->addr;
+        return 0;
+    }
+
+    if ((def = sym->st_shndx != SHN_UNDEF ? sym : elf_object_lookup(img, name))) {
+        *paddr = def->st_value;
+        return 0;
+    }
+
+    if (ELF64_ST_BIND(sym->st_info) == STB_WEAK) {
+        *paddr = 0;
+        return 0;
+    }
+
+    printk("Unresolved symbol: %s\n", name);
+    return -ENOENT;
+}
+
+/**
+ * *******************************************************************
+ * @brief   Reading the tables and relocating.                        *
+ * *******************************************************************/
+
+/*Read 'size' bytes at user address 'va' of the image from the file.*/
+static int elf_read_vaddr(inode_t *binary, const exec_image_t *img, Elf64_Addr va, void *buf, usize size) {
+    for (const exec_segment_t *seg = img->ei_segs; seg < &img->ei_segs[img->ei_nseg]; ++seg) {
+        if (va < seg->es_start || va + size < va || va + size > seg->es_start + seg->es_filesz) {
+            continue;
+        }
+
+        if (iread(binary, seg->es_file_pos + (va - seg->es_start), buf, size) != (isize)size) {
+            return -ENOEXEC;
+        }
+
+        return 0;
+    }
+
+    return -ENOEXEC;
+}
+
+/*Copy a table of the image into a new buffer charged to it.*/
+static int elf_read_table(inode_t *binary, exec_image_t *img, Elf64_Addr va, usize size, void **pbuf) {
+    int     err = 0;
+    void    *buf = NULL;
+
+    // one more byte, to NUL terminate a string table.
+    if ((buf = kzalloc(size + 1)) == NULL) {
+        return -ENOMEM;
+    }
+
+    if ((err = elf_read_vaddr(binary, img, va, buf, size))) {
+        kfree(buf);
+        return err;
+    }
+
+    img->ei_bytes += size + 1;
+    *pbuf = buf;
+    return 0;
+}
+
+/**
+ * Read the DT_GNU_HASH table at 'va'. Nothing records how many
+ * symbols it covers, that is where the longest-indexed chain ends.
+ */
+static int elf_read_gnu_hash(inode_t *binary, exec_image_t *img, Elf64_Addr va, u64 *pnsym) {
+    int     err     = 0;
+    u32     hdr[4]  = {0};
+    u32     hash    = 0;
+    u32     *ht     = NULL;
+    const u32 *bucket = NULL;
+    u64     nsym    = 0;
+    u64     last    = 0;
+    usize   size    = 0;
+
+    if ((err = elf_read_vaddr(binary, img, va, hdr, sizeof hdr))) {
+        return err;
+    }
+
+    if (hdr[0] == 0 || hdr[2] == 0 || hdr[3] >= 64) {
+        return -ENOEXEC;
+    }
+
+    size = sizeof hdr + hdr[2] * sizeof (u64) + hdr[0] * sizeof (u32);
+    if ((err = elf_read_table(binary, img, va, size, (void **)&ht))) {
+        return err;
+    }
+
+    // the buckets follow the bloom filter.
+    bucket = (const u32 *)((const u64 *)&ht[4] + hdr[2]);
+    for (u32 b = 0; b < hdr[0]; ++b) {
+        last = bucket[b] > last ? bucket[b] : last;
+    }
+
+    for (nsym = hdr[1]; last >= hdr[1]; ++last) {
+        if ((err = elf_read_vaddr(binary, img, va + size + (last - hdr[1]) * sizeof hash, &hash, sizeof hash))) {
+            goto error;
+        }
+
+        if (hash & 1) {
+            nsym = last + 1;
+            break;
+        }
+    }
+
+    // the chains, one hash per symbol past the ones not in the table.
+    kfree(ht);
+    img->ei_bytes -= size + 1;
+    if ((err = elf_read_table(binary, img, va, size + (nsym - hdr[1]) * sizeof hash, (void **)&ht))) {
+        return err;
+    }
+
+    img->ei_gnu_hash = ht;
+    *pnsym = nsym;
+    return 0;
+error:
+    kfree(ht);
+    img->ei_bytes -= size + 1;
+    return err;
+}
+
+static int elf_read_sysv_hash(inode_t *binary, exec_image_t *img, Elf64_Addr va, u64 *pnsym) {
+    int     err     = 0;
+    u32     hdr[2]  = {0};
+
+    if ((err = elf_read_vaddr(binary, img, va, hdr, sizeof hdr))) {
+        return err;
+    }
+
+    if (hdr[0] == 0) {
+        return -ENOEXEC;
+    }
+
+    if ((err = elf_read_table(binary, img, va, (2ul + hdr[0] + hdr[1]) * sizeof (u32), (void **)&img->ei_hash))) {
+        return err;
+    }
+
+    *pnsym = hdr[1];
+    return 0;
+}
+
+static u64 elf_max_symix(const Elf64_Rela *rela, u64 count) {
+    u64 max = 0;
+
+    for (u64 i = 0; i < count; ++i) {
+        max = ELF64_R_SYM(rela[i].r_info) > max ? ELF64_R_SYM(rela[i].r_info) : max;
+    }
+
+    return max;
+}
+
+int elf_dynamic_parse(inode_t *binary, exec_image_t *img, const Elf64_Dyn *dyn) {
+    int         err         = 0;
+    u64         nsym        = 0;
+    u64         strsz       = 0;
+    u64         relasz      = 0;
+    u64         pltrelsz    = 0;
+    u64         pltrel      = DT_RELA;
+    Elf64_Addr  symtab      = 0;
+    Elf64_Addr  strtab      = 0;
+    Elf64_Addr  rela        = 0;
+    Elf64_Addr  jmprel      = 0;
+    Elf64_Addr  hash        = 0;
+    Elf64_Addr  gnu_hash    = 0;
+
+    if (binary == NULL || img == NULL || dyn == NULL) {
+        return -EINVAL;
+    }
+
+    for (u64 i = 0; dyn[i].d_tag != DT_NULL; i++) {
+        switch (dyn[i].d_tag) {
+        case DT_SYMTAB:     symtab          = dyn[i].d_un.d_ptr; break;
+        case DT_STRTAB:     strtab          = dyn[i].d_un.d_ptr; break;
+        case DT_STRSZ:      strsz           = dyn[i].d_un.d_val; break;
+        case DT_RELA:       rela            = dyn[i].d_un.d_ptr; break;
+        case DT_RELASZ:     relasz          = dyn[i].d_un.d_val; break;
+        case DT_JMPREL:     jmprel          = dyn[i].d_un.d_ptr; break;
+        case DT_PLTRELSZ:   pltrelsz        = dyn[i].d_un.d_val; break;
+        case DT_PLTREL:     pltrel          = dyn[i].d_un.d_val; break;
+        case DT_PLTGOT:     img->ei_pltgot  = dyn[i].d_un.d_ptr; break;
+        case DT_HASH:       hash            = dyn[i].d_un.d_ptr; break;
+        case DT_GNU_HASH:   gnu_hash        = dyn[i].d_un.d_ptr; break;
+        case DT_BIND_NOW:   img->ei_bindnow = true; break;
+        case DT_FLAGS:      img->ei_bindnow |= (dyn[i].d_un.d_val & DF_BIND_NOW) != 0; break;
+        case DT_FLAGS_1:    img->ei_bindnow |= (dyn[i].d_un.d_val & DF_1_NOW) != 0; break;
+        case DT_SYMENT:
+            if (dyn[i].d_un.d_val != sizeof (Elf64_Sym)) return -ENOEXEC;
+            break;
+        case DT_RELAENT:
+            if (dyn[i].d_un.d_val != sizeof (Elf64_Rela)) return -ENOEXEC;
+            break;
+        }
+    }
+
+    // nothing to bind against.
+    if (symtab == 0 || strtab == 0) {
+        return 0;
+    }
+
+    if (pltrel != DT_RELA) {
+        return -ENOEXEC;
+    }
+
+    if (relasz && (err = elf_read_table(binary, img, rela, relasz, (void **)&img->ei_rela))) {
+        return err;
+    }
+
+    if (pltrelsz && (err = elf_read_table(binary, img, jmprel, pltrelsz, (void **)&img->ei_jmprel))) {
+        return err;
+    }
+
+    img->ei_rela_count      = relasz / sizeof (Elf64_Rela);
+    img->ei_jmprel_count    = pltrelsz / sizeof (Elf64_Rela);
+
+    // the symbol table is as long as the hash table says, or as far as relocations reach.
+    if (gnu_hash) {
+        err = elf_read_gnu_hash(binary, img, gnu_hash, &nsym);
+    } else if (hash) {
+        err = elf_read_sysv_hash(binary, img, hash, &nsym);
+    }
+
+    if (err) {
+        return err;
+    }
+
+    nsym = MAX(nsym, elf_max_symix(img->ei_rela, img->ei_rela_count) + 1);
+    nsym = MAX(nsym, elf_max_symix(img->ei_jmprel, img->ei_jmprel_count) + 1);
+
+    if ((err = elf_read_table(binary, img, symtab, nsym * sizeof (Elf64_Sym), (void **)&img->ei_symtab))) {
+        return err;
+    }
+
+    if ((err = elf_read_table(binary, img, strtab, strsz, (void **)&img->ei_strtab))) {
+        return err;
+    }
+
+    img->ei_nsym    = nsym;
+    img->ei_strsz   = strsz;
+    return 0;
+}
+
+/**
+ * Fault in the user word at 'va' of the locked and focused 'mmap',
+ * so that the kernel can read or write it without faulting itself.
+ */
+static int elf_user_word(mmap_t *mmap, uintptr_t va, bool write) {
+    vmr_t *vmr = NULL;
+
+    if (iskernel_addr(va) || (vmr = mmap_find(mmap, va)) == NULL ||
+        va + sizeof (u64) - 1 > __vmr_end(vmr)) {
+        return -EFAULT;
+    }
+
+    if (write ? !__vmr_write(vmr) : !__vmr_read(vmr)) {
+        return -EFAULT;
+    }
+
+    return vmr_populate(vmr, va, va + sizeof (u64) - 1);
+}
+
+static int elf_poke(mmap_t *mmap, uintptr_t va, Elf64_Addr val) {
+    int err = 0;
+
+    if ((err = elf_user_word(mmap, va, true))) {
+        return err;
+    }
+
+    *(Elf64_Addr *)va = val;
+    return 0;
+}
+
+static int elf_apply(exec_image_t *img, mmap_t *mmap, const Elf64_Rela *rel) {
+    int         err     = 0;
+    Elf64_Addr  addr    = 0;
+
+    // segments are mapped where they were linked, the load bias is 0.
+    switch (ELF64_R_TYPE(rel->r_info)) {
+    case R_X86_64_NONE:
+        return 0;
+    case R_X86_64_RELATIVE:
+        return elf_poke(mmap, rel->r_offset, rel->r_addend);
+    case R_X86_64_64:
+        if ((err = elf_bind(img, ELF64_R_SYM(rel->r_info), &addr))) {
+            return err;
+        }
+        return elf_poke(mmap, rel->r_offset, addr + rel->r_addend);
+    case R_X86_64_GLOB_DAT:
+    case R_X86_64_JUMP_SLOT:
+        if ((err = elf_bind(img, ELF64_R_SYM(rel->r_info), &addr))) {
+            return err;
+        }
+        return elf_poke(mmap, rel->r_offset, addr);
+    default:
+        printk("Unsupported relocation type: %d\n", ELF64_R_TYPE(rel->r_info));
+        return -ENOEXEC;
+    }
+}
+
+int elf_relocate(exec_image_t *img, mmap_t *mmap) {
+    int err = 0;
+
+    if (img == NULL || mmap == NULL) {
+        return -EINVAL;
+    }
+
+    mmap_assert_locked(mmap);
+
+    if (img->ei_symtab == NULL) {
+        return 0;
+    }
+
+    for (u64 i = 0; i < img->ei_rela_count; ++i) {
+        if ((err = elf_apply(img, mmap, &img->ei_rela[i]))) {
+            return err;
+        }
+    }
+
+    if (img->ei_jmprel_count == 0) {
+        return 0;
+    }
+
+    // no GOT to hook, or asked to bind everything up front.
+    if (img->ei_bindnow || img->ei_pltgot == 0) {
+        for (u64 i = 0; i < img->ei_jmprel_count; ++i) {
+            if ((err = elf_apply(img, mmap, &img->ei_jmprel[i]))) {
+                return err;
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * The slots still hold the address of their PLT entry's push,
+     * which goes on to PLT0 and from there through GOT[2]. Point that
+     * at MAGIC_PLTRESOLVE, the fault lands in elf_plt_resolve().
+     * GOT[1] would tell a resolver which object it is in, we know.
+     */
+    if ((err = elf_poke(mmap, img->ei_pltgot + 1 * sizeof (Elf64_Addr), 0)) ||
+        (err = elf_poke(mmap, img->ei_pltgot + 2 * sizeof (Elf64_Addr), MAGIC_PLTRESOLVE))) {
+        return err;
+    }
+
+    exec_cache_put(mmap->image);
+    mmap->image = exec_image_get(img);
+    return 0;
+}
+
+int elf_plt_resolve(mcontext_t *trapframe) {
+    int             err     = 0;
+    u64             index   = 0;
+    Elf64_Addr      addr    = 0;
+    mmap_t          *mmap   = NULL;
+    exec_image_t    *img    = NULL;
+    const Elf64_Rela *rel   = NULL;
+
+    if (trapframe == NULL || current == NULL || (mmap = current->t_mmap) == NULL) {
+        return -EINVAL;
+    }
+
+    mmap_lock(mmap);
+
+    if ((img = mmap->image) == NULL) {
+        mmap_unlock(mmap);
+        return -ENOEXEC;
+    }
+
+#if defined (__x86_64__)
+    // PLT0 pushed GOT[1] on top of the index the PLT entry pushed.
+    if ((err = elf_user_word(mmap, trapframe->rsp + sizeof (u64), false))) {
+        goto done;
+    }
+
+    index = *(u64 *)(trapframe->rsp + sizeof (u64));
+#endif
+
+    if (index >= img->ei_jmprel_count ||
+        ELF64_R_TYPE((rel = &img->ei_jmprel[index])->r_info) != R_X86_64_JUMP_SLOT) {
+        err = -ENOEXEC;
+        goto done;
+    }
+
+    if ((err = elf_bind(img, ELF64_R_SYM(rel->r_info), &addr)) ||
+        (err = elf_poke(mmap, rel->r_offset, addr))) {
+        goto done;
+    }
+
+#if defined (__x86_64__)
+    // drop what the PLT pushed and make the call the caller meant to.
+    trapframe->rsp += 2 * sizeof (u64);
+    trapframe->rip  = addr;
+#endif
+done:
+    mmap_unlock(mmap);
+    return err;
+}
@@ -0,0 +1,171 @@
+#include <bits/errno.h>
+#include <core/debug.h>
+#include <mm/kalloc.h>
+#include <sync/atomic.h>
+#include <sys/exec_cache.h>
+
+static QUEUE(exec_lru);
+static usize exec_cache_bytes = 0;
+
+#define exec_cache_lock()       queue_lock(exec_lru)
+#define exec_cache_unlock()     queue_unlock(exec_lru)
+
+int exec_image_alloc(int nseg, exec_image_t **pimg) {
+    exec_image_t *img = NULL;
+
+    if (nseg < 0 || pimg == NULL) {
+        return -EINVAL;
+    }
+
+    if ((img = kzalloc(sizeof *img)) == NULL) {
+        return -ENOMEM;
+    }
+
+    if (nseg && (img->ei_segs = kzalloc(nseg * sizeof *img->ei_segs)) == NULL) {
+        kfree(img);
+        return -ENOMEM;
+    }
+
+    img->ei_nseg    = nseg;
+    img->ei_refcnt  = 1;
+    img->ei_bytes   = sizeof *img + nseg * sizeof *img->ei_segs;
+    img->ei_lru     = (queue_node_t){.data = img};
+
+    *pimg = img;
+    return 0;
+}
+
+void exec_cache_put(exec_image_t *img) {
+    if (img == NULL) {
+        return;
+    }
+
+    if (atomic_dec_fetch(&img->ei_refcnt) == 0) {
+        kfree(img->ei_segs);
+        kfree(img->ei_symtab);
+        kfree(img->ei_strtab);
+        kfree(img->ei_rela);
+        kfree(img->ei_jmprel);
+        kfree(img->ei_gnu_hash);
+        kfree(img->ei_hash);
+        kfree(img);
+    }
+}
+
+exec_image_t *exec_image_get(exec_image_t *img) {
+    if (img) {
+        atomic_inc(&img->ei_refcnt);
+    }
+
+    return img;
+}
+
+/*Take 'img' off the LRU and drop the cache's reference, cache locked.*/
+static void exec_cache_evict(exec_image_t *img) {
+    queue_assert_locked(exec_lru);
+
+    embedded_queue_detach(exec_lru, &img->ei_lru);
+    exec_cache_bytes -= img->ei_bytes;
+    exec_cache_put(img);
+}
+
+static exec_image_t *exec_cache_find(inode_t *ip) {
+    exec_image_t *img = NULL;
+
+    queue_foreach_entry(exec_lru, img, ei_lru) {
+        if (img->ei_inode == ip) {
+            return img;
+        }
+    }
+
+    return NULL;
+}
+
+int exec_cache_lookup(inode_t *binary, exec_image_t **pimg) {
+    exec_image_t *img = NULL;
+
+    if (binary == NULL || pimg == NULL) {
+        return -EINVAL;
+    }
+
+    iassert_locked(binary);
+
+    if (!(binary->i_flags & INO_EXEC)) {
+        return -ENOENT;
+    }
+
+    exec_cache_lock();
+    if ((img = exec_cache_find(binary)) == NULL || img->ei_gen != binary->i_gen) {
+        exec_cache_unlock();
+        return -ENOENT;
+    }
+
+    atomic_inc(&img->ei_refcnt);
+
+    // most recently used to the head.
+    embedded_queue_detach(exec_lru, &img->ei_lru);
+    embedded_enqueue_head(exec_lru, &img->ei_lru, QUEUE_DUPLICATES);
+    exec_cache_unlock();
+
+    *pimg = img;
+    return 0;
+}
+
+int exec_cache_insert(inode_t *binary, exec_image_t *img) {
+    exec_image_t *old = NULL;
+
+    if (binary == NULL || img == NULL) {
+        return -EINVAL;
+    }
+
+    iassert_locked(binary);
+
+    // one that alone would fill the cache is not worth keeping.
+    if (img->ei_bytes > EXEC_CACHE_MAX_BYTES / 4) {
+        return -ENOSPC;
+    }
+
+    img->ei_inode   = binary;
+    img->ei_gen     = binary->i_gen;
+
+    exec_cache_lock();
+    if ((old = exec_cache_find(binary))) {
+        if (old->ei_gen == binary->i_gen) {
+            exec_cache_unlock();
+            return -EEXIST;
+        }
+
+        exec_cache_evict(old);
+    }
+
+    // least recently used go first, they are at the tail.
+    while (exec_cache_bytes + img->ei_bytes > EXEC_CACHE_MAX_BYTES && exec_lru->tail) {
+        exec_cache_evict(queue_node_get_container(exec_lru->tail, exec_image_t, ei_lru));
+    }
+
+    atomic_inc(&img->ei_refcnt);
+    exec_cache_bytes += img->ei_bytes;
+    embedded_enqueue_head(exec_lru, &img->ei_lru, QUEUE_DUPLICATES);
+    exec_cache_unlock();
+
+    binary->i_flags |= INO_EXEC;
+    return 0;
+}
+
+void exec_cache_invalidate(inode_t *ip) {
+    exec_image_t *img = NULL;
+
+    if (ip == NULL) {
+        return;
+    }
+
+    iassert_locked(ip);
+
+    exec_cache_lock();
+    if ((img = exec_cache_find(ip))) {
+        exec_cache_evict(img);
+    }
+    exec_cache_unlock();
+
+    ip->i_flags &= ~INO_EXEC;
+}
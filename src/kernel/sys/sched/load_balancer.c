@@ -1,5 +1,6 @@
 #include "metrics.h"
 #include <core/debug.h>
+#include <mm/numa.h>
 
 void MLFQ_adjust_timeslice(MLFQ_t *) {
 }
@@ -34,6 +35,25 @@ MLFQ_t *MLFQ_least_loaded(void) {
     return least_loaded;
 }
 
+MLFQ_t *MLFQ_least_loaded_node(int node) {
+    usize   least        = 0;
+    MLFQ_t  *least_loaded = NULL;
+
+    foreach_MLFQ() {
+        if (numa_cpu_node(mlfq - MLFQ) != node) {
+            continue;
+        }
+
+        const usize load = MLFQ_load(mlfq);
+        if (least_loaded == NULL || load <= least) {
+            least = load;
+            least_loaded = mlfq;
+        }
+    }
+
+    return least_loaded;
+}
+
 void MLFQ_pull(void) {
     usize  count           = 0;
     usize  target_load     = 0;
@@ -36,5 +36,7 @@ extern usize MLFQ_load(MLFQ_t *mlfq);
 extern void MLFQ_balance(void);
 extern MLFQ_t *MLFQ_most_loaded(void);
 extern MLFQ_t *MLFQ_least_loaded(void);
+// least loaded MLFQ of the CPUs on 'node', NULL if there are none.
+extern MLFQ_t *MLFQ_least_loaded_node(int node);
 
 extern void sched_update_thread_metrics(thread_t *thread);
@@ -1,5 +1,6 @@
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <sys/pidhash.h>
 #include <sys/schedule.h>
 #include <sys/thread.h>
 
@@ -249,29 +250,30 @@ int sched_wakeup(queue_t *wait_queue, wakeup_t reason) {
 }
 
 int sched_wakeup_specific(queue_t *wait_queue, wakeup_t reason, tid_t tid) {
+    int         err     = 0;
+    thread_t    *thread = NULL;
+
     if (wait_queue == NULL || tid <= 0) {
         return -EINVAL;
     }
 
     queue_lock(wait_queue);
 
-    thread_t *thread;
-    // retrieve a thread from the front of the queue.
-    foreach_thread(wait_queue, thread, t_wait_qnode) {
-        thread_lock(thread);
-
-        if (thread_gettid(thread) == tid) {
-            int err = sched_detach_and_wakeup(wait_queue, thread, reason);
-            thread_unlock(thread);
-            queue_unlock(wait_queue);
-            return err;
-        }
+    // straight to the thread, then check it is waiting here.
+    if ((err = tidhash_find(tid, &thread))) {
+        queue_unlock(wait_queue);
+        return err;
+    }
 
-        thread_unlock(thread);
+    if (thread->t_wait_queue == wait_queue) {
+        err = sched_detach_and_wakeup(wait_queue, thread, reason);
+    } else {
+        err = -ESRCH;  // No thread was waiting on this wait queue.
     }
 
+    thread_unlock(thread);
     queue_unlock(wait_queue);
-    return -ESRCH;  // No thread was waiting on this wait queue.
+    return err;
 }
 
 int sched_wakeup_all(queue_t *wait_queue, wakeup_t reason, size_t *pnt) {
@@ -1,6 +1,7 @@
 #include "metrics.h"
 #include <core/debug.h>
 #include <limits.h>
+#include <mm/numa.h>
 #include <string.h>
 #include <sys/schedule.h>
 #include <sys/thread.h>
@@ -15,6 +16,9 @@ const char *MLFQ_PRIORITY[] = {
 
 MLFQ_t MLFQ[NCPU];
 
+// extra load a thread's home node may carry and still be picked.
+#define NUMA_SCHED_IMBALANCE    1
+
 static void MLFQ_init(void) {
     usize   t = 0;
     MLFQ_t  *mlfq   = MLFQ_get();
@@ -97,6 +101,13 @@ static int MLFQ_enqueue(thread_t *thread) {
         }
     } else { // Soft affinity.
         target = MLFQ_least_loaded();
+
+        // stay on the home node, near the memory the thread faulted in,
+        // unless that means waiting behind more than one extra thread.
+        MLFQ_t *home = MLFQ_least_loaded_node(thread->t_info.ti_sched.ts_node);
+        if (home && home != target && MLFQ_load(home) <= MLFQ_load(target) + NUMA_SCHED_IMBALANCE) {
+            target = home;
+        }
     }
 
     // Enqueue thread according to it's current priority level.
@@ -153,6 +164,7 @@ static thread_t *MLFQ_get_next_thread(void) {
 
             /* Update scheduling metadata for the chosen thread. */
             thread->t_info.ti_sched.ts_proc = cpu; // set the current processor for chosen thread.
+            thread->t_info.ti_sched.ts_node = numa_local_node();
 
             /// Enter running state.
             thread_enter_state(thread, T_RUNNING);
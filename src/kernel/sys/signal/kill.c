@@ -57,7 +57,8 @@ int pthread_sigqueue(tid_t tid, int signo, union sigval sigval) {
     int      err;
     thread_t *thread = NULL;
 
-    if (SIGBAD(signo)) {
+    // signal 0 only checks that 'tid' exists.
+    if (signo != 0 && SIGBAD(signo)) {
         return -EINVAL;
     }
 
@@ -65,6 +66,11 @@ int pthread_sigqueue(tid_t tid, int signo, union sigval sigval) {
         return err;
     }
 
+    if (signo == 0) {
+        thread_unlock(thread);
+        return 0;
+    }
+
     err = thread_send_signal(thread, signo, sigval);
     thread_unlock(thread);
     return err;
@@ -1,9 +1,29 @@
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <sys/pidhash.h>
 #include <sys/proc.h>
 #include <sys/thread.h>
 
-int copy_proc(proc_t *child, proc_t *parent) {
+/**
+ * Put 'child' on the address space of 'parent' instead of the
+ * fresh one proc_alloc() gave it, for vfork().
+ */
+static int share_mmap(proc_t *child, proc_t *parent) {
+    mmap_t *mmap = child->mmap;
+
+    mmap_lock(parent->mmap);
+    parent->mmap->users++;
+    mmap_unlock(parent->mmap);
+
+    child->mmap                 = parent->mmap;
+    child->main_thread->t_mmap  = parent->mmap;
+    proc_setflags(child, PROC_VFORKED);
+
+    mmap_free(mmap);
+    return 0;
+}
+
+int copy_proc(proc_t *child, proc_t *parent, int how) {
     int         err     = 0;
     file_ctx_t *fctx    = NULL;
     cred_t      *cred   = NULL;
@@ -19,13 +39,17 @@ int copy_proc(proc_t *child, proc_t *parent) {
         return err;
     }
 
-    mmap_lock(parent->mmap);
-    mmap_lock(child->mmap);
+    if (how == COPY_PROC_VFORK) {
+        err = share_mmap(child, parent);
+    } else if (how == COPY_PROC_FORK) {
+        mmap_lock(parent->mmap);
+        mmap_lock(child->mmap);
 
-    err = mmap_copy(child->mmap, parent->mmap);
+        err = mmap_copy(child->mmap, parent->mmap);
 
-    mmap_unlock(child->mmap);
-    mmap_unlock(parent->mmap);
+        mmap_unlock(child->mmap);
+        mmap_unlock(parent->mmap);
+    }
 
     if (err) goto error;
 
@@ -62,20 +86,53 @@ int copy_proc(proc_t *child, proc_t *parent) {
         goto error;
     }
 
-    child->sid      = parent->sid;
-    child->pgid     = parent->pgid;
+    proc_setsid(child, parent->sid);
     child->entry    = parent->entry;
     child->status   = parent->status;
     child->parent   = proc_getref(parent);
 
+    pidhash_setpgid(child, parent->pgid);
+
+    mempolicy_set(&child->mempolicy, parent->mempolicy.mode, parent->mempolicy.nodes);
+
     return 0;
 error:
-    /// TODO: Reverse mmap_clone(),
-    /// but i think it will be handled by proc_free().
+    // discard_proc() takes back what was done so far.
     return err;
 }
 
-pid_t fork(void) {
+void discard_proc(proc_t *child, proc_t *parent) {
+    proc_assert_locked(child);
+    proc_assert_locked(parent);
+
+    queue_lock(&parent->children);
+    embedded_queue_remove(&parent->children, &child->child_qnode);
+    queue_unlock(&parent->children);
+
+    if (child->parent == parent) {
+        child->parent = NULL;
+        proc_putref(parent);
+    }
+
+    // procQ_remove() gives the PID back, unless the child never
+    // made it onto procQ and its PID still names only itself.
+    if (procQ_remove(child)) {
+        proc_pid_put(child->pgid);
+        proc_pid_put(child->sid);
+        proc_pid_put(child->pid);
+    }
+
+    // the main thread never ran, it goes along with its reference.
+    if (child->main_thread) {
+        thread_free(child->main_thread);
+        child->main_thread = NULL;
+        proc_putref(child);
+    }
+
+    proc_free(child);
+}
+
+static pid_t fork_proc(bool vfork) {
     if (curproc == NULL) {
         return -EINVAL;
     }
@@ -88,7 +145,7 @@ pid_t fork(void) {
         return err;
     }
 
-    if ((err = copy_proc(child, curproc))) {
+    if ((err = copy_proc(child, curproc, vfork ? COPY_PROC_VFORK : COPY_PROC_FORK))) {
         goto error;
     }
 
@@ -115,21 +172,49 @@ pid_t fork(void) {
         goto error;
     }
 
-    proc_unlock(curproc);
-
     err = thread_schedule(child->main_thread);
     thread_unlock(child->main_thread);
 
     debuglog();
 
-    proc_unlock(child);
     if (err) {
         goto error;
     }
 
+    proc_unlock(curproc);
+
+    // the child is on our address space and stack, stay
+    // out of its way until it calls exec() or exit().
+    // It is ours to reap, so it can't be freed under us.
+    while (vfork && proc_testflags(child, PROC_VFORKED)) {
+        cond_wait(&curproc->vfork_event, NULL, &child->lock);
+    }
+
+    proc_unlock(child);
     return child_pid;
 error:
+    discard_proc(child, curproc);
     proc_unlock(curproc);
-    proc_free(child);
     return err;
+}
+
+pid_t fork(void) {
+    return fork_proc(false);
+}
+
+pid_t vfork(void) {
+    return fork_proc(true);
+}
+
+void vfork_done(proc_t *proc) {
+    proc_assert_locked(proc);
+
+    if (!proc_testflags(proc, PROC_VFORKED)) {
+        return;
+    }
+
+    proc_unsetflags(proc, PROC_VFORKED);
+    // threads of the parent may each wait on a vfork()ed child of
+    // their own, wake them all and let each recheck its child.
+    cond_broadcast(&proc->parent->vfork_event);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <mm/mmap.h>
 #include <bits/errno.h>
 #include <sys/sysproc.h>
+#include <sys/mman/mman.h>
 #include <arch/paging.h>
 
 void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off) {
@@ -76,6 +77,14 @@ anon:
 
     // mmap() operation is done.
 done:
+    // a failure to fault the pages in leaves them to lock as they fault.
+    if (__flags_locked(flags) || (mmap->flags & MMAP_LOCKFUTURE)) {
+        if (mmap_mlock(mmap, (uintptr_t)addr, __vmr_size(vmr),
+            (mmap->flags & MMAP_LOCKONFAULT) ? MLOCK_ONFAULT : 0)) {
+            vmr->flags |= VM_LOCKED;
+        }
+    }
+
     mmap_unlock(mmap);
     return addr;
 error:
@@ -134,4 +143,170 @@ int mprotect(void *addr, size_t len, int prot) {
     int err = mmap_protect(mmap, (uintptr_t)addr, len, prot);
     mmap_unlock(mmap);
     return err;
-}
\ No newline at end of file
+}
+/*Common entry checks of the calls below, returns curproc's mmap, locked.*/
+static mmap_t *mmap_curlock(void) {
+    if (!curproc || !curproc->mmap) {
+        return NULL;
+    }
+
+    mmap_lock(curproc->mmap);
+    return curproc->mmap;
+}
+
+int madvise(void *addr, size_t len, int advice) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_advise(mmap, (uintptr_t)addr, len, advice);
+    mmap_unlock(mmap);
+    return err;
+}
+
+int msync(void *addr, size_t len, int flags) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_sync(mmap, (uintptr_t)addr, len, flags);
+    mmap_unlock(mmap);
+    return err;
+}
+
+void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address) {
+    int         err     = 0;
+    uintptr_t   addr    = 0;
+    mmap_t      *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return (void *)-EINVAL;
+    }
+
+    err = mmap_remap(mmap, (uintptr_t)old_address, old_size,
+        new_size, flags, (uintptr_t)new_address, &addr);
+    mmap_unlock(mmap);
+    return err ? (void *)(long)err : (void *)addr;
+}
+
+int mlock(const void *addr, size_t len) {
+    return mlock2(addr, len, 0);
+}
+
+int mlock2(const void *addr, size_t len, unsigned int flags) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_mlock(mmap, (uintptr_t)addr, len, flags);
+    mmap_unlock(mmap);
+    return err;
+}
+
+int munlock(const void *addr, size_t len) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_munlock(mmap, (uintptr_t)addr, len);
+    mmap_unlock(mmap);
+    return err;
+}
+
+int mlockall(int flags) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_mlockall(mmap, flags);
+    mmap_unlock(mmap);
+    return err;
+}
+
+int munlockall(void) {
+    int     err     = 0;
+    mmap_t  *mmap   = NULL;
+
+    if ((mmap = mmap_curlock()) == NULL) {
+        return -EINVAL;
+    }
+
+    err = mmap_munlockall(mmap);
+    mmap_unlock(mmap);
+    return err;
+}
+
+int set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode) {
+    int     err     = 0;
+    ulong   nodes   = 0;
+    proc_t  *proc   = NULL;
+
+    if ((proc = curproc) == NULL) {
+        return -EINVAL;
+    }
+
+    if (mode != MPOL_DEFAULT) {
+        if (nodemask == NULL || maxnode == 0) {
+            return -EINVAL;
+        }
+
+        // only the first 'maxnode' bits count.
+        nodes = *nodemask;
+        if (maxnode < sizeof nodes * 8) {
+            nodes &= BS(maxnode) - 1;
+        }
+    }
+
+    proc_lock(proc);
+    err = mempolicy_set(&proc->mempolicy, mode, nodes);
+    proc_unlock(proc);
+    return err;
+}
+
+int get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags) {
+    proc_t      *proc   = NULL;
+    mempolicy_t pol     = {0};
+
+    // per-address policies are not supported.
+    if (addr != NULL || flags != 0) {
+        return -EINVAL;
+    }
+
+    if (nodemask && maxnode < NNUMA) {
+        return -EINVAL;
+    }
+
+    if ((proc = curproc) == NULL) {
+        return -EINVAL;
+    }
+
+    proc_lock(proc);
+    pol.mode    = proc->mempolicy.mode;
+    pol.nodes   = proc->mempolicy.nodes;
+    proc_unlock(proc);
+
+    if (mode) {
+        *mode = pol.mode;
+    }
+
+    if (nodemask) {
+        *nodemask = pol.nodes;
+    }
+
+    return 0;
+}
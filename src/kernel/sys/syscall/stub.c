@@ -62,8 +62,11 @@ size_t (*syscall[])() = {
     [SYS_getpid]            = (void *)sys_getpid,
     [SYS_getppid]           = (void *)sys_getppid,
     [SYS_fork]              = (void *)sys_fork,
+    [SYS_vfork]             = (void *)sys_vfork,
     [SYS_waitpid]           = (void *)sys_waitpid,
+    [SYS_waitbatch]         = (void *)sys_waitbatch,
     [SYS_execve]            = (void *)sys_execve,
+    [SYS_spawn]             = (void *)sys_spawn,
     // [SYS_ptrace]            = (void *)sys_ptrace,
     // [SYS_wait4]             = (void *)sys_wait4,
         
@@ -107,15 +110,17 @@ size_t (*syscall[])() = {
     [SYS_mmap]              = (void *)sys_mmap,
     [SYS_munmap]            = (void *)sys_munmap,
     [SYS_mprotect]          = (void *)sys_mprotect,
-    // [SYS_mlock]             = (void *)sys_mlock,
-    // [SYS_mlock2]            = (void *)sys_mlock2,
-    // [SYS_munlock]           = (void *)sys_munlock,
-    // [SYS_mlockall]          = (void *)sys_mlockall,
-    // [SYS_munlockall]        = (void *)sys_munlockall,
-    // [SYS_msync]             = (void *)sys_msync,
-    // [SYS_mremap]            = (void *)sys_mremap,
-    // [SYS_madvise]           = (void *)sys_madvise,
+    [SYS_mlock]             = (void *)sys_mlock,
+    [SYS_mlock2]            = (void *)sys_mlock2,
+    [SYS_munlock]           = (void *)sys_munlock,
+    [SYS_mlockall]          = (void *)sys_mlockall,
+    [SYS_munlockall]        = (void *)sys_munlockall,
+    [SYS_msync]             = (void *)sys_msync,
+    [SYS_mremap]            = (void *)sys_mremap,
+    [SYS_madvise]           = (void *)sys_madvise,
     [SYS_sbrk]              = (void *)sys_sbrk,
+    [SYS_set_mempolicy]     = (void *)sys_set_mempolicy,
+    [SYS_get_mempolicy]     = (void *)sys_get_mempolicy,
         
     /** Miscelleneous syscalls */
         
@@ -265,8 +265,10 @@ int sys_munlock(const void *addr, size_t len);
 int sys_mlockall(int flags);
 int sys_munlockall(void);
 int sys_msync(void *addr, size_t length, int flags);
-void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
+void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address);
 int sys_madvise(void *addr, size_t length, int advice);
+int sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+int sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags);
 void *sys_sbrk(intptr_t increment);
 
 /** Miscelleneous syscalls */
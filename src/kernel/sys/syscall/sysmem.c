@@ -29,11 +29,42 @@ int sys_mprotect(void *addr, size_t len, int prot) {
     return mprotect(addr, len, prot);
 }
 
-void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
-int sys_mlock(const void *addr, size_t len);
-int sys_mlock2(const void *addr, size_t len, unsigned int flags);
-int sys_munlock(const void *addr, size_t len);
-int sys_mlockall(int flags);
-int sys_munlockall(void);
-int sys_msync(void *addr, size_t length, int flags);
-int sys_madvise(void *addr, size_t length, int advice);
\ No newline at end of file
+void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address) {
+    return mremap(old_address, old_size, new_size, flags, new_address);
+}
+
+int sys_mlock(const void *addr, size_t len) {
+    return mlock(addr, len);
+}
+
+int sys_mlock2(const void *addr, size_t len, unsigned int flags) {
+    return mlock2(addr, len, flags);
+}
+
+int sys_munlock(const void *addr, size_t len) {
+    return munlock(addr, len);
+}
+
+int sys_mlockall(int flags) {
+    return mlockall(flags);
+}
+
+int sys_munlockall(void) {
+    return munlockall();
+}
+
+int sys_msync(void *addr, size_t length, int flags) {
+    return msync(addr, length, flags);
+}
+
+int sys_madvise(void *addr, size_t length, int advice) {
+    return madvise(addr, length, advice);
+}
+
+int sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode) {
+    return set_mempolicy(mode, nodemask, maxnode);
+}
+
+int sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags) {
+    return get_mempolicy(mode, nodemask, maxnode, addr, flags);
+}
@@ -1,3 +1,4 @@
+#include <sys/pidhash.h>
 #include <sys/proc.h>
 #include <sys/sysproc.h>
 
@@ -28,10 +29,8 @@ pid_t getsid(pid_t pid) {
 pid_t   setsid(void) {
     pid_t   pid     = 0;
     
-    if (procQ_search_bypgid(curproc->pid, NULL) == 0) {
-        proc_unlock(curproc);
+    if (procQ_search_bypgid(curproc->pid, NULL) == 0)
         return -EPERM;
-    }
     
     proc_lock(curproc);
 
@@ -40,8 +39,9 @@ pid_t   setsid(void) {
         return -EPERM;
     }
 
-    curproc->sid        = curproc->pid;
-    pid = curproc->pgid   = curproc->pid;
+    pid = curproc->pid;
+    proc_setsid(curproc, pid);
+    pidhash_setpgid(curproc, pid);
     proc_unlock(curproc);
     return pid;
 }
@@ -146,22 +146,9 @@ int   setpgid(pid_t pid, pid_t pgid) {
         return -EPERM;
     }
     
-    queue_lock(procQ);
-    forlinked (node, procQ->head, node->next) {
-        leader = node->data;
-        if (leader == proc) {
-            leader = NULL;
-            continue;
-        }
-        proc_lock(leader);
-        if (leader->pgid == pgid) {
-            proc_getref(leader);
-            break;
-        }
-        proc_unlock(leader);
+    // our own 'proc' is locked and passed over.
+    if (procQ_search_bypgid(pgid, &leader))
         leader = NULL;
-    }
-    queue_unlock(procQ);
 
     /**The value of the pgid argument is valid
      * but does not match the process ID of the
@@ -186,7 +173,7 @@ int   setpgid(pid_t pid, pid_t pgid) {
         }
     }
     
-    proc->pgid = pgid;
+    pidhash_setpgid(proc, pgid);
 
     if (leader)
         proc_release(leader);
@@ -4,79 +4,10 @@
 #include <string.h>
 #include <sys/binary_loader.h>
 #include <sys/proc.h>
+#include <sys/spawn.h>
 #include <sys/sysproc.h>
 #include <sys/thread.h>
 
-static int exec_copy_vec(char *const src_vec[], char *const *pdst_vec[], size_t *pcnt) {
-    if (src_vec == NULL || pdst_vec == NULL) {
-        return -EINVAL;
-    }
-
-    usize cnt = 0;
-    char **dst_vec = NULL;
-
-    foreach (arg, (char **)src_vec) {
-        char **tmpv = (char **)krealloc(dst_vec, (cnt + 2) * sizeof(char *));
-        if (tmpv == NULL) {
-            tokens_free(dst_vec);
-            return -ENOMEM;
-        }
-
-        dst_vec = tmpv;
-        dst_vec[cnt] = strdup(arg);
-
-        if (dst_vec[cnt] == NULL) {
-            tokens_free(dst_vec);
-            return -ENOMEM;
-        }
-
-        dst_vec[++cnt] = NULL;
-    }
-
-    if (pcnt) { *pcnt = cnt; }
-
-    *pdst_vec = dst_vec;
-
-    return 0;
-}
-
-static void exec_free_tmp_arglist(char *const argv[], char *const envp[]) {
-    tokens_free((char **)argv);
-    tokens_free((char **)envp);
-}
-
-/* Assumptions:
- * - tokens_free(char **vec) frees each strdup'd element and the vector itself; NULL-safe.
- * - mmap_set_focus(new, &old_pgdir) activates 'new' address space and returns previous pgdir in *old_pgdir.
- * - Kernel is globally mapped so switching CR3 while in kernel is safe.
- * - thread_exit() is noreturn.
- */
-static int exec_copy_arglist(char *const argv[], char *const envv[], char *const *pargv[], char *const *penvp[]) {
-    int     err    = 0;
-    
-    if (!pargv || !penvp) {
-        return -EINVAL;
-    }
-    
-    // copy argv.
-    char  *const *argp;
-    if ((err = exec_copy_vec(argv, &argp, NULL))) {
-        return err;
-    }
-
-    // copy envp.
-    char  *const *envp;
-    if ((err = exec_copy_vec(envv, &envp, NULL))) {
-        tokens_free((char **)argp);
-        return err;
-    }
-
-    *pargv = argp;
-    *penvp = envp;
-
-    return 0;
-}
-
 static int exec_verify_image(inode_t *image_inode) {
     if (image_inode == NULL) {
         return -EINVAL;
@@ -116,7 +47,7 @@ static int exec_get_new_mmap(mmap_t **pmm) {
     return 0;
 }
 
-static int exec_spawn_thread(mmap_t *mmap, char *const argv[], char *const envp[], thread_t **pthread) {
+static int exec_spawn_thread(mmap_t *mmap, const exec_args_t *args, thread_t **pthread) {
     int err;
 
     if (!mmap) {
@@ -140,7 +71,7 @@ static int exec_spawn_thread(mmap_t *mmap, char *const argv[], char *const envp[
     t_info->ti_entry = mmap->entry;
     thread->t_mmap   = mmap;
 
-    if ((err = thread_execve(thread, argv, envp))) {
+    if ((err = thread_execve(thread, args))) {
         goto error;
     }
 
@@ -236,8 +167,9 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
         return -EINVAL;
     }
 
-    char *const *tmpargv, *const *tmpenvp;
-    int err = exec_copy_arglist(argv, envp, &tmpargv, &tmpenvp);
+    // staged while our address space, which they are in, is still in focus.
+    exec_args_t args;
+    int err = exec_args_copy(argv, envp, &args);
     if (err) {
         return err;
     }
@@ -252,7 +184,7 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
     }
     
     thread_t *thread;
-    if ((err = exec_spawn_thread(mmap, tmpargv, tmpenvp, &thread))) {
+    if ((err = exec_spawn_thread(mmap, &args, &thread))) {
         goto spawn_error;
     }
 
@@ -263,6 +195,9 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
     curproc->entry = mmap->entry;
     curproc->mmap  = mmap;
     curproc->main_thread = thread;
+
+    // off the parent's address space, it may run again.
+    vfork_done(curproc);
     
     proc_unlock(curproc);
     
@@ -270,7 +205,7 @@ int execve(const char *path, char *const argv[], char *const envp[]) {
 
     exec_thread_resign(thread);
 
-    exec_free_tmp_arglist(tmpargv, tmpenvp);
+    exec_args_free(&args);
 
     current_lock();
     mmap_free(current->t_mmap);
@@ -285,6 +220,120 @@ load_error:
     mmap_free(mmap);
 
 mmap_error:
-    exec_free_tmp_arglist(tmpargv, tmpenvp);
+    exec_args_free(&args);
     return err;
-}
\ No newline at end of file
+}
+
+static int spawn_file_actions(file_ctx_t *fctx, const spawn_file_action_t *actions, int nactions) {
+    int err = 0;
+
+    for (const spawn_file_action_t *fa = actions; fa < &actions[nactions]; ++fa) {
+        switch (fa->sfa_type) {
+        case SPAWN_FA_CLOSE:
+            err = fctx_close(fctx, fa->sfa_fd);
+            break;
+        case SPAWN_FA_DUP2:
+            err = fctx_dup2(fctx, fa->sfa_srcfd, fa->sfa_fd);
+            break;
+        case SPAWN_FA_OPEN:
+            err = fctx_open(fctx, fa->sfa_fd, fa->sfa_path, fa->sfa_oflags, fa->sfa_mode);
+            break;
+        default:
+            err = -EINVAL;
+        }
+
+        if (err < 0) {
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+pid_t spawn(const char *path, const spawn_file_action_t *actions,
+    int nactions, char *const argv[], char *const envp[]) {
+    int         err     = 0;
+    pid_t       pid     = 0;
+    char        *kpath  = NULL;
+    proc_t      *child  = NULL;
+    uintptr_t   oldpdbr = 0;
+    exec_args_t args    = {0};
+
+    if (curproc == NULL || path == NULL) {
+        return -EINVAL;
+    }
+
+    if (nactions < 0 || nactions > SPAWN_NACTION || (nactions && actions == NULL)) {
+        return -EINVAL;
+    }
+
+    // our address space is out of sight once the child's is in focus,
+    // so take everything the image needs from it up front.
+    if ((kpath = strdup(path)) == NULL) {
+        return -ENOMEM;
+    }
+
+    if ((err = exec_args_copy(argv, envp, &args))) {
+        kfree(kpath);
+        return err;
+    }
+
+    proc_lock(curproc);
+    if ((err = proc_alloc(kpath, &child))) {
+        proc_unlock(curproc);
+        goto done;
+    }
+
+    if ((err = copy_proc(child, curproc, COPY_PROC_SPAWN))) {
+        discard_proc(child, curproc);
+        proc_unlock(curproc);
+        goto done;
+    }
+
+    proc_unlock(curproc);
+
+    if ((err = spawn_file_actions(child->fctx, actions, nactions))) {
+        goto error;
+    }
+
+    // the image goes straight into the child's own, fresh address space.
+    mmap_lock(child->mmap);
+    if ((err = mmap_set_focus(child->mmap, &oldpdbr))) {
+        mmap_unlock(child->mmap);
+        goto error;
+    }
+
+    thread_lock(child->main_thread);
+
+    if ((err = exec_load_image(kpath, child->mmap)) == 0) {
+        child->entry = child->mmap->entry;
+        child->main_thread->t_info.ti_entry = child->entry;
+        err = thread_execve(child->main_thread, &args);
+    }
+
+    arch_switch_pgdir(oldpdbr, NULL);
+    mmap_unlock(child->mmap);
+
+    if (err || (err = enqueue_global_thread(child->main_thread)) ||
+        (err = thread_schedule(child->main_thread))) {
+        thread_unlock(child->main_thread);
+        goto error;
+    }
+
+    thread_unlock(child->main_thread);
+
+    pid = child->pid;
+    proc_unlock(child);
+    goto done;
+error:
+    // the child is published, the parent's lock goes first.
+    proc_unlock(child);
+    proc_lock(curproc);
+    proc_lock(child);
+    discard_proc(child, curproc);
+    proc_unlock(curproc);
+done:
+    exec_args_free(&args);
+    kfree(kpath);
+    return err ? err : pid;
+}
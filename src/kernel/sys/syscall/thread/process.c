@@ -28,13 +28,25 @@ pid_t sys_fork(void) {
     return fork();
 }
 
+pid_t sys_vfork(void) {
+    return vfork();
+}
+
 pid_t sys_waitpid(pid_t __pid, int *__stat_loc, int __options) {
     return waitpid(__pid, __stat_loc, __options);
 }
 
+int sys_waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options) {
+    return waitbatch(pid, ents, nent, options);
+}
+
 int sys_execve(const char *pathname, char *const argv[], char *const envp[]) {
     return execve(pathname, argv, envp);
 }
 
+pid_t sys_spawn(const char *path, const spawn_file_action_t *actions, int nactions, char *const argv[], char *const envp[]) {
+    return spawn(path, actions, nactions, argv, envp);
+}
+
 long sys_ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data);
 pid_t sys_wait4(pid_t pid, int *wstatus, int options, void /*struct rusage*/ *rusage);
\ No newline at end of file
@@ -1,145 +1,292 @@
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <mm/kalloc.h>
+#include <mm/mmap.h>
+#include <string.h>
 #include <sys/proc.h>
 #include <sys/thread.h>
 #include <sys/_wait.h>
 
-pid_t match_child_pid(pid_t pid, int *stat, int opt) {
-    proc_t *child = NULL;
+/**
+ * exit() puts a child on its parent's 'exited' queue, in the order
+ * children exit, and broadcasts 'child_event' with the parent locked.
+ * Waiting for any child takes the head of that queue, waiting for one
+ * finds it by its PID, neither looks through the other children.
+ *
+ * A waiter holds curproc's lock or a child's, never both: exit() takes
+ * them in either order, the exiting child locks its parent in
+ * signal_parent() and abandon_children() locks each child of the
+ * exiting parent. A dead child's pid, pgid and status no longer change.
+ */
+
+// children waitbatch() reaps in one call at most.
+#define WAITBATCH_MAX   512
+
+/*Called with curproc locked, is 'child' still on its exited queue?*/
+static bool exit_queued(proc_t *child) {
+    return child->exit_qnode.prev || child->exit_qnode.next ||
+        curproc->exited.head == &child->exit_qnode;
+}
+
+/**
+ * Take the exited 'child' off curproc's exited and children queues,
+ * it is the caller's to reap, or to give back, from then on.
+ * Called with curproc locked.
+ */
+static void exited_unlink(proc_t *child) {
+    queue_lock(&curproc->exited);
+    embedded_queue_detach(&curproc->exited, &child->exit_qnode);
+    queue_unlock(&curproc->exited);
+
     queue_lock(&curproc->children);
-    queue_foreach_entry(&curproc->children, child, child_qnode) {
-        proc_lock(child);
-        if (pid == child->pid) {
-            break;
-        }
-        proc_unlock(child);
-    }
+    embedded_queue_detach(&curproc->children, &child->child_qnode);
     queue_unlock(&curproc->children);
 
-    if (child == NULL) {
-        return -ECHILD;
-    }
+    child->parent = NULL;
+    proc_putref(curproc);
+}
 
-    int retval = 0;
-    while (!__proc_died(child) && !__proc_stopped(child)) {
-        if (opt & WNOHANG) {
-            proc_unlock(child);
-            return 0;
-        }
+/**
+ * Take the oldest child off curproc's exited queue,
+ * the oldest in process group 'pgid' unless it is 0.
+ * Called with curproc locked.
+ */
+static proc_t *exited_take(pid_t pgid) {
+    proc_t *child = NULL;
 
-        proc_unlock(child);
-        retval = cond_wait(&curproc->child_event, NULL, &curproc->lock);
-        proc_lock(child);
-        if (retval) {
+    queue_lock(&curproc->exited);
+    queue_foreach_entry(&curproc->exited, child, exit_qnode) {
+        if (pgid == 0 || child->pgid == pgid) {
             break;
         }
     }
+    queue_unlock(&curproc->exited);
 
-    if (stat && (__proc_died(child) || __proc_stopped(child))) {
-        *stat = child->status;
+    if (child) {
+        exited_unlink(child);
     }
 
-    if (__proc_died(child)) {
-        proc_free(child);
-    } else {
-        proc_unlock(child);
+    return child;
+}
+
+/**
+ * Give the 'n' children in 'kids' back to curproc, at the head of
+ * its exited queue and in the same order, for a waiter to take again.
+ */
+static void exited_putback(proc_t *kids[], int n) {
+    proc_lock(curproc);
+
+    while (n-- > 0) {
+        queue_lock(&curproc->children);
+        embedded_enqueue(&curproc->children, &kids[n]->child_qnode, QUEUE_DUPLICATES);
+        queue_unlock(&curproc->children);
+
+        kids[n]->parent = proc_getref(curproc);
+
+        queue_lock(&curproc->exited);
+        embedded_enqueue_head(&curproc->exited, &kids[n]->exit_qnode, QUEUE_DUPLICATES);
+        queue_unlock(&curproc->exited);
     }
 
-    return pid;
+    cond_broadcast(&curproc->child_event);
+    proc_unlock(curproc);
+}
+
+/*Release the 'child' exited_unlink() took, its PID is free for reuse after this.*/
+static void reap_child(proc_t *child) {
+    proc_lock(child);
+    procQ_remove(child);
+    proc_free(child);
 }
 
-pid_t match_pid(int *stat, int opt) {
+/*Wait for the child 'pid', '*pchild' is set to it once it is taken.*/
+static int wait_child(pid_t pid, int opt, proc_t **pchild) {
+    int     err     = 0;
+    proc_t  *child  = NULL;
+
+    if ((err = procQ_search_bypid(pid, &child))) {
+        return err == -ESRCH ? -ECHILD : err;
+    }
+
+    // the reference keeps it around, its lock is not needed.
+    proc_unlock(child);
+
+    proc_lock(curproc);
     loop() {
-        proc_t *child;
-        queue_lock(&curproc->children);
-        queue_foreach_entry(&curproc->children, child, child_qnode) {
-            proc_lock(child);
-            if (__proc_died(child) || __proc_stopped(child)) {
-                if (stat) {
-                    *stat = child->status;
-                }
-
-                pid_t pid = child->pid;
-                if (__proc_died(child)) {
-                    proc_free(child);
-                } else {
-                    proc_unlock(child);
-                }
-
-                queue_unlock(&curproc->children);
-                return pid;
-            }
-            proc_unlock(child);
+        // not ours, or taken by another thread while we slept.
+        if (child->parent != curproc) {
+            err = -ECHILD;
+            break;
+        }
+
+        if (exit_queued(child)) {
+            exited_unlink(child);
+            *pchild = child;
+            break;
         }
-        queue_unlock(&curproc->children);
 
         if (opt & WNOHANG) {
-            return -ECHILD;
+            break;
         }
 
-        int err;
         if ((err = cond_wait(&curproc->child_event, NULL, &curproc->lock))) {
-            return err;
+            break;
         }
     }
+    proc_unlock(curproc);
+
+    proc_free(child);
+    return err;
 }
 
-pid_t match_pgid(pid_t pgid, int *stat, int opt) {
+/**
+ * Wait for a child 'pid' picks, as waitpid() does. '*pchild' is set
+ * to the child, taken off curproc's queues, or to NULL if there is
+ * none yet and WNOHANG is in 'opt'.
+ */
+static int wait_one(pid_t pid, int opt, proc_t **pchild) {
+    int     err     = 0;
+    pid_t   pgid    = 0;
+    proc_t  *child  = NULL;
+
+    *pchild = NULL;
+
+    if (pid > 0) {
+        return wait_child(pid, opt, pchild);
+    }
+
+    proc_lock(curproc);
+
+    if (pid < -1) {
+        pgid = -pid;
+    } else if (pid == 0) {
+        pgid = curproc->pgid;
+    }
+
     loop() {
-        proc_t *child;
-        queue_lock(&curproc->children);
-        queue_foreach_entry(&curproc->children, child, child_qnode) {
-            proc_lock(child);
-            if (pgid == child->pgid) {
-                if (__proc_died(child) || __proc_stopped(child)) {
-                    if (stat) {
-                        *stat = child->status;
-                    }
-
-                    pid_t pid = child->pid;
-                    if (__proc_died(child)) {
-                        proc_free(child);
-                    } else {
-                        proc_unlock(child);
-                    }
-
-                    queue_unlock(&curproc->children);
-                    return pid;
-                }
-            }
-            proc_unlock(child);
+        if ((child = exited_take(pgid))) {
+            break;
         }
+
+        queue_lock(&curproc->children);
+        err = curproc->children.q_count ? 0 : -ECHILD;
         queue_unlock(&curproc->children);
 
-        if (opt & WNOHANG) {
-            return -ECHILD;
+        if (err || (opt & WNOHANG)) {
+            break;
         }
 
-        int err;
         if ((err = cond_wait(&curproc->child_event, NULL, &curproc->lock))) {
-            return err;
+            break;
         }
     }
+
+    proc_unlock(curproc);
+
+    *pchild = child;
+    return err;
 }
 
 pid_t waitpid(pid_t pid, int *stat, int opt) {
+    int     err     = 0;
+    proc_t  *child  = NULL;
+
     if (pid == getpid()) {
         return -EDEADLOCK;
     }
 
-    int retval = -ECHILD;
-    proc_lock(curproc);
+    if ((err = wait_one(pid, opt, &child)) || child == NULL) {
+        return err;
+    }
 
-    if (pid < -1) {
-        retval = match_pgid(ABS(pid), stat, opt);
-    } else if (pid == -1) {
-        retval = match_pid(stat, opt);
-    } else if (pid == 0) {
-        retval = match_pgid(curproc->pgid, stat, opt);
-    } else {
-        retval = match_child_pid(pid, stat, opt);
+    pid = child->pid;
+    if (stat) {
+        *stat = child->status;
     }
 
-    proc_unlock(curproc);
-    return retval;
-}
\ No newline at end of file
+    reap_child(child);
+    return pid;
+}
+
+/**
+ * Copy the 'n' entries staged in 'kents' out to 'ents'. The range is
+ * faulted in and written with the address space locked, so nothing
+ * can unmap it in between and the copy itself never faults.
+ */
+static int wait_entries_copyout(wait_entry_t *ents, const wait_entry_t *kents, int n) {
+    int             err     = 0;
+    mmap_t          *mmap   = curproc->mmap;
+    const uintptr_t start   = (uintptr_t)ents;
+    const uintptr_t end     = start + (usize)n * sizeof *ents - 1;
+
+    if (mmap == NULL || end < start || !__valid_addr(end)) {
+        return -EFAULT;
+    }
+
+    mmap_lock(mmap);
+    if ((err = mmap_prefault_write(mmap, start, end)) == 0) {
+        memcpy(ents, kents, (usize)n * sizeof *ents);
+    }
+    mmap_unlock(mmap);
+
+    return err;
+}
+
+int waitbatch(pid_t pid, wait_entry_t *ents, int nent, int opt) {
+    int             err     = 0;
+    int             n       = 0;
+    proc_t          **kids  = NULL;
+    wait_entry_t    *kents  = NULL;
+
+    if (ents == NULL || nent <= 0) {
+        return -EINVAL;
+    }
+
+    if (pid == getpid()) {
+        return -EDEADLOCK;
+    }
+
+    nent = nent < WAITBATCH_MAX ? nent : WAITBATCH_MAX;
+
+    if ((kids = kmalloc(nent * sizeof *kids)) == NULL ||
+        (kents = kmalloc(nent * sizeof *kents)) == NULL) {
+        err = -ENOMEM;
+        goto done;
+    }
+
+    // only the first child is waited for, the rest are those already gone.
+    for (n = 0; n < nent; ++n) {
+        if ((err = wait_one(pid, n ? opt | WNOHANG : opt, &kids[n])) || kids[n] == NULL) {
+            break;
+        }
+
+        kents[n].we_pid     = kids[n]->pid;
+        kents[n].we_status  = kids[n]->status;
+    }
+
+    if (n == 0) {
+        goto done;
+    }
+
+    // the children are released only once the caller has their entries.
+    if ((err = wait_entries_copyout(ents, kents, n))) {
+        exited_putback(kids, n);
+        goto done;
+    }
+
+    for (int i = 0; i < n; ++i) {
+        reap_child(kids[i]);
+    }
+
+    err = n;
+done:
+    if (kents) {
+        kfree(kents);
+    }
+
+    if (kids) {
+        kfree(kids);
+    }
+
+    return err;
+}
@@ -20,20 +20,44 @@ int abandon_children(proc_t *target) {
     }
 
     int err = 0;
-    proc_t *child;
-    queue_foreach_entry(&curproc->children, child, child_qnode) {
+    queue_node_t *node;
+    while (embedded_dequeue(&curproc->children, &node) == 0) {
+        proc_t *child = queue_node_get_container(node, proc_t, child_qnode);
+
         proc_lock(child);
-        err = embedded_queue_relloc(&target->children, &curproc->children,
-            &child->child_qnode, QUEUE_UNIQUE, QUEUE_TAIL);
+        err = embedded_enqueue(&target->children, node, QUEUE_DUPLICATES);
+        if (err == 0 && child->parent == curproc) {
+            child->parent = proc_getref(target);
+            proc_putref(curproc);
+        }
         proc_unlock(child);
 
-        if (err != 0) return err;
+        if (err != 0) break;
     }
 
     queue_unlock(&target->children);
     queue_unlock(&curproc->children);
 
-    return err;
+    if (err != 0) return err;
+
+    // those that already exited are for 'target' to wait for now.
+    queue_lock(&target->exited);
+    queue_lock(&curproc->exited);
+
+    bool moved = false;
+    while (embedded_dequeue(&curproc->exited, &node) == 0) {
+        embedded_enqueue(&target->exited, node, QUEUE_DUPLICATES);
+        moved = true;
+    }
+
+    queue_unlock(&curproc->exited);
+    queue_unlock(&target->exited);
+
+    if (moved) {
+        cond_broadcast(&target->child_event);
+    }
+
+    return 0;
 }
 
 void discard_signals(void) {
@@ -47,11 +71,19 @@ void discard_signals(void) {
 }
 
 void signal_parent(void) {
-    if (curproc->parent) {
-        proc_lock(curproc->parent);
-        cond_signal(&curproc->parent->child_event);
-        proc_send_signal(curproc->parent, SIGCHLD, (sigval_t) {0});
-        proc_unlock(curproc->parent);
+    proc_t *parent = curproc->parent;
+
+    if (parent) {
+        proc_lock(parent);
+
+        queue_lock(&parent->exited);
+        embedded_enqueue(&parent->exited, &curproc->exit_qnode, QUEUE_DUPLICATES);
+        queue_unlock(&parent->exited);
+
+        // its threads may be waiting for different children.
+        cond_broadcast(&parent->child_event);
+        proc_send_signal(parent, SIGCHLD, (sigval_t) {0});
+        proc_unlock(parent);
     }
 }
 
@@ -78,11 +110,24 @@ __noreturn void exit(int status) {
     curproc->state  = P_TERMINATED;
     curproc->status = __W_EXITCODE(status, 0);
 
-    // TODO: Maybe this should be done by the parent.
-    mmap_lock(curproc->mmap);
-    err = mmap_clean(curproc->mmap);
-    mmap_unlock(curproc->mmap);
-    assert_eq(err, 0, "Error[%s]: Failed to clean memory map.\n", strerror(err));
+    if (proc_testflags(curproc, PROC_VFORKED)) {
+        // the address space and stack are the parent's, only let go of them.
+        current_lock();
+        current->t_mmap = NULL;
+        current->t_arch.t_ustack = (uc_stack_t){0};
+        current_unlock();
+
+        arch_switchkvm();
+        mmap_free(curproc->mmap);
+        curproc->mmap = NULL;
+        vfork_done(curproc);
+    } else {
+        // TODO: Maybe this should be done by the parent.
+        mmap_lock(curproc->mmap);
+        err = mmap_clean(curproc->mmap);
+        mmap_unlock(curproc->mmap);
+        assert_eq(err, 0, "Error[%s]: Failed to clean memory map.\n", strerror(err));
+    }
 
     signal_parent();
 
@@ -0,0 +1,186 @@
+#include <bits/errno.h>
+#include <sys/pidhash.h>
+
+typedef struct pid_bucket {
+    void        *head;  // first task in the chain.
+    spinlock_t  lock;   // protects the chain.
+} pid_bucket_t;
+
+static pid_bucket_t pid_table[PIDHASH_NBUCKET];
+static pid_bucket_t pgid_table[PIDHASH_NBUCKET];
+static pid_bucket_t tid_table[PIDHASH_NBUCKET];
+
+// IDs are handed out in sequence, the low bits spread them well enough.
+#define pid_bucket(table, id)   (&(table)[(usize)(id) & (PIDHASH_NBUCKET - 1)])
+
+// the link of 'item' in a chain whose links are at 'off' into each task.
+#define pid_link(item, off)     ((void **)((char *)(item) + (off)))
+
+static void pid_chain_add(pid_bucket_t *bucket, void *item, usize off) {
+    spin_lock(&bucket->lock);
+    *pid_link(item, off) = bucket->head;
+    bucket->head = item;
+    spin_unlock(&bucket->lock);
+}
+
+static void pid_chain_del(pid_bucket_t *bucket, void *item, usize off) {
+    spin_lock(&bucket->lock);
+    for (void **pp = &bucket->head; *pp; pp = pid_link(*pp, off)) {
+        if (*pp == item) {
+            *pp = *pid_link(item, off);
+            *pid_link(item, off) = NULL;
+            break;
+        }
+    }
+    spin_unlock(&bucket->lock);
+}
+
+int pidhash_insert(proc_t *proc) {
+    if (proc == NULL)
+        return -EINVAL;
+
+    proc_assert_locked(proc);
+
+    pid_chain_add(pid_bucket(pid_table, proc->pid), proc, offsetof(proc_t, pid_hnext));
+    pid_chain_add(pid_bucket(pgid_table, proc->pgid), proc, offsetof(proc_t, pgid_hnext));
+    return 0;
+}
+
+void pidhash_remove(proc_t *proc) {
+    if (proc == NULL)
+        return;
+
+    proc_assert_locked(proc);
+
+    pid_chain_del(pid_bucket(pgid_table, proc->pgid), proc, offsetof(proc_t, pgid_hnext));
+    pid_chain_del(pid_bucket(pid_table, proc->pid), proc, offsetof(proc_t, pid_hnext));
+}
+
+void pidhash_setpgid(proc_t *proc, pid_t pgid) {
+    proc_assert_locked(proc);
+
+    if (proc->pgid == pgid)
+        return;
+
+    // pgid only changes while off the chains, lookups read it under the bucket lock.
+    pid_chain_del(pid_bucket(pgid_table, proc->pgid), proc, offsetof(proc_t, pgid_hnext));
+    proc_pid_get(pgid);
+    proc_pid_put(proc->pgid);
+    proc->pgid = pgid;
+    pid_chain_add(pid_bucket(pgid_table, pgid), proc, offsetof(proc_t, pgid_hnext));
+}
+
+/**
+ * Look 'id' up in the process chain of 'table' whose links are at
+ * 'off', 'bypgid' tells which ID to match.
+ */
+static int proc_lookup(pid_bucket_t *table, usize off, bool bypgid, pid_t id, proc_t **ref) {
+    int             err     = -ESRCH;
+    proc_t          *proc   = NULL;
+    pid_bucket_t    *bucket = pid_bucket(table, id);
+
+retry:
+    spin_lock(&bucket->lock);
+    for (proc = bucket->head; proc; proc = *(proc_t **)pid_link(proc, off)) {
+        if ((bypgid ? proc->pgid : proc->pid) != id)
+            continue;
+
+        if (ref == NULL) {
+            err = 0;
+            break;
+        }
+
+        if (proc_islocked(proc)) {
+            if (bypgid)
+                continue;
+            err = -EDEADLK;
+            break;
+        }
+
+        if (!spin_trylock(&proc->lock)) {
+            spin_unlock(&bucket->lock);
+            cpu_pause();
+            goto retry;
+        }
+
+        *ref = proc_getref(proc);
+        err  = 0;
+        break;
+    }
+    spin_unlock(&bucket->lock);
+
+    return err;
+}
+
+int pidhash_find(pid_t pid, proc_t **ref) {
+    if (pid <= 0)
+        return -EINVAL;
+    return proc_lookup(pid_table, offsetof(proc_t, pid_hnext), false, pid, ref);
+}
+
+int pgidhash_find(pid_t pgid, proc_t **ref) {
+    if (pgid <= 0)
+        return -EINVAL;
+    return proc_lookup(pgid_table, offsetof(proc_t, pgid_hnext), true, pgid, ref);
+}
+
+int tidhash_insert(thread_t *thread) {
+    if (thread == NULL)
+        return -EINVAL;
+
+    thread_assert_locked(thread);
+
+    pid_chain_add(pid_bucket(tid_table, thread_gettid(thread)),
+        thread, offsetof(thread_t, t_tid_hnext));
+    return 0;
+}
+
+void tidhash_remove(thread_t *thread) {
+    if (thread == NULL)
+        return;
+
+    thread_assert_locked(thread);
+
+    pid_chain_del(pid_bucket(tid_table, thread_gettid(thread)),
+        thread, offsetof(thread_t, t_tid_hnext));
+}
+
+int tidhash_find(tid_t tid, thread_t **ptp) {
+    int             err     = -ESRCH;
+    thread_t        *thread = NULL;
+    pid_bucket_t    *bucket = NULL;
+
+    if (tid <= 0)
+        return -EINVAL;
+
+    bucket = pid_bucket(tid_table, tid);
+retry:
+    spin_lock(&bucket->lock);
+    for (thread = bucket->head; thread; thread = thread->t_tid_hnext) {
+        if (thread_gettid(thread) != tid)
+            continue;
+
+        if (ptp == NULL) {
+            err = 0;
+            break;
+        }
+
+        if (thread_islocked(thread)) {
+            err = -EDEADLK;
+            break;
+        }
+
+        if (!spin_trylock(&thread->t_lock)) {
+            spin_unlock(&bucket->lock);
+            cpu_pause();
+            goto retry;
+        }
+
+        *ptp = thread;
+        err  = 0;
+        break;
+    }
+    spin_unlock(&bucket->lock);
+
+    return err;
+}
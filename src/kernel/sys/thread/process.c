@@ -1,7 +1,9 @@
 #include <bits/errno.h>
+#include <ds/idmap.h>
 #include <fs/fs.h>
 #include <string.h>
 #include <mm/kalloc.h>
+#include <sys/pidhash.h>
 #include <sys/proc.h>
 #include <sys/elf/elf.h>
 #include <sys/binary_loader.h>
@@ -9,39 +11,46 @@
 proc_t *initproc = NULL;
 queue_t *procQ   = QUEUE_NEW();
 
-// bucket to hold free'd PIDs.
-static queue_t *procIDs = QUEUE_NEW();
-
-/**
- * For process ID alocation.
- * to be moved to sys/proc.c
- */
-static atomic_t pids = {0};
+// PIDs in use, 0 is never handed out.
+static IDMAP(pid_map, 1, NPROC);
 
 static int proc_alloc_pid(pid_t *ref) {
-    int     err = 0;
-    pid_t   pid = 0;
-
     if (ref == NULL)
         return -EINVAL;
-    
-    queue_lock(procIDs);
-    err = dequeue(procIDs, (void **)&pid);
-    queue_unlock(procIDs);
+    return idmap_alloc(&pid_map, ref);
+}
 
-    if (err == 0) goto done;
+static void proc_free_pid(pid_t pid) {
+    idmap_free(&pid_map, pid);
+}
 
-    pid = (pid_t) atomic_inc_fetch(&pids);
-    if (pid >= NPROC)
-        return -EAGAIN;
-done:
-    *ref = pid;
-    return 0;
+/**
+ * Processes using each PID as their own, as their process group
+ * or as their session. A PID goes back to pid_map only once none
+ * does, or a new process could end up leading a group or session
+ * it never created.
+ */
+static atomic_uint pid_users[NPROC];
+
+void proc_pid_get(pid_t id) {
+    if (id > 0 && id < NPROC)
+        atomic_inc(&pid_users[id]);
 }
 
-static void proc_free_pid(pid_t pid) {
-    if (pid <= 0 || pid > NPROC)
+void proc_pid_put(pid_t id) {
+    if (id > 0 && id < NPROC && atomic_dec_fetch(&pid_users[id]) == 0)
+        proc_free_pid(id);
+}
+
+void proc_setsid(proc_t *proc, pid_t sid) {
+    proc_assert_locked(proc);
+
+    if (proc->sid == sid)
         return;
+
+    proc_pid_get(sid);
+    proc_pid_put(proc->sid);
+    proc->sid = sid;
 }
 
 int procQ_remove(proc_t *proc) {
@@ -54,6 +63,12 @@ int procQ_remove(proc_t *proc) {
 
     queue_lock(procQ);
     if ((err = embedded_queue_remove(procQ, &proc->proc_qnode)) == 0) {
+        // nothing can find it by its PID now, it may go to another
+        // once no group or session is left named after it.
+        pidhash_remove(proc);
+        proc_pid_put(proc->pgid);
+        proc_pid_put(proc->sid);
+        proc_pid_put(proc->pid);
         proc_putref(proc);
     }
     queue_unlock(procQ);
@@ -69,6 +84,7 @@ int procQ_insert(proc_t *proc) {
     
     queue_lock(procQ);
     if (0 == (err = embedded_enqueue(procQ, &proc->proc_qnode, QUEUE_UNIQUE))) {
+        pidhash_insert(proc);
         proc_getref(proc);
     }
     queue_unlock(procQ);
@@ -77,51 +93,11 @@ int procQ_insert(proc_t *proc) {
 }
 
 int procQ_search_bypid(pid_t pid, proc_t **ref) {
-    queue_lock(procQ);
-    
-    proc_t *proc;
-    foreach_process(procQ, proc) {
-        proc_lock(proc);
-        if (proc->pid == pid) {
-            if (ref != NULL) {
-                *ref = proc_getref(proc);
-            } else {
-                proc_unlock(proc);
-            }
-
-            queue_lock(procQ);
-            return 0;
-        }
-        proc_unlock(proc);
-    }
-
-    queue_lock(procQ);
-
-    return -ESRCH;
+    return pidhash_find(pid, ref);
 }
 
 int procQ_search_bypgid(pid_t pgid, proc_t **ref) {
-    queue_lock(procQ);
-
-    proc_t *proc;
-    foreach_process(procQ, proc) {
-        proc_lock(proc);
-        if (proc->pgid == pgid) {
-            if (ref != NULL) {
-                *ref = proc_getref(proc);
-            } else {
-                proc_unlock(proc);
-            }
-
-            queue_lock(procQ);
-            return 0;
-        }
-        proc_unlock(proc);
-    }
-
-    queue_lock(procQ);
-
-    return -ESRCH;
+    return pgidhash_find(pgid, ref);
 }
 
 int proc_alloc(const char *name, proc_t **pref) {
@@ -159,11 +135,15 @@ int proc_alloc(const char *name, proc_t **pref) {
         goto error;
     }
 
+    // its PID names its process group and session too.
+    atomic_write(&pid_users[proc->pid], 3);
+
     proc->refcnt        = 1;
     proc->mmap          = mmap;
     proc->pgid          = proc->pid;
     proc->sid           = proc->pid;
     proc->child_event   = COND_INIT();
+    proc->vfork_event   = COND_INIT();
     proc->lock          = SPINLOCK_INIT();
     proc->cred          = thread->t_cred;
     proc->fctx          = thread->t_fctx;
@@ -236,8 +216,6 @@ void proc_free(proc_t *proc) {
             kfree(proc->name);
         }
 
-        proc_free_pid(proc->pid);
-
         proc_unlock(proc);
 
         /// TODO: a solution to the problem above
@@ -283,8 +261,16 @@ int proc_init(const char *initpath) {
     };
 
     char  *const envp[] = { NULL };
-    
-    if ((err = thread_execve(proc->main_thread, argp, envp))) {
+
+    exec_args_t args;
+    if ((err = exec_args_copy(argp, envp, &args))) {
+        thread_unlock(proc->main_thread);
+        goto error;
+    }
+
+    err = thread_execve(proc->main_thread, &args);
+    exec_args_free(&args);
+    if (err) {
         thread_unlock(proc->main_thread);
         goto error;
     }
@@ -1,5 +1,6 @@
 #include <core/debug.h>
 #include <mm/kalloc.h>
+#include <sys/pidhash.h>
 #include <sys/schedule.h>
 #include <sys/thread.h>
 #include <sys/proc.h>
@@ -287,15 +288,24 @@ int thread_queue_find_by_tid(queue_t *thread_queue, tid_t tid, thread_t **ptp) {
 }
 
 int thread_group_get_by_tid(tid_t tid, thread_t **ptp) {
+    int      err     = 0;
+    thread_t *thread = NULL;
+
     if (ptp == NULL) {
         return -EINVAL;
     }
 
-    queue_lock(current->t_group);
-    int err = thread_queue_find_by_tid(current->t_group, tid, ptp);
-    queue_unlock(current->t_group);
+    if ((err = tidhash_find(tid, &thread))) {
+        return err;
+    }
 
-    return err;
+    if (thread->t_group != current->t_group) {
+        thread_unlock(thread);
+        return -ESRCH;
+    }
+
+    *ptp = thread;
+    return 0;
 }
 
 int global_find_by_tid(tid_t tid, thread_t **ptp) {
@@ -303,10 +313,7 @@ int global_find_by_tid(tid_t tid, thread_t **ptp) {
         return -EINVAL;
     }
 
-    queue_lock(global_thread_queue);
-    int err = thread_queue_find_by_tid(global_thread_queue, tid, ptp);
-    queue_unlock(global_thread_queue);
-    return err;
+    return tidhash_find(tid, ptp);
 }
 
 int enqueue_global_thread(thread_t *thread) {
@@ -316,6 +323,9 @@ int enqueue_global_thread(thread_t *thread) {
 
     queue_lock(global_thread_queue);
     int err = thread_enqueue(global_thread_queue, thread, t_global_qnode, QUEUE_TAIL);
+    if (err == 0) {
+        tidhash_insert(thread);
+    }
     queue_unlock(global_thread_queue);
     return err;
 }
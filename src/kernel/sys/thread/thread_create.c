@@ -1,40 +1,89 @@
 #include <arch/paging.h>
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <ds/idmap.h>
 #include <mm/kalloc.h>
 #include <mm/mem.h>
+#include <mm/numa.h>
 #include <string.h>
+#include <sync/preempt.h>
+#include <sys/pidhash.h>
 #include <sys/thread.h>
 
+// TIDs in use, 0 is never handed out.
+static IDMAP(tid_map, 1, NTHREAD);
+
 /**
  * @brief Allocate a new thread ID.
  *
- * Uses a static atomic counter to generate unique thread IDs.
+ * TIDs come from a bitmap with a rolling cursor, a freed one
+ * is handed out again only after the rest of the space was.
  *
- * @return A unique thread ID.
+ * @param[out] ptid Pointer to the allocated thread ID.
+ * @return 0 on success, or -EAGAIN if all TIDs are in use.
  */
-static tid_t alloc_tid(void) {
-    static atomic_t tid = 0;
-    return atomic_inc_fetch(&tid);
+static int alloc_tid(tid_t *ptid) {
+    return idmap_alloc(&tid_map, ptid);
+}
+
+static void free_tid(tid_t tid) {
+    idmap_free(&tid_map, tid);
+}
+
+/**
+ * Kernel stacks of exited threads, per CPU.
+ * A stack is put here mapped, with the thread_t at its top, and the
+ * next thread created on that CPU gets it back without going through
+ * the page allocator or the page tables. Only KSTACK_SIZE stacks are
+ * cached, any other size is freed as before.
+ */
+static struct kstack_cache {
+    usize       count;
+    void        *stacks[KSTACK_CACHE_MAX];
+    spinlock_t  lock;   // the shrinker drains other CPUs' caches.
+} kstack_cache[NCPU];
+
+// Lock and return the calling CPU's stack cache.
+static struct kstack_cache *kstack_cache_lock(void) {
+    struct kstack_cache *cache = NULL;
+
+    pushcli();
+    cache = &kstack_cache[getcpuid()];
+    spin_lock(&cache->lock);
+    popcli();
+
+    return cache;
 }
 
 /**
  * @brief Allocate a kernel stack for a thread.
  *
- * This function allocates a kernel stack of size KSTACK_SIZE.
+ * This function allocates a kernel stack of size kstack_size,
+ * taking a KSTACK_SIZE one from the CPU's cache if it has one.
  *
  * @param[in]  kstack_size Size of kernel stack.
  * @param[out] pp Pointer to the allocated stack address.
  * @return 0 on success, or -EINVAL/-error code on failure.
  */
 static int thread_alloc_kstack(usize kstack_size, void **pp) {
-    int err;
-    uintptr_t addr;
+    int                 err;
+    uintptr_t           addr;
+    struct kstack_cache *cache = NULL;
 
     if (pp == NULL || ((kstack_size < KSTACK_SIZE) || (kstack_size > KSTACK_MAXSIZE))) {
         return -EINVAL;
     }
 
+    if (kstack_size == KSTACK_SIZE) {
+        cache = kstack_cache_lock();
+        if (cache->count) {
+            *pp = cache->stacks[--cache->count];
+            spin_unlock(&cache->lock);
+            return 0;
+        }
+        spin_unlock(&cache->lock);
+    }
+
     if ((err = arch_pagealloc(kstack_size, &addr))) {
         return err;
     }
@@ -43,6 +92,64 @@ static int thread_alloc_kstack(usize kstack_size, void **pp) {
     return 0;
 }
 
+/**
+ * @brief Free a thread's kernel stack.
+ *
+ * A KSTACK_SIZE stack goes to the CPU's cache while it has room.
+ * The caller must be done with the thread_t on it.
+ *
+ * @param stack Base of the stack.
+ * @param kstack_size Size of the stack.
+ */
+static void thread_free_kstack(void *stack, usize kstack_size) {
+    struct kstack_cache *cache = NULL;
+
+    if (kstack_size == KSTACK_SIZE) {
+        cache = kstack_cache_lock();
+        if (cache->count < KSTACK_CACHE_MAX) {
+            cache->stacks[cache->count++] = stack;
+            spin_unlock(&cache->lock);
+            return;
+        }
+        spin_unlock(&cache->lock);
+    }
+
+    arch_pagefree((uintptr_t)stack, kstack_size);
+}
+
+static usize kstack_count(shrinker_t *shrinker __unused) {
+    usize count = 0;
+
+    // a racy read is fine, we only need an estimate.
+    for (usize i = 0; i < NCPU; ++i)
+        count += kstack_cache[i].count;
+    return count;
+}
+
+static usize kstack_scan(shrinker_t *shrinker __unused, usize nr_scan) {
+    usize               freed   = 0;
+    struct kstack_cache *cache  = NULL;
+
+    for (cache = kstack_cache; cache < &kstack_cache[NCPU] && nr_scan; ++cache) {
+        if (spin_trylock(&cache->lock) == 0)
+            continue;
+
+        for (; cache->count && nr_scan; --nr_scan) {
+            arch_pagefree((uintptr_t)cache->stacks[--cache->count], KSTACK_SIZE);
+            freed += NPAGE(KSTACK_SIZE);
+        }
+        spin_unlock(&cache->lock);
+    }
+
+    return freed;
+}
+
+shrinker_t kstack_shrinker = {
+    .name   = "kstack",
+    .count  = kstack_count,
+    .scan   = kstack_scan,
+};
+
 /**
  * @brief Allocate and initialize a new thread structure.
  *
@@ -58,20 +165,26 @@ static int thread_alloc_kstack(usize kstack_size, void **pp) {
  */
 int thread_alloc(usize kstack_size, int flags, thread_t **ptp) {
     int         err;
+    tid_t       tid   = 0;
     uintptr_t   stack = 0;
 
     if (ptp == NULL) {
         return -EINVAL;
     }
 
+    if ((err = alloc_tid(&tid))) {
+        return err;
+    }
+
     if ((err = thread_alloc_kstack(kstack_size, (void **)&stack))) {
+        free_tid(tid);
         return err;
     }
 
     /* Place the thread structure at the top of the allocated stack */
     thread_t *thread = (thread_t *)ALIGN16((stack + kstack_size) - sizeof(*thread));
     
-    // page_check_watermark((uintptr_t)thread);
+    // page_check((uintptr_t)thread);
     memset(thread, 0, sizeof(*thread));
 
     /* Initialize architecture-specific thread context */
@@ -90,7 +203,7 @@ int thread_alloc(usize kstack_size, int flags, thread_t **ptp) {
 
     /* Initialize thread information */
     thread_info_t   *tinfo = &thread->t_info;
-    tinfo->ti_tid   = alloc_tid();
+    tinfo->ti_tid   = tid;
     /* Combine flags for user and detached threads */
     tinfo->ti_flags = ((flags & THREAD_CREATE_USER) ? OsThreadUser : 0) |
                       ((flags & THREAD_CREATE_DETACHED) ? OsThreadDetached : 0);
@@ -100,6 +213,7 @@ int thread_alloc(usize kstack_size, int flags, thread_t **ptp) {
     sched->ts_ctime         = epoch_get();
     sched->ts_affin.cpu_set = -1; /* -1 means all CPUs allowed */
     sched->ts_affin.type    = SOFT_AFFINITY;
+    sched->ts_node          = numa_local_node();
 
     /* Initialize thread qnodes */
     thread->t_run_qnode.data    = (void *)thread;
@@ -306,6 +420,9 @@ void thread_free(thread_t *thread) {
     embedded_queue_remove(global_thread_queue, &thread->t_global_qnode);
     queue_unlock(global_thread_queue);
 
+    tidhash_remove(thread);
+    free_tid(thread_gettid(thread));
+
     if (thread->t_group) {
         queue_lock(thread->t_group);
         embedded_queue_remove(queue, &thread->t_group_qnode);
@@ -329,7 +446,8 @@ void thread_free(thread_t *thread) {
 
     arch_thread_free(arch);
 
-    if (thread_is_user(thread)) {
+    // a vfork()ed child's stack was its parent's, it stays.
+    if (thread_is_user(thread) && arch->t_ustack.ss_size) {
         mmap_lock(thread->t_mmap);
         assert_eq(err = mmap_unmap(thread->t_mmap,
             (uintptr_t)(arch->t_ustack.ss_sp - arch->t_ustack.ss_size),
@@ -347,5 +465,5 @@ void thread_free(thread_t *thread) {
     thread_enter_state(thread, T_TERMINATED);
 
     thread_unlock(thread);
-    arch_pagefree((uintptr_t)arch->t_kstack.ss_sp, arch->t_kstack.ss_size);
+    thread_free_kstack(arch->t_kstack.ss_sp, arch->t_kstack.ss_size);
 }
\ No newline at end of file
@@ -1,9 +1,100 @@
 #include <bits/errno.h>
 #include <core/debug.h>
+#include <mm/kalloc.h>
 #include <string.h>
 #include <sys/thread.h>
 
-int thread_execve(thread_t *thread, char *const argv[], char *const envv[]) {
+/**
+ * Count the strings in 'vec' and add their sizes, NULs included, to
+ * '*pstrsz'. A NULL 'vec' is an empty one.
+ */
+static int exec_args_measure(char *const vec[], int *pcnt, usize *pstrsz) {
+    int cnt = 0;
+
+    for (; vec && vec[cnt]; ++cnt) {
+        *pstrsz += strlen(vec[cnt]) + 1;
+        if (*pstrsz > EXEC_ARGS_MAX) {
+            return -E2BIG;
+        }
+    }
+
+    *pcnt = cnt;
+    return 0;
+}
+
+/**
+ * Copy the 'cnt' strings of 'vec' to 'args->ea_buf' at '*poff',
+ * recording their offsets in 'dst'. '*pleft' is how many strings are
+ * still to be copied, this call's included. The caller may have changed
+ * them since they were measured, a string never takes more than leaves
+ * a byte for each after it, and always ends in a NUL.
+ */
+static void exec_args_fill(exec_args_t *args, char *const vec[], int cnt, char **dst, usize *poff, int *pleft) {
+    for (int i = 0; i < cnt; ++i, --*pleft) {
+        const char  *str    = vec[i] ? vec[i] : "";
+        usize       room    = args->ea_size - *poff - (*pleft - 1);
+        usize       len     = 0;
+
+        while (len + 1 < room && str[len]) {
+            len++;
+        }
+
+        memcpy(args->ea_buf + *poff, str, len);
+        args->ea_buf[*poff + len] = '\0';
+        dst[i] = (char *)*poff;
+        *poff += len + 1;
+    }
+
+    dst[cnt] = NULL;
+}
+
+int exec_args_copy(char *const argv[], char *const envv[], exec_args_t *args) {
+    int     err     = 0;
+    usize   strsz   = 0;
+    usize   off     = 0;
+    usize   vecsz   = 0;
+    int     left    = 0;
+
+    if (args == NULL) {
+        return -EINVAL;
+    }
+
+    *args = (exec_args_t){0};
+
+    if ((err = exec_args_measure(argv, &args->ea_argc, &strsz)) ||
+        (err = exec_args_measure(envv, &args->ea_envc, &strsz))) {
+        return err;
+    }
+
+    vecsz         = (args->ea_argc + args->ea_envc + 2) * sizeof (char *);
+    args->ea_size = vecsz + strsz;
+
+    if (args->ea_size > EXEC_ARGS_MAX) {
+        return -E2BIG;
+    }
+
+    if ((args->ea_buf = kmalloc(args->ea_size)) == NULL) {
+        return -ENOMEM;
+    }
+
+    off  = vecsz;
+    left = args->ea_argc + args->ea_envc;
+    exec_args_fill(args, argv, args->ea_argc, (char **)args->ea_buf, &off, &left);
+    exec_args_fill(args, envv, args->ea_envc, &((char **)args->ea_buf)[args->ea_argc + 1], &off, &left);
+
+    return 0;
+}
+
+void exec_args_free(exec_args_t *args) {
+    if (args == NULL) {
+        return;
+    }
+
+    kfree(args->ea_buf);
+    *args = (exec_args_t){0};
+}
+
+int thread_execve(thread_t *thread, const exec_args_t *args) {
     if (thread == NULL) {
         return -EINVAL;
     }
@@ -27,7 +118,7 @@ int thread_execve(thread_t *thread, char *const argv[], char *const envv[]) {
 
     long argc = 0;
     char *const *argp, *const *envp;
-    if ((err = mmap_copy_arglist(thread->t_mmap, argv, envv, (int *)&argc, &argp, &envp))) {
+    if ((err = mmap_copy_args(thread->t_mmap, args, (int *)&argc, &argp, &envp))) {
         goto error;
     }
 
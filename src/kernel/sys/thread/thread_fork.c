@@ -18,6 +18,7 @@ int thread_fork(thread_t *dst_thread, thread_t *src_thread) {
         .ts_proc        = src_thread->t_info.ti_sched.ts_proc,
         .ts_timeslice   = src_thread->t_info.ti_sched.ts_timeslice,
         .ts_affin.type  = src_thread->t_info.ti_sched.ts_affin.type,
+        .ts_node        = src_thread->t_info.ti_sched.ts_node,
     };
 
     vmr_t *ustack;
@@ -0,0 +1,74 @@
+#include <xyther/spawn.h>
+#include <xyther/stdio.h>
+#include <xyther/string.h>
+#include <xyther/time.h>
+#include <xyther/unistd.h>
+
+/**
+ * Time starting a trivial program with fork()+execve() against posix_spawn().
+ * The program is this one, run with an argument, which makes it exit at once.
+ */
+
+#define NRUNS   200
+
+static int run_fork_exec(char *const argv[], char *const envp[]) {
+    pid_t pid = fork();
+
+    if (pid < 0)
+        return pid;
+
+    if (pid == 0) {
+        execve(argv[0], argv, envp);
+        exit(127);
+    }
+
+    return waitpid(pid, NULL, 0) < 0 ? -1 : 0;
+}
+
+static int run_spawn(char *const argv[], char *const envp[]) {
+    int   err = 0;
+    pid_t pid = 0;
+
+    if ((err = posix_spawn(&pid, argv[0], NULL, NULL, argv, envp)))
+        return err;
+
+    return waitpid(pid, NULL, 0) < 0 ? -1 : 0;
+}
+
+static int bench(const char *name, int (*run)(char *const[], char *const[]),
+    char *const argv[], char *const envp[]) {
+    int         err = 0;
+    timeval_t   start, end;
+
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < NRUNS; ++i) {
+        if ((err = run(argv, envp))) {
+            printf("%s: run %d failed, error: %d\n", name, i, err);
+            return err;
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    printf("%-12s %d runs, %ld us/run\n", name, NRUNS, elapsed_us(&start, &end) / NRUNS);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int err = 0;
+
+    // one of the children we are timing.
+    if (argc > 1)
+        exit(0);
+
+    if ((err = __open_stdio()))
+        return err;
+
+    char *const envp[] = { NULL };
+    char *const argp[] = { argv[0], "--exit", NULL };
+
+    if ((err = bench("fork+execve", run_fork_exec, argp, envp)) == 0)
+        err = bench("posix_spawn", run_spawn, argp, envp);
+
+    __close_stdio();
+    return err;
+}
@@ -0,0 +1,50 @@
+#include <xyther/stdio.h>
+#include <xyther/time.h>
+#include <xyther/unistd.h>
+
+/**
+ * Time thread creation and teardown.
+ * NROUND rounds each start NBATCH threads that return at once and
+ * join them all, so every round after the first runs on the kernel
+ * stacks the one before it freed.
+ */
+
+#define NROUND  1000
+#define NBATCH  8
+
+static void *short_thread(void *arg) {
+    return arg;
+}
+
+int main(void) {
+    int         err = 0;
+    tid_t       tids[NBATCH];
+    timeval_t   start, end;
+
+    if ((err = __open_stdio()))
+        return err;
+
+    gettimeofday(&start, NULL);
+    for (int round = 0; round < NROUND; ++round) {
+        for (int i = 0; i < NBATCH; ++i) {
+            if ((err = thread_create(&tids[i], NULL, short_thread, NULL))) {
+                printf("thread_create: round %d, thread %d, error: %d\n", round, i, err);
+                goto out;
+            }
+        }
+
+        for (int i = 0; i < NBATCH; ++i) {
+            if ((err = thread_join(tids[i], NULL))) {
+                printf("thread_join: round %d, thread %d, error: %d\n", round, i, err);
+                goto out;
+            }
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    printf("%d threads, %ld ns per create and join\n", NROUND * NBATCH,
+        elapsed_us(&start, &end) * 1000 / (NROUND * NBATCH));
+out:
+    __close_stdio();
+    return err;
+}
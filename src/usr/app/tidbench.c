@@ -0,0 +1,67 @@
+#include <xyther/stdio.h>
+#include <xyther/time.h>
+#include <xyther/unistd.h>
+
+/**
+ * Time TID lookups with many threads alive.
+ * NTHREAD threads are started and left in pause(), then every one of
+ * them is looked up in turn with pthread_kill(tid, 0), which finds the
+ * thread and sends nothing, followed by as many lookups of a TID that
+ * does not exist.
+ */
+
+#define NTHREAD     10000
+#define NLOOKUP     100000
+
+static tid_t tids[NTHREAD];
+
+static void *idle_thread(void *arg __unused) {
+    for (;;)
+        pause();
+    return NULL;
+}
+
+static int bench(const char *name, tid_t miss) {
+    int         err = 0;
+    timeval_t   start, end;
+
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < NLOOKUP; ++i) {
+        err = pthread_kill(miss ? miss : tids[i % NTHREAD], 0);
+        if (miss ? err == 0 : err != 0) {
+            printf("%s: lookup %d, error: %d\n", name, i, err);
+            return err ? err : -1;
+        }
+    }
+    gettimeofday(&end, NULL);
+
+    printf("%-8s %d lookups, %ld ns/lookup\n", name, NLOOKUP,
+        elapsed_us(&start, &end) * 1000 / NLOOKUP);
+    return 0;
+}
+
+int main(void) {
+    int     err = 0;
+    tid_t   max = 0;
+
+    if ((err = __open_stdio()))
+        return err;
+
+    for (int i = 0; i < NTHREAD; ++i) {
+        if ((err = thread_create(&tids[i], NULL, idle_thread, NULL))) {
+            printf("thread_create: thread %d, error: %d\n", i, err);
+            goto out;
+        }
+
+        if (tids[i] > max)
+            max = tids[i];
+    }
+
+    printf("%d threads\n", NTHREAD);
+
+    if ((err = bench("hit", 0)) == 0)
+        err = bench("miss", max + NTHREAD);
+out:
+    __close_stdio();
+    return err;
+}
@@ -2,6 +2,7 @@
 #define MMAN_H 1
 
 #include <stddef.h>
+#include <xyther/types.h>
 
 #define PROT_NONE           0x0  // Deny any access, do not ack accesses to this region.
 #define PROT_READ           0x1  // The region is mapped for reading, must always be provided in "prot" argument.
@@ -25,16 +26,54 @@
 #define MAP_FIXED           0x1000
 #define MAP_NORESERVE
 
+#define MADV_NORMAL         0   // No special treatment.
+#define MADV_RANDOM         1   // Expect random page references, no read-ahead.
+#define MADV_SEQUENTIAL     2   // Expect sequential page references, read ahead more.
+#define MADV_WILLNEED       3   // Will need these pages, read them in now.
+#define MADV_DONTNEED       4   // Do not need these pages, drop them now.
+#define MADV_FREE           8   // Pages may be dropped if not written before memory runs short.
+
+#define MREMAP_MAYMOVE      0x0001  // The mapping may move to a new address.
+#define MREMAP_FIXED        0x0002  // Move to the address given as fifth argument.
+
+#define MS_ASYNC            0x0001  // Schedule the write-back.
+#define MS_INVALIDATE       0x0002  // Invalidate other mappings of the file.
+#define MS_SYNC             0x0004  // Write back and wait for it.
+
+#define MLOCK_ONFAULT       0x0001  // Lock pages as they fault in.
+#define MCL_CURRENT         0x0001  // Lock what is mapped now.
+#define MCL_FUTURE          0x0002  // Lock what gets mapped later.
+#define MCL_ONFAULT         0x0004  // Lock pages as they fault in.
+
+#define MPOL_DEFAULT        0   // Allocate on the node of the CPU faulting.
+#define MPOL_PREFERRED      1   // Allocate on the first node in the mask if it can.
+#define MPOL_BIND           2   // Allocate only on the nodes in the mask.
+#define MPOL_INTERLEAVE     3   // Spread allocations over the nodes in the mask.
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
     extern int getpagesize(void);
     extern void *mmap(void *__addr, size_t __len, int __prot,
-                      int __flags, int __fd, long __offset);
+                      int __flags, int __fd, off_t __offset);
 
     extern int munmap(void *addr, size_t length);
     extern int mprotect(void *addr, size_t len, int prot);
+    extern int madvise(void *addr, size_t length, int advice);
+    extern int msync(void *addr, size_t length, int flags);
+    extern void *mremap(void *old_address, size_t old_size,
+                        size_t new_size, int flags, ... /* void *new_address */);
+
+    extern int mlock(const void *addr, size_t len);
+    extern int mlock2(const void *addr, size_t len, unsigned int flags);
+    extern int munlock(const void *addr, size_t len);
+    extern int mlockall(int flags);
+    extern int munlockall(void);
+
+    extern int set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+    extern int get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode,
+                             void *addr, unsigned long flags);
 #ifdef __cplusplus
 }
 #endif
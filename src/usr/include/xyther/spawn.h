@@ -0,0 +1,52 @@
+#pragma once
+
+#include <_cheader.h>
+#include <xyther/types.h>
+
+_Begin_C_Header
+
+#define SPAWN_NACTION           16  // most file actions one posix_spawn() takes.
+
+#define SPAWN_FA_CLOSE          0
+#define SPAWN_FA_DUP2           1
+#define SPAWN_FA_OPEN           2
+
+// must match the kernel's, it is handed to sys_spawn() as is.
+typedef struct spawn_file_action {
+    int         sfa_type;
+    int         sfa_fd;
+    int         sfa_srcfd;
+    int         sfa_oflags;
+    mode_t      sfa_mode;
+    const char  *sfa_path;
+} spawn_file_action_t;
+
+// there is no malloc() to grow it with, so the list is a fixed array.
+typedef struct posix_spawn_file_actions {
+    int                 count;
+    spawn_file_action_t actions[SPAWN_NACTION];
+} posix_spawn_file_actions_t;
+
+// spawn attributes are not supported, 'attrp' must be NULL.
+typedef void posix_spawnattr_t;
+
+extern int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa);
+extern int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa);
+extern int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd);
+extern int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd, int newfd);
+extern int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+    const char *path, int oflags, mode_t mode);
+
+/**
+ * Run 'path' in a new child process, without fork().
+ * Errors are returned negated like the rest of the library,
+ * on success the child's pid goes to '*pid' and 0 is returned.
+ */
+extern int posix_spawn(pid_t *pid, const char *path,
+    const posix_spawn_file_actions_t *fa, const posix_spawnattr_t *attrp,
+    char *const argv[], char *const envp[]);
+
+extern pid_t spawn(const char *path, const spawn_file_action_t *actions,
+    int nactions, char *const argv[], char *const envp[]);
+
+_End_C_Header
@@ -4,6 +4,8 @@
 #include <xyther/bits/stat.h>
 #include <xyther/bits/fcntl.h>
 #include <xyther/signal.h>
+#include <xyther/spawn.h>
+#include <xyther/wait.h>
 #include <xyther/time.h>
 #include <xyther/socket.h>
 #include <xyther/poll.h>
@@ -56,12 +58,15 @@ extern pid_t sys_setpgrp(void);
 extern pid_t sys_getpgid(pid_t pid);
 extern int sys_setpgid(pid_t pid, pid_t pgid);
 extern pid_t sys_fork(void);
+extern pid_t sys_vfork(void);
 extern pid_t sys_getpid(void);
 extern pid_t sys_getppid(void);
 extern void sys_exit(int status);
 extern pid_t sys_waitpid(pid_t __pid, int *__stat_loc, int __options);
+extern int sys_waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options);
 extern long sys_ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data);
 extern int sys_execve(const char *pathname, char *const argv[], char *const envp[]);
+extern pid_t sys_spawn(const char *path, const spawn_file_action_t *actions, int nactions, char *const argv[], char *const envp[]);
 extern pid_t sys_wait4(pid_t pid, int *wstatus, int options, void /*struct rusage*/ *rusage);
 
 extern int sys_park(void);
@@ -101,9 +106,11 @@ extern int sys_munlock(const void *addr, size_t len);
 extern int sys_mlockall(int flags);
 extern int sys_munlockall(void);
 extern int sys_msync(void *addr, size_t length, int flags);
-extern void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
+extern void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, void *new_address);
 extern int sys_madvise(void *addr, size_t length, int advice);
 extern void *sys_sbrk(intptr_t increment);
+extern int sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+extern int sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags);
 
 extern int sys_uname(struct utsname *name);
 
@@ -28,6 +28,11 @@ typedef struct timeval {
 
 int gettimeofday(struct timeval *restrict tp, void *restrict tzp);
 
+/// Microseconds from 'start' to 'end', both taken with gettimeofday().
+static inline long elapsed_us(const timeval_t *start, const timeval_t *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000l + (end->tv_usec - start->tv_usec);
+}
+
 struct timezone
 {
     int tz_minuteswest; /* minutes west of Greenwich */
@@ -54,6 +54,7 @@ extern pid_t setpgrp(void);
 extern pid_t getpgid(pid_t pid);
 extern int setpgid(pid_t pid, pid_t pgid);
 extern pid_t fork(void);
+extern pid_t vfork(void);
 extern pid_t getpid(void);
 extern pid_t getppid(void);
 extern void exit(int status);
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <_cheader.h>
+#include <xyther/types.h>
+#include <xyther/bits/waitflags.h>
+#include <xyther/bits/waitstatus.h>
+
+_Begin_C_Header
+
+// must match the kernel's, waitbatch() fills them in as is.
+typedef struct wait_entry {
+    pid_t   we_pid;     // process ID of the child.
+    int     we_status;  // its status, as waitpid() stores it.
+} wait_entry_t;
+
+/**
+ * Reap up to 'nent' children matching 'pid', as waitpid() does, into
+ * 'ents'. Only the first one is waited for unless WNOHANG is set in
+ * 'options', the rest are those that have already exited. At most 512
+ * are reaped per call. Returns how many were reaped, or -EFAULT, with
+ * none reaped, if 'ents' is not writable for them.
+ */
+extern int waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options);
+
+_End_C_Header
@@ -0,0 +1,74 @@
+#include <xyther/bits/errno.h>
+#include <xyther/spawn.h>
+#include <xyther/syscall.h>
+
+int posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa) {
+    if (fa == NULL)
+        return -EINVAL;
+
+    fa->count = 0;
+    return 0;
+}
+
+int posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa) {
+    return posix_spawn_file_actions_init(fa);
+}
+
+static int spawn_file_actions_add(posix_spawn_file_actions_t *fa, spawn_file_action_t action) {
+    if (fa == NULL || action.sfa_fd < 0)
+        return -EINVAL;
+
+    if (fa->count >= SPAWN_NACTION)
+        return -ENOMEM;
+
+    fa->actions[fa->count++] = action;
+    return 0;
+}
+
+int posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd) {
+    return spawn_file_actions_add(fa, (spawn_file_action_t) {
+        .sfa_type = SPAWN_FA_CLOSE, .sfa_fd = fd,
+    });
+}
+
+int posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd, int newfd) {
+    if (fd < 0)
+        return -EBADF;
+
+    return spawn_file_actions_add(fa, (spawn_file_action_t) {
+        .sfa_type = SPAWN_FA_DUP2, .sfa_fd = newfd, .sfa_srcfd = fd,
+    });
+}
+
+int posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+    const char *path, int oflags, mode_t mode) {
+    if (path == NULL)
+        return -EINVAL;
+
+    return spawn_file_actions_add(fa, (spawn_file_action_t) {
+        .sfa_type = SPAWN_FA_OPEN, .sfa_fd = fd, .sfa_path = path,
+        .sfa_oflags = oflags, .sfa_mode = mode,
+    });
+}
+
+pid_t spawn(const char *path, const spawn_file_action_t *actions,
+    int nactions, char *const argv[], char *const envp[]) {
+    return sys_spawn(path, actions, nactions, argv, envp);
+}
+
+int posix_spawn(pid_t *pid, const char *path,
+    const posix_spawn_file_actions_t *fa, const posix_spawnattr_t *attrp,
+    char *const argv[], char *const envp[]) {
+    pid_t child = 0;
+
+    if (attrp != NULL)
+        return -ENOTSUP;
+
+    child = spawn(path, fa ? fa->actions : NULL, fa ? fa->count : 0, argv, envp);
+    if (child < 0)
+        return child;
+
+    if (pid)
+        *pid = child;
+    return 0;
+}
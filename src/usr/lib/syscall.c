@@ -1,3 +1,4 @@
+#include <xyther/mman.h>
 #include <xyther/syscall.h>
 
 void kputc(int c) {
@@ -197,6 +198,10 @@ pid_t waitpid(pid_t __pid, int *__stat_loc, int __options) {
     return sys_waitpid(__pid, __stat_loc, __options);
 }
 
+int waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options) {
+    return sys_waitbatch(pid, ents, nent, options);
+}
+
 long ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data) {
     return sys_ptrace(op, pid, addr, data);
 }
@@ -351,7 +356,17 @@ int msync(void *addr, size_t length, int flags) {
 }
 
 void *mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */) {
-    return sys_mremap(old_address, old_size, new_size, flags/* void *new_address */);
+    va_list ap;
+    void    *new_address = NULL;
+
+    // only read with MREMAP_FIXED.
+    if (flags & MREMAP_FIXED) {
+        va_start(ap, flags);
+        new_address = va_arg(ap, void *);
+        va_end(ap);
+    }
+
+    return sys_mremap(old_address, old_size, new_size, flags, new_address);
 }
 
 int madvise(void *addr, size_t length, int advice) {
@@ -362,6 +377,14 @@ void *sbrk(intptr_t increment) {
     return sys_sbrk(increment);
 }
 
+int set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode) {
+    return sys_set_mempolicy(mode, nodemask, maxnode);
+}
+
+int get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags) {
+    return sys_get_mempolicy(mode, nodemask, maxnode, addr, flags);
+}
+
 int uname(struct utsname *name) {
     return sys_uname(name);
 }
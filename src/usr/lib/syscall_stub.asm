@@ -66,6 +66,9 @@ sys_%2:
 %define SYS_ptrace              65  ; long sys_ptrace(enum __ptrace_request op, pid_t pid, void *addr, void *data);
 %define SYS_execve              66  ; int sys_execve(const char *pathname, char *const argv[], char *const envp[]);
 %define SYS_wait4               67  ; pid_t sys_wait4(pid_t pid, int *wstatus, int options, void /*struct rusage*/ *rusage);
+%define SYS_vfork               68  ; pid_t sys_vfork(void);
+%define SYS_spawn               69  ; pid_t sys_spawn(const char *path, const spawn_file_action_t *actions, int nactions, char *const argv[], char *const envp[]);
+%define SYS_waitbatch           70  ; int sys_waitbatch(pid_t pid, wait_entry_t *ents, int nent, int options);
 
 %define SYS_park                80  ; int sys_park(void);
 %define SYS_unpark              81  ; int sys_unpark(tid_t);
@@ -109,6 +112,8 @@ sys_%2:
 %define SYS_mremap              141  ; void *sys_mremap(void *old_address, size_t old_size, size_t new_size, int flags, ... /* void *new_address */);
 %define SYS_madvise             142  ; int sys_madvise(void *addr, size_t length, int advice);
 %define SYS_sbrk                143  ; void *sys_sbrk(intptr_t increment);
+%define SYS_set_mempolicy       144  ; int sys_set_mempolicy(int mode, const unsigned long *nodemask, unsigned long maxnode);
+%define SYS_get_mempolicy       145  ; int sys_get_mempolicy(int *mode, unsigned long *nodemask, unsigned long maxnode, void *addr, unsigned long flags);
 
 %define SYS_uname               150  ; int sys_uname(struct utsname *name);
 
@@ -197,12 +202,29 @@ stub SYS_getpgid,           getpgid
 stub SYS_setpgid,           setpgid
 
 stub SYS_fork,              fork
+
+; the child runs on our stack until it calls execve() or _exit(),
+; so the return address is kept in a register rather than left in
+; a stack slot the child is free to overwrite before we get to 'ret'.
+; vfork() itself is this stub, a C wrapper would have the same problem.
+global sys_vfork
+global vfork
+sys_vfork:
+vfork:
+    pop rdi
+    mov rax, SYS_vfork
+    int 0x80
+    push rdi
+    ret
+
 stub SYS_getpid,            getpid
 stub SYS_getppid,           getppid
 stub SYS_exit,              exit
 stub SYS_waitpid,           waitpid
 stub SYS_ptrace,            ptrace
 stub SYS_execve,            execve
+stub SYS_spawn,             spawn
+stub SYS_waitbatch,         waitbatch
 stub SYS_wait4,             wait4
 
 stub SYS_park,              park
@@ -247,6 +269,8 @@ stub SYS_msync,             msync
 stub SYS_mremap,            mremap
 stub SYS_madvise,           madvise
 stub SYS_sbrk,              sbrk
+stub SYS_set_mempolicy,     set_mempolicy
+stub SYS_get_mempolicy,     get_mempolicy
 
 stub SYS_uname,             uname
 